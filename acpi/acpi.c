@@ -0,0 +1,198 @@
+#include "acpi.h"
+#include "memory/paging.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Minimal ACPI table discovery: RSDP -> RSDT -> MADT.
+// Tables usually live in reserved memory at the top of RAM, which may be
+// past the direct map, so every table goes through paging_map_phys().
+
+#define EBDA_SEGMENT_PTR    0x40E           // BIOS data area word holding the EBDA segment
+#define BIOS_ROM_START      0xE0000
+#define BIOS_ROM_END        0x100000
+
+// MADT entry types
+#define MADT_LAPIC          0
+#define MADT_IOAPIC         1
+#define MADT_OVERRIDE       2
+
+#define MADT_LAPIC_ENABLED  0x1
+#define MADT_PCAT_COMPAT    0x1
+
+typedef struct {
+    char signature[8];                      // "RSD PTR "
+    uint8_t checksum;
+    char oem_id[6];
+    uint8_t revision;
+    uint32_t rsdt_addr;
+} __attribute__((packed)) acpi_rsdp_t;
+
+typedef struct {
+    acpi_header_t header;
+    uint32_t lapic_addr;
+    uint32_t flags;
+} __attribute__((packed)) acpi_madt_table_t;
+
+typedef struct {
+    uint8_t type;
+    uint8_t length;
+} __attribute__((packed)) madt_entry_t;
+
+typedef struct {
+    madt_entry_t entry;
+    uint8_t processor_id;
+    uint8_t apic_id;
+    uint32_t flags;
+} __attribute__((packed)) madt_lapic_t;
+
+typedef struct {
+    madt_entry_t entry;
+    uint8_t ioapic_id;
+    uint8_t reserved;
+    uint32_t ioapic_addr;
+    uint32_t gsi_base;
+} __attribute__((packed)) madt_ioapic_t;
+
+typedef struct {
+    madt_entry_t entry;
+    uint8_t bus;
+    uint8_t source;                         // ISA IRQ
+    uint32_t gsi;
+    uint16_t flags;
+} __attribute__((packed)) madt_override_t;
+
+static acpi_header_t* rsdt;
+static acpi_madt_t madt;
+static int madt_found = 0;
+
+static uint8_t checksum(const void* data, uint32_t length) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    uint8_t sum = 0;
+    for (uint32_t i = 0; i < length; i++) {
+        sum += bytes[i];
+    }
+    return sum;
+}
+
+static int signature_is(const char* a, const char* b, int n) {
+    for (int i = 0; i < n; i++) {
+        if (a[i] != b[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Search [start, end) on 16-byte boundaries for a valid RSDP
+static acpi_rsdp_t* rsdp_scan(uint32_t start, uint32_t end) {
+    for (uint32_t addr = start; addr + sizeof(acpi_rsdp_t) <= end; addr += 16) {
+        acpi_rsdp_t* rsdp = phys_to_virt(addr);
+        if (signature_is(rsdp->signature, "RSD PTR ", 8) && checksum(rsdp, sizeof(acpi_rsdp_t)) == 0) {
+            return rsdp;
+        }
+    }
+    return NULL;
+}
+
+// Map a table: the header first, then its full length.
+// Mapped writable so RAM pages that happen to hold a table keep their access.
+static acpi_header_t* map_table(uint32_t phys) {
+    acpi_header_t* table = paging_map_phys(phys, sizeof(acpi_header_t), PAGE_PRESENT | PAGE_WRITE);
+    if (table == NULL) {
+        return NULL;
+    }
+    return paging_map_phys(phys, table->length, PAGE_PRESENT | PAGE_WRITE);
+}
+
+acpi_header_t* acpi_find_table(const char* signature) {
+    if (rsdt == NULL) {
+        return NULL;
+    }
+    uint32_t entries = (rsdt->length - sizeof(acpi_header_t)) / sizeof(uint32_t);
+    uint32_t* table_addrs = (uint32_t*)(rsdt + 1);
+    for (uint32_t i = 0; i < entries; i++) {
+        acpi_header_t* table = map_table(table_addrs[i]);
+        if (table && signature_is(table->signature, signature, 4) && checksum(table, table->length) == 0) {
+            return table;
+        }
+    }
+    return NULL;
+}
+
+static void parse_madt(acpi_madt_table_t* table) {
+    madt.lapic_addr = table->lapic_addr;
+    madt.pcat_compat = table->flags & MADT_PCAT_COMPAT;
+    for (uint32_t i = 0; i < ACPI_ISA_IRQS; i++) {
+        madt.isa_gsi[i] = i;                // Identity routing unless overridden
+        madt.isa_flags[i] = 0;              // Bus default: ISA is edge triggered, active high
+    }
+
+    uint8_t* p = (uint8_t*)(table + 1);
+    uint8_t* end = (uint8_t*)table + table->header.length;
+    while (p + sizeof(madt_entry_t) <= end) {
+        madt_entry_t* entry = (madt_entry_t*)p;
+        if (entry->length == 0) {
+            break;
+        }
+        switch (entry->type) {
+            case MADT_LAPIC: {
+                madt_lapic_t* cpu = (madt_lapic_t*)entry;
+                if ((cpu->flags & MADT_LAPIC_ENABLED) && madt.cpu_count < ACPI_MAX_CPUS) {
+                    madt.cpu_apic_id[madt.cpu_count++] = cpu->apic_id;
+                }
+                break;
+            }
+            case MADT_IOAPIC: {
+                madt_ioapic_t* ioapic = (madt_ioapic_t*)entry;
+                if (madt.ioapic_addr == 0) { // Only the first I/O APIC is used
+                    madt.ioapic_addr = ioapic->ioapic_addr;
+                    madt.ioapic_gsi_base = ioapic->gsi_base;
+                }
+                break;
+            }
+            case MADT_OVERRIDE: {
+                madt_override_t* o = (madt_override_t*)entry;
+                if (o->bus == 0 && o->source < ACPI_ISA_IRQS) {
+                    madt.isa_gsi[o->source] = o->gsi;
+                    madt.isa_flags[o->source] = o->flags;
+                }
+                break;
+            }
+            default:
+                break;
+        }
+        p += entry->length;
+    }
+    madt_found = 1;
+}
+
+int acpi_init(void) {
+    // The RSDP is in the first KB of the EBDA or in the BIOS ROM area (both in the direct map)
+    uint32_t ebda = (uint32_t)*(volatile uint16_t*)phys_to_virt(EBDA_SEGMENT_PTR) << 4;
+    acpi_rsdp_t* rsdp = NULL;
+    if (ebda != 0) {
+        rsdp = rsdp_scan(ebda, ebda + 1024);
+    }
+    if (rsdp == NULL) {
+        rsdp = rsdp_scan(BIOS_ROM_START, BIOS_ROM_END);
+    }
+    if (rsdp == NULL) {
+        return 0;
+    }
+
+    rsdt = map_table(rsdp->rsdt_addr);
+    if (rsdt == NULL || !signature_is(rsdt->signature, "RSDT", 4) || checksum(rsdt, rsdt->length) != 0) {
+        rsdt = NULL;
+        return 0;
+    }
+
+    acpi_madt_table_t* table = (acpi_madt_table_t*)acpi_find_table("APIC");
+    if (table != NULL) {
+        parse_madt(table);
+    }
+    return 1;
+}
+
+const acpi_madt_t* acpi_get_madt(void) {
+    return madt_found ? &madt : NULL;
+}
@@ -0,0 +1,50 @@
+#ifndef ACPI_ACPI_H
+#define ACPI_ACPI_H
+
+#include <stdint.h>
+
+#define ACPI_MAX_CPUS       16
+#define ACPI_ISA_IRQS       16
+
+// ISA IRQ routing flags (MPS INTI flags from MADT interrupt source overrides)
+#define ACPI_POLARITY_MASK  0x3
+#define ACPI_POLARITY_LOW   0x3
+#define ACPI_TRIGGER_MASK   0xC
+#define ACPI_TRIGGER_LEVEL  0xC
+
+// Common header of every ACPI system description table
+typedef struct {
+    char signature[4];
+    uint32_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__((packed)) acpi_header_t;
+
+// Interrupt controller layout found in the MADT ("APIC" table)
+typedef struct {
+    uint32_t lapic_addr;                    // Physical address of the local APIC registers
+    uint32_t ioapic_addr;                   // First I/O APIC (0 if none)
+    uint32_t ioapic_gsi_base;
+    uint32_t cpu_count;
+    uint8_t cpu_apic_id[ACPI_MAX_CPUS];     // Local APIC IDs of enabled CPUs
+    uint32_t isa_gsi[ACPI_ISA_IRQS];        // ISA IRQ -> global system interrupt
+    uint16_t isa_flags[ACPI_ISA_IRQS];      // Polarity/trigger for each ISA IRQ
+    uint32_t pcat_compat;                   // Dual 8259s are present as well
+} acpi_madt_t;
+
+// Locate the RSDP/RSDT and parse the MADT. Requires paging (tables are mapped on demand).
+// Returns 0 when no usable ACPI tables are found.
+int acpi_init(void);
+
+// Find a table by its 4-character signature. Returns NULL if absent.
+acpi_header_t* acpi_find_table(const char* signature);
+
+// Parsed MADT, or NULL if there is none
+const acpi_madt_t* acpi_get_madt(void);
+
+#endif // ACPI_ACPI_H
@@ -0,0 +1,114 @@
+#include "bench.h"
+#include "libc/include/stdio.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Only the benchmark image carries the harness
+#ifdef BENCH_MODE
+
+#define CPUID_EXT_MAX       0x80000000
+#define CPUID_EXT_FEATURES  0x80000001
+#define CPUID_EDX_RDTSCP    (1u << 27)
+
+// Bounds of the 'bench_table' section, provided by ld (weak: the table may be empty)
+extern const bench_t* const __start_bench_table[] __attribute__((weak));
+extern const bench_t* const __stop_bench_table[] __attribute__((weak));
+
+static int have_rdtscp = 0;
+static uint32_t samples[BENCH_MAX_REPEATS];
+
+// lfence keeps earlier instructions from drifting into the timed region
+static inline uint64_t tsc_begin(void) {
+    uint32_t lo, hi;
+    asm volatile ("lfence\n\trdtsc" : "=a"(lo), "=d"(hi) : : "memory");
+    return ((uint64_t)hi << 32) | lo;
+}
+
+// rdtscp waits for the measured code to finish; plain rdtsc needs an lfence
+static inline uint64_t tsc_end(void) {
+    uint32_t lo, hi;
+    if (have_rdtscp) {
+        asm volatile ("rdtscp\n\tlfence" : "=a"(lo), "=d"(hi) : : "ecx", "memory");
+    } else {
+        asm volatile ("lfence\n\trdtsc" : "=a"(lo), "=d"(hi) : : "memory");
+    }
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static void detect_rdtscp(void) {
+    uint32_t eax, ebx, ecx, edx;
+    asm volatile ("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(CPUID_EXT_MAX));
+    if (eax < CPUID_EXT_FEATURES) {
+        return;
+    }
+    asm volatile ("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(CPUID_EXT_FEATURES));
+    have_rdtscp = (edx & CPUID_EDX_RDTSCP) != 0;
+}
+
+// Shell sort: small, in place, fast enough for a few hundred samples
+static void sort(uint32_t* v, uint32_t n) {
+    for (uint32_t gap = n / 2; gap > 0; gap /= 2) {
+        for (uint32_t i = gap; i < n; i++) {
+            uint32_t x = v[i];
+            uint32_t j = i;
+            for (; j >= gap && v[j - gap] > x; j -= gap) {
+                v[j] = v[j - gap];
+            }
+            v[j] = x;
+        }
+    }
+}
+
+// Take 'repeats' samples of 'b' into 'samples', sorted, less 'overhead'
+static uint32_t measure(const bench_t* b, uint32_t overhead) {
+    uint32_t warmup = b->warmup ? b->warmup : BENCH_DEFAULT_WARMUP;
+    uint32_t repeats = b->repeats ? b->repeats : BENCH_DEFAULT_REPEATS;
+    if (repeats > BENCH_MAX_REPEATS) {
+        repeats = BENCH_MAX_REPEATS;
+    }
+
+    if (b->setup != NULL) {
+        b->setup(b->arg);
+    }
+    for (uint32_t i = 0; i < warmup; i++) {
+        b->fn(b->arg);
+    }
+    for (uint32_t i = 0; i < repeats; i++) {
+        uint64_t start = tsc_begin();
+        b->fn(b->arg);
+        uint32_t cycles = (uint32_t)(tsc_end() - start);
+        samples[i] = cycles > overhead ? cycles - overhead : 0;
+    }
+    if (b->teardown != NULL) {
+        b->teardown(b->arg);
+    }
+
+    sort(samples, repeats);
+    return repeats;
+}
+
+static void __attribute__((noinline)) bench_empty(void* arg) {
+    (void)arg;
+    asm volatile ("" : : : "memory");
+}
+
+void bench_run_all(void) {
+    detect_rdtscp();
+
+    // Cost of the timing itself: the fastest empty sample
+    const bench_t empty = { .name = "empty", .fn = bench_empty };
+    measure(&empty, 0);
+    uint32_t overhead = samples[0];
+
+    uint32_t count = __stop_bench_table - __start_bench_table;
+    kprintf("BENCH begin count=%u timer=%s overhead=%u\n",
+            count, have_rdtscp ? "rdtscp" : "rdtsc", overhead);
+    for (const bench_t* const* b = __start_bench_table; b < __stop_bench_table; b++) {
+        uint32_t n = measure(*b, overhead);
+        uint32_t p99 = (n * 99 + 99) / 100 - 1;     // Nearest-rank percentile
+        kprintf("BENCH name=%s n=%u min=%u median=%u p99=%u\n",
+                (*b)->name, n, samples[0], samples[n / 2], samples[p99]);
+    }
+    kprintf("BENCH end\n");
+}
+#endif // BENCH_MODE
@@ -0,0 +1,51 @@
+#ifndef BENCH_BENCH_H
+#define BENCH_BENCH_H
+
+#include <stdint.h>
+
+// Microbenchmark harness for the benchmark image (scripts/linux-build-bench.sh,
+// which builds with -DBENCH_MODE). Each registered benchmark is run 'warmup'
+// times untimed, then timed 'repeats' times with rdtsc/rdtscp around a single
+// call. Results go to kprintf (serial + VGA) as one line per benchmark:
+//
+//   BENCH name=<name> n=<repeats> min=<cycles> median=<cycles> p99=<cycles>
+//
+// Cycles exclude the cost of the timing itself (an empty benchmark's minimum).
+
+#define BENCH_MAX_REPEATS   1024
+#define BENCH_DEFAULT_WARMUP    16
+#define BENCH_DEFAULT_REPEATS   512
+
+typedef void (*bench_fn_t)(void* arg);
+
+typedef struct {
+    const char* name;
+    bench_fn_t fn;                  // Measured: one call per sample
+    void* arg;
+    bench_fn_t setup;               // Optional, run once before warm-up
+    bench_fn_t teardown;            // Optional, run once after the last sample
+    uint32_t warmup;                // 0: BENCH_DEFAULT_WARMUP
+    uint32_t repeats;               // 0: BENCH_DEFAULT_REPEATS (capped at BENCH_MAX_REPEATS)
+} bench_t;
+
+// Register a benchmark, e.g.
+//   BENCH_REGISTER(memset_4k, .fn = bench_memset, .arg = (void*)4096);
+// Entries are collected in the 'bench_table' section; ld provides its bounds.
+#define BENCH_REGISTER(id, ...)                                                 \
+    static const bench_t bench_##id = { .name = #id, __VA_ARGS__ };             \
+    static const bench_t* const bench_ptr_##id                                  \
+        __attribute__((used, section("bench_table"))) = &bench_##id
+
+// Run every registered benchmark and print the results
+void bench_run_all(void);
+
+// xorshift32 for benchmark workloads: advances *state, never 0 from a nonzero seed
+static inline uint32_t bench_rand(uint32_t* state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+#endif // BENCH_BENCH_H
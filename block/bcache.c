@@ -0,0 +1,550 @@
+#include "bcache.h"
+#include "drivers/timer.h"
+#include "interrupt/irqflags.h"
+#include "memory/kmalloc.h"
+#include "memory/paging.h"
+#include "memory/pmm.h"
+#include "task/sched.h"
+#include "libc/include/stdio.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Cache state is changed with interrupts disabled: I/O completions update
+// the buffers from the driver's bottom half.
+
+#define BCACHE_HASH_SIZE    (1u << BCACHE_HASH_BITS)
+#define BCACHE_FLUSH_TICKS  TIMER_HZ            // Flusher wakeups: once a second
+
+// A thread sleeping in wait_on_buffer()
+typedef struct bwaiter {
+    thread_t* thread;
+    struct bwaiter* next;
+    volatile int queued;
+} bwaiter_t;
+
+// Readahead of one device
+typedef struct {
+    uint32_t next;                  // Block that would continue the last read
+    uint32_t size;                  // Current window, 0 when off
+    uint32_t trigger;               // First block of the last window: reaching it starts the next
+    uint32_t end;                   // Block after the last window
+} readahead_t;
+
+static buffer_t* hash_table[BCACHE_HASH_SIZE];
+static buffer_t* lru_head;          // Most recently released
+static buffer_t* lru_tail;
+static buffer_t* all_buffers;
+static uint32_t nbuffers;
+static uint32_t max_buffers;
+static uint32_t ndirty;
+static volatile int flush_all;      // Dirty buffers fill a quarter of the cache
+static kmem_cache_t* buffer_cache;
+static readahead_t readahead_state[BLKDEV_MAX];
+static bcache_stats_t stats;
+
+static uint32_t hash(const block_device_t* dev, uint32_t block) {
+    return ((block ^ (dev->index << 24)) * 2654435761u) >> (32 - BCACHE_HASH_BITS);
+}
+
+static buffer_t* lookup(const block_device_t* dev, uint32_t block) {
+    for (buffer_t* b = hash_table[hash(dev, block)]; b != NULL; b = b->hash_next) {
+        if (b->dev == dev && b->block == block) {
+            return b;
+        }
+    }
+    return NULL;
+}
+
+static void hash_insert(buffer_t* b) {
+    buffer_t** bucket = &hash_table[hash(b->dev, b->block)];
+    b->hash_next = *bucket;
+    *bucket = b;
+}
+
+static void hash_remove(buffer_t* b) {
+    buffer_t** link = &hash_table[hash(b->dev, b->block)];
+    while (*link != b) {
+        link = &(*link)->hash_next;
+    }
+    *link = b->hash_next;
+}
+
+static void lru_push(buffer_t* b) {
+    b->lru_prev = NULL;
+    b->lru_next = lru_head;
+    if (lru_head != NULL) {
+        lru_head->lru_prev = b;
+    } else {
+        lru_tail = b;
+    }
+    lru_head = b;
+}
+
+static void lru_remove(buffer_t* b) {
+    if (b->lru_prev != NULL) {
+        b->lru_prev->lru_next = b->lru_next;
+    } else {
+        lru_head = b->lru_next;
+    }
+    if (b->lru_next != NULL) {
+        b->lru_next->lru_prev = b->lru_prev;
+    } else {
+        lru_tail = b->lru_prev;
+    }
+}
+
+static void get_ref(buffer_t* b) {
+    if (b->refs++ == 0) {
+        lru_remove(b);
+    }
+}
+
+static void put_ref(buffer_t* b) {
+    if (--b->refs == 0) {
+        lru_push(b);
+    }
+}
+
+static void set_dirty(buffer_t* b) {
+    if (!(b->flags & BH_DIRTY)) {
+        b->flags |= BH_DIRTY;
+        b->dirtied_ns = timer_now_ns();
+        ndirty++;
+        if (ndirty > max_buffers / 4) {
+            flush_all = 1;
+        }
+    }
+}
+
+// A new buffer while under the limit, else the least recently used clean one
+static buffer_t* alloc_buffer(void) {
+    if (nbuffers < max_buffers) {
+        buffer_t* b = kmem_cache_alloc(buffer_cache);
+        uint32_t frame = b != NULL ? pmm_alloc_frame() : 0;
+        if (frame != 0) {
+            b->data = phys_to_virt(frame);
+            b->all_next = all_buffers;
+            all_buffers = b;
+            nbuffers++;
+            return b;
+        }
+        if (b != NULL) {
+            kmem_cache_free(buffer_cache, b);
+        }
+        max_buffers = nbuffers;     // Out of memory: stop growing
+    }
+    for (buffer_t* b = lru_tail; b != NULL; b = b->lru_prev) {
+        if (b->flags & (BH_DIRTY | BH_LOCKED)) {
+            continue;
+        }
+        lru_remove(b);
+        hash_remove(b);
+        if (b->flags & BH_READAHEAD) {
+            stats.ra_wasted++;
+        }
+        stats.evictions++;
+        return b;
+    }
+    return NULL;
+}
+
+// Referenced buffer for (dev, block), set up if not cached. NULL when no
+// buffer is free; then *writeback (if given) is the oldest dirty idle buffer,
+// whose write-back would free one. Interrupts disabled.
+static buffer_t* get_buffer(block_device_t* dev, uint32_t block, buffer_t** writeback) {
+    buffer_t* b = lookup(dev, block);
+    if (b != NULL) {
+        get_ref(b);
+        return b;
+    }
+    b = alloc_buffer();
+    if (b == NULL) {
+        if (writeback != NULL) {
+            *writeback = NULL;
+            for (buffer_t* d = lru_tail; d != NULL; d = d->lru_prev) {
+                if ((d->flags & (BH_DIRTY | BH_LOCKED)) == BH_DIRTY) {
+                    *writeback = d;
+                    break;
+                }
+            }
+        }
+        return NULL;
+    }
+    b->dev = dev;
+    b->block = block;
+    b->flags = 0;
+    b->refs = 1;
+    b->waiters = NULL;
+    hash_insert(b);
+    return b;
+}
+
+static void io_done(void* arg, int status) {
+    buffer_t* b = arg;
+    uint32_t flags = irq_save();
+    if (status != BLK_OK) {
+        b->flags |= BH_ERROR;
+        stats.io_errors++;
+        if (b->flags & BH_WRITE) {
+            set_dirty(b);   // Try again later
+        }
+    } else if (!(b->flags & BH_WRITE)) {
+        b->flags |= BH_VALID;
+    }
+    b->flags &= ~(BH_LOCKED | BH_WRITE);
+
+    bwaiter_t* w = b->waiters;
+    b->waiters = NULL;
+    while (w != NULL) {
+        bwaiter_t* next = w->next;
+        thread_t* thread = w->thread;
+        w->queued = 0;              // The waiter may return once this is clear
+        thread_unblock(thread);
+        w = next;
+    }
+    irq_restore(flags);
+}
+
+// Start reading or writing the buffer. Interrupts disabled; the completion
+// may run before this returns.
+static void start_io(buffer_t* b, int write) {
+    b->flags = (b->flags | BH_LOCKED) & ~BH_ERROR;
+    if (write) {
+        b->flags = (b->flags | BH_WRITE) & ~BH_DIRTY;
+        ndirty--;
+        stats.writebacks++;
+    }
+    int err = b->dev->submit(b->dev, b->block * BCACHE_BLOCK_SECTORS, BCACHE_BLOCK_SECTORS,
+                             b->data, write, io_done, b);
+    if (err != BLK_OK) {
+        io_done(b, err);
+    }
+}
+
+static void wait_on_buffer(buffer_t* b) {
+    bwaiter_t w = { thread_current(), NULL, 0 };
+    for (;;) {
+        uint32_t flags = irq_save();
+        if (!(b->flags & BH_LOCKED)) {
+            irq_restore(flags);
+            return;
+        }
+        if (!w.queued) {
+            w.queued = 1;
+            w.next = b->waiters;
+            b->waiters = &w;
+        }
+        irq_restore(flags);
+        thread_block();
+    }
+}
+
+// Read 'count' blocks from 'start' in the background, skipping cached ones.
+// Returns the first block after the window. Interrupts disabled.
+static uint32_t readahead_submit(block_device_t* dev, uint32_t start, uint32_t count) {
+    uint32_t blocks = dev->sectors / BCACHE_BLOCK_SECTORS;
+    uint32_t end = start + count < blocks ? start + count : blocks;
+    for (uint32_t block = start; block < end; block++) {
+        if (lookup(dev, block) != NULL) {
+            continue;
+        }
+        buffer_t* b = get_buffer(dev, block, NULL);
+        if (b == NULL) {
+            return block;   // Everything busy: read ahead less
+        }
+        b->flags |= BH_READAHEAD;
+        stats.ra_blocks++;
+        start_io(b, 0);
+        put_ref(b);
+    }
+    return end;
+}
+
+// Called by bread() for every block it returns; 'miss' if it had to be read
+static void readahead(block_device_t* dev, uint32_t block, int miss) {
+    uint32_t flags = irq_save();
+    readahead_t* ra = &readahead_state[dev->index];
+    int sequential = block == ra->next;
+    ra->next = block + 1;
+
+    uint32_t start;
+    if (!sequential) {
+        if (miss) {
+            ra->size = 0;   // Random access: read ahead nothing
+        }
+        irq_restore(flags);
+        return;
+    } else if (miss) {
+        start = block + 1;  // Start (or restart) right behind the reader
+    } else if (ra->size != 0 && block == ra->trigger) {
+        start = ra->end;    // The reader entered the last window: fetch the next one
+    } else {
+        irq_restore(flags);
+        return;
+    }
+    ra->size = ra->size == 0 ? BCACHE_RA_MIN :
+               ra->size * 2 <= BCACHE_RA_MAX ? ra->size * 2 : BCACHE_RA_MAX;
+    ra->trigger = start;
+    ra->end = readahead_submit(dev, start, ra->size);
+    irq_restore(flags);
+}
+
+buffer_t* bgetblk(block_device_t* dev, uint32_t block) {
+    if (block >= dev->sectors / BCACHE_BLOCK_SECTORS) {
+        return NULL;
+    }
+    for (;;) {
+        buffer_t* writeback = NULL;
+        uint32_t flags = irq_save();
+        buffer_t* b = get_buffer(dev, block, &writeback);
+        if (writeback != NULL) {
+            get_ref(writeback);
+        }
+        irq_restore(flags);
+        if (b != NULL) {
+            return b;
+        }
+        if (writeback == NULL) {
+            return NULL;    // Every buffer is referenced or busy
+        }
+        // All idle buffers are dirty: clean the oldest and try again
+        bwrite(writeback);
+        brelse(writeback);
+    }
+}
+
+buffer_t* bread(block_device_t* dev, uint32_t block) {
+    buffer_t* b = bgetblk(dev, block);
+    if (b == NULL) {
+        return NULL;
+    }
+    uint32_t flags = irq_save();
+    stats.lookups++;
+    // Being read already (ahead) counts as a hit: the read started earlier
+    int miss = !(b->flags & (BH_VALID | BH_LOCKED));
+    if (miss) {
+        stats.misses++;
+        start_io(b, 0);
+    } else {
+        stats.hits++;
+        if (b->flags & BH_READAHEAD) {
+            b->flags &= ~BH_READAHEAD;
+            stats.ra_used++;
+        }
+    }
+    irq_restore(flags);
+
+    readahead(dev, block, miss);
+    wait_on_buffer(b);
+    if (!(b->flags & BH_VALID)) {
+        brelse(b);
+        return NULL;
+    }
+    return b;
+}
+
+void brelse(buffer_t* b) {
+    uint32_t flags = irq_save();
+    put_ref(b);
+    irq_restore(flags);
+}
+
+void bmark_dirty(buffer_t* b) {
+    uint32_t flags = irq_save();
+    b->flags |= BH_VALID;
+    set_dirty(b);
+    irq_restore(flags);
+}
+
+int bwrite(buffer_t* b) {
+    wait_on_buffer(b);
+    uint32_t flags = irq_save();
+    if (b->flags & BH_DIRTY) {
+        start_io(b, 1);
+    }
+    irq_restore(flags);
+    wait_on_buffer(b);
+    return (b->flags & BH_ERROR) ? -1 : 0;
+}
+
+uint32_t bcache_sync(block_device_t* dev) {
+    // Start every write before waiting for any, so the driver can merge neighbours
+    for (buffer_t* b = all_buffers; b != NULL; b = b->all_next) {
+        uint32_t flags = irq_save();
+        if ((dev == NULL || b->dev == dev) && (b->flags & (BH_DIRTY | BH_LOCKED)) == BH_DIRTY) {
+            start_io(b, 1);
+        }
+        irq_restore(flags);
+    }
+    uint32_t failed = 0;
+    for (buffer_t* b = all_buffers; b != NULL; b = b->all_next) {
+        if (dev != NULL && b->dev != dev) {
+            continue;
+        }
+        uint32_t flags = irq_save();
+        int writing = (b->flags & BH_WRITE) != 0;
+        get_ref(b);         // Keep it from being reused while we sleep
+        irq_restore(flags);
+        if (writing) {
+            wait_on_buffer(b);
+            failed += (b->flags & BH_ERROR) != 0;
+        }
+        brelse(b);
+    }
+    return failed;
+}
+
+// Write back buffers dirty for too long, or all of them under pressure
+static void flusher_thread(void* arg) {
+    (void)arg;
+    for (;;) {
+        thread_sleep(BCACHE_FLUSH_TICKS);
+        int all = flush_all;
+        flush_all = 0;
+        uint64_t now = timer_now_ns();
+        for (buffer_t* b = all_buffers; b != NULL; b = b->all_next) {
+            uint32_t flags = irq_save();
+            if ((b->flags & (BH_DIRTY | BH_LOCKED)) == BH_DIRTY &&
+                (all || now - b->dirtied_ns >= BCACHE_DIRTY_EXPIRE_NS)) {
+                start_io(b, 1);
+            }
+            irq_restore(flags);
+        }
+    }
+}
+
+uint32_t bcache_init(void) {
+    pmm_stats_t mem;
+    pmm_get_stats(&mem);
+    max_buffers = mem.free_frames / BCACHE_MEM_SHARE;
+    if (max_buffers > BCACHE_MAX_BUFFERS) {
+        max_buffers = BCACHE_MAX_BUFFERS;
+    }
+    buffer_cache = kmem_cache_create("buffer", sizeof(buffer_t), NULL);
+    if (buffer_cache == NULL) {
+        max_buffers = 0;
+        return 0;
+    }
+    thread_create("bflush", flusher_thread, NULL, SCHED_PRIO_DEFAULT);
+    return max_buffers;
+}
+
+void bcache_get_stats(bcache_stats_t* out) {
+    uint32_t flags = irq_save();
+    *out = stats;
+    out->buffers = nbuffers;
+    out->max_buffers = max_buffers;
+    out->dirty = ndirty;
+    irq_restore(flags);
+}
+
+// part / whole in hundredths of a percent, without overflowing 32 bits
+static uint32_t percent_x100(uint32_t part, uint32_t whole) {
+    while (part > 0xFFFFFFFFu / 10000) {
+        part >>= 1;
+        whole >>= 1;
+    }
+    return whole != 0 ? part * 10000 / whole : 0;
+}
+
+void bcache_dump_stats(void) {
+    bcache_stats_t s;
+    bcache_get_stats(&s);
+    uint32_t hit = percent_x100(s.hits, s.lookups);
+    uint32_t ra = percent_x100(s.ra_used, s.ra_blocks);
+    kprintf("bcache: %u lookups, %u.%02u%% hits; %u of %u buffers in use, %u dirty\n",
+            s.lookups, hit / 100, hit % 100, s.buffers, s.max_buffers, s.dirty);
+    kprintf("bcache: %u blocks read ahead, %u.%02u%% used, %u evicted unused; %u evictions, "
+            "%u writebacks, %u I/O errors\n",
+            s.ra_blocks, ra / 100, ra % 100, s.ra_wasted, s.evictions, s.writebacks, s.io_errors);
+}
+
+#ifdef BCACHE_BENCH
+#include "bench/bench.h"
+
+#define BENCH_TRACE_LEN     4096                // Block reads
+#define BENCH_HOT_BLOCKS    64                  // Metadata: inode tables, directories
+#define BENCH_SCAN_BLOCKS   16                  // 64 KB file reads
+
+static uint32_t bench_trace[BENCH_TRACE_LEN];
+static uint32_t bench_seed = 0x9E3779B9;
+
+// 40% hot metadata blocks (skewed towards the first ones), 30% blocks of
+// sequential scans, 30% random blocks
+static void bench_make_trace(uint32_t blocks) {
+    uint32_t n = 0;
+    while (n < BENCH_TRACE_LEN) {
+        uint32_t kind = bench_rand(&bench_seed) % 10;
+        if (kind < 4) {
+            uint32_t a = bench_rand(&bench_seed) % BENCH_HOT_BLOCKS;
+            uint32_t b = bench_rand(&bench_seed) % BENCH_HOT_BLOCKS;
+            bench_trace[n++] = (a * b / BENCH_HOT_BLOCKS) % blocks;
+        } else if (kind < 7) {
+            uint32_t start = bench_rand(&bench_seed) % blocks;
+            for (uint32_t i = 0; i < BENCH_SCAN_BLOCKS && n < BENCH_TRACE_LEN; i++) {
+                bench_trace[n++] = (start + i) % blocks;
+            }
+        } else {
+            bench_trace[n++] = bench_rand(&bench_seed) % blocks;
+        }
+    }
+}
+
+static uint32_t elapsed_us(uint64_t start_ns) {
+    return timer_ns_to_us(timer_now_ns() - start_ns);
+}
+
+static void bench_thread(void* arg) {
+    (void)arg;
+    // The scratch disk if there is one; only reads
+    block_device_t* dev = blkdev_find("hdb");
+    if (dev == NULL) {
+        dev = blkdev_find("hda");
+    }
+    uint32_t blocks = dev != NULL ? dev->sectors / BCACHE_BLOCK_SECTORS : 0;
+    uint32_t frame = pmm_alloc_frame();
+    if (blocks < BENCH_HOT_BLOCKS || frame == 0) {
+        kprintf("bcache: bench needs a disk of at least 256 KB\n");
+        return;
+    }
+    bench_make_trace(blocks);
+
+    uint8_t* buf = phys_to_virt(frame);
+    int err = 0;
+    uint64_t start = timer_now_ns();
+    for (uint32_t i = 0; i < BENCH_TRACE_LEN && err == 0; i++) {
+        err = blkdev_read(dev, bench_trace[i] * BCACHE_BLOCK_SECTORS, BCACHE_BLOCK_SECTORS, buf);
+    }
+    uint32_t direct_us = elapsed_us(start);
+    pmm_free_frame(frame);
+
+    bcache_stats_t before, after;
+    bcache_get_stats(&before);
+    start = timer_now_ns();
+    for (uint32_t i = 0; i < BENCH_TRACE_LEN && err == 0; i++) {
+        buffer_t* b = bread(dev, bench_trace[i]);
+        if (b == NULL) {
+            err = 1;
+            break;
+        }
+        brelse(b);
+    }
+    uint32_t cached_us = elapsed_us(start);
+    bcache_get_stats(&after);
+
+    uint32_t lookups = after.lookups - before.lookups;
+    uint32_t hit = percent_x100(after.hits - before.hits, lookups);
+    uint32_t ra = percent_x100(after.ra_used - before.ra_used, after.ra_blocks - before.ra_blocks);
+    uint32_t speedup = cached_us != 0 ? percent_x100(direct_us, cached_us) / 100 : 0;
+    kprintf("bcache: %u-read trace on %s: direct %u us, cached %u us (%u.%02ux)%s\n",
+            BENCH_TRACE_LEN, dev->name, direct_us, cached_us, speedup / 100, speedup % 100,
+            err ? " [I/O error]" : "");
+    kprintf("bcache: %u.%02u%% hits, %u blocks read ahead (%u.%02u%% used), %u evictions\n",
+            hit / 100, hit % 100, after.ra_blocks - before.ra_blocks, ra / 100, ra % 100,
+            after.evictions - before.evictions);
+}
+
+void bcache_bench_start(void) {
+    thread_create("bcbench", bench_thread, NULL, SCHED_PRIO_DEFAULT);
+}
+#endif
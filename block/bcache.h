@@ -0,0 +1,110 @@
+#ifndef BLOCK_BCACHE_H
+#define BLOCK_BCACHE_H
+
+#include <stdint.h>
+#include "blkdev.h"
+
+// Buffer cache: 4 KB blocks of block devices, one frame each, found through
+// a hash table keyed by (device, block). Unreferenced buffers sit on an LRU
+// list. A miss takes a new frame while the cache is under its limit (a share
+// of the free memory at boot), and otherwise reuses the least recently used
+// clean buffer. Dirty buffers are written back by the "bflush" thread once
+// they have been dirty for BCACHE_DIRTY_EXPIRE_NS, or all of them when they
+// fill a quarter of the cache.
+//
+// A miss that continues the previous read of the same device starts
+// readahead: the next window of blocks is read asynchronously (the driver
+// merges the requests into large commands), and when the reader reaches the
+// first block of a window the following one is started, so the disk stays a
+// window ahead. Windows double from BCACHE_RA_MIN up to BCACHE_RA_MAX blocks
+// while the reads stay sequential; a random miss turns readahead off again.
+//
+// Buffers are shared, not locked: users of the same block see each other's
+// writes. bread() and friends sleep, so call them from threads.
+
+#define BCACHE_BLOCK_SIZE       4096
+#define BCACHE_BLOCK_SECTORS    (BCACHE_BLOCK_SIZE / BLKDEV_SECTOR_SIZE)
+#define BCACHE_HASH_BITS        10
+#define BCACHE_MAX_BUFFERS      4096        // 16 MB
+#define BCACHE_MEM_SHARE        8           // At most 1/8 of the frames free at boot
+#define BCACHE_RA_MIN           4           // Blocks
+#define BCACHE_RA_MAX           32          // 128 KB, one ATA command
+#define BCACHE_DIRTY_EXPIRE_NS  5000000000ull
+
+// Buffer flags
+#define BH_VALID                0x01        // Data is the disk's, or newer
+#define BH_DIRTY                0x02        // Newer than the disk
+#define BH_LOCKED               0x04        // I/O in flight
+#define BH_WRITE                0x08        // ...and it is a write
+#define BH_READAHEAD            0x10        // Read ahead and not used yet
+#define BH_ERROR                0x20        // The last I/O failed
+
+struct bwaiter;
+
+typedef struct buffer {
+    block_device_t* dev;
+    uint32_t block;                         // In BCACHE_BLOCK_SIZE units
+    uint8_t* data;
+    volatile uint32_t flags;
+    uint32_t refs;
+    uint64_t dirtied_ns;
+    struct bwaiter* waiters;                // Threads sleeping until the I/O is done
+    struct buffer* hash_next;
+    struct buffer* lru_prev;                // LRU links while refs == 0
+    struct buffer* lru_next;
+    struct buffer* all_next;                // Every buffer ever set up
+} buffer_t;
+
+typedef struct {
+    uint32_t lookups;                       // bread() calls
+    uint32_t hits;                          // ...found valid or already being read
+    uint32_t misses;
+    uint32_t ra_blocks;                     // Blocks read ahead
+    uint32_t ra_used;                       // ...later found by bread()
+    uint32_t ra_wasted;                     // ...evicted unused
+    uint32_t evictions;
+    uint32_t writebacks;                    // Block writes started
+    uint32_t io_errors;
+    uint32_t buffers;                       // Buffers set up so far
+    uint32_t max_buffers;
+    uint32_t dirty;
+} bcache_stats_t;
+
+// Size the cache from the free memory and start the flusher thread.
+// Needs sched_init(). Returns the most buffers it will use.
+uint32_t bcache_init(void);
+
+// Referenced buffer holding block 'block' of 'dev', read from the disk on
+// a miss. NULL on an I/O error, past the end of the device, or when every
+// buffer is in use.
+buffer_t* bread(block_device_t* dev, uint32_t block);
+
+// Referenced buffer for the block without reading it, for callers that
+// overwrite the whole block (check BH_VALID otherwise)
+buffer_t* bgetblk(block_device_t* dev, uint32_t block);
+
+void brelse(buffer_t* b);
+
+// The caller changed the data; it is written back later
+void bmark_dirty(buffer_t* b);
+
+// Write a dirty buffer now and wait. Returns 0, or -1 if the write failed.
+int bwrite(buffer_t* b);
+
+// Write back every dirty buffer of 'dev' (all devices if NULL) and wait.
+// Returns the number of failed writes.
+uint32_t bcache_sync(block_device_t* dev);
+
+// Counters
+void bcache_get_stats(bcache_stats_t* out);
+
+// Print the counters (kprintf; on F12 with the IRQ stats)
+void bcache_dump_stats(void);
+
+#ifdef BCACHE_BENCH
+// Replay a synthetic read trace (hot metadata, sequential scans, random
+// reads) against the raw device and through the cache (build with -DBCACHE_BENCH)
+void bcache_bench_start(void);
+#endif
+
+#endif // BLOCK_BCACHE_H
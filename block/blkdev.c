@@ -0,0 +1,79 @@
+#include "blkdev.h"
+#include "task/sched.h"
+#include "libc/include/string.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#define BLK_PENDING         1
+
+static block_device_t* devices[BLKDEV_MAX];
+static uint32_t device_count;
+
+// Synchronous transfers: the submitter sleeps until the completion
+typedef struct {
+    thread_t* waiter;
+    volatile int status;
+} blk_wait_t;
+
+int blkdev_register(block_device_t* dev) {
+    if (device_count == BLKDEV_MAX) {
+        return 0;
+    }
+    dev->index = device_count;
+    devices[device_count++] = dev;
+    return 1;
+}
+
+uint32_t blkdev_count(void) {
+    return device_count;
+}
+
+block_device_t* blkdev_get(uint32_t index) {
+    return index < device_count ? devices[index] : NULL;
+}
+
+block_device_t* blkdev_find(const char* name) {
+    for (uint32_t i = 0; i < device_count; i++) {
+        if (strcmp(devices[i]->name, name) == 0) {
+            return devices[i];
+        }
+    }
+    return NULL;
+}
+
+static void wake_waiter(void* arg, int status) {
+    blk_wait_t* wait = arg;
+    thread_t* waiter = wait->waiter;    // 'wait' lives on the waiter's stack
+    asm volatile ("" : : : "memory");   // Keep the load above the store
+    wait->status = status;
+    thread_unblock(waiter);
+}
+
+static int transfer(block_device_t* dev, uint32_t lba, uint32_t count, uint8_t* buf, int write) {
+    while (count > 0) {
+        uint32_t n = count < dev->max_sectors ? count : dev->max_sectors;
+        blk_wait_t wait = { thread_current(), BLK_PENDING };
+        int err = dev->submit(dev, lba, n, buf, write, wake_waiter, &wait);
+        if (err != BLK_OK) {
+            return err;
+        }
+        while (wait.status == BLK_PENDING) {
+            thread_block();
+        }
+        if (wait.status != BLK_OK) {
+            return wait.status;
+        }
+        lba += n;
+        count -= n;
+        buf += n * BLKDEV_SECTOR_SIZE;
+    }
+    return BLK_OK;
+}
+
+int blkdev_read(block_device_t* dev, uint32_t lba, uint32_t count, void* buf) {
+    return transfer(dev, lba, count, buf, 0);
+}
+
+int blkdev_write(block_device_t* dev, uint32_t lba, uint32_t count, const void* buf) {
+    return transfer(dev, lba, count, (uint8_t*)buf, 1);
+}
@@ -0,0 +1,45 @@
+#ifndef BLOCK_BLKDEV_H
+#define BLOCK_BLKDEV_H
+
+#include <stdint.h>
+
+// Block devices: a name, a size in 512-byte sectors and an asynchronous
+// submit function. Drivers register their disks; the buffer cache
+// (block/bcache.h) and anything else that wants raw sectors go through here.
+
+#define BLKDEV_MAX          8
+#define BLKDEV_NAME_LEN     8
+#define BLKDEV_SECTOR_SIZE  512
+
+// Status passed to completions: 0, or a negative driver error
+#define BLK_OK              0
+
+typedef void (*blk_done_fn_t)(void* arg, int status);
+
+typedef struct block_device {
+    char name[BLKDEV_NAME_LEN];
+    uint32_t index;                     // Position in the registry, set by blkdev_register()
+    uint32_t sectors;
+    uint32_t max_sectors;               // Largest single transfer
+
+    // Start reading or writing 'count' sectors (1..max_sectors) at 'lba'.
+    // done(arg, status) runs once it finishes, from a bottom half or before
+    // submit returns. Returns BLK_OK, or a negative error without calling done.
+    int (*submit)(struct block_device* dev, uint32_t lba, uint32_t count, void* buf,
+                  int write, blk_done_fn_t done, void* arg);
+    void* priv;                         // Driver data
+} block_device_t;
+
+// Add a device; returns 0 when the registry is full
+int blkdev_register(block_device_t* dev);
+
+uint32_t blkdev_count(void);
+block_device_t* blkdev_get(uint32_t index);
+block_device_t* blkdev_find(const char* name);
+
+// Blocking transfer of any length, split into max_sectors pieces.
+// Returns BLK_OK or the first error. Call from a thread.
+int blkdev_read(block_device_t* dev, uint32_t lba, uint32_t count, void* buf);
+int blkdev_write(block_device_t* dev, uint32_t lba, uint32_t count, const void* buf);
+
+#endif // BLOCK_BLKDEV_H
@@ -0,0 +1,42 @@
+#ifndef BOOTLOADER_BOOT_INFO_H
+#define BOOTLOADER_BOOT_INFO_H
+
+#include <stdint.h>
+
+// Fixed low-memory locations written by the boot stages before entering the kernel.
+// Must match BOOT_INFO / E820_MAP in bootloader/memory_map.asm and the BI_*
+// offsets in bootloader/stage2.asm.
+#define BOOT_INFO_ADDR      0x500
+#define E820_MAP_ADDR       0x600
+#define E820_MAX_ENTRIES    64
+
+// E820 region types
+#define E820_USABLE         1
+#define E820_RESERVED       2
+#define E820_ACPI_RECLAIM   3
+#define E820_ACPI_NVS       4
+#define E820_BAD            5
+
+// One entry of the BIOS int 0x15, eax=0xE820 memory map
+typedef struct {
+    uint64_t base;
+    uint64_t length;
+    uint32_t type;
+    uint32_t acpi;      // ACPI 3.x extended attributes (may be left unset by the BIOS)
+} __attribute__((packed)) e820_entry_t;
+
+// Information handed from the bootloader to kernel_main
+typedef struct {
+    uint32_t e820_count;            // Number of valid entries in e820_map
+    e820_entry_t* e820_map;         // Points to E820_MAP_ADDR
+    uint32_t kernel_addr;           // Where stage 2 loaded the kernel image (1 MB)
+    uint32_t kernel_size;           // Bytes loaded, whole sectors
+    uint32_t boot_drive;            // BIOS drive number (0x80 = first hard disk)
+    uint32_t load_reads;            // int 0x13 AH=42h calls used to load the kernel
+    uint64_t load_cycles;           // TSC cycles spent loading the kernel
+    uint64_t sector_load_cycles;    // Same load one sector per call (BOOT_BENCH builds), else 0
+    uint32_t initrd_addr;           // Physical address of the initrd (cpio newc archive), 0 if none
+    uint32_t initrd_size;           // Archive bytes
+} __attribute__((packed)) boot_info_t;
+
+#endif // BOOTLOADER_BOOT_INFO_H
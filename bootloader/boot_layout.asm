@@ -0,0 +1,19 @@
+; Disk and memory layout shared by both boot stages
+;
+;   LBA 0                       MBR (stage 1), loads stage 2 with CHS int 0x13
+;   LBA 1 .. STAGE2_SECTORS     Stage 2, loaded to STAGE2_ADDR
+;   LBA KERNEL_LBA ..           Kernel image, loaded to KERNEL_LOAD_ADDR (1 MB)
+;   right after the kernel      Initrd (if any), loaded to INITRD_LOAD_ADDR (4 MB)
+;
+; KERNEL_LOAD_ADDR plus KERNEL_VIRT_BASE (kernel_entry.asm) must match the -Ttext
+; address in scripts/linux-build.sh.
+
+STAGE2_ADDR equ 0x7E00          ; Right after the MBR
+STAGE2_SECTORS equ 4            ; 2 KB, padded by stage2.asm
+KERNEL_LBA equ 1 + STAGE2_SECTORS
+KERNEL_LOAD_ADDR equ 0x100000
+INITRD_LOAD_ADDR equ 0x400000  ; Past the kernel's .bss and the boot page tables
+
+BOUNCE_SEGMENT equ 0x1000       ; 0x10000: int 0x13 reads land here, below 1 MB
+BOUNCE_ADDR equ BOUNCE_SEGMENT << 4
+LBA_BATCH_SECTORS equ 127       ; Largest count every BIOS accepts in one AH=42h call
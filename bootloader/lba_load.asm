@@ -0,0 +1,123 @@
+; Kernel and initrd loading with the INT 13h extensions (AH=42h, disk address packet).
+; Batches are read into the bounce buffer below 1 MB and copied to their
+; final place above 1 MB through unreal mode.
+
+[bits 16]
+
+; Set CF if the BIOS has no extended read for drive 'dl'
+lba_check:
+    pusha
+    mov ah, 0x41
+    mov bx, 0x55AA
+    int 0x13
+    jc lba_check_done
+    cmp bx, 0xAA55      ; Extensions installed
+    jne lba_check_fail
+    test cl, 1          ; Bit 0: packet-based access (AH=42h); test clears CF
+    jnz lba_check_done
+lba_check_fail:
+    stc
+lba_check_done:
+    popa                ; Leaves the flags alone
+    ret
+
+; Give DS and ES a 4 GB limit while staying in real mode ("unreal mode"):
+; load them from a flat descriptor in protected mode and switch back.
+; Real-mode segment loads only change the base, so the limit sticks.
+enter_unreal:
+    pushf
+    cli
+    push eax
+    push ds
+    push es
+    lgdt [gdt_descriptor]
+    mov eax, cr0
+    or al, 1
+    mov cr0, eax
+    jmp $+2             ; Flush the prefetch queue
+    mov ax, 0x10        ; Flat data descriptor
+    mov ds, ax
+    mov es, ax
+    mov eax, cr0
+    and al, 0xFE
+    mov cr0, eax
+    pop es
+    pop ds
+    pop eax
+    popf
+    ret
+
+; Read KERNEL_SECTORS sectors from KERNEL_LBA to KERNEL_LOAD_ADDR
+lba_read_kernel:
+    mov dword [lba_next], KERNEL_LBA
+    mov dword [lba_dest], KERNEL_LOAD_ADDR
+    mov dword [lba_left], KERNEL_SECTORS
+    ; Fall through
+
+; Read [lba_left] sectors from LBA [lba_next] to [lba_dest], at most
+; [lba_batch] sectors per int 0x13 call; [lba_reads] counts the calls.
+; Expects ds = es = 0.
+lba_read:
+    pushad
+
+lba_read_loop:
+    mov eax, [lba_left]
+    test eax, eax
+    jz lba_read_done
+    movzx ecx, word [lba_batch]
+    cmp eax, ecx
+    jbe lba_read_count
+    mov eax, ecx
+lba_read_count:
+    mov [dap_count], ax
+    mov word [dap_offset], 0
+    mov word [dap_segment], BOUNCE_SEGMENT
+    mov eax, [lba_next]
+    mov [dap_lba], eax
+    mov dword [dap_lba + 4], 0
+    mov si, dap         ; ds:si <- disk address packet
+    mov ah, 0x42
+    mov dl, [BOOT_DRIVE]
+    int 0x13
+    jc disk_error
+    inc dword [lba_reads]
+
+    movzx ecx, word [dap_count]     ; The BIOS writes back the sectors transferred
+    test ecx, ecx
+    jz sectors_error
+    add [lba_next], ecx
+    sub [lba_left], ecx
+
+    ; The BIOS may have reloaded DS/ES, so re-enter unreal mode before the copy
+    call enter_unreal
+    shl ecx, 7          ; Sectors -> dwords
+    mov esi, BOUNCE_ADDR
+    mov edi, [lba_dest]
+    cld
+    a32 rep movsd       ; ds:esi -> es:edi with 32-bit addresses
+    mov [lba_dest], edi
+    jmp lba_read_loop
+
+lba_read_done:
+    popad
+    ret
+
+; Disk address packet for AH=42h
+align 4
+dap:
+    db 0x10             ; Packet size
+    db 0
+dap_count:
+    dw 0                ; Sectors to read
+dap_offset:
+    dw 0                ; Buffer offset
+dap_segment:
+    dw 0                ; Buffer segment
+dap_lba:
+    dq 0                ; First sector
+
+lba_next dd 0
+lba_dest dd 0
+lba_left dd 0
+lba_reads dd 0
+lba_batch dw LBA_BATCH_SECTORS
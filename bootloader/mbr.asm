@@ -1,12 +1,10 @@
 [org 0x7C00]                ; BIOS loads boot sector to this address
 mov sp, 0x7C00              ; Temporary stack
-%ifndef KERNEL_SECTORS
-    %define KERNEL_SECTORS 2 ; default value, will be overridden by build script
-%endif
-KERNEL_OFFSET equ 0x1000
+
+%include './boot_layout.asm'
 
 ; ========================
-; Start in 16-bit real mode
+; Stage 1: load stage 2 right behind us and jump to it
 ; ========================
 [bits 16]
 main:
@@ -22,84 +20,14 @@ main:
     ; Save BIOS-supplied boot drive number (DL) for later disk operations
     mov [BOOT_DRIVE], dl
 
-    mov ax, msg_boot
-    call print
-    call print_nl
-
-    ; load kernel from boot sector
-    mov bx, KERNEL_OFFSET ; Read from disk and store in 0x1000
-    mov dh, KERNEL_SECTORS
+    ; Stage 2 sits on the first track, so a plain CHS read is enough
+    mov bx, STAGE2_ADDR ; Read from disk and store in 0:STAGE2_ADDR
+    mov dh, STAGE2_SECTORS
     mov dl, [BOOT_DRIVE]
     call disk_load
 
-    call enable_a20     ; Enable access above 1MB
-    call setup_gdt      ; Load GDT
-
-    ; Set PE (Protection Enable) bit in CR0
-    mov eax, cr0
-    or eax, 1
-    mov cr0, eax
-
-    ; Far jump to protected mode code
-    jmp 0x08:protected_mode_start
-
-; ========================
-; Protected Mode Code
-; ========================
-[bits 32]
-protected_mode_start:
-    ; Set up segments with flat model
-    mov ax, 0x10        ; Data segment selector
-    mov ds, ax
-    mov es, ax
-    mov fs, ax
-    mov gs, ax
-    mov ss, ax
-    mov esp, 0x9FBFF    ; Setup stack
-
-    ; print 32-bit message
-    mov ebx, msg32
-    call print_string_pm
-
-    ; Enter kernel
-    call KERNEL_OFFSET
-    jmp $
-
-; ========================
-; GDT Setup
-; ========================
-[bits 16]
-setup_gdt:
-    lgdt [gdt_descriptor]
-    ret
-
-; ========================
-; A20 Line Enabler (simple BIOS method)
-; ========================
-enable_a20:
-    in al, 0x92         ; Read System Control Port A
-    or al, 00000010b    ; Set A20 bit (bit 1; expands accessible memory)
-    out 0x92, al
-    ret
-
-; ========================
-; GDT (Global Descriptor Table)
-; ========================
-gdt_start:
-    ; Null descriptor
-    dq 0x0000000000000000
-
-    ; Code segment: base=0, limit=4GB, flags=0x9A
-    dq 0x00CF9A000000FFFF
-
-    ; Data segment: base=0, limit=4GB, flags=0x92
-    dq 0x00CF92000000FFFF
-
-gdt_descriptor:
-    dw gdt_end - gdt_start - 1      ; Size (limit)
-    dd gdt_start                    ; Address (base)
-
-gdt_end:
+    mov dl, [BOOT_DRIVE] ; Stage 2 expects the boot drive in DL
+    jmp 0:STAGE2_ADDR
 
 
 %include './boot_sect.asm'
@@ -110,14 +38,9 @@ BOOT_DRIVE db 0x00
 ; ========================
 %include './print.asm'
 %include './print_hex.asm'
-%include './print32.asm'
 
 msg16:
     db 'wsg 16-bit', 0
-msg32:
-    db 'wagwan 32-bit', 0
-msg_boot:
-    db 'mi get dat bombaclaat kernel v0.1', 0
 
 ; ========================
 ; Boot Signature (MUST be last 2 bytes)
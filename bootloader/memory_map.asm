@@ -0,0 +1,37 @@
+; Query the BIOS memory map (int 0x15, eax=0xE820) into E820_MAP
+; and store the entry count and map address in BOOT_INFO.
+; Layout must match bootloader/boot_info.h
+BOOT_INFO equ 0x500
+E820_MAP equ 0x600
+E820_MAX equ 64
+E820_ENTRY_SIZE equ 24
+SMAP equ 0x534D4150        ; 'SMAP' signature
+
+[bits 16]
+detect_memory:
+    pusha
+    mov di, E820_MAP        ; es:di <- buffer for each entry (es = 0)
+    xor ebx, ebx            ; ebx <- continuation value, 0 = first entry
+    xor ebp, ebp            ; ebp <- number of entries stored
+
+e820_loop:
+    mov eax, 0xE820
+    mov edx, SMAP
+    mov ecx, E820_ENTRY_SIZE
+    int 0x15
+    jc e820_done            ; carry = unsupported, or past the last entry
+    cmp eax, SMAP           ; BIOS must echo the signature back
+    jne e820_done
+
+    inc bp
+    add di, E820_ENTRY_SIZE
+    cmp bp, E820_MAX        ; keep the map below 0x1000
+    je e820_done
+    test ebx, ebx           ; ebx = 0 means that was the last entry
+    jnz e820_loop
+
+e820_done:
+    mov [BOOT_INFO], ebp                    ; boot_info->e820_count
+    mov dword [BOOT_INFO + 4], E820_MAP     ; boot_info->e820_map
+    popa
+    ret
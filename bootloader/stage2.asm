@@ -0,0 +1,191 @@
+; Stage 2 (NASM syntax). The MBR loads it to STAGE2_ADDR and jumps here with
+; the boot drive in DL. It loads the kernel to 1 MB (and the initrd, if the
+; build packed one, to 4 MB) with INT 13h extended reads, collects the
+; memory map, fills in boot_info_t, enters protected mode and calls the kernel.
+%include './boot_layout.asm'
+%ifndef KERNEL_SECTORS
+    %define KERNEL_SECTORS 2 ; default value, will be overridden by build script
+%endif
+%ifndef INITRD_SECTORS
+    %define INITRD_SECTORS 0 ; No initrd unless the build script packed one
+    %define INITRD_SIZE 0
+%endif
+
+; boot_info_t fields written here (see boot_info.h; detect_memory fills 0 and 4)
+BI_KERNEL_ADDR equ 8
+BI_KERNEL_SIZE equ 12
+BI_BOOT_DRIVE equ 16
+BI_LOAD_READS equ 20
+BI_LOAD_CYCLES equ 24
+BI_SECTOR_CYCLES equ 32
+BI_INITRD_ADDR equ 40
+BI_INITRD_SIZE equ 44
+
+[org STAGE2_ADDR]
+[bits 16]
+stage2:
+    mov [BOOT_DRIVE], dl
+    mov ax, msg_boot
+    call print
+    call print_nl
+
+    call enable_a20     ; Enable access above 1MB
+    mov dl, [BOOT_DRIVE]
+    call lba_check
+    jc no_lba
+    call enter_unreal
+
+    ; Load the kernel in batches, timed with the TSC
+    mov word [lba_batch], LBA_BATCH_SECTORS
+    mov dword [lba_reads], 0
+    rdtsc
+    mov [load_start], eax
+    mov [load_start + 4], edx
+    call lba_read_kernel
+    rdtsc
+    sub eax, [load_start]
+    sbb edx, [load_start + 4]
+    mov [BOOT_INFO + BI_LOAD_CYCLES], eax
+    mov [BOOT_INFO + BI_LOAD_CYCLES + 4], edx
+    mov eax, [lba_reads]
+    mov [BOOT_INFO + BI_LOAD_READS], eax
+
+%ifdef BOOT_BENCH
+    ; Load it again one sector per call, for comparison
+    mov word [lba_batch], 1
+    rdtsc
+    mov [load_start], eax
+    mov [load_start + 4], edx
+    call lba_read_kernel
+    rdtsc
+    sub eax, [load_start]
+    sbb edx, [load_start + 4]
+%else
+    xor eax, eax
+    xor edx, edx
+%endif
+    mov [BOOT_INFO + BI_SECTOR_CYCLES], eax
+    mov [BOOT_INFO + BI_SECTOR_CYCLES + 4], edx
+
+    ; The initrd follows the kernel on disk
+%if INITRD_SECTORS > 0
+    mov word [lba_batch], LBA_BATCH_SECTORS
+    mov dword [lba_next], KERNEL_LBA + KERNEL_SECTORS
+    mov dword [lba_dest], INITRD_LOAD_ADDR
+    mov dword [lba_left], INITRD_SECTORS
+    call lba_read
+    mov dword [BOOT_INFO + BI_INITRD_ADDR], INITRD_LOAD_ADDR
+    mov dword [BOOT_INFO + BI_INITRD_SIZE], INITRD_SIZE
+%else
+    mov dword [BOOT_INFO + BI_INITRD_ADDR], 0
+    mov dword [BOOT_INFO + BI_INITRD_SIZE], 0
+%endif
+
+    mov dword [BOOT_INFO + BI_KERNEL_ADDR], KERNEL_LOAD_ADDR
+    mov dword [BOOT_INFO + BI_KERNEL_SIZE], KERNEL_SECTORS * 512
+    movzx eax, byte [BOOT_DRIVE]
+    mov [BOOT_INFO + BI_BOOT_DRIVE], eax
+
+    ; collect the BIOS memory map while we still have the BIOS
+    xor ax, ax
+    mov es, ax          ; detect_memory writes to 0:E820_MAP
+    call detect_memory
+
+    cli                 ; Disable interrupts
+    call setup_gdt      ; Load GDT
+
+    ; Set PE (Protection Enable) bit in CR0
+    mov eax, cr0
+    or eax, 1
+    mov cr0, eax
+
+    ; Far jump to protected mode code
+    jmp 0x08:protected_mode_start
+
+no_lba:
+    mov ax, msg_no_lba
+    call print
+    jmp $
+
+; ========================
+; Protected Mode Code
+; ========================
+[bits 32]
+protected_mode_start:
+    ; Set up segments with flat model
+    mov ax, 0x10        ; Data segment selector
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    mov ss, ax
+    mov esp, 0x9FBFF    ; Setup stack
+
+    ; print 32-bit message
+    mov ebx, msg32
+    call print_string_pm
+
+    ; Enter kernel, ebx = boot_info_t* (see boot_info.h)
+    mov ebx, BOOT_INFO
+    call KERNEL_LOAD_ADDR
+    jmp $
+
+; ========================
+; GDT Setup
+; ========================
+[bits 16]
+setup_gdt:
+    lgdt [gdt_descriptor]
+    ret
+
+; ========================
+; A20 Line Enabler (simple BIOS method)
+; ========================
+enable_a20:
+    in al, 0x92         ; Read System Control Port A
+    or al, 00000010b    ; Set A20 bit (bit 1; expands accessible memory)
+    out 0x92, al
+    ret
+
+; ========================
+; GDT (Global Descriptor Table)
+; ========================
+gdt_start:
+    ; Null descriptor
+    dq 0x0000000000000000
+
+    ; Code segment: base=0, limit=4GB, flags=0x9A
+    dq 0x00CF9A000000FFFF
+
+    ; Data segment: base=0, limit=4GB, flags=0x92
+    dq 0x00CF92000000FFFF
+
+gdt_descriptor:
+    dw gdt_end - gdt_start - 1      ; Size (limit)
+    dd gdt_start                    ; Address (base)
+
+gdt_end:
+
+
+%include './boot_sect.asm'
+%include './lba_load.asm'
+%include './memory_map.asm'
+BOOT_DRIVE db 0x00
+load_start dq 0
+
+; ========================
+; Strings, for debugging
+; ========================
+%include './print.asm'
+%include './print_hex.asm'
+%include './print32.asm'
+
+msg32:
+    db 'wagwan 32-bit', 0
+msg_boot:
+    db 'mi get dat bombaclaat kernel v0.1', 0
+msg_no_lba:
+    db 'No INT 13h extensions', 0
+
+; Pad to the sectors the MBR loads
+times STAGE2_SECTORS * 512 - ($ - $$) db 0
@@ -0,0 +1,240 @@
+#include "fpu.h"
+#include "percpu.h"
+#include "interrupt/isr.h"
+#include "interrupt/irqflags.h"
+#include "memory/kmalloc.h"
+#include "task/sched.h"
+#include "libc/include/stdio.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Lazy FPU/SSE switching (see fpu.h). Threads only run on the boot CPU, so
+// only its owner ever holds thread state; application processors just clear
+// TS when kernel code there traps after a kernel_fpu_end().
+
+#define CPUID_EDX_FXSR      (1u << 24)
+#define CPUID_EDX_SSE       (1u << 25)
+#define CPUID_EDX_SSE2      (1u << 26)
+#define CR0_MP              (1u << 1)
+#define CR0_EM              (1u << 2)
+#define CR0_TS              (1u << 3)
+#define CR0_NE              (1u << 5)
+#define CR4_OSFXSR          (1u << 9)
+#define CR4_OSXMMEXCPT      (1u << 10)
+
+#define NM_VECTOR           7
+
+static int has_fxsr;
+static int has_sse2;
+static int lazy;
+static kmem_cache_t* state_cache;       // 512-byte objects: slab objects start 16-byte aligned
+static fpu_stats_t stats;
+
+// State after fninit (and the default MXCSR), loaded on a thread's first use
+static uint8_t clean_state[FPU_STATE_SIZE] __attribute__((aligned(16)));
+
+static inline void clts(void) {
+    asm volatile ("clts");
+}
+
+static inline void stts(void) {
+    uint32_t cr0;
+    asm volatile ("mov %%cr0, %0" : "=r"(cr0));
+    asm volatile ("mov %0, %%cr0" : : "r"(cr0 | CR0_TS));
+}
+
+static inline void fxsave(void* area) {
+    asm volatile ("fxsave (%0)" : : "r"(area) : "memory");
+}
+
+static inline void fxrstor(const void* area) {
+    asm volatile ("fxrstor (%0)" : : "r"(area) : "memory");
+}
+
+static void cr0_setup(void) {
+    // Native x87 error reporting, no emulation; MP makes fwait honour TS
+    uint32_t cr0;
+    asm volatile ("mov %%cr0, %0" : "=r"(cr0));
+    cr0 = (cr0 & ~(CR0_EM | CR0_TS)) | CR0_MP | CR0_NE;
+    asm volatile ("mov %0, %%cr0" : : "r"(cr0));
+    asm volatile ("fninit");
+}
+
+void fpu_init(void) {
+    uint32_t eax, ebx, ecx, edx;
+    asm volatile ("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(1));
+    has_fxsr = (edx & CPUID_EDX_FXSR) != 0;
+    cr0_setup();
+    if (!has_fxsr) {
+        return; // No fxsave: the FPU stays usable but is never switched
+    }
+
+    // APs copy CR4 through the trampoline
+    uint32_t cr4;
+    asm volatile ("mov %%cr4, %0" : "=r"(cr4));
+    cr4 |= CR4_OSFXSR;
+    if (edx & CPUID_EDX_SSE) {
+        cr4 |= CR4_OSXMMEXCPT;
+    }
+    asm volatile ("mov %0, %%cr4" : : "r"(cr4));
+    has_sse2 = (edx & CPUID_EDX_SSE2) != 0;
+
+    fxsave(clean_state);
+}
+
+void fpu_init_ap(void) {
+    cr0_setup();
+}
+
+int fpu_has_sse2(void) {
+    return has_sse2;
+}
+
+// #NM: the running thread touched the FPU after a switch set TS
+static void fpu_trap(registers_t* regs) {
+    (void)regs;
+    clts();
+    cpu_t* cpu = this_cpu();
+    thread_t* t = cpu->id == 0 ? thread_current() : NULL;
+    if (t == NULL || t->fpu_state == NULL || cpu->fpu_owner == t) {
+        // Kernel code with no thread state (idle thread, APs): whatever is
+        // loaded stays loaded, and the string functions preserve it
+        return;
+    }
+
+    stats.traps++;
+    if (cpu->fpu_owner != NULL) {
+        fxsave(cpu->fpu_owner->fpu_state);
+        stats.saves++;
+    }
+    fxrstor(t->fpu_used ? t->fpu_state : clean_state);
+    t->fpu_used = 1;
+    stats.restores++;
+    cpu->fpu_owner = t;
+}
+
+void fpu_enable_lazy(void) {
+    if (!has_fxsr) {
+        return;
+    }
+    state_cache = kmem_cache_create("fpu", FPU_STATE_SIZE, NULL);
+    if (state_cache == NULL) {
+        return;
+    }
+    isr_register_handler(NM_VECTOR, fpu_trap);
+    lazy = 1;
+}
+
+int fpu_thread_init(thread_t* t) {
+    t->fpu_used = 0;
+    t->fpu_state = NULL;
+    if (!lazy) {
+        return 1;
+    }
+    t->fpu_state = kmem_cache_alloc(state_cache);
+    return t->fpu_state != NULL;
+}
+
+void fpu_thread_free(thread_t* t) {
+    if (t->fpu_state != NULL) {
+        kmem_cache_free(state_cache, t->fpu_state);
+        t->fpu_state = NULL;
+    }
+}
+
+void fpu_switch(thread_t* next) {
+    if (!lazy) {
+        return;
+    }
+    stats.switches++;
+    if (this_cpu()->fpu_owner == next) {
+        clts();
+        stats.loaded_hits++;
+    } else {
+        stts();
+    }
+}
+
+void fpu_thread_exit(thread_t* t) {
+    cpu_t* cpu = this_cpu();
+    if (cpu->fpu_owner == t) {
+        cpu->fpu_owner = NULL;
+    }
+}
+
+void kernel_fpu_begin(void) {
+    uint32_t flags = irq_save();
+    cpu_t* cpu = this_cpu();
+    cpu->fpu_irq_flags = flags;
+    clts();
+    if (cpu->fpu_owner != NULL) {
+        // Its thread reloads the registers on its next #NM
+        fxsave(cpu->fpu_owner->fpu_state);
+        cpu->fpu_owner = NULL;
+        stats.saves++;
+    }
+    stats.kernel_sections++;
+}
+
+void kernel_fpu_end(void) {
+    cpu_t* cpu = this_cpu();
+    if (lazy) {
+        stts();
+    }
+    irq_restore(cpu->fpu_irq_flags);
+}
+
+void fpu_get_stats(fpu_stats_t* out) {
+    uint32_t flags = irq_save();
+    *out = stats;
+    irq_restore(flags);
+}
+
+void fpu_dump_stats(void) {
+    fpu_stats_t s;
+    fpu_get_stats(&s);
+    if (!lazy) {
+        kprintf("fpu: lazy switching off (no fxsave)\n");
+        return;
+    }
+    // Eager switching would save and restore on every switch
+    kprintf("fpu: %u switches, %u saves and %u restores avoided (%u kept the loaded state)\n",
+            s.switches, s.switches - s.saves, s.switches - s.restores, s.loaded_hits);
+    kprintf("fpu: %u #NM traps, %u saves, %u restores, %u kernel sections\n",
+            s.traps, s.saves, s.restores, s.kernel_sections);
+}
+
+#ifdef BENCH_MODE
+#include "bench/bench.h"
+
+// What eager switching pays per switch, what a lazy restore costs on top of
+// it, and the price of a kernel SSE section
+static uint8_t bench_state[FPU_STATE_SIZE] __attribute__((aligned(16)));
+
+static void save_restore_bench(void* arg) {
+    (void)arg;
+    if (has_fxsr) {
+        fxsave(bench_state);
+        fxrstor(bench_state);
+    }
+}
+
+// The boot context has no thread state, so the handler only clears TS
+static void nm_trap_bench(void* arg) {
+    (void)arg;
+    if (lazy) {
+        stts();
+        asm volatile ("fnop");
+    }
+}
+
+static void kernel_section_bench(void* arg) {
+    (void)arg;
+    kernel_fpu_begin();
+    kernel_fpu_end();
+}
+
+BENCH_REGISTER(fpu_fxsave_fxrstor, .fn = save_restore_bench);
+BENCH_REGISTER(fpu_nm_trap, .fn = nm_trap_bench);
+BENCH_REGISTER(fpu_kernel_section, .fn = kernel_section_bench);
+#endif
@@ -0,0 +1,61 @@
+#ifndef CPU_FPU_H
+#define CPU_FPU_H
+
+#include <stdint.h>
+
+// Lazy FPU/SSE context switching.
+// Each thread has an fxsave area, but a thread switch only sets CR0.TS. The
+// first FPU/SSE instruction after that raises #NM (ISR 7), whose handler
+// saves the registers of the thread that last used them and loads the
+// current thread's. Threads that never touch the FPU never pay for it, and a
+// thread switched back in while its state is still loaded pays nothing.
+//
+// Kernel code must not use FPU/SSE registers except inside
+// kernel_fpu_begin()/kernel_fpu_end(), or like the string functions by
+// saving and restoring every register it touches.
+
+#define FPU_STATE_SIZE      512         // fxsave/fxrstor area, 16-byte aligned
+
+struct thread;
+
+typedef struct {
+    uint32_t switches;          // Thread switches seen with lazy switching on
+    uint32_t loaded_hits;       // Switched back to the thread whose state was loaded: TS stays clear
+    uint32_t traps;             // #NM taken by a thread
+    uint32_t saves;             // fxsave of the previous owner's registers
+    uint32_t restores;          // fxrstor of the trapping thread's state (or the clean state)
+    uint32_t kernel_sections;   // kernel_fpu_begin() calls
+} fpu_stats_t;
+
+// Enable the FPU and, when present, SSE (CR0.MP/NE, CR4.OSFXSR/OSXMMEXCPT)
+// on the boot CPU and record the clean state new threads start from.
+// Call before string_init(), which picks SSE2 routines from fpu_has_sse2().
+void fpu_init(void);
+
+// CR0 setup of an application processor (CR4 comes through the trampoline)
+void fpu_init_ap(void);
+
+int fpu_has_sse2(void);
+
+// Install the #NM handler and start switching lazily.
+// Needs idt_install() and kmalloc_init(); call before the first thread_create().
+void fpu_enable_lazy(void);
+
+// Thread hooks for task/sched.c. fpu_thread_init() returns 0 when out of memory.
+int fpu_thread_init(struct thread* t);
+void fpu_thread_free(struct thread* t);
+void fpu_switch(struct thread* next);       // Interrupts disabled, before switch_context
+void fpu_thread_exit(struct thread* t);     // Its loaded registers can be dropped
+
+// Use FPU/SSE registers in kernel code. Saves the loaded thread state and
+// disables interrupts until kernel_fpu_end(); sections do not nest.
+void kernel_fpu_begin(void);
+void kernel_fpu_end(void);
+
+// Counters
+void fpu_get_stats(fpu_stats_t* out);
+
+// Print the counters (kprintf; on F12 with the IRQ stats)
+void fpu_dump_stats(void);
+
+#endif // CPU_FPU_H
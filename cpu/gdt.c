@@ -0,0 +1,70 @@
+#include "gdt.h"
+#include "percpu.h"
+#include <stdint.h>
+
+// Kernel GDT: null, flat ring 0 code and data, flat ring 3 code and data,
+// then a data segment and a TSS per CPU.
+
+#define GDT_ENTRIES         (GDT_PERCPU_FIRST + 2 * SMP_MAX_CPUS)
+
+#define GDT_ACCESS_CODE     0x9A                // Present, ring 0, code, readable
+#define GDT_ACCESS_DATA     0x92                // Present, ring 0, data, writable
+#define GDT_ACCESS_USER     0x60                // DPL 3, or'ed into the above
+#define GDT_ACCESS_TSS      0x89                // Present, ring 0, 32-bit available TSS
+#define GDT_FLAGS_4K_32     0xC                 // 4 KB granularity, 32-bit
+#define GDT_FLAGS_BYTE_32   0x4                 // Byte granularity, 32-bit
+
+typedef struct {
+    uint16_t limit;
+    uint32_t base;
+} __attribute__((packed)) gdt_ptr_t;
+
+static uint64_t gdt[GDT_ENTRIES];
+static gdt_ptr_t gdt_ptr;
+
+static uint64_t gdt_entry(uint32_t base, uint32_t limit, uint8_t access, uint8_t flags) {
+    uint64_t entry = limit & 0xFFFF;
+    entry |= (uint64_t)(base & 0xFFFFFF) << 16;
+    entry |= (uint64_t)access << 40;
+    entry |= (uint64_t)((limit >> 16) & 0xF) << 48;
+    entry |= (uint64_t)(flags & 0xF) << 52;
+    entry |= (uint64_t)(base >> 24) << 56;
+    return entry;
+}
+
+void gdt_set_percpu(uint32_t cpu, uint32_t base, uint32_t limit) {
+    gdt[GDT_PERCPU_SEL(cpu) / 8] = gdt_entry(base, limit, GDT_ACCESS_DATA, GDT_FLAGS_BYTE_32);
+}
+
+void gdt_set_tss(uint32_t cpu, uint32_t tss) {
+    gdt[GDT_TSS_SEL(cpu) / 8] = gdt_entry(tss, sizeof(tss_t) - 1, GDT_ACCESS_TSS, 0);
+}
+
+void gdt_load(uint32_t cpu) {
+    asm volatile (
+        "lgdt %0\n\t"
+        "ljmp %1, $1f\n"                        // Reload CS
+        "1:\n\t"
+        "mov %2, %%ds\n\t"
+        "mov %2, %%es\n\t"
+        "mov %2, %%fs\n\t"
+        "mov %2, %%ss\n\t"
+        "mov %3, %%gs\n\t"
+        "ltr %w4"
+        : : "m"(gdt_ptr), "i"(GDT_KERNEL_CODE), "r"(GDT_KERNEL_DATA), "r"(GDT_PERCPU_SEL(cpu)),
+            "r"(GDT_TSS_SEL(cpu))
+        : "memory");
+}
+
+void gdt_init(void) {
+    gdt[0] = 0;
+    gdt[1] = gdt_entry(0, 0xFFFFF, GDT_ACCESS_CODE, GDT_FLAGS_4K_32);
+    gdt[2] = gdt_entry(0, 0xFFFFF, GDT_ACCESS_DATA, GDT_FLAGS_4K_32);
+    gdt[3] = gdt_entry(0, 0xFFFFF, GDT_ACCESS_CODE | GDT_ACCESS_USER, GDT_FLAGS_4K_32);
+    gdt[4] = gdt_entry(0, 0xFFFFF, GDT_ACCESS_DATA | GDT_ACCESS_USER, GDT_FLAGS_4K_32);
+    gdt_ptr.limit = sizeof(gdt) - 1;
+    gdt_ptr.base = (uint32_t)gdt;
+
+    percpu_init(0);
+    gdt_load(0);
+}
@@ -0,0 +1,33 @@
+#ifndef CPU_GDT_H
+#define CPU_GDT_H
+
+#include <stdint.h>
+
+// Segment selectors. Every CPU gets its own per-CPU data segment, loaded into
+// %gs, whose base is that CPU's cpu_t (see cpu/percpu.h), followed by its TSS.
+// The entry stubs rely on that pairing: from ring 3, %gs is recovered as the
+// task register minus 8. The user segments sit right after the kernel ones,
+// the order SYSEXIT expects (SYSENTER_CS + 16 and + 24).
+#define GDT_KERNEL_CODE     0x08
+#define GDT_KERNEL_DATA     0x10
+#define GDT_USER_CODE       0x1B                // Index 3, RPL 3
+#define GDT_USER_DATA       0x23                // Index 4, RPL 3
+#define GDT_PERCPU_FIRST    5                   // GDT index of CPU 0's per-CPU segment
+#define GDT_PERCPU_SEL(cpu) ((GDT_PERCPU_FIRST + 2 * (cpu)) * 8)
+#define GDT_TSS_SEL(cpu)    (GDT_PERCPU_SEL(cpu) + 8)
+
+// Build the kernel GDT (replacing the MBR's, which sits in memory the kernel reuses),
+// reload all segment registers and point %gs at CPU 0's per-CPU data
+void gdt_init(void);
+
+// Set the base/limit of a CPU's per-CPU segment
+void gdt_set_percpu(uint32_t cpu, uint32_t base, uint32_t limit);
+
+// Point a CPU's TSS descriptor at 'tss' (104 bytes, see tss_t in cpu/percpu.h)
+void gdt_set_tss(uint32_t cpu, uint32_t tss);
+
+// Load the GDT on the calling CPU, select its per-CPU segment in %gs and
+// load its TSS (once per CPU: ltr marks the TSS busy)
+void gdt_load(uint32_t cpu);
+
+#endif // CPU_GDT_H
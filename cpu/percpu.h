@@ -0,0 +1,62 @@
+#ifndef CPU_PERCPU_H
+#define CPU_PERCPU_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SMP_MAX_CPUS        16
+
+// 32-bit task state segment. Only esp0/ss0 are used: the kernel stack the CPU
+// switches to when an interrupt or int 0x80 arrives from ring 3. Every field
+// is naturally aligned, so the 104-byte layout needs no packing.
+typedef struct {
+    uint32_t prev_tss;
+    uint32_t esp0, ss0;
+    uint32_t esp1, ss1;
+    uint32_t esp2, ss2;
+    uint32_t cr3, eip, eflags;
+    uint32_t eax, ecx, edx, ebx, esp, ebp, esi, edi;
+    uint32_t es, cs, ss, ds, fs, gs;
+    uint32_t ldt;
+    uint16_t trap;
+    uint16_t iomap_base;            // Past the limit: no I/O bitmap, ring 3 gets no ports
+} tss_t;
+
+struct thread;
+
+// Per-CPU data. Each CPU's %gs segment starts at its own cpu_t, so
+// this_cpu() is a single %gs-relative load and needs no locking.
+typedef struct cpu {
+    struct cpu* self;               // Must stay first: read through %gs:0
+    uint32_t id;                    // Logical CPU number, 0 = boot CPU
+    uint32_t apic_id;
+    volatile uint32_t online;
+    volatile uint32_t sleeping;     // Halted in the idle loop, needs a wakeup IPI
+    tss_t tss;                      // esp0 follows the running thread; SYSENTER_ESP points at it
+    struct thread* fpu_owner;       // Thread whose FPU/SSE state is in the registers (cpu/fpu.c)
+    uint32_t fpu_irq_flags;         // EFLAGS saved by kernel_fpu_begin()
+
+    // Statistics
+    uint32_t tasks_run;
+    uint32_t steals;
+    uint32_t wakeups;
+} cpu_t;
+
+extern cpu_t cpu_data[SMP_MAX_CPUS];
+
+// Fill in cpu_data[cpu], its GDT segment and its TSS (does not load them)
+void percpu_init(uint32_t cpu);
+
+static inline cpu_t* this_cpu(void) {
+    cpu_t* cpu;
+    asm volatile ("movl %%gs:0, %0" : "=r"(cpu));
+    return cpu;
+}
+
+static inline uint32_t smp_cpu_id(void) {
+    uint32_t id;
+    asm volatile ("movl %%gs:%c1, %0" : "=r"(id) : "i"(offsetof(cpu_t, id)));
+    return id;
+}
+
+#endif // CPU_PERCPU_H
@@ -0,0 +1,305 @@
+#include "smp.h"
+#include "gdt.h"
+#include "syscall.h"
+#include "fpu.h"
+#include "interrupt/apic.h"
+#include "interrupt/idt.h"
+#include "interrupt/irqflags.h"
+#include "acpi/acpi.h"
+#include "drivers/timer.h"
+#include "memory/paging.h"
+#include "memory/vmm.h"
+#include "task/workpool.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Application processor startup (Intel MP spec: INIT, then two STARTUP IPIs)
+// and the per-CPU idle loop the APs run afterwards.
+
+#define INIT_DELAY_US       10000
+#define SIPI_DELAY_US       200
+#define AP_TIMEOUT_US       100000
+#define IDLE_SPINS          2000        // Polls for work before halting
+
+// Layout of 'trampoline_params' in cpu/trampoline.asm
+typedef struct {
+    uint32_t cr3;
+    uint32_t cr4;
+    uint32_t esp;
+    uint32_t entry;
+} trampoline_params_t;
+
+extern uint8_t trampoline_start[];      // cpu/trampoline.asm
+extern uint8_t trampoline_end[];
+extern uint8_t trampoline_params[];
+extern void ipi_wakeup(void);           // interrupt_asm.s
+
+cpu_t cpu_data[SMP_MAX_CPUS];
+static volatile uint32_t cpu_count = 1;
+static volatile uint32_t ap_booting;    // Logical id handed to the AP being started
+
+void percpu_init(uint32_t cpu) {
+    cpu_data[cpu].self = &cpu_data[cpu];
+    cpu_data[cpu].id = cpu;
+    gdt_set_percpu(cpu, (uint32_t)&cpu_data[cpu], sizeof(cpu_t) - 1);
+
+    tss_t* tss = &cpu_data[cpu].tss;
+    tss->ss0 = GDT_KERNEL_DATA;
+    tss->iomap_base = sizeof(tss_t);
+    gdt_set_tss(cpu, (uint32_t)tss);
+}
+
+uint32_t smp_cpu_count(void) {
+    return cpu_count;
+}
+
+void smp_wake(uint32_t cpu) {
+    uint32_t flags = irq_save();
+    lapic_send_ipi(cpu_data[cpu].apic_id, LAPIC_ICR_FIXED | SMP_WAKE_VECTOR);
+    irq_restore(flags);
+}
+
+void smp_ipi_handler(void) {
+    this_cpu()->wakeups++;
+    lapic_write(LAPIC_EOI, 0);
+}
+
+static void delay_us(uint32_t us) {
+    uint64_t end = timer_now_ns() + (uint64_t)us * 1000;
+    while (timer_now_ns() < end) {
+        asm volatile ("pause");
+    }
+}
+
+// Run pool work; halt when there is none. The 'sleeping' flag is raised with
+// interrupts off and work is re-checked before sti;hlt, so a submitter either
+// sees the flag and sends an IPI or its work is seen here.
+static void ap_idle(void) {
+    cpu_t* cpu = this_cpu();
+    uint32_t spins = 0;
+    for (;;) {
+        if (workpool_run_one()) {
+            spins = 0;
+            continue;
+        }
+        if (++spins < IDLE_SPINS) {
+            asm volatile ("pause");
+            continue;
+        }
+
+        asm volatile ("cli");
+        cpu->sleeping = 1;
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (workpool_has_work()) {
+            asm volatile ("sti");
+        } else {
+            asm volatile ("sti; hlt");  // sti takes effect after hlt starts: no lost IPI
+        }
+        cpu->sleeping = 0;
+        spins = 0;
+    }
+}
+
+// C entry of an AP, called by the trampoline with paging on and its own stack
+static void ap_main(void) {
+    uint32_t id = ap_booting;
+    gdt_load(id);
+    syscall_init_ap(id);
+    fpu_init_ap();
+    idt_load_ap();
+    lapic_init_ap();
+
+    __atomic_store_n(&cpu_data[id].online, 1, __ATOMIC_RELEASE);
+    asm volatile ("sti");
+    ap_idle();
+}
+
+static int start_ap(uint32_t id, uint8_t apic_id) {
+    void* stack = vmm_alloc_stack(SMP_AP_STACK_SIZE);
+    if (stack == NULL) {
+        return 0;
+    }
+
+    uint32_t cr3, cr4;
+    asm volatile ("mov %%cr3, %0" : "=r"(cr3));
+    asm volatile ("mov %%cr4, %0" : "=r"(cr4));
+    volatile trampoline_params_t* params = (volatile trampoline_params_t*)
+        phys_to_virt(SMP_TRAMPOLINE_ADDR + (trampoline_params - trampoline_start));
+    params->cr3 = cr3;
+    params->cr4 = cr4;
+    params->esp = (uint32_t)stack + SMP_AP_STACK_SIZE;
+    params->entry = (uint32_t)ap_main;
+
+    percpu_init(id);
+    cpu_data[id].apic_id = apic_id;
+    cpu_data[id].online = 0;
+    ap_booting = id;
+
+    lapic_send_ipi(apic_id, LAPIC_ICR_INIT | LAPIC_ICR_ASSERT);
+    delay_us(INIT_DELAY_US);
+    for (int i = 0; i < 2; i++) {
+        lapic_send_ipi(apic_id, LAPIC_ICR_STARTUP | (SMP_TRAMPOLINE_ADDR >> 12));
+        delay_us(SIPI_DELAY_US);
+    }
+
+    uint64_t deadline = timer_now_ns() + (uint64_t)AP_TIMEOUT_US * 1000;
+    while (!__atomic_load_n(&cpu_data[id].online, __ATOMIC_ACQUIRE)) {
+        // Withdraw the entry point. If the AP had not taken it yet, it will
+        // halt in the trampoline, so its stack and slot can go to the next
+        // one. If it had, it is already running ap_main(): wait for it.
+        if (timer_now_ns() > deadline &&
+            __atomic_exchange_n(&params->entry, 0, __ATOMIC_SEQ_CST) != 0) {
+            vmm_free(stack);
+            return 0;
+        }
+        asm volatile ("pause");
+    }
+    return 1;
+}
+
+uint32_t smp_init(void) {
+    cpu_data[0].online = 1;
+    if (!lapic_present()) {
+        return cpu_count;
+    }
+    cpu_data[0].apic_id = lapic_id();
+
+    const acpi_madt_t* madt = acpi_get_madt();
+    if (madt == NULL || madt->cpu_count < 2) {
+        return cpu_count;
+    }
+
+    // Copy the real-mode entry below 1 MB. The AP turns paging on while
+    // running there, so the page is identity mapped until every AP is up.
+    uint8_t* dst = phys_to_virt(SMP_TRAMPOLINE_ADDR);
+    for (uint8_t* src = trampoline_start; src < trampoline_end; src++) {
+        *dst++ = *src;
+    }
+    if (!paging_identity_map(SMP_TRAMPOLINE_ADDR, trampoline_end - trampoline_start,
+                             PAGE_PRESENT | PAGE_WRITE)) {
+        return cpu_count;
+    }
+    idt_set_gate(SMP_WAKE_VECTOR, (uint32_t)ipi_wakeup, 0x08, 0x8E);
+
+    for (uint32_t i = 0; i < madt->cpu_count && cpu_count < SMP_MAX_CPUS; i++) {
+        if (madt->cpu_apic_id[i] == cpu_data[0].apic_id) {
+            continue;
+        }
+        if (start_ap(cpu_count, madt->cpu_apic_id[i])) {
+            cpu_count++;
+        }
+    }
+    paging_unmap(SMP_TRAMPOLINE_ADDR);
+    return cpu_count;
+}
+
+#ifdef SMP_BENCH
+#include "memory/pmm.h"
+#include "libc/include/string.h"
+#include "task/sched.h"
+
+extern void term_print(const char* str);    // from drivers/vga.c
+extern void term_print_dec(uint32_t num);
+
+#define BENCH_CHUNK_FRAMES  1024            // 4 MB, the largest buddy block
+#define BENCH_CHUNKS        8               // 32 MB total
+#define BENCH_BLOCK         (64 * 1024)     // Bytes per work item
+#define BENCH_ITEMS         (BENCH_CHUNKS * BENCH_CHUNK_FRAMES * PMM_FRAME_SIZE / BENCH_BLOCK)
+#define BENCH_PATTERN       0x5A
+
+static work_t bench_work[BENCH_ITEMS];
+static volatile uint32_t bench_sum;
+
+static inline uint32_t rdtsc_lo(void) {
+    uint32_t lo, hi;
+    asm volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return lo;
+}
+
+// Fill one block and fold it into the global checksum
+static void bench_block(void* arg) {
+    uint32_t* words = arg;
+    memset(words, BENCH_PATTERN, BENCH_BLOCK);
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < BENCH_BLOCK / 4; i++) {
+        sum += words[i];
+    }
+    __atomic_fetch_add(&bench_sum, sum, __ATOMIC_RELAXED);
+}
+
+static uint32_t bench_run(uint32_t* chunks, uint32_t nchunks, uint32_t cpus) {
+    work_group_t group = { 0 };
+    workpool_set_workers(cpus);
+    bench_sum = 0;
+
+    uint32_t start = rdtsc_lo();
+    uint32_t item = 0;
+    for (uint32_t c = 0; c < nchunks; c++) {
+        for (uint32_t off = 0; off < BENCH_CHUNK_FRAMES * PMM_FRAME_SIZE; off += BENCH_BLOCK) {
+            work_submit(&group, &bench_work[item++], bench_block, phys_to_virt(chunks[c] + off));
+        }
+    }
+    work_wait(&group);
+    return rdtsc_lo() - start;
+}
+
+static void bench_thread(void* arg) {
+    (void)arg;
+    uint32_t chunks[BENCH_CHUNKS];
+    uint32_t nchunks = 0;
+    while (nchunks < BENCH_CHUNKS && (chunks[nchunks] = pmm_alloc_frames(BENCH_CHUNK_FRAMES)) != 0) {
+        nchunks++;
+    }
+    if (nchunks == 0) {
+        term_print("smp: not enough memory for the benchmark\n");
+        return;
+    }
+
+    uint32_t words = nchunks * BENCH_CHUNK_FRAMES * (PMM_FRAME_SIZE / 4);
+    uint32_t expected = words * (BENCH_PATTERN * 0x01010101u);
+    bench_run(chunks, nchunks, 1);              // Warm up: first touch of the buffer
+    uint32_t base = bench_run(chunks, nchunks, 1);
+
+    // 1, 2, 4, ... CPUs, ending with all of them
+    for (uint32_t cpus = 1;; cpus *= 2) {
+        if (cpus > cpu_count) {
+            cpus = cpu_count;
+        }
+        uint32_t cycles = cpus == 1 ? base : bench_run(chunks, nchunks, cpus);
+        term_print("smp: ");
+        term_print_dec(cpus);
+        term_print(" CPUs ");
+        term_print_dec(nchunks * 4);
+        term_print(" MB in ");
+        term_print_dec(cycles / 1000);
+        term_print(" kcycles, speedup x");
+        term_print_dec(base / (cycles / 100));
+        term_print("/100");
+        term_print(bench_sum == expected ? ", checksum ok\n" : ", CHECKSUM MISMATCH\n");
+        if (cpus == cpu_count) {
+            break;
+        }
+    }
+
+    for (uint32_t cpu = 0; cpu < cpu_count; cpu++) {
+        term_print("smp: cpu ");
+        term_print_dec(cpu);
+        term_print(" items ");
+        term_print_dec(cpu_data[cpu].tasks_run);
+        term_print(" steals ");
+        term_print_dec(cpu_data[cpu].steals);
+        term_print(" wakeups ");
+        term_print_dec(cpu_data[cpu].wakeups);
+        term_print("\n");
+    }
+
+    workpool_set_workers(SMP_MAX_CPUS);
+    for (uint32_t c = 0; c < nchunks; c++) {
+        pmm_free_frames(chunks[c], BENCH_CHUNK_FRAMES);
+    }
+}
+
+void smp_bench_start(void) {
+    thread_create("smpbench", bench_thread, NULL, SCHED_PRIO_DEFAULT);
+}
+#endif
@@ -0,0 +1,30 @@
+#ifndef CPU_SMP_H
+#define CPU_SMP_H
+
+#include <stdint.h>
+#include "percpu.h"
+
+#define SMP_TRAMPOLINE_ADDR 0x70000     // Real-mode AP entry (page aligned, below 1 MB, reserved by pmm)
+#define SMP_AP_STACK_SIZE   8192
+#define SMP_WAKE_VECTOR     0xF0        // IPI that gets a halted AP out of its idle loop
+
+// Start every enabled CPU listed in the ACPI MADT with INIT-SIPI-SIPI.
+// Needs the local APIC, the timer and interrupts enabled. Returns the number of CPUs online.
+// APs never run threads: they sit in an idle loop running work from task/workpool.c.
+uint32_t smp_init(void);
+
+// Number of CPUs online (1 until smp_init() has run)
+uint32_t smp_cpu_count(void);
+
+// Send the wakeup IPI to a CPU halted in its idle loop
+void smp_wake(uint32_t cpu);
+
+// Wakeup IPI handler (called from interrupt_asm.s)
+void smp_ipi_handler(void);
+
+#ifdef SMP_BENCH
+// Parallel memset + checksum over a large buffer on 1..N CPUs (build with -DSMP_BENCH)
+void smp_bench_start(void);
+#endif
+
+#endif // CPU_SMP_H
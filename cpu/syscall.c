@@ -0,0 +1,197 @@
+#include "syscall.h"
+#include "gdt.h"
+#include "percpu.h"
+#include "interrupt/idt.h"
+#include "memory/paging.h"
+#include "task/sched.h"
+#include "libc/include/stdio.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// System call table and the SYSENTER setup. The entry stubs
+// (syscall_int80, syscall_sysenter) are in interrupt/interrupt_asm.s.
+
+#define IA32_SYSENTER_CS    0x174
+#define IA32_SYSENTER_ESP   0x175
+#define IA32_SYSENTER_EIP   0x176
+#define CPUID_EDX_SEP       (1u << 11)
+
+#define WRITE_CHUNK         128
+
+typedef int32_t (*syscall_fn_t)(uint32_t arg0, uint32_t arg1, uint32_t arg2);
+
+extern void syscall_int80(void);        // interrupt_asm.s
+extern void syscall_sysenter(void);
+extern int32_t user_enter(uint32_t eip, uint32_t esp, uint32_t* thread_esp0, uint32_t* tss_esp0);
+extern void user_return(uint32_t esp0, int32_t code) __attribute__((noreturn));
+
+static int has_sysenter;
+
+// Every page of [addr, addr + len) below the kernel and mapped for ring 3
+static int user_range_ok(uint32_t addr, uint32_t len) {
+    if (addr >= KERNEL_VIRT_BASE || len > KERNEL_VIRT_BASE - addr) {
+        return 0;
+    }
+    for (uint32_t page = addr & ~(PAGE_SIZE - 1); page < addr + len; page += PAGE_SIZE) {
+        if ((paging_get(page) & (PAGE_PRESENT | PAGE_USER)) != (PAGE_PRESENT | PAGE_USER)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int32_t sys_null(uint32_t arg0, uint32_t arg1, uint32_t arg2) {
+    (void)arg0;
+    (void)arg1;
+    (void)arg2;
+    return 0;
+}
+
+static int32_t sys_write(uint32_t buf, uint32_t len, uint32_t arg2) {
+    (void)arg2;
+    if (!user_range_ok(buf, len)) {
+        return SYSCALL_EFAULT;
+    }
+    // kprintf wants a string: copy out in chunks
+    char chunk[WRITE_CHUNK + 1];
+    const char* src = (const char*)buf;
+    for (uint32_t done = 0; done < len;) {
+        uint32_t n = len - done < WRITE_CHUNK ? len - done : WRITE_CHUNK;
+        for (uint32_t i = 0; i < n; i++) {
+            chunk[i] = src[done + i];
+        }
+        chunk[n] = '\0';
+        kprintf("%s", chunk);
+        done += n;
+    }
+    return (int32_t)len;
+}
+
+// Unwind to user_run() on the thread's kernel stack
+static int32_t sys_exit(uint32_t code, uint32_t arg1, uint32_t arg2) {
+    (void)arg1;
+    (void)arg2;
+    user_return(thread_current()->esp0, (int32_t)code);
+}
+
+static const syscall_fn_t syscall_table[SYS_COUNT] = {
+    [SYS_NULL] = sys_null,
+    [SYS_WRITE] = sys_write,
+    [SYS_EXIT] = sys_exit,
+};
+
+int32_t syscall_dispatch(uint32_t num, uint32_t arg0, uint32_t arg1, uint32_t arg2) {
+    if (num >= SYS_COUNT) {
+        return SYSCALL_ENOSYS;
+    }
+    return syscall_table[num](arg0, arg1, arg2);
+}
+
+static inline void wrmsr(uint32_t msr, uint32_t value) {
+    asm volatile ("wrmsr" :: "a"(value), "d"(0), "c"(msr));
+}
+
+// SYSENTER_ESP points at this CPU's tss.esp0, so the stub can load the
+// running thread's kernel stack with one 'mov esp, [esp]'
+static void sysenter_setup(uint32_t cpu) {
+    wrmsr(IA32_SYSENTER_CS, GDT_KERNEL_CODE);
+    wrmsr(IA32_SYSENTER_ESP, (uint32_t)&cpu_data[cpu].tss.esp0);
+    wrmsr(IA32_SYSENTER_EIP, (uint32_t)syscall_sysenter);
+}
+
+void syscall_init(void) {
+    // Interrupt gate with DPL 3 so ring 3 may use int 0x80
+    idt_set_gate(SYSCALL_VECTOR, (uint32_t)syscall_int80, GDT_KERNEL_CODE, 0xEE);
+
+    // The Pentium Pro reports SEP without supporting it (family 6, model < 3, stepping < 3)
+    uint32_t eax, ebx, ecx, edx;
+    asm volatile ("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(1));
+    uint32_t family = (eax >> 8) & 0xF, model = (eax >> 4) & 0xF, stepping = eax & 0xF;
+    has_sysenter = (edx & CPUID_EDX_SEP) && !(family == 6 && model < 3 && stepping < 3);
+    if (has_sysenter) {
+        sysenter_setup(0);
+    }
+}
+
+void syscall_init_ap(uint32_t cpu) {
+    if (has_sysenter) {
+        sysenter_setup(cpu);
+    }
+}
+
+int syscall_has_sysenter(void) {
+    return has_sysenter;
+}
+
+int32_t user_run(uint32_t eip, uint32_t esp) {
+    thread_t* t = thread_current();
+    int32_t code = user_enter(eip, esp, &t->esp0, &this_cpu()->tss.esp0);
+    t->esp0 = 0;
+    return code;
+}
+
+#ifdef SYSCALL_BENCH
+#include "memory/pmm.h"
+
+extern uint8_t user_bench_start[];      // cpu/user_bench.asm
+extern uint8_t user_bench_end[];
+
+// Must match USER_BENCH_CODE / USER_BENCH_DATA in cpu/user_bench.asm
+#define USER_BENCH_CODE     0x00400000
+#define USER_BENCH_DATA     0x00401000
+#define BENCH_ITERATIONS    10000
+#define BENCH_ROUNDS        5
+
+// Layout of the data page shared with cpu/user_bench.asm
+typedef struct {
+    uint32_t iterations;            // In: calls per round
+    uint32_t rounds;                // In
+    uint32_t use_sysenter;          // In
+    uint32_t int80_cycles;          // Out: fastest round, whole loop
+    uint32_t sysenter_cycles;
+    uint32_t t0;                    // Scratch
+    uint32_t rounds_left;
+} user_bench_data_t;
+
+static void bench_thread(void* arg) {
+    (void)arg;
+    uint32_t code_frame = pmm_alloc_frame();
+    uint32_t data_frame = pmm_alloc_frame();
+    if (code_frame == 0 || data_frame == 0 ||
+        !paging_map(USER_BENCH_CODE, code_frame, PAGE_USER) ||
+        !paging_map(USER_BENCH_DATA, data_frame, PAGE_USER | PAGE_WRITE)) {
+        kprintf("syscall: no memory for the benchmark\n");
+        return;
+    }
+    uint8_t* code = phys_to_virt(code_frame);
+    for (uint8_t* src = user_bench_start; src < user_bench_end; src++) {
+        *code++ = *src;
+    }
+    volatile user_bench_data_t* data = phys_to_virt(data_frame);
+    data->iterations = BENCH_ITERATIONS;
+    data->rounds = BENCH_ROUNDS;
+    data->use_sysenter = has_sysenter;
+    data->int80_cycles = data->sysenter_cycles = ~0u;
+
+    // The stack grows down from the end of the data page
+    user_run(USER_BENCH_CODE, USER_BENCH_DATA + PAGE_SIZE);
+
+    kprintf("syscall: null round trip from ring 3, best of %u x %u calls\n",
+            BENCH_ROUNDS, BENCH_ITERATIONS);
+    kprintf("syscall: int 0x80 %u cycles\n", data->int80_cycles / BENCH_ITERATIONS);
+    if (has_sysenter) {
+        kprintf("syscall: sysenter %u cycles\n", data->sysenter_cycles / BENCH_ITERATIONS);
+    } else {
+        kprintf("syscall: sysenter not supported\n");
+    }
+
+    paging_unmap(USER_BENCH_CODE);
+    paging_unmap(USER_BENCH_DATA);
+    pmm_free_frame(code_frame);
+    pmm_free_frame(data_frame);
+}
+
+void syscall_bench_start(void) {
+    thread_create("syscallbench", bench_thread, NULL, SCHED_PRIO_DEFAULT);
+}
+#endif
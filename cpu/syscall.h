@@ -0,0 +1,49 @@
+#ifndef CPU_SYSCALL_H
+#define CPU_SYSCALL_H
+
+#include <stdint.h>
+
+// System calls from ring 3. Two entry paths share one dispatch table:
+//
+//   int 0x80   eax = number, arguments in ebx, esi, edi; result in eax.
+//              Every other register is preserved.
+//   sysenter   Same, plus ecx = user esp and edx = return address for
+//              sysexit. ecx, edx and the arithmetic flags are clobbered.
+//
+// Arguments skip ecx/edx so both paths can pass them in the same registers.
+#define SYSCALL_VECTOR      0x80
+
+#define SYS_NULL            0       // Does nothing; for measuring the entry/exit cost
+#define SYS_WRITE           1       // (const char* buf, uint32_t len): print to the console
+#define SYS_EXIT            2       // (int32_t code): leave ring 3, user_run() returns 'code'
+#define SYS_COUNT           3
+
+#define SYSCALL_ENOSYS      (-1)    // Unknown system call number
+#define SYSCALL_EFAULT      (-2)    // Buffer not mapped for ring 3
+
+// Install the int 0x80 gate (DPL 3) and, when the CPU has SEP, this CPU's
+// SYSENTER MSRs. Needs gdt_init() and idt_install().
+void syscall_init(void);
+
+// SYSENTER MSRs of an application processor (called from ap_main)
+void syscall_init_ap(uint32_t cpu);
+
+// Whether the sysenter path is available
+int syscall_has_sysenter(void);
+
+// C side of both entry stubs in interrupt_asm.s
+int32_t syscall_dispatch(uint32_t num, uint32_t arg0, uint32_t arg1, uint32_t arg2);
+
+// Run the calling kernel thread in ring 3 at 'eip' with stack 'esp' (both in
+// pages mapped with PAGE_USER) until it makes SYS_EXIT, and return its exit
+// code. Traps from ring 3 use the kernel stack right below this call's frame.
+// Call with interrupts enabled; they stay enabled in user mode.
+int32_t user_run(uint32_t eip, uint32_t esp);
+
+#ifdef SYSCALL_BENCH
+// Round-trip cycles of a null system call through int 0x80 and sysenter,
+// measured from ring 3 (build with -DSYSCALL_BENCH)
+void syscall_bench_start(void);
+#endif
+
+#endif // CPU_SYSCALL_H
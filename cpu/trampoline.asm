@@ -0,0 +1,83 @@
+; cpu/trampoline.asm
+; Real-mode entry for application processors (NASM syntax).
+; smp_init() copies trampoline_start..trampoline_end to TRAMPOLINE_ADDR and
+; sends a STARTUP IPI with vector TRAMPOLINE_ADDR >> 12. The AP switches to
+; protected mode with a temporary flat GDT, turns on paging with the boot
+; CPU's page directory (smp_init() identity maps this page while the APs
+; start) and calls the C entry point on its own stack.
+;
+; The AP first takes the entry point out of the parameters with xchg. The
+; boot CPU withdraws it the same way when it gives up on an AP, so a late AP
+; finds 0 and halts here, before it touches the stack or the page tables
+; the boot CPU is about to free or hand to the next AP.
+
+TRAMPOLINE_ADDR equ 0x70000     ; Must match SMP_TRAMPOLINE_ADDR in cpu/smp.h
+
+%define TRAMP(label) (TRAMPOLINE_ADDR + (label) - trampoline_start)
+
+global trampoline_start
+global trampoline_end
+global trampoline_params
+
+section .text
+[bits 16]
+trampoline_start:
+    cli
+    cld
+    mov ax, cs                  ; cs = TRAMPOLINE_ADDR >> 4
+    mov ds, ax
+    xor ebx, ebx
+    xchg ebx, [trampoline_params - trampoline_start + 12]
+    test ebx, ebx
+    jz .cancelled               ; Timed out: the boot CPU has moved on
+    lgdt [tramp_gdt_ptr - trampoline_start]
+
+    mov eax, cr0
+    or eax, 1                   ; PE
+    mov cr0, eax
+    jmp dword 0x08:TRAMP(tramp_pm)
+.cancelled:
+    hlt
+    jmp .cancelled
+
+[bits 32]
+tramp_pm:
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    mov ss, ax
+
+    ; Same address space as the boot CPU
+    mov eax, [TRAMP(trampoline_params) + 4]
+    mov cr4, eax
+    mov eax, [TRAMP(trampoline_params) + 0]
+    mov cr3, eax
+    mov eax, cr0
+    or eax, 0x80000000          ; PG
+    mov cr0, eax
+
+    mov esp, [TRAMP(trampoline_params) + 8]
+    call ebx                    ; ap_main(), never returns
+.hang:
+    hlt
+    jmp .hang
+
+align 8
+tramp_gdt:
+    dq 0x0000000000000000       ; Null descriptor
+    dq 0x00CF9A000000FFFF       ; Flat code
+    dq 0x00CF92000000FFFF       ; Flat data
+tramp_gdt_ptr:
+    dw tramp_gdt_ptr - tramp_gdt - 1
+    dd TRAMP(tramp_gdt)
+
+; Filled in by smp_init() for each AP (see trampoline_params_t in cpu/smp.c)
+align 4
+trampoline_params:
+    dd 0                        ; cr3
+    dd 0                        ; cr4
+    dd 0                        ; esp
+    dd 0                        ; entry, taken (zeroed) by the AP that claims it
+trampoline_end:
@@ -0,0 +1,76 @@
+; cpu/user_bench.asm
+; Ring 3 side of the SYSCALL_BENCH null system call benchmark (NASM syntax).
+; bench_thread() in cpu/syscall.c copies user_bench_start..user_bench_end to
+; USER_BENCH_CODE, fills in the data page at USER_BENCH_DATA and runs it with
+; user_run(). Each round times 'iterations' null calls through int 0x80 and
+; then through sysenter; the fastest round of each is kept.
+
+USER_BENCH_CODE equ 0x00400000  ; Must match cpu/syscall.c
+USER_BENCH_DATA equ 0x00401000
+
+SYS_NULL        equ 0           ; cpu/syscall.h
+SYS_EXIT        equ 2
+
+; user_bench_data_t in cpu/syscall.c
+%define ITERATIONS      (USER_BENCH_DATA + 0)
+%define ROUNDS          (USER_BENCH_DATA + 4)
+%define USE_SYSENTER    (USER_BENCH_DATA + 8)
+%define INT80_CYCLES    (USER_BENCH_DATA + 12)
+%define SYSENTER_CYCLES (USER_BENCH_DATA + 16)
+%define T0              (USER_BENCH_DATA + 20)
+%define ROUNDS_LEFT     (USER_BENCH_DATA + 24)
+
+%define UADDR(label) (USER_BENCH_CODE + (label) - user_bench_start)
+
+global user_bench_start
+global user_bench_end
+
+section .text
+[bits 32]
+user_bench_start:
+    mov eax, [ROUNDS]
+    mov [ROUNDS_LEFT], eax
+
+.round:
+    rdtsc
+    mov [T0], eax
+    mov ebp, [ITERATIONS]
+.int80_loop:
+    mov eax, SYS_NULL
+    int 0x80
+    dec ebp
+    jnz .int80_loop
+    rdtsc
+    sub eax, [T0]
+    cmp eax, [INT80_CYCLES]
+    jae .sysenter
+    mov [INT80_CYCLES], eax
+
+.sysenter:
+    cmp dword [USE_SYSENTER], 0
+    je .next
+    rdtsc
+    mov [T0], eax
+    mov ebp, [ITERATIONS]
+.sysenter_loop:
+    mov eax, SYS_NULL
+    mov ecx, esp                ; sysexit restores esp from ecx
+    mov edx, UADDR(.sysenter_ret) ; ... and eip from edx
+    sysenter
+.sysenter_ret:
+    dec ebp
+    jnz .sysenter_loop
+    rdtsc
+    sub eax, [T0]
+    cmp eax, [SYSENTER_CYCLES]
+    jae .next
+    mov [SYSENTER_CYCLES], eax
+
+.next:
+    dec dword [ROUNDS_LEFT]
+    jnz .round
+
+    mov eax, SYS_EXIT
+    xor ebx, ebx
+    int 0x80                    ; Does not return
+user_bench_end:
@@ -0,0 +1,944 @@
+#include "ata.h"
+#include "pci.h"
+#include "timer.h"
+#include "interrupt/io.h"
+#include "interrupt/irq.h"
+#include "interrupt/irqflags.h"
+#include "interrupt/softirq.h"
+#include "block/blkdev.h"
+#include "memory/kmalloc.h"
+#include "memory/paging.h"
+#include "memory/pmm.h"
+#include "task/ktimer.h"
+#include "task/sched.h"
+#include "libc/include/stdio.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Primary channel in compatibility mode
+#define ATA_IO_BASE         0x1F0
+#define ATA_CTL_BASE        0x3F6
+#define ATA_IRQ             14
+
+#define ATA_REG_DATA        (ATA_IO_BASE + 0)
+#define ATA_REG_ERROR       (ATA_IO_BASE + 1)
+#define ATA_REG_COUNT       (ATA_IO_BASE + 2)
+#define ATA_REG_LBA0        (ATA_IO_BASE + 3)
+#define ATA_REG_LBA1        (ATA_IO_BASE + 4)
+#define ATA_REG_LBA2        (ATA_IO_BASE + 5)
+#define ATA_REG_DEVICE      (ATA_IO_BASE + 6)
+#define ATA_REG_STATUS      (ATA_IO_BASE + 7)   // Reading it acknowledges the interrupt
+#define ATA_REG_COMMAND     (ATA_IO_BASE + 7)
+#define ATA_REG_ALTSTATUS   ATA_CTL_BASE        // Status without the acknowledge
+#define ATA_REG_CONTROL     ATA_CTL_BASE
+
+#define ATA_SR_BSY          0x80
+#define ATA_SR_DRDY         0x40
+#define ATA_SR_DF           0x20
+#define ATA_SR_DRQ          0x08
+#define ATA_SR_ERR          0x01
+
+#define ATA_CTL_NIEN        0x02                // Interrupts off
+#define ATA_CTL_SRST        0x04                // Software reset of both drives
+
+#define ATA_DEV_BASE        0xA0                // Obsolete bits 7 and 5 set
+#define ATA_DEV_LBA         0x40
+
+#define ATA_CMD_READ_SECTORS        0x20
+#define ATA_CMD_READ_SECTORS_EXT    0x24
+#define ATA_CMD_WRITE_SECTORS       0x30
+#define ATA_CMD_WRITE_SECTORS_EXT   0x34
+#define ATA_CMD_READ_MULTIPLE       0xC4
+#define ATA_CMD_READ_MULTIPLE_EXT   0x29
+#define ATA_CMD_WRITE_MULTIPLE      0xC5
+#define ATA_CMD_WRITE_MULTIPLE_EXT  0x39
+#define ATA_CMD_READ_DMA            0xC8
+#define ATA_CMD_READ_DMA_EXT        0x25
+#define ATA_CMD_WRITE_DMA           0xCA
+#define ATA_CMD_WRITE_DMA_EXT       0x35
+#define ATA_CMD_SET_MULTIPLE        0xC6
+#define ATA_CMD_IDENTIFY            0xEC
+
+// IDENTIFY DEVICE words
+#define ID_MODEL            27                  // 20 words, bytes swapped
+#define ID_MULTIPLE_MAX     47                  // Low byte: most sectors per READ MULTIPLE block
+#define ID_CAPABILITIES     49
+#define ID_LBA28_SECTORS    60                  // 2 words
+#define ID_COMMAND_SETS     83
+#define ID_LBA48_SECTORS    100                 // 4 words
+#define ID_CAP_DMA          (1u << 8)
+#define ID_CMD_LBA48        (1u << 10)
+
+#define LBA28_LIMIT         0x10000000
+
+// Bus-master IDE registers, primary channel (offsets from BAR4)
+#define BM_COMMAND          0
+#define BM_STATUS           2
+#define BM_PRDT             4
+#define BM_CMD_START        0x01
+#define BM_CMD_READ         0x08                // Device to memory
+#define BM_ST_ERROR         0x02                // Write 1 to clear
+#define BM_ST_IRQ           0x04                // Write 1 to clear
+#define BM_ST_DRV_DMA       0x60                // Drive 0/1 DMA capable (set by software)
+#define IDE_PROGIF_BUS_MASTER 0x80
+
+// Physical region descriptor: one piece of the transfer, not crossing a 64 KB boundary
+typedef struct {
+    uint32_t addr;
+    uint16_t bytes;                             // 0 means 64 KB
+    uint16_t flags;
+} prd_t;
+
+#define PRD_EOT             0x8000              // Last entry
+#define PRD_MAX_ENTRIES     (PAGE_SIZE / sizeof(prd_t))
+
+#define POLL_LIMIT          1000000             // Status reads before a polled wait gives up
+
+// Work for the bottom half
+#define EV_IRQ              0x1
+#define EV_TIMEOUT          0x2
+
+static ata_drive_info_t drives[ATA_DRIVES];
+static uint32_t multiple_max[ATA_DRIVES];       // From IDENTIFY, to redo SET MULTIPLE after a reset
+static uint16_t bm_base;                        // 0: no bus-master engine
+static prd_t* prdt;                             // One frame, in the direct map
+static uint32_t prdt_phys;
+static int use_dma;
+
+// Channel state; 'queue', 'active' and the head position change with interrupts disabled.
+// Only one command runs at a time, and only the bottom half finishes it.
+static ata_request_t* queue;                    // Groups waiting, sorted by (drive, LBA)
+static ata_request_t* active;                   // Group whose command is running
+static int active_dma;
+static uint32_t head_drive, head_lba;           // Where the last command ended
+static uint32_t selected = ATA_DRIVES;          // Drive in the device register (none yet)
+
+// PIO progress of the active command
+static ata_request_t* pio_req;                  // Request the next sector belongs to
+static uint32_t pio_offset;                     // Byte offset into pio_req->buf
+static uint32_t pio_left;                       // Sectors still to transfer
+
+static volatile uint32_t events;
+static volatile uint8_t irq_status;             // Drive status read by the top half
+static volatile uint8_t irq_bm_status;
+static tasklet_t ata_tasklet;
+static ktimer_t watchdog;
+static ata_stats_t stats;
+
+// Block device side: each request is wrapped with the block layer's completion
+typedef struct {
+    ata_request_t req;                          // First: the completion gets a pointer to it
+    blk_done_fn_t done;
+    void* arg;
+} ata_blk_request_t;
+
+static block_device_t blkdevs[ATA_DRIVES];
+static kmem_cache_t* blk_request_cache;
+
+// 400 ns after selecting a drive: four alternate status reads
+static void ata_delay(void) {
+    for (int i = 0; i < 4; i++) {
+        inb(ATA_REG_ALTSTATUS);
+    }
+}
+
+// Busy-wait until BSY clears. Returns the status, 0xFF if it never does
+// (also what a floating bus without drives reads as).
+static uint8_t wait_not_busy(void) {
+    for (uint32_t i = 0; i < POLL_LIMIT; i++) {
+        uint8_t status = inb(ATA_REG_ALTSTATUS);
+        if (!(status & ATA_SR_BSY)) {
+            return status;
+        }
+    }
+    return 0xFF;
+}
+
+// Busy-wait for DRQ or an error, for the data phase of a polled command
+static uint8_t wait_drq(void) {
+    for (uint32_t i = 0; i < POLL_LIMIT; i++) {
+        uint8_t status = inb(ATA_REG_ALTSTATUS);
+        if (!(status & ATA_SR_BSY) && (status & (ATA_SR_DRQ | ATA_SR_ERR | ATA_SR_DF))) {
+            return status;
+        }
+    }
+    return 0xFF;
+}
+
+static void select_drive(uint32_t drive, uint8_t bits) {
+    outb(ATA_REG_DEVICE, ATA_DEV_BASE | (drive << 4) | bits);
+    if (drive != selected) {
+        ata_delay();
+        selected = drive;
+    }
+}
+
+// Polled commands run with the drive's interrupt off (ata_init(), channel reset)
+static void setup_multiple(uint32_t drive, uint32_t max) {
+    drives[drive].multiple = 1;
+    if (max <= 1) {
+        return;
+    }
+    select_drive(drive, 0);
+    outb(ATA_REG_COUNT, (uint8_t)max);
+    outb(ATA_REG_COMMAND, ATA_CMD_SET_MULTIPLE);
+    uint8_t status = wait_not_busy();
+    if (!(status & (ATA_SR_ERR | ATA_SR_DF))) {
+        drives[drive].multiple = max;
+    }
+}
+
+static void identify(uint32_t drive) {
+    ata_drive_info_t* info = &drives[drive];
+    uint16_t id[256];
+
+    select_drive(drive, 0);
+    outb(ATA_REG_COUNT, 0);
+    outb(ATA_REG_LBA0, 0);
+    outb(ATA_REG_LBA1, 0);
+    outb(ATA_REG_LBA2, 0);
+    outb(ATA_REG_COMMAND, ATA_CMD_IDENTIFY);
+    uint8_t status = inb(ATA_REG_ALTSTATUS);
+    if (status == 0 || status == 0xFF) {
+        return;     // No drive
+    }
+    if (wait_not_busy() == 0xFF) {
+        return;
+    }
+    if (inb(ATA_REG_LBA1) != 0 || inb(ATA_REG_LBA2) != 0) {
+        return;     // ATAPI (or SATA) signature: not an ATA disk
+    }
+    status = wait_drq();
+    if (status == 0xFF || (status & (ATA_SR_ERR | ATA_SR_DF))) {
+        return;
+    }
+    insw(ATA_REG_DATA, id, 256);
+
+    info->lba48 = (id[ID_COMMAND_SETS] & ID_CMD_LBA48) != 0;
+    if (info->lba48) {
+        info->sectors = id[ID_LBA48_SECTORS] | ((uint32_t)id[ID_LBA48_SECTORS + 1] << 16);
+        if (id[ID_LBA48_SECTORS + 2] != 0 || id[ID_LBA48_SECTORS + 3] != 0) {
+            info->sectors = 0xFFFFFFFF;     // Beyond 2 TB: only the first 2^32 - 1 sectors
+        }
+    } else {
+        info->sectors = id[ID_LBA28_SECTORS] | ((uint32_t)id[ID_LBA28_SECTORS + 1] << 16);
+    }
+    if (info->sectors == 0) {
+        return;     // CHS-only drive
+    }
+    info->dma = (id[ID_CAPABILITIES] & ID_CAP_DMA) != 0;
+
+    // Model string: two characters per word, high byte first, space padded
+    int len = 0;
+    for (int i = 0; i < 20; i++) {
+        info->model[len++] = (char)(id[ID_MODEL + i] >> 8);
+        info->model[len++] = (char)(id[ID_MODEL + i] & 0xFF);
+    }
+    while (len > 0 && info->model[len - 1] == ' ') {
+        len--;
+    }
+    info->model[len] = '\0';
+
+    info->present = 1;
+    multiple_max[drive] = id[ID_MULTIPLE_MAX] & 0xFF;
+    setup_multiple(drive, multiple_max[drive]);
+}
+
+// Software reset of the channel after a timeout; the drives forget their
+// multiple-sector setting
+static void reset_channel(void) {
+    if (bm_base != 0) {
+        outb(bm_base + BM_COMMAND, 0);
+    }
+    outb(ATA_REG_CONTROL, ATA_CTL_SRST | ATA_CTL_NIEN);
+    for (int i = 0; i < 4; i++) {
+        ata_delay();                            // Reset pulse: at least 5 us
+    }
+    outb(ATA_REG_CONTROL, ATA_CTL_NIEN);
+    wait_not_busy();
+    selected = ATA_DRIVES;
+    for (uint32_t drive = 0; drive < ATA_DRIVES; drive++) {
+        if (drives[drive].present) {
+            setup_multiple(drive, multiple_max[drive]);
+        }
+    }
+    outb(ATA_REG_CONTROL, 0);
+}
+
+// Physical address of a buffer byte, 0 if its page is not mapped (e.g. a
+// demand-zero page nothing has touched yet)
+static uint32_t buf_phys(uint32_t virt) {
+    if (virt >= KERNEL_VIRT_BASE && virt - KERNEL_VIRT_BASE < paging_direct_map_end()) {
+        return virt_to_phys((const void*)virt);
+    }
+    uint32_t pte = paging_get(virt & ~(PAGE_SIZE - 1));
+    if (!(pte & PAGE_PRESENT)) {
+        return 0;
+    }
+    return (pte & ~(PAGE_SIZE - 1)) | (virt & (PAGE_SIZE - 1));
+}
+
+// Describe every buffer of the group in the PRD table, one page at a time,
+// joining physically contiguous pages within a 64 KB window. Returns 0 if a
+// buffer cannot be used for DMA.
+static int build_prdt(ata_request_t* group) {
+    uint32_t n = 0;
+    for (ata_request_t* req = group; req != NULL; req = req->chain) {
+        uint32_t virt = (uint32_t)req->buf;
+        uint32_t left = req->count * ATA_SECTOR_SIZE;
+        if (virt & 1) {
+            return 0;   // The engine moves 16-bit words
+        }
+        while (left > 0) {
+            uint32_t chunk = PAGE_SIZE - (virt & (PAGE_SIZE - 1));
+            if (chunk > left) {
+                chunk = left;
+            }
+            uint32_t phys = buf_phys(virt);
+            if (phys == 0) {
+                return 0;
+            }
+            prd_t* last = n > 0 ? &prdt[n - 1] : NULL;
+            uint32_t last_bytes = last != NULL ? (last->bytes != 0 ? last->bytes : 0x10000) : 0;
+            if (last != NULL && last->addr + last_bytes == phys &&
+                ((phys + chunk - 1) >> 16) == (last->addr >> 16)) {
+                last->bytes = (uint16_t)(last_bytes + chunk);   // 64 KB wraps to 0
+            } else {
+                // A page never crosses a 64 KB boundary
+                if (n == PRD_MAX_ENTRIES) {
+                    return 0;
+                }
+                prdt[n].addr = phys;
+                prdt[n].bytes = (uint16_t)chunk;
+                prdt[n].flags = 0;
+                n++;
+            }
+            virt += chunk;
+            left -= chunk;
+        }
+    }
+    prdt[n - 1].flags = PRD_EOT;
+    return 1;
+}
+
+// Move the next block of the active PIO command (multiple sectors, one interrupt)
+static void pio_block(void) {
+    uint32_t n = drives[active->drive].multiple;
+    if (n > pio_left) {
+        n = pio_left;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        uint8_t* p = (uint8_t*)pio_req->buf + pio_offset;
+        if (active->write) {
+            outsw(ATA_REG_DATA, p, ATA_SECTOR_SIZE / 2);
+        } else {
+            insw(ATA_REG_DATA, p, ATA_SECTOR_SIZE / 2);
+        }
+        // Sectors never straddle requests: each buffer holds whole sectors
+        pio_offset += ATA_SECTOR_SIZE;
+        if (pio_offset == pio_req->count * ATA_SECTOR_SIZE) {
+            pio_req = pio_req->chain;
+            pio_offset = 0;
+        }
+    }
+    pio_left -= n;
+}
+
+static uint8_t command_for(const ata_request_t* group, int dma, int ext) {
+    if (dma) {
+        if (group->write) {
+            return ext ? ATA_CMD_WRITE_DMA_EXT : ATA_CMD_WRITE_DMA;
+        }
+        return ext ? ATA_CMD_READ_DMA_EXT : ATA_CMD_READ_DMA;
+    }
+    if (drives[group->drive].multiple > 1) {
+        if (group->write) {
+            return ext ? ATA_CMD_WRITE_MULTIPLE_EXT : ATA_CMD_WRITE_MULTIPLE;
+        }
+        return ext ? ATA_CMD_READ_MULTIPLE_EXT : ATA_CMD_READ_MULTIPLE;
+    }
+    if (group->write) {
+        return ext ? ATA_CMD_WRITE_SECTORS_EXT : ATA_CMD_WRITE_SECTORS;
+    }
+    return ext ? ATA_CMD_READ_SECTORS_EXT : ATA_CMD_READ_SECTORS;
+}
+
+// Start the command for 'group'. Interrupts disabled, channel idle.
+static void issue(ata_request_t* group) {
+    uint32_t drive = group->drive;
+    uint32_t lba = group->lba;
+    uint32_t count = group->span;
+    int ext = lba + count > LBA28_LIMIT;        // ata_submit() only lets that through on LBA48 drives
+    int dma = use_dma && drives[drive].dma;
+    if (dma && !build_prdt(group)) {
+        dma = 0;
+        stats.pio_fallbacks++;
+    }
+    active = group;
+    active_dma = dma;
+    events = 0;
+
+    if (dma) {
+        outb(bm_base + BM_COMMAND, 0);
+        outl(bm_base + BM_PRDT, prdt_phys);
+        outb(bm_base + BM_STATUS, (inb(bm_base + BM_STATUS) & BM_ST_DRV_DMA) | BM_ST_ERROR | BM_ST_IRQ);
+        outb(bm_base + BM_COMMAND, group->write ? 0 : BM_CMD_READ);
+    }
+
+    if (ext) {
+        select_drive(drive, ATA_DEV_LBA);
+        // High bytes first, then the low ones (count 256 is 0x0100)
+        outb(ATA_REG_COUNT, (uint8_t)(count >> 8));
+        outb(ATA_REG_LBA0, (uint8_t)(lba >> 24));
+        outb(ATA_REG_LBA1, 0);
+        outb(ATA_REG_LBA2, 0);
+    } else {
+        select_drive(drive, ATA_DEV_LBA | ((lba >> 24) & 0x0F));
+    }
+    outb(ATA_REG_COUNT, (uint8_t)count);        // 256 is 0 in LBA28
+    outb(ATA_REG_LBA0, (uint8_t)lba);
+    outb(ATA_REG_LBA1, (uint8_t)(lba >> 8));
+    outb(ATA_REG_LBA2, (uint8_t)(lba >> 16));
+
+    add_timer(&watchdog, timer_now_ns() + ATA_TIMEOUT_NS);
+    outb(ATA_REG_COMMAND, command_for(group, dma, ext));
+    stats.commands++;
+    stats.sectors += count;
+
+    if (dma) {
+        stats.dma_commands++;
+        outb(bm_base + BM_COMMAND, inb(bm_base + BM_COMMAND) | BM_CMD_START);
+        return;
+    }
+    pio_req = group;
+    pio_offset = 0;
+    pio_left = count;
+    if (group->write) {
+        // The first block goes out without an interrupt; an error raises one
+        uint8_t status = wait_drq();
+        if (status != 0xFF && (status & ATA_SR_DRQ) && !(status & (ATA_SR_ERR | ATA_SR_DF))) {
+            pio_block();
+        }
+    }
+}
+
+// (drive_a, lba_a) sorts before (drive_b, lba_b)
+static int before(uint32_t drive_a, uint32_t lba_a, uint32_t drive_b, uint32_t lba_b) {
+    return drive_a < drive_b || (drive_a == drive_b && lba_a < lba_b);
+}
+
+// Group 'b' starts where group 'a' ends and both fit in one command
+static int can_merge(const ata_request_t* a, const ata_request_t* b) {
+    return a->drive == b->drive && a->write == b->write &&
+           a->lba + a->span == b->lba && a->span + b->span <= ATA_MAX_SECTORS;
+}
+
+// Put group 'b' behind group 'a'
+static void chain_append(ata_request_t* a, ata_request_t* b) {
+    ata_request_t* tail = a;
+    while (tail->chain != NULL) {
+        tail = tail->chain;
+    }
+    tail->chain = b;
+    a->span += b->span;
+}
+
+// Insert in (drive, LBA) order, merging with the neighbours when contiguous.
+// Requests for the same sector stay in submission order; overlapping ones
+// that are in flight together may complete in either order.
+static void queue_insert(ata_request_t* req) {
+    ata_request_t* prev = NULL;
+    ata_request_t* next = queue;
+    while (next != NULL && !before(req->drive, req->lba, next->drive, next->lba)) {
+        prev = next;
+        next = next->next;
+    }
+
+    if (prev != NULL && can_merge(prev, req)) {
+        chain_append(prev, req);
+        stats.merges++;
+        // It may have closed the gap to the next group
+        if (next != NULL && can_merge(prev, next)) {
+            prev->next = next->next;
+            chain_append(prev, next);
+            stats.merges++;
+        }
+        return;
+    }
+    if (next != NULL && can_merge(req, next)) {
+        req->next = next->next;
+        chain_append(req, next);
+        stats.merges++;
+    } else {
+        req->next = next;
+    }
+    if (prev != NULL) {
+        prev->next = req;
+    } else {
+        queue = req;
+    }
+}
+
+// C-LOOK: the first group at or after the head, or back to the lowest one.
+// Interrupts disabled.
+static void start_next(void) {
+    if (active != NULL || queue == NULL) {
+        return;
+    }
+    ata_request_t* prev = NULL;
+    ata_request_t* group = queue;
+    while (group != NULL && before(group->drive, group->lba, head_drive, head_lba)) {
+        prev = group;
+        group = group->next;
+    }
+    if (group == NULL) {
+        prev = NULL;
+        group = queue;
+    }
+    if (prev != NULL) {
+        prev->next = group->next;
+    } else {
+        queue = group->next;
+    }
+    group->next = NULL;
+    issue(group);
+}
+
+// Finish the active command, start the next one, then complete every request of the group
+static void complete(int result) {
+    uint32_t flags = irq_save();
+    ata_request_t* group = active;
+    del_timer(&watchdog);
+    events &= ~EV_TIMEOUT;                      // A watchdog that fired meanwhile was for this command
+    active = NULL;
+    head_drive = group->drive;
+    head_lba = group->lba + group->span;
+    if (result == ATA_EIO) {
+        stats.errors++;
+    }
+    start_next();
+    irq_restore(flags);
+
+    while (group != NULL) {
+        // The submitter may reuse the request once its status is set, so
+        // that is the last store; with a callback, the callback makes it
+        ata_request_t* next = group->chain;
+        if (group->done != NULL) {
+            group->done(group, result);
+        } else {
+            group->status = result;
+        }
+        group = next;
+    }
+}
+
+// Bottom half: PIO data transfer, completion, watchdog recovery
+static void ata_bh(void* arg) {
+    (void)arg;
+    uint32_t flags = irq_save();
+    uint32_t ev = events;
+    uint8_t status = irq_status;
+    uint8_t bm_status = irq_bm_status;
+    events = 0;
+    irq_restore(flags);
+    if (active == NULL) {
+        return;
+    }
+
+    int result = ATA_PENDING;
+    if (ev & EV_IRQ) {
+        if (status & (ATA_SR_ERR | ATA_SR_DF)) {
+            result = ATA_EIO;
+        } else if (active_dma) {
+            result = (bm_status & BM_ST_ERROR) ? ATA_EIO : ATA_OK;
+        } else if (active->write && pio_left == 0) {
+            result = ATA_OK;                    // Interrupt after the last block
+        } else if (status & ATA_SR_DRQ) {
+            pio_block();                        // Reads: one interrupt before every block
+            if (!active->write && pio_left == 0) {
+                result = ATA_OK;
+            }
+        } else {
+            result = ATA_EIO;
+        }
+    } else if (ev & EV_TIMEOUT) {
+        stats.timeouts++;
+        reset_channel();
+        result = ATA_ETIMEDOUT;
+    }
+    if (result != ATA_PENDING) {
+        complete(result);
+    }
+}
+
+// IRQ 14: stop the DMA engine, acknowledge the drive, leave the rest to the tasklet
+static void ata_irq(registers_t* regs) {
+    (void)regs;
+    uint8_t bm_status = 0;
+    if (bm_base != 0) {
+        bm_status = inb(bm_base + BM_STATUS);
+        if (active_dma) {
+            outb(bm_base + BM_COMMAND, 0);
+        }
+    }
+    uint8_t status = inb(ATA_REG_STATUS);
+    if (bm_base != 0) {
+        outb(bm_base + BM_STATUS, (bm_status & BM_ST_DRV_DMA) | BM_ST_ERROR | BM_ST_IRQ);
+    }
+    if (active == NULL) {
+        stats.spurious++;
+        return;
+    }
+    irq_status = status;
+    irq_bm_status = bm_status;
+    events |= EV_IRQ;
+    tasklet_schedule(&ata_tasklet);
+}
+
+// Watchdog, from the timer interrupt
+static void ata_timeout(void* arg) {
+    (void)arg;
+    events |= EV_TIMEOUT;
+    tasklet_schedule(&ata_tasklet);
+}
+
+// Bus-master registers of the IDE controller, DMA enabled on the PCI side
+static void find_bus_master(void) {
+    pci_addr_t addr;
+    uint8_t prog_if;
+    if (!pci_find_class(PCI_CLASS_STORAGE, PCI_SUBCLASS_IDE, &addr, &prog_if) ||
+        !(prog_if & IDE_PROGIF_BUS_MASTER)) {
+        return;
+    }
+    uint32_t bar4 = pci_read32(addr, PCI_BAR4);
+    if (!(bar4 & PCI_BAR_IO) || (bar4 & PCI_BAR_IO_MASK) == 0) {
+        return;
+    }
+    uint32_t frame = pmm_alloc_frame();
+    if (frame == 0) {
+        return;
+    }
+    pci_enable(addr, PCI_COMMAND_IO | PCI_COMMAND_MASTER);
+    bm_base = (uint16_t)(bar4 & PCI_BAR_IO_MASK);
+    prdt = phys_to_virt(frame);
+    prdt_phys = frame;
+}
+
+static void blk_complete(ata_request_t* req, int status) {
+    ata_blk_request_t* blk = (ata_blk_request_t*)req;
+    blk_done_fn_t done = blk->done;
+    void* arg = blk->arg;
+    kmem_cache_free(blk_request_cache, blk);
+    done(arg, status);
+}
+
+static int blk_submit(block_device_t* dev, uint32_t lba, uint32_t count, void* buf,
+                      int write, blk_done_fn_t done, void* arg) {
+    ata_blk_request_t* blk = kmem_cache_alloc(blk_request_cache);
+    if (blk == NULL) {
+        return ATA_ENOMEM;
+    }
+    blk->req = (ata_request_t){
+        .drive = (uint8_t)(uint32_t)dev->priv,
+        .write = (uint8_t)write,
+        .lba = lba,
+        .count = count,
+        .buf = buf,
+        .done = blk_complete,
+    };
+    blk->done = done;
+    blk->arg = arg;
+    int err = ata_submit(&blk->req);
+    if (err != ATA_PENDING) {
+        kmem_cache_free(blk_request_cache, blk);
+        return err;
+    }
+    return BLK_OK;
+}
+
+// Register "hda"/"hdb" with the block layer
+static void register_blkdevs(void) {
+    blk_request_cache = kmem_cache_create("ata_request", sizeof(ata_blk_request_t), NULL);
+    if (blk_request_cache == NULL) {
+        return;
+    }
+    for (uint32_t drive = 0; drive < ATA_DRIVES; drive++) {
+        if (!drives[drive].present) {
+            continue;
+        }
+        block_device_t* dev = &blkdevs[drive];
+        dev->name[0] = 'h';
+        dev->name[1] = 'd';
+        dev->name[2] = (char)('a' + drive);
+        dev->name[3] = '\0';
+        dev->sectors = drives[drive].sectors;
+        dev->max_sectors = ATA_MAX_SECTORS;
+        dev->submit = blk_submit;
+        dev->priv = (void*)drive;
+        blkdev_register(dev);
+    }
+}
+
+uint32_t ata_init(void) {
+    tasklet_init(&ata_tasklet, ata_bh, NULL);
+    ktimer_setup(&watchdog, ata_timeout, NULL);
+
+    // Probe with the drives' interrupt off
+    outb(ATA_REG_CONTROL, ATA_CTL_NIEN);
+    if (inb(ATA_REG_ALTSTATUS) == 0xFF) {
+        return 0;   // Floating bus: no channel
+    }
+    uint32_t found = 0;
+    for (uint32_t drive = 0; drive < ATA_DRIVES; drive++) {
+        identify(drive);
+        found += drives[drive].present;
+    }
+    if (found == 0) {
+        return 0;
+    }
+
+    find_bus_master();
+    uint8_t dma_bits = 0;
+    for (uint32_t drive = 0; drive < ATA_DRIVES; drive++) {
+        ata_drive_info_t* info = &drives[drive];
+        if (!info->present) {
+            continue;
+        }
+        info->dma = info->dma && bm_base != 0;
+        dma_bits |= info->dma ? 0x20 << drive : 0;
+        use_dma |= info->dma;
+        kprintf("ata%u: %s, %u MB, LBA%s, %u sectors per PIO interrupt%s\n", drive,
+                info->model, info->sectors >> 11, info->lba48 ? "48" : "28",
+                info->multiple, info->dma ? ", bus-master DMA" : "");
+    }
+    if (bm_base != 0) {
+        outb(bm_base + BM_STATUS, dma_bits | BM_ST_ERROR | BM_ST_IRQ);
+    }
+
+    irq_register_handler(ATA_IRQ, ata_irq);
+    inb(ATA_REG_STATUS);    // Drop an interrupt left over from probing
+    outb(ATA_REG_CONTROL, 0);
+    register_blkdevs();
+    return found;
+}
+
+const ata_drive_info_t* ata_drive_info(uint32_t drive) {
+    if (drive >= ATA_DRIVES || !drives[drive].present) {
+        return NULL;
+    }
+    return &drives[drive];
+}
+
+int ata_set_dma(int dma) {
+    if (dma && !drives[0].dma && !drives[1].dma) {
+        return 0;
+    }
+    use_dma = dma;
+    return 1;
+}
+
+int ata_submit(ata_request_t* req) {
+    const ata_drive_info_t* info = ata_drive_info(req->drive);
+    if (info == NULL || req->count == 0 || req->count > ATA_MAX_SECTORS ||
+        req->lba >= info->sectors || info->sectors - req->lba < req->count) {
+        req->status = ATA_EINVAL;
+        return ATA_EINVAL;
+    }
+    req->status = ATA_PENDING;
+    req->next = NULL;
+    req->chain = NULL;
+    req->span = req->count;
+
+    uint32_t flags = irq_save();
+    stats.requests++;
+    queue_insert(req);
+    start_next();
+    irq_restore(flags);
+    return ATA_PENDING;
+}
+
+// The request lives on the submitter's stack: once the status is stored the
+// submitter may return, so read everything needed before that
+static void wake_submitter(ata_request_t* req, int status) {
+    thread_t* submitter = req->arg;
+    asm volatile ("" : : : "memory");   // Keep the load above the store
+    req->status = status;
+    thread_unblock(submitter);
+}
+
+static int transfer(uint32_t drive, uint32_t lba, uint32_t count, uint8_t* buf, int write) {
+    while (count > 0) {
+        uint32_t n = count < ATA_MAX_SECTORS ? count : ATA_MAX_SECTORS;
+        ata_request_t req = {
+            .drive = (uint8_t)drive,
+            .write = (uint8_t)write,
+            .lba = lba,
+            .count = n,
+            .buf = buf,
+            .done = wake_submitter,
+            .arg = thread_current(),
+        };
+        if (ata_submit(&req) != ATA_PENDING) {
+            return req.status;
+        }
+        while (req.status == ATA_PENDING) {
+            thread_block();
+        }
+        if (req.status != ATA_OK) {
+            return req.status;
+        }
+        lba += n;
+        count -= n;
+        buf += n * ATA_SECTOR_SIZE;
+    }
+    return ATA_OK;
+}
+
+int ata_read(uint32_t drive, uint32_t lba, uint32_t count, void* buf) {
+    return transfer(drive, lba, count, buf, 0);
+}
+
+int ata_write(uint32_t drive, uint32_t lba, uint32_t count, const void* buf) {
+    return transfer(drive, lba, count, (uint8_t*)buf, 1);
+}
+
+void ata_get_stats(ata_stats_t* out) {
+    uint32_t flags = irq_save();
+    *out = stats;
+    irq_restore(flags);
+}
+
+void ata_dump_stats(void) {
+    ata_stats_t s;
+    ata_get_stats(&s);
+    kprintf("ata: %u requests, %u merged, %u commands (%u DMA, %u fell back to PIO), %u sectors\n",
+            s.requests, s.merges, s.commands, s.dma_commands, s.pio_fallbacks, s.sectors);
+    kprintf("ata: %u errors, %u timeouts, %u spurious interrupts\n",
+            s.errors, s.timeouts, s.spurious);
+}
+
+#ifdef ATA_BENCH
+#include "bench/bench.h"
+
+#define BENCH_SEQ_BYTES     (16u << 20)
+#define BENCH_SEQ_SECTORS   ATA_MAX_SECTORS     // 128 KB per read
+#define BENCH_RAND_READS    1024
+#define BENCH_RAND_SECTORS  8                   // 4 KB per read
+#define BENCH_MERGE_READS   32                  // 4 KB each: one full group
+#define BENCH_BUF_FRAMES    (ATA_MAX_SECTORS * ATA_SECTOR_SIZE / PMM_FRAME_SIZE)
+
+static uint32_t bench_seed = 0x2545F491;
+static volatile uint32_t merge_done;
+
+static uint32_t elapsed_us(uint64_t start_ns) {
+    return timer_ns_to_us(timer_now_ns() - start_ns);
+}
+
+// MB/s x100 (10^6 bytes, i.e. bytes per microsecond)
+static uint32_t rate(uint32_t bytes, uint32_t us) {
+    return us != 0 ? bytes * 100 / us : 0;
+}
+
+static void bench_mode(uint32_t drive, int dma, uint8_t* buf) {
+    const ata_drive_info_t* info = ata_drive_info(drive);
+    ata_set_dma(dma);
+
+    // Sequential, wrapping around on small disks
+    uint32_t chunk = info->sectors < BENCH_SEQ_SECTORS ? info->sectors : BENCH_SEQ_SECTORS;
+    uint32_t lba = 0;
+    uint32_t bytes = 0;
+    int err = ATA_OK;
+    uint64_t start = timer_now_ns();
+    while (bytes < BENCH_SEQ_BYTES && err == ATA_OK) {
+        if (lba + chunk > info->sectors) {
+            lba = 0;
+        }
+        err = ata_read(drive, lba, chunk, buf);
+        lba += chunk;
+        bytes += chunk * ATA_SECTOR_SIZE;
+    }
+    uint32_t seq = rate(bytes, elapsed_us(start));
+
+    // Random 4 KB-aligned 4 KB reads
+    uint32_t slots = info->sectors / BENCH_RAND_SECTORS;
+    start = timer_now_ns();
+    for (uint32_t i = 0; i < BENCH_RAND_READS && err == ATA_OK; i++) {
+        err = ata_read(drive, (bench_rand(&bench_seed) % slots) * BENCH_RAND_SECTORS, BENCH_RAND_SECTORS, buf);
+    }
+    uint32_t rnd = rate(BENCH_RAND_READS * BENCH_RAND_SECTORS * ATA_SECTOR_SIZE, elapsed_us(start));
+
+    kprintf("ata: %s: sequential %u.%02u MB/s (128 KB reads), random %u.%02u MB/s (4 KB reads)%s\n",
+            dma ? "DMA" : "PIO", seq / 100, seq % 100, rnd / 100, rnd % 100,
+            err != ATA_OK ? " [I/O error]" : "");
+}
+
+static void merge_complete(ata_request_t* req, int status) {
+    req->status = status;
+    merge_done++;
+}
+
+// Adjacent reads submitted in shuffled order while the channel is busy
+static void bench_merge(uint32_t drive, uint8_t* buf) {
+    static ata_request_t reqs[BENCH_MERGE_READS];
+    uint32_t order[BENCH_MERGE_READS];
+    for (uint32_t i = 0; i < BENCH_MERGE_READS; i++) {
+        order[i] = i;
+    }
+    for (uint32_t i = BENCH_MERGE_READS - 1; i > 0; i--) {
+        uint32_t j = bench_rand(&bench_seed) % (i + 1);
+        uint32_t t = order[i];
+        order[i] = order[j];
+        order[j] = t;
+    }
+
+    ata_stats_t before, after;
+    ata_get_stats(&before);
+    merge_done = 0;
+    uint32_t flags = irq_save();        // Nothing completes until all are queued
+    for (uint32_t i = 0; i < BENCH_MERGE_READS; i++) {
+        uint32_t k = order[i];
+        reqs[k] = (ata_request_t){
+            .drive = (uint8_t)drive,
+            .lba = k * BENCH_RAND_SECTORS,
+            .count = BENCH_RAND_SECTORS,
+            .buf = buf + k * BENCH_RAND_SECTORS * ATA_SECTOR_SIZE,
+            .done = merge_complete,
+        };
+        ata_submit(&reqs[k]);
+    }
+    irq_restore(flags);
+    while (merge_done < BENCH_MERGE_READS) {
+        thread_sleep(1);
+    }
+    ata_get_stats(&after);
+    kprintf("ata: %u shuffled adjacent 4 KB reads: %u commands, %u merges\n",
+            BENCH_MERGE_READS, after.commands - before.commands, after.merges - before.merges);
+}
+
+static void bench_thread(void* arg) {
+    (void)arg;
+    // The scratch disk (-hdb) if there is one, else the boot disk; read only
+    uint32_t drive = ata_drive_info(1) != NULL ? 1 : 0;
+    const ata_drive_info_t* info = ata_drive_info(drive);
+    uint32_t frames = pmm_alloc_frames(BENCH_BUF_FRAMES);
+    if (info == NULL || info->sectors < ATA_MAX_SECTORS || frames == 0) {
+        kprintf("ata: bench needs a disk of at least 128 KB\n");
+        return;
+    }
+    uint8_t* buf = phys_to_virt(frames);
+    int dma = use_dma;
+
+    bench_merge(drive, buf);
+    bench_mode(drive, 0, buf);
+    if (info->dma) {
+        bench_mode(drive, 1, buf);
+    }
+    ata_set_dma(dma);
+    pmm_free_frames(frames, BENCH_BUF_FRAMES);
+    ata_dump_stats();
+}
+
+void ata_bench_start(void) {
+    thread_create("atabench", bench_thread, NULL, SCHED_PRIO_DEFAULT);
+}
+#endif
@@ -0,0 +1,109 @@
+#ifndef DRIVERS_ATA_H
+#define DRIVERS_ATA_H
+
+#include <stdint.h>
+
+// ATA disks on the primary IDE channel (0x1F0/0x3F6, IRQ 14), master and
+// slave. Requests go into one queue per channel kept sorted by (drive, LBA):
+// a request that continues or precedes a queued one in the same direction is
+// merged with it, and the channel serves the queue in one direction (C-LOOK)
+// from where the last command ended. Each merged group is one command: READ/
+// WRITE MULTIPLE in PIO mode (one interrupt per block of sectors), or READ/
+// WRITE DMA through the PCI bus-master engine with a PRD table covering every
+// buffer of the group. IRQ 14 only acknowledges the drive; the data transfer
+// and the completions run in a tasklet.
+
+#define ATA_SECTOR_SIZE     512
+#define ATA_MAX_SECTORS     256         // Per command, and per merged group
+#define ATA_DRIVES          2           // Master, slave
+#define ATA_TIMEOUT_NS      5000000000ull   // Command watchdog: fail and reset the channel
+
+// Request status
+#define ATA_PENDING         1
+#define ATA_OK              0
+#define ATA_EIO             (-1)        // The drive reported an error
+#define ATA_ETIMEDOUT       (-2)        // No interrupt within ATA_TIMEOUT_NS
+#define ATA_EINVAL          (-3)        // Bad drive, range or size
+#define ATA_ENOMEM          (-4)        // No memory for a block layer request
+
+struct ata_request;
+// Completion callback, from the bottom half. It is handed the result instead
+// of req->status being set first: a submitter polling req->status may reuse
+// the request as soon as it changes, so the callback stores the status (if
+// anyone polls it) as its last access to the request.
+typedef void (*ata_done_fn_t)(struct ata_request* req, int status);
+
+typedef struct ata_request {
+    // Filled in by the submitter
+    uint8_t drive;                      // 0 master, 1 slave
+    uint8_t write;
+    uint32_t lba;
+    uint32_t count;                     // Sectors, 1..ATA_MAX_SECTORS
+    void* buf;                          // count * ATA_SECTOR_SIZE bytes
+    ata_done_fn_t done;                 // Called from the bottom half on completion (may be NULL)
+    void* arg;
+
+    volatile int status;                // ATA_PENDING until completed, then ATA_OK or an error (set by done, if any)
+
+    // Queue state
+    struct ata_request* next;           // Next group in the queue
+    struct ata_request* chain;          // Next request merged into this group, in LBA order
+    uint32_t span;                      // Sectors of the whole group (head request only)
+} ata_request_t;
+
+typedef struct {
+    uint32_t present;
+    uint32_t lba48;
+    uint32_t sectors;                   // Capacity (clamped to 2^32 - 1)
+    uint32_t multiple;                  // Sectors per PIO interrupt (READ/WRITE MULTIPLE), 1 without
+    uint32_t dma;                       // The drive and the controller can do bus-master DMA
+    char model[41];
+} ata_drive_info_t;
+
+typedef struct {
+    uint32_t requests;                  // ata_submit() calls accepted
+    uint32_t merges;                    // Requests that joined another group
+    uint32_t commands;                  // Commands issued
+    uint32_t dma_commands;
+    uint32_t sectors;
+    uint32_t errors;
+    uint32_t timeouts;
+    uint32_t pio_fallbacks;             // DMA mode, but a buffer page was not mapped or aligned
+    uint32_t spurious;                  // IRQ 14 with no command running
+} ata_stats_t;
+
+// Probe the primary channel (polled IDENTIFY), find the IDE controller's
+// bus-master registers on PCI, install IRQ 14 and register the drives as
+// block devices "hda" and "hdb". Needs the timer and kmalloc_init().
+// Returns the number of drives found.
+uint32_t ata_init(void);
+
+// Drive information, NULL if 'drive' does not exist
+const ata_drive_info_t* ata_drive_info(uint32_t drive);
+
+// Use DMA (1) or PIO (0) for the commands issued from now on.
+// Returns 0 if DMA was asked for but no drive or controller supports it.
+int ata_set_dma(int dma);
+
+// Queue a request; it completes asynchronously. Fills in req->status (and
+// returns) ATA_PENDING, or ATA_EINVAL without queuing it.
+int ata_submit(ata_request_t* req);
+
+// Blocking transfers of any length, split into ATA_MAX_SECTORS commands.
+// Return ATA_OK or the first error. Call from a thread.
+int ata_read(uint32_t drive, uint32_t lba, uint32_t count, void* buf);
+int ata_write(uint32_t drive, uint32_t lba, uint32_t count, const void* buf);
+
+// Counters
+void ata_get_stats(ata_stats_t* out);
+
+// Print the counters (kprintf; on F12 with the IRQ stats)
+void ata_dump_stats(void);
+
+#ifdef ATA_BENCH
+// Sequential and random read throughput with PIO and DMA, and how the queue
+// merges shuffled adjacent reads (build with -DATA_BENCH)
+void ata_bench_start(void);
+#endif
+
+#endif // DRIVERS_ATA_H
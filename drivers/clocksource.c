@@ -0,0 +1,136 @@
+#include "clocksource.h"
+#include "timer.h"
+#include "interrupt/io.h"
+#include "interrupt/irqflags.h"
+#include "cpu/percpu.h"
+#include <stdint.h>
+
+// PIT channel 2 as the calibration reference (the gate is in port 0x61, so
+// channel 0 stays free for timer_init)
+#define PIT_CMD_PORT        0x43
+#define PIT_CHANNEL2_DATA_PORT 0x42
+#define PIT_GATE_PORT       0x61            // Bit 0: channel 2 gate, bit 5: channel 2 output
+#define PIT_BASE_FREQUENCY  1193182
+#define PIT_CMD_CH2_ONESHOT 0xB0            // Channel 2, lobyte/hibyte, mode 0
+
+#define CPUID_FEATURES      0x00000001
+#define CPUID_EDX_TSC       (1u << 4)
+#define CPUID_EXT_MAX       0x80000000
+#define CPUID_EXT_POWER     0x80000007
+#define CPUID_EDX_INVARIANT_TSC (1u << 8)
+
+#define CALIBRATE_WINDOWS   3
+#define CALIBRATE_PIT_COUNT (PIT_BASE_FREQUENCY / 40)  // 25 ms per window
+
+static int have_tsc;
+static int use_tsc;
+static uint32_t tsc_khz;
+
+// TSC cycles -> ns since tsc_base as (cycles * mult) >> shift
+static uint64_t tsc_base;
+static uint32_t tsc_mult, tsc_shift;
+
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    asm volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static int tsc_invariant(void) {
+    uint32_t eax, ebx, ecx, edx;
+    asm volatile ("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(CPUID_FEATURES));
+    if (!(edx & CPUID_EDX_TSC)) {
+        return -1;
+    }
+    have_tsc = 1;
+    asm volatile ("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(CPUID_EXT_MAX));
+    if (eax < CPUID_EXT_POWER) {
+        return 0;
+    }
+    asm volatile ("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(CPUID_EXT_POWER));
+    return (edx & CPUID_EDX_INVARIANT_TSC) != 0;
+}
+
+// TSC cycles during one CALIBRATE_PIT_COUNT run of PIT channel 2
+static uint64_t calibrate_window(void) {
+    uint32_t flags = irq_save();
+    outb(PIT_GATE_PORT, inb(PIT_GATE_PORT) & ~0x03);         // Gate off, speaker off
+    outb(PIT_CMD_PORT, PIT_CMD_CH2_ONESHOT);
+    outb(PIT_CHANNEL2_DATA_PORT, CALIBRATE_PIT_COUNT & 0xFF);
+    outb(PIT_CHANNEL2_DATA_PORT, (CALIBRATE_PIT_COUNT >> 8) & 0xFF);
+
+    // Counting starts on the gate's rising edge, so both ends of the window
+    // are one port access from their TSC read
+    outb(PIT_GATE_PORT, inb(PIT_GATE_PORT) | 0x01);
+    uint64_t start = rdtsc();
+    while (!(inb(PIT_GATE_PORT) & 0x20)) {
+        // Wait for channel 2 terminal count
+    }
+    uint64_t end = rdtsc();
+    irq_restore(flags);
+    return end - start;
+}
+
+int clocksource_init(void) {
+    int invariant = tsc_invariant();
+    if (invariant < 0) {
+        return 0;
+    }
+
+    // Polling overhead and SMIs only ever lengthen a window: keep the shortest
+    uint64_t cycles = ~0ull;
+    for (int i = 0; i < CALIBRATE_WINDOWS; i++) {
+        uint64_t c = calibrate_window();
+        if (c < cycles) {
+            cycles = c;
+        }
+    }
+    uint32_t mult, shift;
+    timer_calc_mult(&mult, &shift, PIT_BASE_FREQUENCY, 1000000000);
+    uint32_t window_ns = (uint32_t)(((uint64_t)CALIBRATE_PIT_COUNT * mult) >> shift);
+    if ((cycles >> 32) != 0) {
+        return 0;
+    }
+    timer_calc_mult(&mult, &shift, window_ns, 1000000);
+    tsc_khz = (uint32_t)((cycles * mult) >> shift);
+    if (tsc_khz < CLOCKSOURCE_MIN_KHZ) {
+        tsc_khz = 0;                    // No PIT behind port 0x61, or an emulated TSC stuck in place
+        return 0;
+    }
+
+    // A TSC that follows the core clock can't keep time across P-states and halts
+    if (!invariant) {
+        return 0;
+    }
+    timer_calc_mult(&tsc_mult, &tsc_shift, (uint32_t)cycles, window_ns);
+    tsc_base = rdtsc();
+    use_tsc = 1;
+    return 1;
+}
+
+int clocksource_tsc(void) {
+    return use_tsc;
+}
+
+uint64_t ktime_get_ns(void) {
+    if (use_tsc) {
+        return mul_u64_u32_shr(rdtsc() - tsc_base, tsc_mult, tsc_shift);
+    }
+    // The counter clock syncs from the boot CPU's LAPIC timer; on an AP that
+    // register is another (masked) counter, so APs get the last synced time
+    if (smp_cpu_id() != 0) {
+        return timer_last_ns();
+    }
+    return timer_now_ns();
+}
+
+uint32_t clocksource_tsc_khz(void) {
+    return tsc_khz;
+}
+
+const char* clocksource_name(void) {
+    if (use_tsc) {
+        return "TSC";
+    }
+    return have_tsc ? "timer counter, TSC not invariant" : "timer counter";
+}
@@ -0,0 +1,52 @@
+#ifndef DRIVERS_CLOCKSOURCE_H
+#define DRIVERS_CLOCKSOURCE_H
+
+#include <stdint.h>
+
+// Monotonic clock. With an invariant TSC (constant rate through P- and
+// C-states, CPUID 0x80000007 EDX bit 8) time is read from the TSC scaled by
+// a multiply-shift calibrated against the PIT; otherwise ktime_get_ns()
+// falls back to timer_now_ns(), which counts the one-shot timer's cycles.
+
+#define CLOCKSOURCE_MIN_KHZ 10000       // Calibrations below 10 MHz are rejected
+
+// Detect and calibrate the TSC (three PIT channel 2 windows). Call once,
+// before timer_init(). Returns 1 when the TSC became the clock source.
+int clocksource_init(void);
+
+// Nonzero when ktime_get_ns() reads the TSC
+int clocksource_tsc(void);
+
+// Nanoseconds since clocksource_init, monotonic, on any CPU. The TSC path
+// is a rdtsc and one 64x32 multiply-shift: no division, no locks, no I/O.
+// Without it, only the boot CPU reads the live counter clock; APs get
+// timer_last_ns(), which advances at every timer interrupt.
+uint64_t ktime_get_ns(void);
+
+// Measured TSC rate, also when the TSC is not invariant; 0 without a TSC
+uint32_t clocksource_tsc_khz(void);
+
+// "TSC" or the name of the fallback clock
+const char* clocksource_name(void);
+
+// (a * mul) >> shift for a 64-bit a and shift <= 32, without 128-bit math
+static inline uint64_t mul_u64_u32_shr(uint64_t a, uint32_t mul, uint32_t shift) {
+    uint64_t lo = (uint64_t)(uint32_t)a * mul;
+    uint64_t hi = (a >> 32) * mul;
+    if (shift == 0) {
+        return lo + (hi << 32);
+    }
+    return (lo >> shift) + (hi << (32 - shift));
+}
+
+// total / count, e.g. an average of cycle counts, without a 64-bit division:
+// both are scaled down until total fits, so large totals lose low bits
+static inline uint32_t avg_u64_u32(uint64_t total, uint32_t count) {
+    while (total >> 32) {
+        total >>= 1;
+        count >>= 1;
+    }
+    return count ? (uint32_t)total / count : 0;
+}
+
+#endif // DRIVERS_CLOCKSOURCE_H
@@ -1,14 +1,28 @@
 #include "keyboard.h"
 #include "interrupt/irq.h"
 #include "interrupt/io.h"
+#include "interrupt/softirq.h"
+#include "task/sched.h"
+#include "trace/trace.h"
+#include <stddef.h>
 #include <stdint.h>
 
 // Keyboard controller ports
 #define KBD_DATA_PORT   0x60
 #define KBD_STATUS_PORT 0x64 // Reading status, writing command
 
-// Simple buffer for the last pressed character
-static volatile char last_char = 0;
+// Single-producer (keyboard_handler) / single-consumer (reader thread) scancode ring.
+// The producer only writes kbd_head, the consumer only writes kbd_tail, so neither
+// side needs a lock or cli. Indices run freely and are masked on access.
+static uint8_t kbd_ring[KBD_RING_SIZE];
+static volatile uint32_t kbd_head = 0;     // Next slot to write (producer)
+static volatile uint32_t kbd_tail = 0;     // Next slot to read (consumer)
+static volatile uint32_t kbd_dropped = 0;  // Scancodes lost because the ring was full
+static thread_t* volatile kbd_waiter = NULL; // Reader blocked in keyboard_read()
+static tasklet_t kbd_tasklet;              // Bottom half: wakes the reader once per batch
+
+// Keep the compiler from reordering ring accesses (x86 stores are not reordered with each other)
+#define barrier() asm volatile ("" : : : "memory")
 
 // Basic US QWERTY Keyboard Layout (Scancode Set 1 - Make codes)
 // Only handles basic printable characters and Enter/Backspace for simplicity
@@ -26,12 +40,13 @@ const unsigned char kbd_us_layout[128] = {
     0, // Left Alt
   ' ', // Spacebar
     0, // Caps Lock
-    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // F1-F10
+    0, 0, 0, 0, 0, 0, 0, 0, 0, // F1-F9
+    KBD_F10, // F10
     0, // Num Lock
     0, // Scroll Lock
     0, // Home key
     0, // Up Arrow
-    0, // Page Up
+    KBD_PAGE_UP, // Page Up
   '-', // Keypad -
     0, // Left Arrow
     0, // Center key (Keypad 5)
@@ -39,18 +54,28 @@ const unsigned char kbd_us_layout[128] = {
   '+', // Keypad +
     0, // End key
     0, // Down Arrow
-    0, // Page Down
+    KBD_PAGE_DOWN, // Page Down
     0, // Insert key
     0, // Delete key
     0, 0, 0, 
-    0, // F11
-    0, // F12
+    KBD_F11, // F11
+    KBD_F12, // F12
     0, // All other keys are undefined
 };
 
 
+// Bottom half: one wakeup for every scancode queued since the last run
+static void keyboard_bh(void* arg) {
+    (void)arg;
+    if (kbd_waiter != NULL) {
+        thread_unblock(kbd_waiter);
+    }
+}
+
 // Initialize the keyboard driver
 void keyboard_init(void) {
+    tasklet_init(&kbd_tasklet, keyboard_bh, NULL);
+
     // Register the keyboard handler for IRQ 1
     irq_register_handler(1, keyboard_handler);
     
@@ -60,37 +85,90 @@ void keyboard_init(void) {
     }
 }
 
-// The keyboard interrupt handler
+// The keyboard interrupt handler (top half): reading the data port acks the
+// controller; the scancode is queued and the reader woken from the tasklet
 void keyboard_handler(registers_t* regs) {
     (void)regs; // Mark regs as unused to prevent compiler warning
     uint8_t scancode;
 
     // Read from the keyboard's data buffer
     scancode = inb(KBD_DATA_PORT);
-    io_wait(); // Give the hardware a moment
-
-    // Simple check: if the highest bit is set, it's a key release. Ignore releases for now.
-    if (!(scancode & 0x80)) { 
-        // It's a key press (Make code)
-        if (scancode < 128) { // Ensure scancode is within our map bounds
-            char c = kbd_us_layout[scancode];
-            if (c != 0) { // If it's a character we handle
-                last_char = c;
-                
-                // For debugging: print the character to the screen immediately
-                // Replace with your kernel's terminal output function
-                // term_putc(c); 
-            }
-        }
+    trace_event(TRACE_KEYBOARD, scancode, 0);
+
+    // Queue the raw scancode; translation happens on the reader side
+    uint32_t head = kbd_head;
+    if (head - kbd_tail == KBD_RING_SIZE) {
+        kbd_dropped++;
+    } else {
+        kbd_ring[head & (KBD_RING_SIZE - 1)] = scancode;
+        barrier();
+        kbd_head = head + 1; // Publish after the data is written
     }
-    // Note: A more robust driver would handle key releases, shift/ctrl/alt states, etc.
+    tasklet_schedule(&kbd_tasklet);
 }
 
-// Basic function to get the last pressed character
+// Translate one scancode to a character, 0 for releases and keys we don't map
+static char translate(uint8_t scancode) {
+    // If the highest bit is set, it's a key release. Ignore releases for now.
+    if (scancode & 0x80) {
+        return 0;
+    }
+    return kbd_us_layout[scancode];
+}
+
+// Pop one scancode from the ring. Returns 0 when empty.
+static int ring_pop(uint8_t* scancode) {
+    uint32_t tail = kbd_tail;
+    if (tail == kbd_head) {
+        return 0;
+    }
+    barrier();
+    *scancode = kbd_ring[tail & (KBD_RING_SIZE - 1)];
+    barrier();
+    kbd_tail = tail + 1; // Release the slot after the data is read
+    return 1;
+}
+
+// Get the next typed character without blocking (0 if none)
 char keyboard_getchar(void) {
-    // Atomically read and clear last_char (simplified - assumes interrupts are off or handles this carefully)
-    // In a real scenario, use a proper buffer and synchronization
-    char c = last_char;
-    last_char = 0; // Clear the buffer
-    return c;
+    uint8_t scancode;
+    while (ring_pop(&scancode)) {
+        char c = translate(scancode);
+        if (c != 0) {
+            return c;
+        }
+    }
+    return 0;
+}
+
+// Read up to n characters, sleeping until at least one is available
+size_t keyboard_read(char* buf, size_t n) {
+    size_t count = 0;
+    if (n == 0) {
+        return 0;
+    }
+
+    for (;;) {
+        char c;
+        while (count < n && (c = keyboard_getchar()) != 0) {
+            buf[count++] = c;
+        }
+        if (count > 0) {
+            return count;
+        }
+
+        // Publish ourselves, then re-check: a key that arrives in between
+        // leaves a pending wakeup and thread_block() returns at once.
+        kbd_waiter = thread_current();
+        barrier();
+        if (kbd_tail == kbd_head) {
+            thread_block();
+        }
+        kbd_waiter = NULL;
+    }
+}
+
+// Scancodes lost because the ring overflowed
+uint32_t keyboard_dropped(void) {
+    return kbd_dropped;
 }
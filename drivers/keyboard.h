@@ -2,6 +2,17 @@
 #define DRIVERS_KEYBOARD_H
 
 #include "interrupt/isr.h" // For registers_t
+#include <stddef.h>
+
+// Scancode ring buffer size (power of two)
+#define KBD_RING_SIZE 256
+
+// Control characters returned for keys without an ASCII code
+#define KBD_PAGE_UP     '\x11'
+#define KBD_PAGE_DOWN   '\x12'
+#define KBD_F12         '\x13'
+#define KBD_F11         '\x14'
+#define KBD_F10         '\x15'
 
 // Initialize the keyboard driver
 void keyboard_init(void);
@@ -9,4 +20,14 @@ void keyboard_init(void);
 // The keyboard interrupt handler
 void keyboard_handler(registers_t* regs);
 
+// Get the next typed character (non-blocking, 0 if none)
+char keyboard_getchar(void);
+
+// Read up to n characters, sleeping until at least one is available.
+// Only one thread may read from the keyboard.
+size_t keyboard_read(char* buf, size_t n);
+
+// Number of scancodes dropped because the ring buffer was full
+uint32_t keyboard_dropped(void);
+
 #endif // DRIVERS_KEYBOARD_H
\ No newline at end of file
@@ -0,0 +1,90 @@
+#include "pci.h"
+#include "interrupt/io.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#define PCI_CONFIG_ADDRESS  0xCF8
+#define PCI_CONFIG_DATA     0xCFC
+#define PCI_ENABLE_BIT      0x80000000
+
+#define PCI_BUSES           256
+#define PCI_DEVICES         32
+#define PCI_FUNCTIONS       8
+#define PCI_MULTIFUNCTION   0x80            // Header type bit 7
+
+static int present = -1;                    // Not probed yet
+
+static uint32_t config_address(pci_addr_t addr, uint8_t offset) {
+    return PCI_ENABLE_BIT | ((uint32_t)addr.bus << 16) | ((uint32_t)addr.dev << 11) |
+           ((uint32_t)addr.fn << 8) | (offset & 0xFC);
+}
+
+int pci_present(void) {
+    if (present < 0) {
+        // The address register reads back what was written only if mechanism #1 exists
+        uint32_t saved = inl(PCI_CONFIG_ADDRESS);
+        outl(PCI_CONFIG_ADDRESS, PCI_ENABLE_BIT);
+        present = inl(PCI_CONFIG_ADDRESS) == PCI_ENABLE_BIT;
+        outl(PCI_CONFIG_ADDRESS, saved);
+    }
+    return present;
+}
+
+uint32_t pci_read32(pci_addr_t addr, uint8_t offset) {
+    outl(PCI_CONFIG_ADDRESS, config_address(addr, offset));
+    return inl(PCI_CONFIG_DATA);
+}
+
+void pci_write32(pci_addr_t addr, uint8_t offset, uint32_t value) {
+    outl(PCI_CONFIG_ADDRESS, config_address(addr, offset));
+    outl(PCI_CONFIG_DATA, value);
+}
+
+uint16_t pci_read16(pci_addr_t addr, uint8_t offset) {
+    return (uint16_t)(pci_read32(addr, offset) >> ((offset & 2) * 8));
+}
+
+void pci_write16(pci_addr_t addr, uint8_t offset, uint16_t value) {
+    uint32_t shift = (offset & 2) * 8;
+    uint32_t dword = pci_read32(addr, offset);
+    dword = (dword & ~(0xFFFFu << shift)) | ((uint32_t)value << shift);
+    pci_write32(addr, offset, dword);
+}
+
+int pci_find_class(uint8_t class_code, uint8_t subclass, pci_addr_t* out, uint8_t* prog_if) {
+    if (!pci_present()) {
+        return 0;
+    }
+    for (uint32_t bus = 0; bus < PCI_BUSES; bus++) {
+        for (uint8_t dev = 0; dev < PCI_DEVICES; dev++) {
+            pci_addr_t addr = { (uint8_t)bus, dev, 0 };
+            if (pci_read16(addr, PCI_VENDOR_ID) == 0xFFFF) {
+                continue;   // No device
+            }
+            uint8_t functions = (pci_read32(addr, PCI_HEADER_TYPE) >> 16) & PCI_MULTIFUNCTION ?
+                                PCI_FUNCTIONS : 1;
+            for (uint8_t fn = 0; fn < functions; fn++) {
+                addr.fn = fn;
+                if (pci_read16(addr, PCI_VENDOR_ID) == 0xFFFF) {
+                    continue;
+                }
+                uint32_t class_rev = pci_read32(addr, PCI_CLASS_REVISION);
+                if ((class_rev >> 24) == class_code && ((class_rev >> 16) & 0xFF) == subclass) {
+                    *out = addr;
+                    if (prog_if != NULL) {
+                        *prog_if = (class_rev >> 8) & 0xFF;
+                    }
+                    return 1;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+void pci_enable(pci_addr_t addr, uint16_t command_bits) {
+    uint16_t command = pci_read16(addr, PCI_COMMAND);
+    if ((command & command_bits) != command_bits) {
+        pci_write16(addr, PCI_COMMAND, command | command_bits);
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef DRIVERS_PCI_H
+#define DRIVERS_PCI_H
+
+#include <stdint.h>
+
+// PCI configuration space through configuration mechanism #1 (ports 0xCF8/0xCFC)
+
+// Configuration registers (offsets into the header)
+#define PCI_VENDOR_ID       0x00
+#define PCI_COMMAND         0x04
+#define PCI_CLASS_REVISION  0x08            // Class, subclass, prog-if, revision (high to low)
+#define PCI_HEADER_TYPE     0x0E
+#define PCI_BAR0            0x10
+#define PCI_BAR4            0x20
+#define PCI_INTERRUPT_LINE  0x3C
+
+#define PCI_COMMAND_IO      0x0001          // Respond to I/O space accesses
+#define PCI_COMMAND_MASTER  0x0004          // Bus mastering (DMA)
+
+#define PCI_BAR_IO          0x1             // BAR bit 0: I/O space
+#define PCI_BAR_IO_MASK     0xFFFFFFFC
+
+// Class codes
+#define PCI_CLASS_STORAGE   0x01
+#define PCI_SUBCLASS_IDE    0x01
+
+typedef struct {
+    uint8_t bus;
+    uint8_t dev;
+    uint8_t fn;
+} pci_addr_t;
+
+// Whether configuration mechanism #1 answers (set by the first pci_find_class())
+int pci_present(void);
+
+uint32_t pci_read32(pci_addr_t addr, uint8_t offset);
+void pci_write32(pci_addr_t addr, uint8_t offset, uint32_t value);
+uint16_t pci_read16(pci_addr_t addr, uint8_t offset);
+void pci_write16(pci_addr_t addr, uint8_t offset, uint16_t value);
+
+// Find the first function of the given class and subclass. Fills *out and
+// its prog-if and returns 1, or returns 0 if there is none.
+int pci_find_class(uint8_t class_code, uint8_t subclass, pci_addr_t* out, uint8_t* prog_if);
+
+// Set bits in the command register (e.g. PCI_COMMAND_IO | PCI_COMMAND_MASTER)
+void pci_enable(pci_addr_t addr, uint16_t command_bits);
+
+#endif // DRIVERS_PCI_H
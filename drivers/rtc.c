@@ -0,0 +1,193 @@
+#include "rtc.h"
+#include "clocksource.h"
+#include "interrupt/io.h"
+#include "interrupt/irq.h"
+#include "interrupt/irqflags.h"
+#include <stdint.h>
+
+// CMOS index and data ports. Bit 7 of the index masks NMIs; it stays clear.
+#define CMOS_INDEX_PORT     0x70
+#define CMOS_DATA_PORT      0x71
+
+#define RTC_REG_SECONDS     0x00
+#define RTC_REG_MINUTES     0x02
+#define RTC_REG_HOURS       0x04
+#define RTC_REG_DAY         0x07
+#define RTC_REG_MONTH       0x08
+#define RTC_REG_YEAR        0x09
+#define RTC_REG_A           0x0A
+#define RTC_REG_B           0x0B
+#define RTC_REG_C           0x0C
+
+#define REG_A_UIP           0x80            // Update in progress: the time registers are changing
+#define REG_B_UIE           0x10            // Update-ended interrupt enable
+#define REG_B_BINARY        0x04            // Binary rather than BCD
+#define REG_B_24H           0x02
+#define REG_C_UF            0x10            // Update ended
+#define HOUR_PM             0x80            // In 12-hour mode
+
+#define RTC_CENTURY         2000            // The century register isn't standard; assume 20xx
+
+#define barrier() asm volatile ("" : : : "memory")
+
+static uint8_t reg_b;
+
+// Wall clock anchor: the RTC second and ktime_get_ns() when it started.
+// Written by the update interrupt, read on any CPU (APs see the coarse time
+// of ktime_get_ns() without a TSC clocksource): an odd anchor_seq means
+// a write is in progress. When our clock ran fast, re-anchoring would move
+// wall time back; anchor_floor, the latest time readers could have seen
+// under the old anchor, holds it still until the new anchor catches up.
+static volatile uint32_t anchor_seq;
+static uint64_t anchor_sec;
+static uint64_t anchor_ns;
+static uint64_t anchor_floor;
+static uint32_t updates;
+
+// Callers keep interrupts off: the update handler also moves the index port
+static uint8_t cmos_read(uint8_t reg) {
+    outb(CMOS_INDEX_PORT, reg);
+    return inb(CMOS_DATA_PORT);
+}
+
+static void cmos_write(uint8_t reg, uint8_t value) {
+    outb(CMOS_INDEX_PORT, reg);
+    outb(CMOS_DATA_PORT, value);
+}
+
+static void read_raw(rtc_time_t* t) {
+    t->second = cmos_read(RTC_REG_SECONDS);
+    t->minute = cmos_read(RTC_REG_MINUTES);
+    t->hour = cmos_read(RTC_REG_HOURS);
+    t->day = cmos_read(RTC_REG_DAY);
+    t->month = cmos_read(RTC_REG_MONTH);
+    t->year = cmos_read(RTC_REG_YEAR);
+}
+
+static int same_raw(const rtc_time_t* a, const rtc_time_t* b) {
+    return a->second == b->second && a->minute == b->minute && a->hour == b->hour &&
+           a->day == b->day && a->month == b->month && a->year == b->year;
+}
+
+static uint8_t from_bcd(uint8_t v) {
+    return (v >> 4) * 10 + (v & 0x0F);
+}
+
+// Register values to binary, 24-hour, four-digit year
+static void decode(rtc_time_t* t) {
+    int pm = (t->hour & HOUR_PM) != 0;
+    t->hour &= ~HOUR_PM;
+    if (!(reg_b & REG_B_BINARY)) {
+        t->second = from_bcd(t->second);
+        t->minute = from_bcd(t->minute);
+        t->hour = from_bcd(t->hour);
+        t->day = from_bcd(t->day);
+        t->month = from_bcd(t->month);
+        t->year = from_bcd(t->year);
+    }
+    if (!(reg_b & REG_B_24H)) {
+        t->hour %= 12;                      // 12 AM is hour 0
+        if (pm) {
+            t->hour += 12;
+        }
+    }
+    t->year += RTC_CENTURY;
+}
+
+static void set_anchor(uint64_t sec, uint64_t ns) {
+    anchor_seq++;
+    barrier();
+    // Readers that finished before the write began read the clock before now
+    uint64_t seen = anchor_sec * 1000000000ull + (ktime_get_ns() - anchor_ns);
+    if (seen > anchor_floor) {
+        anchor_floor = seen;
+    }
+    anchor_sec = sec;
+    anchor_ns = ns;
+    barrier();
+    anchor_seq++;
+}
+
+// IRQ8: the time registers just changed and stay put for almost a second
+static void rtc_handler(registers_t* regs) {
+    (void)regs;
+    uint64_t now = ktime_get_ns();
+    // Reading register C acknowledges: no further IRQ8 until it is read
+    if (!(cmos_read(RTC_REG_C) & REG_C_UF)) {
+        return;
+    }
+    rtc_time_t t;
+    read_raw(&t);
+    decode(&t);
+    set_anchor(rtc_to_unix(&t), now);
+    updates++;
+}
+
+void rtc_get_time(rtc_time_t* t) {
+    rtc_time_t prev;
+    uint32_t flags = irq_save();
+    // Two identical reads, both outside an update, can't straddle one
+    do {
+        while (cmos_read(RTC_REG_A) & REG_A_UIP) {
+            // An update takes under 2 ms
+        }
+        read_raw(&prev);
+        while (cmos_read(RTC_REG_A) & REG_A_UIP) {
+        }
+        read_raw(t);
+    } while (!same_raw(&prev, t));
+    irq_restore(flags);
+    decode(t);
+}
+
+void rtc_init(void) {
+    uint32_t flags = irq_save();
+    reg_b = cmos_read(RTC_REG_B) & ~REG_B_UIE;
+    irq_restore(flags);
+
+    // The first anchor sets the time rather than correcting it, so no floor.
+    // IRQ8 is still off and the APs aren't up: plain stores will do.
+    rtc_time_t t;
+    rtc_get_time(&t);
+    anchor_sec = rtc_to_unix(&t);
+    anchor_ns = ktime_get_ns();
+    anchor_floor = 0;
+
+    irq_register_handler(RTC_IRQ, rtc_handler);
+    flags = irq_save();
+    cmos_write(RTC_REG_B, reg_b | REG_B_UIE);
+    cmos_read(RTC_REG_C);                   // Drop anything pending so IRQ8 can fire
+    irq_restore(flags);
+}
+
+// Days since the epoch counted in 400-year eras of years starting in March,
+// so the leap day is the last day of its year
+uint64_t rtc_to_unix(const rtc_time_t* t) {
+    uint32_t y = t->year - (t->month <= 2);
+    uint32_t era = y / 400;
+    uint32_t yoe = y - era * 400;
+    uint32_t doy = (153 * (t->month > 2 ? t->month - 3 : t->month + 9) + 2) / 5 + t->day - 1;
+    uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    uint32_t days = era * 146097 + doe - 719468;
+    return (uint64_t)days * 86400 + t->hour * 3600 + t->minute * 60 + t->second;
+}
+
+uint64_t ktime_get_real_ns(void) {
+    uint32_t seq;
+    uint64_t sec, base, floor, now;
+    do {
+        seq = anchor_seq;
+        barrier();
+        sec = anchor_sec;
+        base = anchor_ns;
+        floor = anchor_floor;
+        now = ktime_get_ns();           // Inside the loop, so set_anchor()'s floor covers it
+        barrier();
+    } while ((seq & 1) || anchor_seq != seq);
+    uint64_t real = sec * 1000000000ull + (now - base);
+    return real > floor ? real : floor;
+}
+
+uint32_t rtc_updates(void) {
+    return updates;
+}
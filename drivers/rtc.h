@@ -0,0 +1,39 @@
+#ifndef DRIVERS_RTC_H
+#define DRIVERS_RTC_H
+
+#include <stdint.h>
+
+// MC146818 real-time clock in CMOS: wall-clock time, kept in UTC
+#define RTC_IRQ             8
+
+typedef struct {
+    uint16_t year;
+    uint8_t month;          // 1-12
+    uint8_t day;            // 1-31
+    uint8_t hour;           // 0-23
+    uint8_t minute;
+    uint8_t second;
+} rtc_time_t;
+
+// Read the clock and enable the update-ended interrupt on IRQ8, which
+// re-anchors ktime_get_real_ns() to the RTC once a second. Call after
+// clocksource_init().
+void rtc_init(void);
+
+// Current RTC time, read between updates (waits out an update in progress)
+void rtc_get_time(rtc_time_t* t);
+
+// Seconds since 1970-01-01 00:00:00 UTC
+uint64_t rtc_to_unix(const rtc_time_t* t);
+
+// Wall-clock nanoseconds since the epoch: the second of the last RTC update
+// plus ktime_get_ns() since then. Before the first update interrupt the
+// anchor is the rtc_init() read, up to a second early. Never goes back: when
+// an update finds our clock ahead of the RTC, the value stays put until the
+// new anchor catches up.
+uint64_t ktime_get_real_ns(void);
+
+// Update interrupts taken so far
+uint32_t rtc_updates(void);
+
+#endif // DRIVERS_RTC_H
@@ -0,0 +1,276 @@
+#include "serial.h"
+#include "interrupt/io.h"
+#include "interrupt/irq.h"
+#include "interrupt/irqflags.h"
+#include "interrupt/softirq.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// 16550 UART registers (offsets from the base port)
+#define UART_DATA           0               // RBR/THR, or divisor low with DLAB
+#define UART_IER            1               // Interrupt enable, or divisor high with DLAB
+#define UART_IIR            2               // Interrupt identification (read)
+#define UART_FCR            2               // FIFO control (write)
+#define UART_LCR            3
+#define UART_MCR            4
+#define UART_LSR            5
+
+#define IER_RDA             0x01            // Received data available
+#define IER_THRE            0x02            // Transmit holding register empty
+
+#define IIR_FIFO_16550A     0xC0            // Both bits set: working 16-byte FIFO
+
+#define FCR_ENABLE_CLEAR    0xC7            // Enable, clear RX/TX, RX trigger at 14 bytes
+#define LCR_DLAB            0x80
+#define LCR_8N1             0x03
+#define MCR_DTR_RTS_OUT2    0x0B            // OUT2 gates the IRQ line on PC hardware
+#define MCR_LOOPBACK        0x1E
+
+#define LSR_DATA_READY      0x01
+#define LSR_THRE            0x20            // TX FIFO empty
+#define LSR_TEMT            0x40            // FIFO and shift register empty
+
+#define UART_CLOCK          115200          // Divisor base
+#define RING_MASK           (SERIAL_TX_RING_SIZE - 1)
+
+// Producers (writers, with interrupts off) move tx_head; the IRQ handler moves
+// tx_tail. Indices run freely and are masked on access.
+static char tx_ring[SERIAL_TX_RING_SIZE];
+static volatile uint32_t tx_head = 0;
+static volatile uint32_t tx_tail = 0;
+
+static int uart_present = 0;
+static int irq_driven = 0;
+static int tx_busy = 0;                     // THRE interrupt enabled, bytes in flight
+static uint32_t fifo_size = 1;
+static volatile uint32_t tx_bytes = 0;
+static volatile uint32_t tx_dropped = 0;
+static tasklet_t serial_tasklet;
+
+static inline uint8_t uart_in(uint8_t reg) {
+    return inb(SERIAL_COM1 + reg);
+}
+
+static inline void uart_out(uint8_t reg, uint8_t val) {
+    outb(SERIAL_COM1 + reg, val);
+}
+
+// Hand the UART up to one FIFO's worth of bytes. The caller has seen THRE,
+// so the whole FIFO is free and no per-byte status poll is needed.
+static void fill_fifo(void) {
+    uint32_t tail = tx_tail;
+    uint32_t n = tx_head - tail;
+    if (n > fifo_size) {
+        n = fifo_size;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        uart_out(UART_DATA, tx_ring[(tail + i) & RING_MASK]);
+    }
+    tx_tail = tail + n;
+    tx_bytes += n;
+}
+
+// Start or stop the THRE interrupt to match the ring (interrupts off)
+static void tx_kick(void) {
+    if (!tx_busy && tx_head != tx_tail) {
+        if (uart_in(UART_LSR) & LSR_THRE) {
+            fill_fifo();
+        }
+        tx_busy = 1;
+        uart_out(UART_IER, IER_RDA | IER_THRE);
+    }
+}
+
+// Transmit everything by polling (before interrupts, and for panics)
+static void tx_drain_polled(void) {
+    while (tx_head != tx_tail) {
+        while (!(uart_in(UART_LSR) & LSR_THRE)) {
+            asm volatile ("pause");
+        }
+        fill_fifo();
+    }
+}
+
+// Top half: masking the UART's interrupts drops the line; the tasklet
+// services the FIFOs with interrupts enabled and unmasks them again
+static void serial_handler(registers_t* regs) {
+    (void)regs;
+    uart_out(UART_IER, 0);
+    tasklet_schedule(&serial_tasklet);
+}
+
+static void serial_bh(void* arg) {
+    (void)arg;
+    // No console input yet: drain received bytes
+    uint8_t lsr;
+    while ((lsr = uart_in(UART_LSR)) & LSR_DATA_READY) {
+        uart_in(UART_DATA);
+    }
+
+    // While tx_busy is set tx_kick() leaves the FIFO alone, so this is the
+    // only consumer of the ring and needs no lock
+    if (tx_busy && (lsr & LSR_THRE) && tx_head != tx_tail) {
+        fill_fifo();
+    }
+
+    uint32_t flags = irq_save();
+    if (tx_busy && tx_head == tx_tail && (uart_in(UART_LSR) & LSR_THRE)) {
+        tx_busy = 0;
+    }
+    // THRE fires again once the FIFO has drained
+    uart_out(UART_IER, tx_busy ? IER_RDA | IER_THRE : IER_RDA);
+    irq_restore(flags);
+}
+
+int serial_init(void) {
+    uart_out(UART_IER, 0);
+    uart_out(UART_LCR, LCR_DLAB);
+    uart_out(UART_DATA, (UART_CLOCK / SERIAL_BAUD) & 0xFF);
+    uart_out(UART_IER, (UART_CLOCK / SERIAL_BAUD) >> 8);
+    uart_out(UART_LCR, LCR_8N1);
+    uart_out(UART_FCR, FCR_ENABLE_CLEAR);
+
+    // Loopback self-test: a missing UART reads back 0xFF
+    uart_out(UART_MCR, MCR_LOOPBACK);
+    uart_out(UART_DATA, 0xAE);
+    if (uart_in(UART_DATA) != 0xAE) {
+        return 0;
+    }
+    uart_out(UART_MCR, MCR_DTR_RTS_OUT2);
+
+    fifo_size = (uart_in(UART_IIR) & IIR_FIFO_16550A) == IIR_FIFO_16550A ? 16 : 1;
+    uart_present = 1;
+    return 1;
+}
+
+void serial_enable_irq(void) {
+    if (!uart_present) {
+        return;
+    }
+    uint32_t flags = irq_save();
+    tasklet_init(&serial_tasklet, serial_bh, NULL);
+    irq_register_handler(SERIAL_IRQ, serial_handler);
+    irq_driven = 1;
+    uart_out(UART_IER, IER_RDA);
+    tx_kick();
+    irq_restore(flags);
+}
+
+static inline int ring_put(char c) {
+    if (tx_head - tx_tail == SERIAL_TX_RING_SIZE) {
+        return 0;
+    }
+    tx_ring[tx_head & RING_MASK] = c;
+    tx_head++;
+    return 1;
+}
+
+size_t serial_write(const char* buf, size_t n) {
+    if (!uart_present) {
+        return 0;
+    }
+
+    uint32_t flags = irq_save();
+    size_t i;
+    for (i = 0; i < n; i++) {
+        if (buf[i] == '\n') {
+            // Keep "\r\n" together so a full ring never splits a line ending
+            if (SERIAL_TX_RING_SIZE - (tx_head - tx_tail) < 2) {
+                break;
+            }
+            ring_put('\r');
+        }
+        if (!ring_put(buf[i])) {
+            break;
+        }
+    }
+    tx_dropped += n - i;
+
+    if (irq_driven) {
+        tx_kick();
+    } else {
+        tx_drain_polled();
+    }
+    irq_restore(flags);
+    return i;
+}
+
+void serial_flush(void) {
+    if (!uart_present) {
+        return;
+    }
+    uint32_t flags = irq_save();
+    tx_drain_polled();
+    while (!(uart_in(UART_LSR) & LSR_TEMT)) {
+        asm volatile ("pause");
+    }
+    irq_restore(flags);
+}
+
+size_t serial_tx_space(void) {
+    return SERIAL_TX_RING_SIZE - (tx_head - tx_tail);
+}
+
+uint32_t serial_tx_bytes(void) {
+    return tx_bytes;
+}
+
+uint32_t serial_dropped(void) {
+    return tx_dropped;
+}
+
+#ifdef SERIAL_BENCH
+#include "libc/include/stdio.h"
+#include "drivers/timer.h"
+#include "task/sched.h"
+
+#define BENCH_NS            2000000000ull   // Logging phase length
+#define BENCH_BACKOFF_NS    1000000         // Sleep when the ring is full
+
+static inline uint32_t rdtsc_lo(void) {
+    uint32_t lo, hi;
+    asm volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return lo;
+}
+
+// Log lines as fast as the ring accepts them, then report the drain rate
+static void bench_thread(void* arg) {
+    (void)arg;
+    char line[96];
+    uint32_t lines = 0, enqueue_cycles = 0, backoffs = 0;
+    uint32_t bytes_start = tx_bytes;
+    uint32_t dropped_start = tx_dropped;
+    uint64_t start = timer_now_ns();
+    uint64_t now = start;
+
+    while (now - start < BENCH_NS) {
+        int len = ksnprintf(line, sizeof(line), "log %u: t=%llu ns, the quick brown fox jumps over the lazy dog\n",
+                            lines, now - start);
+        if (serial_tx_space() < (size_t)len + 1) {
+            backoffs++;
+            sleep_ns(BENCH_BACKOFF_NS);
+        } else {
+            uint32_t t0 = rdtsc_lo();
+            serial_write(line, len);
+            enqueue_cycles += rdtsc_lo() - t0;
+            lines++;
+        }
+        now = timer_now_ns();
+    }
+    while (tx_head != tx_tail) {
+        sleep_ns(BENCH_BACKOFF_NS);
+    }
+
+    uint32_t us = timer_ns_to_us(timer_now_ns() - start);
+    uint32_t ms = us / 1000 ? us / 1000 : 1;
+    uint32_t bytes = tx_bytes - bytes_start;
+    kprintf("serial: %u lines, %u bytes in %u ms: %u bytes/s (115200 8N1 wire rate %u bytes/s)\n",
+            lines, bytes, ms, bytes / ms * 1000, SERIAL_BAUD / 10);
+    kprintf("serial: %u cycles per enqueue, %u ring-full backoffs, %u dropped, FIFO %u bytes\n",
+            lines ? enqueue_cycles / lines : 0, backoffs, tx_dropped - dropped_start, fifo_size);
+}
+
+void serial_bench_start(void) {
+    thread_create("serialbench", bench_thread, NULL, SCHED_PRIO_DEFAULT);
+}
+#endif
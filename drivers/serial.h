@@ -0,0 +1,39 @@
+#ifndef DRIVERS_SERIAL_H
+#define DRIVERS_SERIAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SERIAL_COM1         0x3F8
+#define SERIAL_IRQ          4
+#define SERIAL_BAUD         115200
+#define SERIAL_TX_RING_SIZE 4096        // Power of two
+
+// Probe and program COM1 (115200 8N1, FIFOs on). Output is polled until
+// serial_enable_irq(). Returns 0 when there is no UART.
+int serial_init(void);
+
+// Switch to interrupt-driven transmit on IRQ4 (needs idt_install)
+void serial_enable_irq(void);
+
+// Queue bytes for transmission, translating '\n' to "\r\n". Never waits once
+// interrupts drive the UART: bytes that don't fit in the ring are dropped and
+// counted. Returns the number of input bytes queued.
+size_t serial_write(const char* buf, size_t n);
+
+// Busy-wait until the ring and the UART FIFO are empty (for panics)
+void serial_flush(void);
+
+// Free space in the transmit ring
+size_t serial_tx_space(void);
+
+// Bytes handed to the UART and bytes dropped because the ring was full
+uint32_t serial_tx_bytes(void);
+uint32_t serial_dropped(void);
+
+#ifdef SERIAL_BENCH
+// Sustained log throughput over the serial console (build with -DSERIAL_BENCH)
+void serial_bench_start(void);
+#endif
+
+#endif // DRIVERS_SERIAL_H
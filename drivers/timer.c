@@ -1,67 +1,389 @@
 #include "timer.h"
+#include "clocksource.h"
 #include "interrupt/irq.h"
 #include "interrupt/io.h"
+#include "interrupt/apic.h"
+#include "interrupt/irqflags.h"
+#include "task/ktimer.h"
+#include "task/sched.h"
+#include "trace/trace.h"
+#include <stddef.h>
 #include <stdint.h>
 
+// Tickless timekeeping.
+// The hardware is always armed in one-shot mode for the earliest pending
+// ktimer (at most TIMER_MAX_SLEEP_NS ahead). The clock is kept by reading
+// how far the down-counter got every time it is synced or re-armed, or,
+// with an invariant TSC, read from the clocksource instead.
+
 // PIT (Programmable Interval Timer) ports
 #define PIT_CMD_PORT    0x43
 #define PIT_CHANNEL0_DATA_PORT 0x40
+#define PIT_CHANNEL2_DATA_PORT 0x42
+#define PIT_GATE_PORT   0x61            // Bit 0: channel 2 gate, bit 5: channel 2 output
 
 // PIT base frequency (approx 1.193182 MHz)
 #define PIT_BASE_FREQUENCY 1193182
 
+#define PIT_CMD_CH0_ONESHOT 0x30        // Channel 0, lobyte/hibyte, mode 0 (interrupt on terminal count)
+#define PIT_CMD_CH2_ONESHOT 0xB0        // Channel 2, lobyte/hibyte, mode 0
+#define PIT_CMD_READBACK_CH0 0xC2       // Latch count and status of channel 0
+#define PIT_STATUS_OUT      0x80
+#define PIT_STATUS_NULL     0x40        // New count not loaded yet
+
+#define LAPIC_TIMER_VECTOR  32          // Delivered like IRQ0, so timer_handler gets it
+#define LAPIC_TIMER_DIV16   0x3
+#define CALIBRATE_NS        10000000    // 10 ms PIT window for the LAPIC calibration
+#define MIN_COUNT           16          // Shortest one-shot, in counter cycles
+
+static int use_lapic;
+static int use_tsc;                     // clock_ns follows ktime_get_ns()
+static int timer_ready;
+static int in_handler;                  // timer_handler re-arms once at the end
+
+// Counter cycles <-> ns as (x * mult) >> shift
+static uint32_t cyc2ns_mult, cyc2ns_shift;
+static uint32_t ns2cyc_mult, ns2cyc_shift;
+static uint32_t max_cycles;
+
+static uint64_t clock_ns;               // Time at the last sync
+static uint64_t clock_frac;             // Sub-ns remainder of the last conversion
+static uint32_t hw_remaining;           // Down-counter value at the last sync
+static int hw_expired;                  // PIT output was already high at the last sync
+static uint64_t armed_ns = KTIMER_NEVER;
+
 // Global tick counter
 static uint32_t timer_ticks = 0;
+static uint32_t tick_rem_ns;
+static uint32_t timer_irqs;
+static uint32_t latency_max_ns;         // Handler entry minus armed_ns, worst case
 
-// Initialize the PIT and register the IRQ handler
-void timer_init(uint32_t frequency) {
-    // Register the timer handler for IRQ 0
-    irq_register_handler(0, timer_handler);
+// 64 by 32 bit division without libgcc (init only)
+static uint64_t div_u64_u32(uint64_t n, uint32_t d) {
+    uint64_t q = 0, r = 0;
+    for (int i = 63; i >= 0; i--) {
+        r = (r << 1) | ((n >> i) & 1);
+        if (r >= d) {
+            r -= d;
+            q |= 1ull << i;
+        }
+    }
+    return q;
+}
 
-    // Calculate the divisor needed for the desired frequency
-    uint32_t divisor = PIT_BASE_FREQUENCY / frequency;
-    if (PIT_BASE_FREQUENCY % frequency > frequency / 2) {
-        divisor++; // Round up if closer to the next integer
+// Pick the largest shift whose multiplier for x * to / from still fits 32 bits
+static void calc_mult(uint32_t* mult, uint32_t* shift, uint32_t from, uint32_t to) {
+    uint32_t s = 32;
+    uint64_t m;
+    for (;; s--) {
+        m = div_u64_u32((uint64_t)to << s, from);
+        if ((m >> 32) == 0 || s == 0) {
+            break;
+        }
     }
+    *mult = (uint32_t)m;
+    *shift = s;
+}
 
-    // Clamp divisor to 16 bits
-    if (divisor > 0xFFFF) divisor = 0xFFFF; // Max divisor
-    if (divisor < 1) divisor = 1;         // Min divisor (though practically higher)
+// Read PIT channel 0; returns the count and whether OUT went high (terminal count reached)
+static uint32_t pit_read(int* expired, int* loaded) {
+    outb(PIT_CMD_PORT, PIT_CMD_READBACK_CH0);
+    uint8_t status = inb(PIT_CHANNEL0_DATA_PORT);
+    uint32_t count = inb(PIT_CHANNEL0_DATA_PORT);
+    count |= (uint32_t)inb(PIT_CHANNEL0_DATA_PORT) << 8;
+    *expired = (status & PIT_STATUS_OUT) != 0;
+    *loaded = (status & PIT_STATUS_NULL) == 0;
+    return count;
+}
+
+void timer_calc_mult(uint32_t* mult, uint32_t* shift, uint32_t from, uint32_t to) {
+    calc_mult(mult, shift, from, to);
+}
 
-    // Send the command byte to the PIT command port
-    // Channel 0, Low/High byte access mode, Square wave generator (mode 3)
-    outb(PIT_CMD_PORT, 0x36); // 0b00110110
+static void clock_advance(uint32_t delta) {
+    clock_ns += delta;
+    tick_rem_ns += delta;
+    if (tick_rem_ns >= TIMER_TICK_NS) {
+        timer_ticks += tick_rem_ns / TIMER_TICK_NS;
+        tick_rem_ns %= TIMER_TICK_NS;
+    }
+}
 
-    // Send the frequency divisor byte by byte (low byte first)
-    uint8_t low_byte = (uint8_t)(divisor & 0xFF);
-    uint8_t high_byte = (uint8_t)((divisor >> 8) & 0xFF);
-    outb(PIT_CHANNEL0_DATA_PORT, low_byte);
-    io_wait(); // Short delay after I/O
-    outb(PIT_CHANNEL0_DATA_PORT, high_byte);
-    io_wait();
+// Fold the cycles counted since the last sync into the clock. Interrupts must be disabled.
+static void clock_sync(void) {
+    uint32_t elapsed;
+    if (use_tsc) {
+        uint64_t now = ktime_get_ns();
+        // Syncs are at most TIMER_MAX_SLEEP_NS apart unless interrupts stayed off
+        while (now - clock_ns > TIMER_MAX_SLEEP_NS) {
+            clock_advance(TIMER_MAX_SLEEP_NS);
+        }
+        clock_advance((uint32_t)(now - clock_ns));
+        return;
+    }
+    if (use_lapic) {
+        uint32_t now = lapic_read(LAPIC_TIMER_CCR); // Stops at 0
+        elapsed = hw_remaining - now;
+        hw_remaining = now;
+    } else {
+        int expired, loaded;
+        uint32_t now = pit_read(&expired, &loaded);
+        if (!loaded) {
+            return;
+        }
+        // After terminal count the PIT keeps counting down from 0xFFFF
+        if (expired && !hw_expired) {
+            elapsed = hw_remaining + ((0x10000 - now) & 0xFFFF);
+        } else {
+            elapsed = (hw_remaining - now) & 0xFFFF;
+        }
+        hw_remaining = now;
+        hw_expired = expired;
+    }
+
+    uint64_t ns = (uint64_t)elapsed * cyc2ns_mult + clock_frac;
+    uint32_t delta = (uint32_t)(ns >> cyc2ns_shift);
+    clock_frac = ns & ((1ull << cyc2ns_shift) - 1);
+    clock_advance(delta);
+}
+
+// Arm the one-shot for 'deadline_ns'. Interrupts must be disabled.
+static void program(uint64_t deadline_ns) {
+    clock_sync();
+    uint64_t delta = deadline_ns > clock_ns ? deadline_ns - clock_ns : 0;
+    if (delta > TIMER_MAX_SLEEP_NS) {
+        delta = TIMER_MAX_SLEEP_NS;
+    }
+    uint32_t cycles = (uint32_t)(((uint64_t)(uint32_t)delta * ns2cyc_mult) >> ns2cyc_shift);
+    if (cycles > max_cycles) {
+        cycles = max_cycles;
+    }
+    if (cycles < MIN_COUNT) {
+        cycles = MIN_COUNT;
+    }
+
+    if (use_lapic) {
+        lapic_write(LAPIC_TIMER_ICR, cycles);
+    } else {
+        outb(PIT_CMD_PORT, PIT_CMD_CH0_ONESHOT);
+        outb(PIT_CHANNEL0_DATA_PORT, cycles & 0xFF);
+        outb(PIT_CHANNEL0_DATA_PORT, (cycles >> 8) & 0xFF);
+        hw_expired = 0;
+    }
+    hw_remaining = cycles;
+    armed_ns = clock_ns + delta;
+}
+
+// LAPIC timer cycles (divide by 16) per CALIBRATE_NS, measured with PIT channel 2
+static uint32_t lapic_calibrate(void) {
+    uint32_t pit_count = PIT_BASE_FREQUENCY / (1000000000 / CALIBRATE_NS);
+
+    outb(PIT_GATE_PORT, (inb(PIT_GATE_PORT) & ~0x02) | 0x01); // Gate on, speaker off
+    outb(PIT_CMD_PORT, PIT_CMD_CH2_ONESHOT);
+    lapic_write(LAPIC_TIMER_DCR, LAPIC_TIMER_DIV16);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED);
+
+    outb(PIT_CHANNEL2_DATA_PORT, pit_count & 0xFF);
+    outb(PIT_CHANNEL2_DATA_PORT, (pit_count >> 8) & 0xFF); // Counting starts here
+    lapic_write(LAPIC_TIMER_ICR, 0xFFFFFFFF);
+    while (!(inb(PIT_GATE_PORT) & 0x20)) {
+        // Wait for channel 2 terminal count
+    }
+    uint32_t cycles = 0xFFFFFFFF - lapic_read(LAPIC_TIMER_CCR);
+    lapic_write(LAPIC_TIMER_ICR, 0);
+    return cycles;
+}
+
+void timer_init(void) {
+    // Channel 0 to one-shot mode with no count loaded: OUT stays low, so the
+    // BIOS's 18.2 Hz square wave stops even when the LAPIC takes over
+    outb(PIT_CMD_PORT, PIT_CMD_CH0_ONESHOT);
+
+    uint32_t lapic_cycles = lapic_present() ? lapic_calibrate() : 0;
+    if (lapic_cycles > MIN_COUNT) {
+        use_lapic = 1;
+        calc_mult(&cyc2ns_mult, &cyc2ns_shift, lapic_cycles, CALIBRATE_NS);
+        calc_mult(&ns2cyc_mult, &ns2cyc_shift, CALIBRATE_NS, lapic_cycles);
+        max_cycles = 0xFFFFFFFF;
+        lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_VECTOR); // One-shot, unmasked
+    } else {
+        calc_mult(&cyc2ns_mult, &cyc2ns_shift, PIT_BASE_FREQUENCY, 1000000000);
+        calc_mult(&ns2cyc_mult, &ns2cyc_shift, 1000000000, PIT_BASE_FREQUENCY);
+        max_cycles = 0xFFFF;
+    }
+
+    // The TSC keeps the clock; the counter above only raises the interrupts
+    use_tsc = clocksource_tsc();
+    if (use_tsc) {
+        clock_ns = ktime_get_ns();
+    }
+    ktimer_init(clock_ns);
+    irq_register_handler(0, timer_handler);
 
-    // Optionally print the actual frequency achieved
-    // uint32_t actual_freq = PIT_BASE_FREQUENCY / divisor;
-    // print("PIT initialized to %u Hz (divisor: %u)\n", actual_freq, divisor);
+    uint32_t flags = irq_save();
+    timer_ready = 1;
+    program(KTIMER_NEVER);
+    irq_restore(flags);
 }
 
 // The actual timer interrupt handler (called by IRQ0 stub)
 void timer_handler(registers_t* regs) {
-    timer_ticks++;
+    (void)regs;
+    timer_irqs++;
 
-    // For debugging/demonstration: Update a character on screen every second (approx)
-    // if (timer_ticks % 100 == 0) { // Assuming 100 Hz
-    //    // Example: toggle a character in the corner
-    //    volatile uint16_t* video_memory = (volatile uint16_t*)0xB8000;
-    //    static uint8_t toggle = 0;
-    //    video_memory[79] = (0x0F << 8) | (toggle ? '*' : '+'); // White on Black
-    //    toggle = !toggle;
-    // }
+    clock_sync();
+    uint32_t late = clock_ns > armed_ns ? (uint32_t)(clock_ns - armed_ns) : 0;
+    if (late > latency_max_ns) {
+        latency_max_ns = late;
+    }
+    trace_event(TRACE_TIMER, 0, late);
+    armed_ns = KTIMER_NEVER;
+    in_handler = 1;
+    ktimer_run(clock_ns);               // Sleeper wakeups, time slices; the switch happens after EOI
+    in_handler = 0;
+    program(ktimer_next_deadline());
+}
+
+void timer_request_deadline(uint64_t deadline_ns) {
+    uint32_t flags = irq_save();
+    if (timer_ready && !in_handler && deadline_ns < armed_ns) {
+        program(deadline_ns);
+    }
+    irq_restore(flags);
+}
 
-    // TODO: Implement task switching/scheduling logic here
+uint64_t timer_now_ns(void) {
+    if (use_tsc) {
+        return ktime_get_ns();          // Lock-free, and no counter readback
+    }
+    uint32_t flags = irq_save();
+    if (timer_ready) {
+        clock_sync();
+    }
+    uint64_t now = clock_ns;
+    irq_restore(flags);
+    return now;
+}
+
+uint64_t timer_last_ns(void) {
+    // Written only on the boot CPU; re-read until both halves agree
+    volatile uint64_t* clock = &clock_ns;
+    uint64_t now;
+    do {
+        now = *clock;
+    } while (now != *clock);
+    return now;
 }
 
 // Optional: Function to get current tick count
-uint32_t get_timer_ticks() {
-    return timer_ticks;
+uint32_t get_timer_ticks(void) {
+    uint32_t flags = irq_save();
+    if (timer_ready) {
+        clock_sync();
+    }
+    uint32_t ticks = timer_ticks;
+    irq_restore(flags);
+    return ticks;
+}
+
+const char* timer_source_name(void) {
+    return use_lapic ? "LAPIC one-shot" : "PIT one-shot";
+}
+
+uint32_t timer_wakeups(void) {
+    return timer_irqs;
+}
+
+uint32_t timer_latency_max_ns(void) {
+    return latency_max_ns;
+}
+
+void timer_latency_reset(void) {
+    latency_max_ns = 0;
+}
+
+#ifdef TIMER_BENCH
+extern void term_print(const char* str);    // from drivers/vga.c
+extern void term_print_dec(uint32_t num);
+
+#define BENCH_IDLE_SECONDS  5
+#define BENCH_SLEEPS        100
+#define BENCH_TIMERS        1000
+
+static const uint32_t bench_sleep_ns[] = { 50000, 100000, 500000, 2000000 };
+static ktimer_t bench_timers[BENCH_TIMERS];
+
+static inline uint32_t rdtsc_lo(void) {
+    uint32_t lo, hi;
+    asm volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return lo;
+}
+
+static void bench_nop(void* arg) {
+    (void)arg;
+}
+
+static void bench_thread(void* arg) {
+    (void)arg;
+
+    // Idle wakeups: nothing but this sleep is pending
+    uint32_t wakeups = timer_irqs;
+    thread_sleep(BENCH_IDLE_SECONDS * TIMER_HZ);
+    wakeups = timer_irqs - wakeups;
+    term_print("timer: ");
+    term_print(timer_source_name());
+    term_print(", idle wakeups/s: ");
+    term_print_dec(wakeups / BENCH_IDLE_SECONDS);
+    term_print(" (periodic PIT: ");
+    term_print_dec(TIMER_HZ);
+    term_print(")\n");
+
+    // How late sleep_ns() returns
+    for (uint32_t i = 0; i < sizeof(bench_sleep_ns) / sizeof(bench_sleep_ns[0]); i++) {
+        uint32_t total = 0, worst = 0;
+        for (int n = 0; n < BENCH_SLEEPS; n++) {
+            uint64_t start = timer_now_ns();
+            sleep_ns(bench_sleep_ns[i]);
+            uint32_t late = (uint32_t)(timer_now_ns() - start) - bench_sleep_ns[i];
+            total += late;
+            if (late > worst) worst = late;
+        }
+        term_print("timer: sleep_ns(");
+        term_print_dec(bench_sleep_ns[i]);
+        term_print(") late avg ");
+        term_print_dec(total / BENCH_SLEEPS);
+        term_print(" ns, max ");
+        term_print_dec(worst);
+        term_print(" ns\n");
+    }
+
+    // Wheel add + cancel, spread over all levels
+    uint64_t now = timer_now_ns();
+    uint32_t start = rdtsc_lo();
+    for (int i = 0; i < BENCH_TIMERS; i++) {
+        ktimer_setup(&bench_timers[i], bench_nop, NULL);
+        add_timer(&bench_timers[i], now + TIMER_MAX_SLEEP_NS + ((uint64_t)i << 24));
+    }
+    for (int i = 0; i < BENCH_TIMERS; i++) {
+        del_timer(&bench_timers[i]);
+    }
+    term_print("timer: add_timer + del_timer ");
+    term_print_dec((rdtsc_lo() - start) / BENCH_TIMERS);
+    term_print(" cycles\n");
+
+    // Reading the clock: TSC multiply-shift, or a counter readback under irq_save
+    start = rdtsc_lo();
+    for (int i = 0; i < BENCH_TIMERS; i++) {
+        timer_now_ns();
+    }
+    term_print("timer: timer_now_ns() ");
+    term_print_dec((rdtsc_lo() - start) / BENCH_TIMERS);
+    term_print(" cycles (");
+    term_print(clocksource_name());
+    term_print(")\n");
+}
+
+void timer_bench_start(void) {
+    thread_create("tbench", bench_thread, NULL, SCHED_PRIO_MAX);
 }
+#endif
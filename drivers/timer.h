@@ -1,12 +1,60 @@
 #ifndef DRIVERS_TIMER_H
 #define DRIVERS_TIMER_H
 
+#include <stdint.h>
 #include "interrupt/isr.h" // For registers_t
 
-// Initialize the PIT and register the IRQ handler
-void timer_init(uint32_t frequency);
+// Rate of get_timer_ticks(). Bookkeeping only: there is no periodic interrupt.
+#define TIMER_HZ            100
+#define TIMER_TICK_NS       (1000000000 / TIMER_HZ)
+
+// Longest one-shot period; an idle system wakes up at most this often
+#define TIMER_MAX_SLEEP_NS  1000000000
+
+// Start the one-shot clock event device: the local APIC timer (calibrated
+// against the PIT) when the APIC is active, PIT mode 0 otherwise.
+void timer_init(void);
 
 // The actual timer interrupt handler (called by IRQ0 stub)
 void timer_handler(registers_t* regs);
 
+// Nanoseconds since boot: ktime_get_ns() when the TSC is the clocksource,
+// otherwise counted from timer_init by reading back the one-shot counter
+uint64_t timer_now_ns(void);
+
+// ns / 1000 as a multiply-shift (no 64-bit division in the kernel); exact
+// to within 1 us for spans up to the 71 minutes a uint32_t of us can hold
+static inline uint32_t timer_ns_to_us(uint64_t ns) {
+    return (uint32_t)((ns * 4294967ull) >> 32);
+}
+
+// The clock as of its last sync, without reading the counter. Lags
+// timer_now_ns() by up to TIMER_MAX_SLEEP_NS, but is safe on any CPU: the
+// counter clock_sync() reads is the calling CPU's LAPIC timer.
+uint64_t timer_last_ns(void);
+
+// Number of TIMER_HZ ticks since timer_init
+uint32_t get_timer_ticks(void);
+
+// Make sure the hardware fires no later than 'deadline_ns' (used by add_timer)
+void timer_request_deadline(uint64_t deadline_ns);
+
+// Worst lateness of a timer interrupt (handler entry minus the programmed
+// deadline) since the last reset
+uint32_t timer_latency_max_ns(void);
+void timer_latency_reset(void);
+
+// Name of the clock event device and the number of timer interrupts taken so far
+const char* timer_source_name(void);
+uint32_t timer_wakeups(void);
+
+// x * to / from as (x * mult) >> shift with the largest shift that fits.
+// Init only: the division is bit-serial.
+void timer_calc_mult(uint32_t* mult, uint32_t* shift, uint32_t from, uint32_t to);
+
+#ifdef TIMER_BENCH
+// Idle wakeups per second, sleep_ns() precision and wheel add/cancel cost (build with -DTIMER_BENCH)
+void timer_bench_start(void);
+#endif
+
 #endif // DRIVERS_TIMER_H
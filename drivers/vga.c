@@ -0,0 +1,360 @@
+#include "vga.h"
+#include "drivers/timer.h"
+#include "interrupt/irqflags.h"
+#include "libc/include/string.h"
+#include "task/ktimer.h"
+#include "trace/trace.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Terminal history, in lines (power of two); the screen shows the newest VGA_HEIGHT
+#define TERM_HISTORY_LINES  256
+#define TERM_HISTORY_MASK   (TERM_HISTORY_LINES - 1)
+#define TERM_FLUSH_NS       10000000    // Deferred flush delay once the timer runs (10 ms)
+
+// Global variables
+static volatile uint16_t* const vga_buffer = (uint16_t*)VGA_MEMORY;
+static size_t term_row = 0;
+static size_t term_col = 0;
+static uint8_t term_color;
+
+// Shadow of the screen plus scrollback: a ring of lines. Screen row y is
+// history line (term_top + y); scrolling just advances term_top.
+static uint16_t term_history[TERM_HISTORY_LINES][VGA_WIDTH];
+static uint32_t term_top = 0;
+static uint32_t term_lines = VGA_HEIGHT;    // History lines holding output (up to TERM_HISTORY_LINES)
+static uint32_t term_view = 0;              // Lines scrolled back from the bottom
+
+// Screen rows [dirty_lo, dirty_hi) differ from VGA memory
+static uint32_t dirty_lo = VGA_HEIGHT;
+static uint32_t dirty_hi = 0;
+
+// Once the timer is up, output is flushed by a one-shot ktimer instead of at every newline
+static int term_deferred = 0;
+static ktimer_t term_flush_timer;
+
+// Create a VGA entry from character and color
+static inline uint16_t vga_entry(char c, uint8_t color) {
+    return (uint16_t)c | ((uint16_t)color << 8);
+}
+
+// Create a color attribute from foreground and background
+static inline uint8_t vga_color(enum vga_color fg, enum vga_color bg) {
+    return fg | (bg << 4);
+}
+
+static inline uint16_t* term_line(uint32_t row) {
+    return term_history[(term_top + row) & TERM_HISTORY_MASK];
+}
+
+static void term_clear_line(uint16_t* line) {
+    for (size_t x = 0; x < VGA_WIDTH; x++) {
+        line[x] = vga_entry(' ', term_color);
+    }
+}
+
+static inline void term_mark_dirty(uint32_t lo, uint32_t hi) {
+    if (lo < dirty_lo) {
+        dirty_lo = lo;
+    }
+    if (hi > dirty_hi) {
+        dirty_hi = hi;
+    }
+}
+
+// Copy the dirty rows of the shadow buffer to VGA memory (interrupts off)
+static void term_flush_locked(void) {
+    for (uint32_t y = dirty_lo; y < dirty_hi; y++) {
+        memcpy((void*)&vga_buffer[y * VGA_WIDTH], term_line(y - term_view), VGA_WIDTH * sizeof(uint16_t));
+    }
+    dirty_lo = VGA_HEIGHT;
+    dirty_hi = 0;
+}
+
+void term_flush(void) {
+    uint32_t flags = irq_save();
+    term_flush_locked();
+    irq_restore(flags);
+}
+
+static void term_flush_expired(void* arg) {
+    (void)arg;
+    term_flush_locked();
+}
+
+// Batch output: at each newline during early boot, a little later once the timer runs
+static void term_schedule_flush(char c) {
+    if (!term_deferred) {
+        if (c == '\n') {
+            term_flush_locked();
+        }
+    } else if (dirty_hi != 0 && !timer_pending(&term_flush_timer)) {
+        add_timer(&term_flush_timer, timer_now_ns() + TERM_FLUSH_NS);
+    }
+}
+
+// Initialize terminal
+void term_init(void) {
+    term_row = 0;
+    term_col = 0;
+    term_color = vga_color(WHITE, BLACK);
+    term_top = 0;
+    term_lines = VGA_HEIGHT;
+    term_view = 0;
+    ktimer_setup(&term_flush_timer, term_flush_expired, NULL);
+
+    // Clear screen
+    for (size_t y = 0; y < VGA_HEIGHT; y++) {
+        term_clear_line(term_line(y));
+    }
+    term_mark_dirty(0, VGA_HEIGHT);
+    term_flush();
+}
+
+// Switch from flushing at every newline to timer-batched flushes (needs timer_init)
+void term_enable_deferred_flush(void) {
+    term_deferred = 1;
+}
+
+// Set terminal color
+void term_setcolor(enum vga_color fg, enum vga_color bg) {
+    term_color = vga_color(fg, bg);
+}
+
+// Scroll the screen up one line: O(1) in the shadow, VGA is redrawn on flush
+static void term_scroll(void) {
+    trace_event(TRACE_SCROLL, 0, 0);
+    term_top++;
+    if (term_lines < TERM_HISTORY_LINES) {
+        term_lines++;
+    }
+    term_clear_line(term_line(VGA_HEIGHT - 1));
+    term_mark_dirty(0, VGA_HEIGHT);
+    term_row = VGA_HEIGHT - 1;
+}
+
+// Move the view 'delta' lines back into history (negative: towards the newest output)
+void term_scrollback(int delta) {
+    uint32_t flags = irq_save();
+    int32_t view = (int32_t)term_view + delta;
+    int32_t max = (int32_t)(term_lines - VGA_HEIGHT);
+    if (view < 0) {
+        view = 0;
+    }
+    if (view > max) {
+        view = max;
+    }
+    if ((uint32_t)view != term_view) {
+        term_view = view;
+        term_mark_dirty(0, VGA_HEIGHT);
+        term_flush_locked();
+    }
+    irq_restore(flags);
+}
+
+// Put a character into the shadow buffer (interrupts off)
+static void term_putchar_locked(char c) {
+    // New output snaps a scrolled-back view to the bottom
+    if (term_view != 0) {
+        term_view = 0;
+        term_mark_dirty(0, VGA_HEIGHT);
+    }
+
+    switch (c) {
+        case '\n':
+            term_col = 0;
+            term_row++;
+            break;
+        case '\b':
+            if (term_col > 0) {
+                term_col--;
+                term_line(term_row)[term_col] = vga_entry(' ', term_color);
+                term_mark_dirty(term_row, term_row + 1);
+            }
+            break;
+
+        /* TODO: add cases
+            case '\t':  // tab (advance to next 8‑column boundary)
+            case '\r':  // carriage return
+            case 0x1B: // ESC sequences
+        */
+        default:
+            term_line(term_row)[term_col] = vga_entry(c, term_color);
+            term_mark_dirty(term_row, term_row + 1);
+            term_col++;
+            break;
+    }
+
+    if (term_col >= VGA_WIDTH) {
+        term_col = 0;
+        term_row++;
+    }
+    if (term_row >= VGA_HEIGHT) {
+        term_scroll();
+    }
+    term_schedule_flush(c);
+}
+
+// Put a character on screen
+void term_putchar(char c) {
+    uint32_t flags = irq_save();
+    term_putchar_locked(c);
+    irq_restore(flags);
+}
+
+void term_putc(char c) {
+    term_putchar(c);
+}
+
+void term_print(const char* str) {
+    uint32_t flags = irq_save();
+    for (size_t i = 0; str[i] != '\0'; i++) {
+        term_putchar_locked(str[i]);
+    }
+    irq_restore(flags);
+}
+
+// Print an unsigned number in decimal
+void term_print_dec(uint32_t num) {
+    char buf[11];
+    int i = 0;
+    do {
+        buf[i++] = '0' + (num % 10);
+        num /= 10;
+    } while (num != 0);
+    while (i > 0) {
+        term_putchar(buf[--i]);
+    }
+}
+
+// Print an unsigned number as 0x-prefixed hex
+void term_print_hex(uint32_t num) {
+    term_print("0x");
+    for (int shift = 28; shift >= 0; shift -= 4) {
+        term_putchar("0123456789ABCDEF"[(num >> shift) & 0xF]);
+    }
+}
+
+#ifdef TERM_BENCH
+// Print 100k lines through the old write-through terminal and the shadow buffer
+
+#define BENCH_LINES         100000
+
+static size_t bench_row = 0;
+static size_t bench_col = 0;
+
+// The terminal as it was: every cell straight to VGA memory, scrolling by
+// reading back and rewriting the whole screen
+static void bench_putchar_direct(char c) {
+    if (c == '\n') {
+        bench_col = 0;
+        bench_row++;
+    } else {
+        vga_buffer[bench_row * VGA_WIDTH + bench_col] = vga_entry(c, term_color);
+        bench_col++;
+    }
+    if (bench_col >= VGA_WIDTH) {
+        bench_col = 0;
+        bench_row++;
+    }
+    if (bench_row >= VGA_HEIGHT) {
+        for (size_t i = VGA_WIDTH; i < VGA_WIDTH * VGA_HEIGHT; i++) {
+            vga_buffer[i - VGA_WIDTH] = vga_buffer[i];
+        }
+        for (size_t x = 0; x < VGA_WIDTH; x++) {
+            vga_buffer[(VGA_HEIGHT - 1) * VGA_WIDTH + x] = vga_entry(' ', term_color);
+        }
+        bench_row = VGA_HEIGHT - 1;
+    }
+}
+
+// "line <n>: the quick brown fox jumps over the lazy dog\n"
+static size_t bench_format(char* buf, uint32_t n) {
+    static const char text[] = ": the quick brown fox jumps over the lazy dog\n";
+    char digits[11];
+    size_t len = 0, d = 0;
+    memcpy(buf, "line ", 5);
+    len = 5;
+    do {
+        digits[d++] = '0' + (n % 10);
+        n /= 10;
+    } while (n != 0);
+    while (d > 0) {
+        buf[len++] = digits[--d];
+    }
+    memcpy(buf + len, text, sizeof(text));
+    return len + sizeof(text) - 1;
+}
+
+// Milliseconds since 'start'
+static uint32_t bench_ms_since(uint64_t start) {
+    uint32_t ms = timer_ns_to_us(timer_now_ns() - start) / 1000;
+    return ms ? ms : 1;
+}
+
+void term_bench(void) {
+    char line[64];
+    uint32_t chars = 0;
+
+    uint64_t start = timer_now_ns();
+    for (uint32_t i = 0; i < BENCH_LINES; i++) {
+        size_t len = bench_format(line, i);
+        for (size_t j = 0; j < len; j++) {
+            bench_putchar_direct(line[j]);
+        }
+        chars += len;
+    }
+    uint32_t direct_ms = bench_ms_since(start);
+
+    start = timer_now_ns();
+    for (uint32_t i = 0; i < BENCH_LINES; i++) {
+        bench_format(line, i);
+        term_print(line);
+    }
+    term_flush();
+    uint32_t shadow_ms = bench_ms_since(start);
+
+    term_print("term: ");
+    term_print_dec(BENCH_LINES);
+    term_print(" lines, ");
+    term_print_dec(chars);
+    term_print(" chars\n");
+    term_print("term: write-through ");
+    term_print_dec(direct_ms);
+    term_print(" ms, ");
+    term_print_dec(chars / direct_ms * 1000);
+    term_print(" chars/s\n");
+    term_print("term: shadow buffer ");
+    term_print_dec(shadow_ms);
+    term_print(" ms, ");
+    term_print_dec(chars / shadow_ms * 1000);
+    term_print(" chars/s\n");
+}
+#endif
+
+#ifdef BENCH_MODE
+#include "bench/bench.h"
+
+static void term_line_bench(void* arg) {
+    (void)arg;
+    term_print("benchmark line: the quick brown fox jumps over the lazy dog 0123456789 abcdef\n");
+}
+
+static void term_putchar_bench(void* arg) {
+    (void)arg;
+    term_putchar('x');
+}
+
+// Copy the whole shadow screen to VGA memory
+static void term_redraw_bench(void* arg) {
+    (void)arg;
+    uint32_t flags = irq_save();
+    term_mark_dirty(0, VGA_HEIGHT);
+    term_flush_locked();
+    irq_restore(flags);
+}
+
+BENCH_REGISTER(term_print_line, .fn = term_line_bench);
+BENCH_REGISTER(term_putchar, .fn = term_putchar_bench);
+BENCH_REGISTER(term_redraw, .fn = term_redraw_bench, .repeats = 128);
+#endif
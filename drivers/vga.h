@@ -0,0 +1,62 @@
+#ifndef DRIVERS_VGA_H
+#define DRIVERS_VGA_H
+
+#include <stdint.h>
+
+// Text-mode terminal: a shadow buffer with scrollback, copied to VGA memory
+// in batches (see drivers/vga.c)
+
+// VGA constants
+#ifndef VGA_MEMORY
+#define VGA_MEMORY 0xC00B8000    // 0xB8000 in the direct map; host tests point this at a mock buffer
+#endif
+#define VGA_WIDTH 80
+#define VGA_HEIGHT 25
+
+// VGA colors
+enum vga_color {
+    BLACK = 0,
+    BLUE = 1,
+    GREEN = 2,
+    CYAN = 3,
+    RED = 4,
+    MAGENTA = 5,
+    BROWN = 6,
+    LIGHT_GRAY = 7,
+    DARK_GRAY = 8,
+    LIGHT_BLUE = 9,
+    LIGHT_GREEN = 10,
+    LIGHT_CYAN = 11,
+    LIGHT_RED = 12,
+    LIGHT_MAGENTA = 13,
+    YELLOW = 14,
+    WHITE = 15
+};
+
+// Clear the screen and reset the cursor and history
+void term_init(void);
+
+// Switch from flushing at every newline to timer-batched flushes (needs timer_init)
+void term_enable_deferred_flush(void);
+
+void term_setcolor(enum vga_color fg, enum vga_color bg);
+
+// Move the view 'delta' lines back into history (negative: towards the newest output)
+void term_scrollback(int delta);
+
+// Output goes to the shadow buffer; VGA memory is updated on the next flush
+void term_putchar(char c);
+void term_putc(char c);
+void term_print(const char* str);
+void term_print_dec(uint32_t num);
+void term_print_hex(uint32_t num);
+
+// Copy the changed rows to VGA memory now
+void term_flush(void);
+
+#ifdef TERM_BENCH
+// Write-through terminal against the shadow buffer, 100k lines (build with -DTERM_BENCH)
+void term_bench(void);
+#endif
+
+#endif // DRIVERS_VGA_H
@@ -0,0 +1,301 @@
+#include "initrd.h"
+#include "memory/kmalloc.h"
+#include "memory/paging.h"
+#include "drivers/timer.h"
+#include "libc/include/stdio.h"
+#include "libc/include/string.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// cpio "newc" archive, as written by `cpio -o -H newc`:
+//   110-byte ASCII header: "070701" and 13 fields of 8 hex digits
+//   name (namesize bytes, NUL included), padded so header + name is 4-aligned
+//   data (filesize bytes), padded to 4
+// The last entry is named "TRAILER!!!".
+//
+// The index is built in two passes over the archive: count the entries,
+// then fill one array with pointers into it. 'slots' holds index + 1 of
+// each entry (0 = empty), linearly probed from the path's hash.
+
+#define CPIO_MAGIC          "070701"
+#define CPIO_HEADER_SIZE    110
+#define CPIO_MODE           14      // Field offsets in the header
+#define CPIO_FILESIZE       54
+#define CPIO_NAMESIZE       94
+#define CPIO_TRAILER        "TRAILER!!!"
+
+#define FNV_OFFSET          2166136261u
+#define FNV_PRIME           16777619u
+
+static const uint8_t* archive;
+static uint32_t archive_size;
+static initrd_file_t* files;
+static uint32_t file_count;
+static uint32_t* slots;
+static uint32_t slot_mask;
+static initrd_info_t info;
+
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    asm volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline uint32_t align4(uint32_t n) {
+    return (n + 3) & ~3u;
+}
+
+// One 8-digit hex field; returns 0 on a bad digit
+static int parse_hex(const uint8_t* p, uint32_t* out) {
+    uint32_t v = 0;
+    for (int i = 0; i < 8; i++) {
+        uint8_t c = p[i];
+        if (c >= '0' && c <= '9') {
+            c -= '0';
+        } else if (c >= 'a' && c <= 'f') {
+            c -= 'a' - 10;
+        } else if (c >= 'A' && c <= 'F') {
+            c -= 'A' - 10;
+        } else {
+            return 0;
+        }
+        v = (v << 4) | c;
+    }
+    *out = v;
+    return 1;
+}
+
+// Path without "/" or "./" in front
+static const char* skip_root(const char* path) {
+    if (path[0] == '.' && path[1] == '/') {
+        path += 2;
+    }
+    while (*path == '/') {
+        path++;
+    }
+    return path;
+}
+
+static uint32_t path_hash(const char* path, uint32_t* len) {
+    uint32_t h = FNV_OFFSET;
+    const char* p = path;
+    while (*p != '\0') {
+        h = (h ^ (uint8_t)*p++) * FNV_PRIME;
+    }
+    *len = p - path;
+    return h;
+}
+
+// Walk the archive once. With 'out', store every entry (there is room for
+// all of them, counted by the previous walk). Archives appended after a
+// trailer (and cpio's zero padding) are walked too. Returns the entry count,
+// or -1 if the archive is malformed.
+static int walk(initrd_file_t* out) {
+    uint32_t pos = 0;
+    int count = 0;
+    while (pos + CPIO_HEADER_SIZE <= archive_size) {
+        const uint8_t* h = archive + pos;
+        uint32_t mode, size, namesize;
+        if (memcmp(h, CPIO_MAGIC, 6) != 0 || !parse_hex(h + CPIO_MODE, &mode) ||
+            !parse_hex(h + CPIO_FILESIZE, &size) || !parse_hex(h + CPIO_NAMESIZE, &namesize) ||
+            namesize == 0) {
+            return -1;
+        }
+        // Checked before any sum with namesize, which could wrap
+        if (namesize > archive_size - pos - CPIO_HEADER_SIZE) {
+            return -1;
+        }
+        const char* name = (const char*)h + CPIO_HEADER_SIZE;
+        uint32_t data_pos = align4(pos + CPIO_HEADER_SIZE + namesize);
+        if (data_pos > archive_size || size > archive_size - data_pos ||
+            name[namesize - 1] != '\0') {
+            return -1;
+        }
+        if (strcmp(name, CPIO_TRAILER) == 0) {
+            // Anything but another archive after the padding ends the walk
+            pos = align4(data_pos + size);
+            while (pos + 4 <= archive_size && *(const uint32_t*)(archive + pos) == 0) {
+                pos += 4;
+            }
+            if (pos + CPIO_HEADER_SIZE > archive_size || memcmp(archive + pos, CPIO_MAGIC, 6) != 0) {
+                return count;
+            }
+            continue;
+        }
+        const char* path = skip_root(name);
+        if (*path != '\0' && strcmp(path, ".") != 0) {      // The root itself is not an entry
+            if (out != NULL) {
+                initrd_file_t* f = &out[count];
+                f->path = path;
+                f->data = archive + data_pos;
+                f->size = size;
+                f->mode = mode;
+            }
+            count++;
+        }
+        pos = align4(data_pos + size);
+    }
+    return -1;                                              // No trailer
+}
+
+// Slot of 'path' (or of the empty slot where it would go) and its probe length
+static uint32_t find_slot(const char* path, uint32_t hash, uint32_t* probes) {
+    uint32_t i = hash & slot_mask;
+    uint32_t n = 1;
+    while (slots[i] != 0) {
+        const initrd_file_t* f = &files[slots[i] - 1];
+        if (f->hash == hash && strcmp(f->path, path) == 0) {
+            break;
+        }
+        i = (i + 1) & slot_mask;
+        n++;
+    }
+    *probes = n;
+    return i;
+}
+
+uint32_t initrd_init(const boot_info_t* boot_info) {
+    if (boot_info == NULL || boot_info->initrd_addr == 0 || boot_info->initrd_size == 0) {
+        return 0;
+    }
+    uint64_t start_ns = timer_now_ns();
+    uint64_t start = rdtsc();
+
+    // Loaded at a fixed physical address, reached through the direct map
+    archive = phys_to_virt(boot_info->initrd_addr);
+    archive_size = boot_info->initrd_size;
+
+    int count = walk(NULL);
+    if (count <= 0) {
+        if (count < 0) {
+            kprintf("initrd: malformed archive at %p\n", (void*)boot_info->initrd_addr);
+        }
+        return 0;
+    }
+    uint32_t nslots = 1;
+    while (nslots < 2 * (uint32_t)count) {
+        nslots <<= 1;
+    }
+    files = kmalloc(count * sizeof(initrd_file_t));
+    slots = kzalloc(nslots * sizeof(uint32_t));
+    if (files == NULL || slots == NULL) {
+        kfree(files);
+        kfree(slots);
+        files = NULL;
+        slots = NULL;
+        kprintf("initrd: no memory for %u entries\n", count);
+        return 0;
+    }
+    slot_mask = nslots - 1;
+    walk(files);
+
+    // Later duplicates (an archive appended to another) replace earlier entries
+    uint32_t max_probe = 0;
+    for (uint32_t i = 0; i < (uint32_t)count; i++) {
+        uint32_t len, probes;
+        files[i].hash = path_hash(files[i].path, &len);
+        uint32_t slot = find_slot(files[i].path, files[i].hash, &probes);
+        slots[slot] = i + 1;
+        if (probes > max_probe) {
+            max_probe = probes;
+        }
+    }
+    file_count = count;
+
+    info.files = count;
+    info.bytes = archive_size;
+    info.slots = nslots;
+    info.max_probe = max_probe;
+    info.build_cycles = rdtsc() - start;
+    info.build_ns = timer_now_ns() - start_ns;
+    return count;
+}
+
+const initrd_file_t* initrd_lookup(const char* path) {
+    if (file_count == 0 || path == NULL) {
+        return NULL;
+    }
+    path = skip_root(path);
+    uint32_t len, probes;
+    uint32_t slot = find_slot(path, path_hash(path, &len), &probes);
+    return slots[slot] != 0 ? &files[slots[slot] - 1] : NULL;
+}
+
+uint32_t initrd_count(void) {
+    return file_count;
+}
+
+const initrd_file_t* initrd_file(uint32_t index) {
+    return index < file_count ? &files[index] : NULL;
+}
+
+void initrd_get_info(initrd_info_t* out) {
+    *out = info;
+}
+
+#ifdef INITRD_BENCH
+#define BENCH_SCAN_SAMPLE   64              // Paths looked up by linear scan
+#define BENCH_PATH_MAX      128
+
+// Baseline: compare every path in archive order
+static const initrd_file_t* scan_lookup(const char* path) {
+    path = skip_root(path);
+    for (uint32_t i = 0; i < file_count; i++) {
+        if (strcmp(files[i].path, path) == 0) {
+            return &files[i];
+        }
+    }
+    return NULL;
+}
+
+void initrd_bench(void) {
+    if (file_count == 0) {
+        kprintf("initrd bench: no initrd\n");
+        return;
+    }
+    uint32_t hit_total = 0, miss_total = 0, scan_total = 0;   // No 64-bit division here
+    uint32_t hit_min = UINT32_MAX, errors = 0;
+    char miss[BENCH_PATH_MAX];
+
+    for (uint32_t i = 0; i < file_count; i++) {
+        const char* path = files[i].path;
+        uint64_t t0 = rdtsc();
+        const initrd_file_t* f = initrd_lookup(path);
+        uint32_t dt = rdtsc() - t0;
+        hit_total += dt;
+        if (dt < hit_min) {
+            hit_min = dt;
+        }
+        // A later duplicate may own the path; it must still resolve to that path
+        if (f == NULL || strcmp(f->path, path) != 0) {
+            errors++;
+        }
+
+        ksnprintf(miss, sizeof(miss), "%sx", path);
+        t0 = rdtsc();
+        f = initrd_lookup(miss);
+        miss_total += rdtsc() - t0;
+        if (f != NULL && strcmp(f->path, miss) != 0) {
+            errors++;
+        }
+    }
+
+    // Spread the scan sample over the archive, so the average is about half of it
+    uint32_t sample = file_count < BENCH_SCAN_SAMPLE ? file_count : BENCH_SCAN_SAMPLE;
+    for (uint32_t i = 0; i < sample; i++) {
+        const char* path = files[i * file_count / sample].path;
+        uint64_t t0 = rdtsc();
+        if (scan_lookup(path) == NULL) {
+            errors++;
+        }
+        scan_total += rdtsc() - t0;
+    }
+
+    kprintf("initrd bench: %u entries, %u slots, longest probe %u, index built in %u cycles\n",
+            file_count, info.slots, info.max_probe, (uint32_t)info.build_cycles);
+    kprintf("initrd bench: lookup hit avg %u min %u cycles, miss avg %u cycles, "
+            "linear scan avg %u cycles (%u paths)%s\n",
+            hit_total / file_count, hit_min, miss_total / file_count,
+            scan_total / sample, sample, errors ? ", LOOKUP ERRORS" : "");
+}
+#endif
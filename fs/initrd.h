@@ -0,0 +1,57 @@
+#ifndef FS_INITRD_H
+#define FS_INITRD_H
+
+#include <stdint.h>
+#include "bootloader/boot_info.h"
+
+// Read-only initrd: a cpio "newc" archive that the build script packs from
+// initrd/ and stage 2 loads after the kernel. Files are never copied: the
+// index points at names and contents inside the loaded archive, which stays
+// where it is (the frame allocator leaves it alone).
+//
+// Paths are relative to the archive root; a leading "/" or "./" is ignored.
+// Lookups hash the path (FNV-1a) into an open-addressing table sized to at
+// least twice the number of entries.
+
+#define INITRD_MODE_TYPE    0170000         // File type bits of initrd_file_t.mode
+#define INITRD_MODE_DIR     0040000
+#define INITRD_MODE_FILE    0100000
+
+typedef struct {
+    const char* path;                       // NUL-terminated, inside the archive
+    const uint8_t* data;                    // Contents, inside the archive (4-byte aligned)
+    uint32_t size;
+    uint32_t mode;
+    uint32_t hash;
+} initrd_file_t;
+
+typedef struct {
+    uint32_t files;                         // Entries indexed (directories included)
+    uint32_t bytes;                         // Archive size
+    uint32_t slots;                         // Hash table size
+    uint32_t max_probe;                     // Longest probe sequence of an indexed path
+    uint64_t build_cycles;                  // Parsing and indexing, TSC cycles
+    uint64_t build_ns;
+} initrd_info_t;
+
+// Index the archive described by boot_info. Needs kmalloc_init() and the
+// timer. Returns the number of entries, 0 without an initrd or if it is
+// malformed.
+uint32_t initrd_init(const boot_info_t* boot_info);
+
+// Entry for 'path', NULL if there is none
+const initrd_file_t* initrd_lookup(const char* path);
+
+// Every entry, in archive order
+uint32_t initrd_count(void);
+const initrd_file_t* initrd_file(uint32_t index);
+
+void initrd_get_info(initrd_info_t* out);
+
+#ifdef INITRD_BENCH
+// Lookup latency for every path, misses and a linear scan for comparison
+// (build with -DINITRD_BENCH; INITRD_BENCH_FILES=N adds N files to the archive)
+void initrd_bench(void);
+#endif
+
+#endif // FS_INITRD_H
@@ -0,0 +1,201 @@
+#include "apic.h"
+#include "pic.h"
+#include "idt.h"
+#include "acpi/acpi.h"
+#include "memory/paging.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Local APIC + I/O APIC interrupt controller.
+// ISA IRQ n is routed to its global system interrupt (MADT overrides) and
+// delivered to the boot CPU as vector (class << 4) | n. EOI is one MMIO write.
+
+#define IA32_APIC_BASE_MSR  0x1B
+#define APIC_BASE_ENABLE    0x800
+#define CPUID_FEAT_EDX_APIC (1 << 9)
+
+#define LAPIC_SVR_ENABLE    0x100
+
+// I/O APIC registers
+#define IOAPIC_REGSEL       0x00
+#define IOAPIC_WINDOW       0x10
+#define IOAPIC_VER          0x01
+#define IOAPIC_REDTBL(n)    (0x10 + 2 * (n))
+
+// Redirection entry bits
+#define IOREDTBL_ACTIVE_LOW (1 << 13)
+#define IOREDTBL_LEVEL      (1 << 15)
+#define IOREDTBL_MASKED     (1 << 16)
+
+#define ISA_IRQS            16
+
+static volatile uint32_t* lapic_base;
+static volatile uint32_t* ioapic_base;
+static uint32_t ioapic_gsi_base;
+static uint32_t ioapic_max_entry;
+static uint32_t irq_gsi[ISA_IRQS];
+static uint32_t irq_flags[ISA_IRQS];        // Polarity/trigger bits of the redirection entry
+static uint8_t irq_vector[ISA_IRQS];
+
+extern void apic_spurious(void);            // interrupt_asm.s: bare iret, no EOI
+extern uint32_t irq_vector_stubs[];         // interrupt_asm.s: stubs for vectors 0x30-0xEF
+
+uint32_t lapic_read(uint32_t reg) {
+    return lapic_base[reg / 4];
+}
+
+void lapic_write(uint32_t reg, uint32_t value) {
+    lapic_base[reg / 4] = value;
+}
+
+uint32_t lapic_id(void) {
+    return lapic_read(LAPIC_ID) >> 24;
+}
+
+int lapic_present(void) {
+    return lapic_base != NULL;
+}
+
+static uint32_t ioapic_read(uint32_t reg) {
+    ioapic_base[IOAPIC_REGSEL / 4] = reg;
+    return ioapic_base[IOAPIC_WINDOW / 4];
+}
+
+static void ioapic_write(uint32_t reg, uint32_t value) {
+    ioapic_base[IOAPIC_REGSEL / 4] = reg;
+    ioapic_base[IOAPIC_WINDOW / 4] = value;
+}
+
+// Program the redirection entry for an ISA IRQ
+static void ioapic_route(uint8_t irq, int masked) {
+    uint32_t pin = irq_gsi[irq] - ioapic_gsi_base;
+    if (pin > ioapic_max_entry) {
+        return;
+    }
+    uint32_t low = irq_vector[irq] | irq_flags[irq]; // Fixed delivery, physical destination
+    if (masked) {
+        low |= IOREDTBL_MASKED;
+    }
+    ioapic_write(IOAPIC_REDTBL(pin) + 1, lapic_id() << 24);
+    ioapic_write(IOAPIC_REDTBL(pin), low);
+}
+
+static int cpu_has_apic(void) {
+    uint32_t eax, ebx, ecx, edx;
+    asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(1));
+    return (edx & CPUID_FEAT_EDX_APIC) != 0;
+}
+
+static void apic_eoi(uint8_t irq) {
+    (void)irq;
+    lapic_base[LAPIC_EOI / 4] = 0;
+}
+
+static void apic_mask(uint8_t irq) {
+    if (irq < ISA_IRQS) {
+        ioapic_route(irq, 1);
+    }
+}
+
+static void apic_unmask(uint8_t irq) {
+    if (irq < ISA_IRQS) {
+        ioapic_route(irq, 0);
+    }
+}
+
+// Move an IRQ to another priority class. The LAPIC delivers higher classes
+// first and masks everything at or below the class of the interrupt in service.
+static int apic_set_priority(uint8_t irq, uint8_t priority) {
+    if (irq >= ISA_IRQS || priority < APIC_PRIO_MIN || priority > APIC_PRIO_MAX ||
+        priority == APIC_PRIO_SYSCALL) {
+        return 0;                       // Class 8 would replace the DPL 3 int 0x80 gate
+    }
+    uint8_t vector = (priority << 4) | irq;
+    if (priority > APIC_PRIO_MIN) {
+        idt_set_gate(vector, irq_vector_stubs[vector - 0x30], 0x08, 0x8E);
+    }
+
+    uint32_t pin = irq_gsi[irq] - ioapic_gsi_base;
+    int masked = pin > ioapic_max_entry || (ioapic_read(IOAPIC_REDTBL(pin)) & IOREDTBL_MASKED);
+    irq_vector[irq] = vector;
+    ioapic_route(irq, masked);
+    return 1;
+}
+
+const irq_chip_t apic_chip = {
+    .name = "Local APIC + I/O APIC",
+    .eoi = apic_eoi,
+    .mask = apic_mask,
+    .unmask = apic_unmask,
+    .set_priority = apic_set_priority,
+    .spurious = NULL,       // The LAPIC sends spurious interrupts to their own vector
+};
+
+// Spurious vector + software enable, accept all priorities
+static void lapic_setup(void) {
+    lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | LAPIC_SPURIOUS_VECTOR);
+    lapic_write(LAPIC_TPR, 0);
+    lapic_write(LAPIC_LVT_LINT0, LAPIC_LVT_MASKED); // No more virtual-wire ExtINT from the 8259
+    lapic_write(LAPIC_LVT_ERROR, LAPIC_LVT_MASKED);
+}
+
+void lapic_init_ap(void) {
+    lapic_setup();
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED);
+}
+
+void lapic_send_ipi(uint32_t apic_id, uint32_t command) {
+    lapic_write(LAPIC_ICR_HI, apic_id << 24);
+    lapic_write(LAPIC_ICR_LO, command);     // Writing the low half sends it
+    while (lapic_read(LAPIC_ICR_LO) & LAPIC_ICR_PENDING) {
+        asm volatile ("pause");
+    }
+}
+
+int apic_init(void) {
+    if (!cpu_has_apic() || !acpi_init()) {
+        return 0;
+    }
+    const acpi_madt_t* madt = acpi_get_madt();
+    if (madt == NULL || madt->lapic_addr == 0 || madt->ioapic_addr == 0) {
+        return 0;
+    }
+
+    // Map both register windows uncached
+    if (!paging_identity_map(madt->lapic_addr, PAGE_SIZE, PAGE_MMIO) ||
+        !paging_identity_map(madt->ioapic_addr, PAGE_SIZE, PAGE_MMIO)) {
+        return 0;
+    }
+    lapic_base = (volatile uint32_t*)madt->lapic_addr;
+    ioapic_base = (volatile uint32_t*)madt->ioapic_addr;
+    ioapic_gsi_base = madt->ioapic_gsi_base;
+    ioapic_max_entry = (ioapic_read(IOAPIC_VER) >> 16) & 0xFF;
+
+    // Make sure the APIC is globally enabled at the MADT address
+    uint32_t lo, hi;
+    asm volatile("rdmsr" : "=a"(lo), "=d"(hi) : "c"(IA32_APIC_BASE_MSR));
+    lo = (madt->lapic_addr & 0xFFFFF000) | (lo & 0xFFF) | APIC_BASE_ENABLE;
+    asm volatile("wrmsr" :: "a"(lo), "d"(hi), "c"(IA32_APIC_BASE_MSR));
+
+    // The 8259s stay remapped (their spurious IRQs land on 32-47) but fully masked
+    pic_disable();
+
+    idt_set_gate(LAPIC_SPURIOUS_VECTOR, (uint32_t)apic_spurious, 0x08, 0x8E);
+    lapic_setup();
+
+    // Route every ISA IRQ to its default vector, masked until a handler is registered
+    for (uint8_t irq = 0; irq < ISA_IRQS; irq++) {
+        uint16_t flags = madt->isa_flags[irq];
+        irq_gsi[irq] = madt->isa_gsi[irq];
+        irq_flags[irq] = 0;
+        if ((flags & ACPI_POLARITY_MASK) == ACPI_POLARITY_LOW) {
+            irq_flags[irq] |= IOREDTBL_ACTIVE_LOW;
+        }
+        if ((flags & ACPI_TRIGGER_MASK) == ACPI_TRIGGER_LEVEL) {
+            irq_flags[irq] |= IOREDTBL_LEVEL;
+        }
+        irq_vector[irq] = 32 + irq;
+        ioapic_route(irq, 1);
+    }
+    return 1;
+}
@@ -0,0 +1,62 @@
+#ifndef INTERRUPT_APIC_H
+#define INTERRUPT_APIC_H
+
+#include <stdint.h>
+#include "irq_chip.h"
+#include "cpu/syscall.h"
+
+// Local APIC registers (byte offsets from the LAPIC base)
+#define LAPIC_ID            0x020
+#define LAPIC_VERSION       0x030
+#define LAPIC_TPR           0x080
+#define LAPIC_EOI           0x0B0
+#define LAPIC_SVR           0x0F0
+#define LAPIC_ICR_LO        0x300
+#define LAPIC_ICR_HI        0x310
+#define LAPIC_LVT_TIMER     0x320
+#define LAPIC_LVT_LINT0     0x350
+#define LAPIC_LVT_LINT1     0x360
+#define LAPIC_LVT_ERROR     0x370
+#define LAPIC_TIMER_ICR     0x380       // Initial count
+#define LAPIC_TIMER_CCR     0x390       // Current count
+#define LAPIC_TIMER_DCR     0x3E0       // Divide configuration
+
+#define LAPIC_LVT_MASKED    0x10000
+#define LAPIC_SPURIOUS_VECTOR 0xFF
+
+// Interrupt command register (low half)
+#define LAPIC_ICR_FIXED     0x00000
+#define LAPIC_ICR_INIT      0x00500
+#define LAPIC_ICR_STARTUP   0x00600
+#define LAPIC_ICR_PENDING   0x01000     // Delivery status
+#define LAPIC_ICR_ASSERT    0x04000
+
+// IRQ priority classes for irq_set_priority(): vector = (class << 4) | irq.
+// Class 2 holds the default vectors 32-47; higher classes preempt lower ones.
+// Class 8 is refused: it holds the int 0x80 system call gate (SYSCALL_VECTOR).
+#define APIC_PRIO_MIN       2
+#define APIC_PRIO_MAX       14
+#define APIC_PRIO_SYSCALL   (SYSCALL_VECTOR >> 4)
+
+// Switch from the 8259 to the local APIC + I/O APIC described by the ACPI MADT.
+// Returns 0 (and leaves the PIC in charge) when the CPU or firmware lacks them.
+int apic_init(void);
+
+// Local APIC register access
+uint32_t lapic_read(uint32_t reg);
+void lapic_write(uint32_t reg, uint32_t value);
+uint32_t lapic_id(void);
+
+// Non-zero once apic_init() has enabled the local APIC
+int lapic_present(void);
+
+// Enable the calling application processor's local APIC (timer masked)
+void lapic_init_ap(void);
+
+// Send an IPI to one local APIC and wait until it has been accepted
+void lapic_send_ipi(uint32_t apic_id, uint32_t command);
+
+// Local APIC + I/O APIC backend
+extern const irq_chip_t apic_chip;
+
+#endif // INTERRUPT_APIC_H
@@ -1,5 +1,5 @@
 #include "idt.h"
-#include "libc/include/memset.h" // For memset
+#include "libc/include/string.h" // For memset
 #include <stdint.h>
 #include "isr.h"
 #include "irq.h"
@@ -40,3 +40,24 @@ void idt_install(void)
     // Load the IDT using the assembly function
     idt_load(&idt_ptr);
 }
+
+// Application processors share the boot CPU's IDT
+void idt_load_ap(void)
+{
+    idt_load(&idt_ptr);
+}
+
+#ifdef BENCH_MODE
+#include "bench/bench.h"
+
+// Rewrite the IRQ13 gate with its current contents
+#define GATE_BENCH_VECTOR   45
+
+static void gate_bench(void* arg) {
+    (void)arg;
+    idt_entry_t* e = &idt_entries[GATE_BENCH_VECTOR];
+    idt_set_gate(GATE_BENCH_VECTOR, e->base_lo | ((uint32_t)e->base_hi << 16), e->sel, e->flags);
+}
+
+BENCH_REGISTER(idt_set_gate, .fn = gate_bench);
+#endif
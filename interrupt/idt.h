@@ -24,4 +24,7 @@ typedef struct {
 void idt_set_gate(uint8_t num, uint32_t base, uint16_t sel, uint8_t flags);
 void idt_install(void);
 
+// Load the already installed IDT on an application processor
+void idt_load_ap(void);
+
 #endif // INTERRUPT_IDT_H
\ No newline at end of file
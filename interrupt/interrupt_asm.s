@@ -3,9 +3,12 @@
 
 extern isr_handler ; Defined in isr.c
 extern irq_handler ; Defined in irq.c (will be created)
+extern apic_spurious_count ; Defined in irq_stats.c
+extern syscall_dispatch ; Defined in cpu/syscall.c
 
 section .text
 global idt_load   ; Export idt_load for C code
+global switch_context ; Export the thread context switch for task/sched.c
 global isr0       ; Export ISR stubs
 global isr1
 global isr2
@@ -56,31 +59,85 @@ global irq13
 global irq14
 global irq15
 
+global apic_spurious    ; Local APIC spurious vector (0xFF)
+global ipi_wakeup       ; Wakeup IPI for halted CPUs (cpu/smp.c)
+global ipi_profile      ; Profiler sample IPI (trace/profile.c)
+global irq_vector_stubs ; Stub table for IRQs moved to vectors 0x30-0xEF
+
+global syscall_int80    ; System call entry points (cpu/syscall.c)
+global syscall_sysenter
+global user_enter       ; Enter and leave ring 3 for user_run()
+global user_return
+
+KERNEL_DATA_SEL equ 0x10        ; GDT_KERNEL_DATA in cpu/gdt.h
+USER_CODE_SEL   equ 0x1B        ; GDT_USER_CODE
+USER_DATA_SEL   equ 0x23        ; GDT_USER_DATA
+
+; Returning to ring 3 nulls gs (its descriptor has DPL 0), so an entry from
+; ring 3 reloads it: this CPU's per-CPU segment sits just below its TSS in
+; the GDT (GDT_TSS_SEL - 8). Clobbers ax.
+%macro LOAD_PERCPU_GS 0
+    str ax
+    sub ax, 8
+    mov gs, ax
+%endmacro
+
+; Same, only when the interrupted code was in ring 3.
+; %1: offset of the saved CS from esp
+%macro LOAD_PERCPU_GS_FROM_USER 1
+    test byte [esp+%1], 3
+    jz %%kernel
+    LOAD_PERCPU_GS
+%%kernel:
+%endmacro
+
 ; Loads the IDT pointer into the processor's IDTR register
 idt_load:
     mov eax, [esp+4] ; Get the pointer argument (address of idt_ptr_t)
     lidt [eax]       ; Load IDT register
     ret
 
+; void switch_context(uint32_t* old_esp, uint32_t new_esp)
+; Saves the callee-saved registers on the current stack, stores ESP in
+; *old_esp, then switches to new_esp and restores the registers saved there.
+; Caller-saved registers (eax, ecx, edx) are already preserved by the C caller.
+switch_context:
+    mov eax, [esp+4] ; old_esp
+    mov edx, [esp+8] ; new_esp
+    push ebp
+    push ebx
+    push esi
+    push edi
+    mov [eax], esp   ; Save the outgoing thread's stack pointer
+    mov esp, edx     ; Switch to the incoming thread's stack
+    pop edi
+    pop esi
+    pop ebx
+    pop ebp
+    ret              ; Return into the incoming thread
+
 ; Common ISR stub called by individual ISRs
 isr_common_stub:
     pusha          ; Push edi,esi,ebp,esp,ebx,edx,ecx,eax
+    cld            ; C code expects DF=0 (memmove runs rep movsd backwards)
+    LOAD_PERCPU_GS_FROM_USER 44 ; Saved CS, above the pusha block, number and error code
     mov ax, ds     ; Lower 16 bits of ds register
     push eax       ; Save the data segment descriptor
 
     mov ax, 0x10   ; Load the kernel data segment descriptor (adjust if different)
     mov ds, ax
     mov es, ax
-    mov fs, ax
-    mov gs, ax
+    mov fs, ax     ; gs is left alone: it selects this CPU's per-CPU data
 
+    mov eax, esp   ; ESP points at the saved DS, the start of registers_t
+    push eax       ; Push pointer to registers_t struct for C handler
     call isr_handler ; Call the C handler
+    add esp, 4     ; Pop the registers_t pointer argument
 
     pop eax        ; Restore original data segment descriptor
     mov ds, ax
     mov es, ax
     mov fs, ax
-    mov gs, ax
 
     popa           ; Pop edi,esi,ebp,esp,ebx,edx,ecx,eax
     add esp, 8     ; Clean up the pushed error code and ISR number
@@ -89,25 +146,29 @@ isr_common_stub:
 ; Common IRQ stub called by individual IRQs
 irq_common_stub:
     pusha          ; Push edi,esi,ebp,esp,ebx,edx,ecx,eax
+    cld            ; C code expects DF=0 (memmove runs rep movsd backwards)
+    rdtsc          ; Entry time for the handler run time histogram (eax/edx are saved)
+    mov ebx, eax
+    LOAD_PERCPU_GS_FROM_USER 44 ; Saved CS
     mov ax, ds     ; Lower 16 bits of ds register
     push eax       ; Save the data segment descriptor
 
     mov ax, 0x10   ; Load the kernel data segment descriptor (adjust if different)
     mov ds, ax
     mov es, ax
-    mov fs, ax
-    mov gs, ax
+    mov fs, ax     ; gs is left alone: it selects this CPU's per-CPU data
 
     ; The C handler expects a pointer to the registers_t struct
     ; EAX currently holds the original DS value, ESP points to it.
     ; The full structure starts just above the pushed DS.
     mov eax, esp   ; Get pointer to the location of the pushed DS
     ; eax already points to start of registers_t (saved DS)
+    push ebx       ; Push the entry TSC
     push eax       ; Push pointer to registers_t struct for C handler
 
     call irq_handler ; Call the C IRQ handler
 
-    pop eax        ; Pop the registers_t pointer argument
+    add esp, 8     ; Pop the registers_t pointer and TSC arguments
 
     ; C handler must have sent EOI
 
@@ -115,7 +176,6 @@ irq_common_stub:
     mov ds, ax
     mov es, ax
     mov fs, ax
-    mov gs, ax
 
     popa           ; Pop edi,esi,ebp,esp,ebx,edx,ecx,eax
     add esp, 8     ; Clean up the pushed interrupt number and error code (0 in this case)
@@ -197,3 +257,151 @@ IRQ_STUB 12   ; PS/2 Mouse
 IRQ_STUB 13   ; FPU / Coprocessor
 IRQ_STUB 14   ; Primary ATA Hard Disk
 IRQ_STUB 15   ; Secondary ATA Hard Disk
+
+; Local APIC spurious interrupt: must not be acknowledged with an EOI
+apic_spurious:
+    inc dword [apic_spurious_count] ; interrupt/irq_stats.c; no EOI for spurious interrupts
+    iret
+
+; Wakeup IPI: only breaks a CPU out of hlt; smp_ipi_handler sends the EOI
+extern smp_ipi_handler
+ipi_wakeup:
+    pusha
+    cld
+    LOAD_PERCPU_GS_FROM_USER 36 ; Saved CS, above the pusha block
+    call smp_ipi_handler
+    popa
+    iret
+
+; Profiler sample IPI: goes through isr_handler like an exception, so
+; profile_ipi_handler gets the interrupted registers; it sends the EOI
+ipi_profile:
+    push dword 0   ; Push dummy error code
+    push dword 0xF1 ; PROFILE_VECTOR in trace/profile.h
+    jmp isr_common_stub
+
+; IRQ stubs for the APIC priority classes 3-14 (vectors 0x30-0xEF).
+; irq_set_priority() routes IRQ n to vector (class << 4) | n, and
+; irq_handler recovers n from the low nibble of the pushed vector.
+%assign vec 0x30
+%rep 0xC0
+irq_vector_ %+ vec:
+    push dword 0   ; Push dummy error code
+    push dword vec ; Push the vector number
+    jmp irq_common_stub
+%assign vec vec+1
+%endrep
+
+
+; int 0x80 system call (gate DPL 3). eax = number, arguments in ebx, esi,
+; edi; the result goes back in eax and every other register is preserved.
+syscall_int80:
+    push ds
+    push es
+    push fs
+    push ecx       ; Caller-saved in C, preserved for the user
+    push edx
+    mov cx, KERNEL_DATA_SEL
+    mov ds, cx
+    mov es, cx
+    mov fs, cx
+    LOAD_PERCPU_GS_FROM_USER 24 ; Saved CS, above the five pushes
+    sti            ; Interrupt gate so that gs is valid first; now preemptible
+    cld
+    push edi
+    push esi
+    push ebx
+    push eax
+    call syscall_dispatch
+    add esp, 16
+    pop edx
+    pop ecx
+    pop fs
+    pop es
+    pop ds
+    iret
+
+; sysenter system call. The CPU loads cs/ss from IA32_SYSENTER_CS and esp
+; from IA32_SYSENTER_ESP, which points at this CPU's tss.esp0: the top of the
+; running thread's kernel stack. Interrupts are off on entry. The user passes
+; its esp in ecx and the return address in edx, which sysexit takes back.
+syscall_sysenter:
+    mov esp, [esp]
+    push ecx
+    push edx
+    mov cx, KERNEL_DATA_SEL
+    mov ds, cx
+    mov es, cx
+    mov fs, cx
+    LOAD_PERCPU_GS
+    sti            ; The stack is set up: the handler may be preempted
+    cld
+    push edi
+    push esi
+    push ebx
+    push eax
+    call syscall_dispatch
+    add esp, 16
+    cli            ; No interrupt between the segment reloads and sysexit
+    mov cx, USER_DATA_SEL
+    mov ds, cx
+    mov es, cx
+    mov fs, cx
+    xor cx, cx
+    mov gs, cx
+    pop edx
+    pop ecx
+    sti            ; Takes effect after sysexit, so nothing lands in between
+    sysexit
+
+; int32_t user_enter(uint32_t eip, uint32_t esp, uint32_t* thread_esp0, uint32_t* tss_esp0)
+; Saves the callee-saved registers, records the kernel stack below them in
+; both *thread_esp0 and *tss_esp0 (traps from ring 3 land there) and irets
+; to ring 3. Returns through user_return() with the SYS_EXIT code.
+user_enter:
+    push ebp
+    push ebx
+    push esi
+    push edi
+    mov eax, [esp+20] ; eip
+    mov ecx, [esp+24] ; esp
+    mov edx, [esp+28] ; thread_esp0
+    mov [edx], esp
+    mov edx, [esp+32] ; tss_esp0
+    mov [edx], esp
+    mov dx, USER_DATA_SEL
+    mov ds, dx
+    mov es, dx
+    mov fs, dx
+    push dword USER_DATA_SEL ; ss
+    push ecx                 ; esp
+    push dword 0x202         ; eflags: IF
+    push dword USER_CODE_SEL ; cs
+    push eax                 ; eip
+    iret
+
+; void user_return(uint32_t esp0, int32_t code)
+; Drops everything above user_enter's saved registers (the system call that
+; got here) and returns 'code' from user_enter.
+user_return:
+    mov eax, [esp+8]  ; code
+    mov esp, [esp+4]  ; esp0
+    mov dx, KERNEL_DATA_SEL
+    mov ds, dx
+    mov es, dx
+    mov fs, dx
+    pop edi
+    pop esi
+    pop ebx
+    pop ebp
+    sti               ; sysenter entered with interrupts off
+    ret
+
+section .rodata
+; Addresses of the stubs above, indexed by vector - 0x30
+irq_vector_stubs:
+%assign vec 0x30
+%rep 0xC0
+    dd irq_vector_ %+ vec
+%assign vec vec+1
+%endrep
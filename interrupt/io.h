@@ -17,6 +17,41 @@ static inline uint8_t inb(uint16_t port) {
     return ret;
 }
 
+// 16- and 32-bit port I/O (ATA data port, PCI configuration space)
+static inline void outw(uint16_t port, uint16_t val) {
+    asm volatile ( "outw %0, %1" : : "a"(val), "Nd"(port) );
+}
+
+static inline uint16_t inw(uint16_t port) {
+    uint16_t ret;
+    asm volatile ( "inw %1, %0" : "=a"(ret) : "Nd"(port) );
+    return ret;
+}
+
+static inline void outl(uint16_t port, uint32_t val) {
+    asm volatile ( "outl %0, %1" : : "a"(val), "Nd"(port) );
+}
+
+static inline uint32_t inl(uint16_t port) {
+    uint32_t ret;
+    asm volatile ( "inl %1, %0" : "=a"(ret) : "Nd"(port) );
+    return ret;
+}
+
+// Move 'count' words between a port and memory with rep insw/outsw
+static inline void insw(uint16_t port, void* buf, uint32_t count) {
+    asm volatile ( "rep insw" : "+D"(buf), "+c"(count) : "d"(port) : "memory" );
+}
+
+static inline void outsw(uint16_t port, const void* buf, uint32_t count) {
+    asm volatile ( "rep outsw" : "+S"(buf), "+c"(count) : "d"(port) : "memory" );
+}
+
+// Write 'count' bytes to a port with rep outsb
+static inline void outsb(uint16_t port, const void* buf, uint32_t count) {
+    asm volatile ( "rep outsb" : "+S"(buf), "+c"(count) : "d"(port) : "memory" );
+}
+
 // Wait for a short time (useful after PIC commands)
 static inline void io_wait(void) {
     // Port 0x80 is used for POST checkpoints by the BIOS.
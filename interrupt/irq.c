@@ -1,24 +1,35 @@
 #include "irq.h"
 #include "idt.h"
-#include "io.h"
+#include "pic.h"
+#include "apic.h"
+#include "irq_stats.h"
+#include "softirq.h"
+#include "task/sched.h"
+#include "trace/trace.h"
+#include "libc/include/stdio.h"
 #include <stddef.h> // For NULL
 #include <stdint.h> // For uint8_t
 
 
-// PIC ports
-#define PIC1_CMD    0x20
-#define PIC1_DATA   0x21
-#define PIC2_CMD    0xA0
-#define PIC2_DATA   0xA1
-
-// PIC initialization commands
-#define ICW1_INIT       0x10
-#define ICW1_ICW4       0x01
-#define ICW4_8086       0x01
-
 // Array for custom IRQ handlers
 static isr_t irq_handlers[16] = {0}; // IRQ 0-15
 
+// Active interrupt controller backend
+static const irq_chip_t* irq_chip = &pic_chip;
+
+// Interrupted context of the top half running now (device IRQs only reach
+// the boot CPU and top halves run with interrupts disabled, so one is enough)
+static registers_t* irq_regs;
+
+// TSC at irq_common_stub entry, per line (entry to EOI never nests with itself)
+static uint32_t irq_entry_tsc[16];
+
+static inline uint32_t rdtsc_lo(void) {
+    uint32_t lo, hi;
+    asm volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return lo;
+}
+
 
 // External assembly IRQ stubs (defined in interrupt_asm.s)
 extern void irq0();
@@ -38,55 +49,6 @@ extern void irq13();
 extern void irq14();
 extern void irq15();
 
-extern void term_putc(char c);     // from kernel.c
-extern void term_print(const char*);
-
-static void print_dec(uint8_t num) {
-    if (num >= 10) {
-        print_dec(num / 10);
-    }
-    term_putc('0' + (num % 10));
-}
-
-// Function to remap the PIC controller IRQs
-static void pic_remap(int offset1, int offset2) {
-    uint8_t mask1, mask2;
-
-    // Save masks
-    mask1 = inb(PIC1_DATA);
-    mask2 = inb(PIC2_DATA);
-
-    // Starts the initialization sequence (in cascade mode)
-    outb(PIC1_CMD, ICW1_INIT | ICW1_ICW4);
-    io_wait();
-    outb(PIC2_CMD, ICW1_INIT | ICW1_ICW4);
-    io_wait();
-
-    // ICW2: Master PIC vector offset
-    outb(PIC1_DATA, offset1); // Remap IRQ 0-7 to offset1..(offset1+7)
-    io_wait();
-    // ICW2: Slave PIC vector offset
-    outb(PIC2_DATA, offset2); // Remap IRQ 8-15 to offset2..(offset2+7)
-    io_wait();
-
-    // ICW3: tell Master PIC that there is a slave PIC at IRQ2 (0000 0100)
-    outb(PIC1_DATA, 4);
-    io_wait();
-    // ICW3: tell Slave PIC its cascade identity (0000 0010)
-    outb(PIC2_DATA, 2);
-    io_wait();
-
-    // ICW4: Have the PICs use 8086 mode (and not auto EOI)
-    outb(PIC1_DATA, ICW4_8086);
-    io_wait();
-    outb(PIC2_DATA, ICW4_8086);
-    io_wait();
-
-    // Restore saved masks (important for enabling/disabling specific IRQs later)
-    outb(PIC1_DATA, mask1); 
-    outb(PIC2_DATA, mask2);
-    
-}
 
 // Installs the IRQ handlers into the IDT
 void irq_install() {
@@ -115,33 +77,61 @@ void irq_install() {
     for (int i = 0; i < 16; i++) {
         irq_handlers[i] = NULL;
     }
+
+    // Prefer the local APIC + I/O APIC; the PIC stays in charge if there is none
+    if (apic_init()) {
+        irq_chip = &apic_chip;
+    }
 }
 
-// Send End-of-Interrupt signal to the PIC(s)
+// Send End-of-Interrupt signal through the active controller
 void irq_send_eoi(uint8_t irq) {
-    if (irq >= 8) {
-        outb(PIC2_CMD, 0x20); // Send EOI to slave PIC
-    }
-    outb(PIC1_CMD, 0x20);     // Send EOI to master PIC
+    irq_stats_run_time(irq, rdtsc_lo() - irq_entry_tsc[irq]);
+    irq_chip->eoi(irq);
 }
 
-// C-level IRQ handler called by the assembly stubs
-void irq_handler(registers_t* regs) {
-    uint8_t irq = regs->int_no - 32; // Get the original IRQ number (0-15)
+// C-level IRQ handler called by the assembly stubs; 'entry_tsc' is read
+// by irq_common_stub right after saving the registers
+void irq_handler(registers_t* regs, uint32_t entry_tsc) {
+    // Get the original IRQ number (0-15). Vectors are (priority class << 4) | irq,
+    // which is 32 + irq for the default class.
+    uint8_t irq = regs->int_no & 0x0F;
+    irq_entry_tsc[irq] = entry_tsc;
+    irq_stats_count(regs->int_no);
 
-    // Call the registered handler, if any
+    // Spurious 8259 IRQ7/15: nothing is in service, so no handler and no EOI
+    if (irq_chip->spurious != NULL && irq_chip->spurious(irq)) {
+        irq_stats_spurious(regs->int_no);
+        return;
+    }
+
+    // Call the registered handler (top half), if any
+    trace_event(TRACE_IRQ_ENTRY, irq, regs->int_no);
+    irq_enter();
+    irq_regs = regs;
     if (irq_handlers[irq] != NULL) {
         isr_t handler = irq_handlers[irq];
         handler(regs);
     } else {
-        term_print("Unhandled IRQ received!\n");
-        term_print("IRQ number: ");
-        print_dec(irq);
-        term_print("\n");
+        irq_stats_unhandled(regs->int_no);
+        kprintf("Unhandled IRQ received!\nIRQ number: %u\n", irq);
     }
+    irq_regs = NULL;
 
-    // Send EOI *after* handling the interrupt
+    // Send EOI *after* the top half; its deferred work runs below
     irq_send_eoi(irq);
+
+    // Bottom halves with interrupts enabled, then preempt the interrupted
+    // thread if a handler made a better one ready
+    int preempt = irq_exit();
+    trace_event(TRACE_IRQ_EXIT, irq, 0);
+    if (preempt) {
+        sched_irq_exit();
+    }
+}
+
+registers_t* irq_get_regs(void) {
+    return irq_regs;
 }
 
 // Register a handler for a specific IRQ line
@@ -149,9 +139,121 @@ void irq_register_handler(uint8_t irq, isr_t handler) {
     if (irq < 16) {
         irq_handlers[irq] = handler;
         // Unmask the specific IRQ line (enable it)
-        uint8_t pic_data_port = (irq < 8) ? PIC1_DATA : PIC2_DATA;
-        uint8_t irq_mask = (irq < 8) ? irq : irq - 8;
-        uint8_t current_mask = inb(pic_data_port);
-        outb(pic_data_port, current_mask & ~(1 << irq_mask));
+        irq_chip->unmask(irq);
     } 
 }
+
+// Mask an IRQ line and remove its handler
+void irq_unregister_handler(uint8_t irq) {
+    if (irq < 16) {
+        irq_chip->mask(irq);
+        irq_handlers[irq] = NULL;
+    }
+}
+
+// Move an IRQ to a higher or lower priority class (APIC only). Returns 0 if unsupported.
+int irq_set_priority(uint8_t irq, uint8_t priority) {
+    if (irq_chip->set_priority == NULL) {
+        return 0;
+    }
+    return irq_chip->set_priority(irq, priority);
+}
+
+// Name of the active interrupt controller
+const char* irq_chip_name(void) {
+    return irq_chip->name;
+}
+
+#ifdef BENCH_MODE
+#include "bench/bench.h"
+
+// IRQ entry/exit through irq_common_stub: a software interrupt on the FPU
+// line (nothing else raises it), dispatched to an empty handler and EOId
+#define ENTRY_BENCH_IRQ     13
+
+static void entry_bench_handler(registers_t* regs) {
+    (void)regs;
+}
+
+static void entry_bench_setup(void* arg) {
+    (void)arg;
+    irq_register_handler(ENTRY_BENCH_IRQ, entry_bench_handler);
+}
+
+static void entry_bench_teardown(void* arg) {
+    (void)arg;
+    irq_unregister_handler(ENTRY_BENCH_IRQ);
+}
+
+static void entry_bench(void* arg) {
+    (void)arg;
+    asm volatile ("int $45");           // 32 + ENTRY_BENCH_IRQ
+}
+
+BENCH_REGISTER(irq_entry_exit, .fn = entry_bench, .setup = entry_bench_setup,
+               .teardown = entry_bench_teardown, .repeats = BENCH_MAX_REPEATS);
+#endif
+
+#ifdef IRQ_BENCH
+#include "interrupt/irqflags.h"
+
+extern void term_print(const char* str);   // from drivers/vga.c
+extern void term_print_dec(uint32_t num);
+
+#define BENCH_ITERATIONS    10000
+#define BENCH_IRQ           13              // FPU line: nothing else raises it
+#define BENCH_VECTOR        "45"            // 32 + BENCH_IRQ
+
+static void bench_handler(registers_t* regs) {
+    (void)regs;
+}
+
+static void bench_report(const char* what, uint32_t cycles) {
+    term_print("irq: ");
+    term_print(what);
+    term_print(" ");
+    term_print_dec(cycles / BENCH_ITERATIONS);
+    term_print(" cycles\n");
+}
+
+// Cycles per EOI for a backend (nothing is in service, so the write is a no-op for the controller)
+static uint32_t bench_eoi(const irq_chip_t* chip) {
+    uint32_t start = rdtsc_lo();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        chip->eoi(BENCH_IRQ);
+    }
+    return rdtsc_lo() - start;
+}
+
+// Per-interrupt overhead of each controller backend
+void irq_bench(void) {
+    uint32_t flags = irq_save();
+    term_print("irq: controller ");
+    term_print(irq_chip->name);
+    term_print("\n");
+
+    bench_report("8259 EOI (slave line)", bench_eoi(&pic_chip));
+    if (irq_chip == &apic_chip) {
+        bench_report("LAPIC EOI", bench_eoi(&apic_chip));
+    }
+
+    // Mask + unmask of one line through the active backend
+    uint32_t start = rdtsc_lo();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        irq_chip->mask(BENCH_IRQ);
+        irq_chip->unmask(BENCH_IRQ);
+    }
+    bench_report("mask+unmask", rdtsc_lo() - start);
+
+    // Full round trip: stub, irq_handler dispatch, EOI, iret
+    irq_register_handler(BENCH_IRQ, bench_handler);
+    start = rdtsc_lo();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        asm volatile ("int $" BENCH_VECTOR);
+    }
+    bench_report("interrupt entry/dispatch/EOI/exit", rdtsc_lo() - start);
+    irq_unregister_handler(BENCH_IRQ);
+
+    irq_restore(flags);
+}
+#endif
@@ -9,7 +9,28 @@ void irq_install(void);
 // Function to register a handler for a specific IRQ line
 void irq_register_handler(uint8_t irq, isr_t handler);
 
+// Function to mask an IRQ line and remove its handler
+void irq_unregister_handler(uint8_t irq);
+
+// Registers saved when the IRQ whose top half is running arrived, for code
+// called from handlers that has no registers_t of its own (ktimer callbacks).
+// NULL outside a top half.
+registers_t* irq_get_regs(void);
+
 // Function to send End-of-Interrupt signal
 void irq_send_eoi(uint8_t irq);
 
+// Move an IRQ to another priority class (APIC_PRIO_MIN..APIC_PRIO_MAX, except
+// APIC_PRIO_SYSCALL). Returns 0 when the active controller has fixed
+// priorities (8259) or refuses the class.
+int irq_set_priority(uint8_t irq, uint8_t priority);
+
+// Name of the active interrupt controller backend
+const char* irq_chip_name(void);
+
+#ifdef IRQ_BENCH
+// Per-interrupt overhead of the controller backends (build with -DIRQ_BENCH)
+void irq_bench(void);
+#endif
+
 #endif // INTERRUPT_IRQ_H
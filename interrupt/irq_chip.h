@@ -0,0 +1,16 @@
+#ifndef INTERRUPT_IRQ_CHIP_H
+#define INTERRUPT_IRQ_CHIP_H
+
+#include <stdint.h>
+
+// Interrupt controller backend used by irq.c (8259 PIC or local APIC + I/O APIC)
+typedef struct {
+    const char* name;
+    void (*eoi)(uint8_t irq);               // Acknowledge the interrupt
+    void (*mask)(uint8_t irq);              // Disable an IRQ line
+    void (*unmask)(uint8_t irq);            // Enable an IRQ line
+    int (*set_priority)(uint8_t irq, uint8_t priority); // NULL if priorities are fixed
+    int (*spurious)(uint8_t irq);           // Nonzero if 'irq' was not really raised; NULL if never
+} irq_chip_t;
+
+#endif // INTERRUPT_IRQ_CHIP_H
@@ -0,0 +1,97 @@
+#include "irq_stats.h"
+#include "idt.h"
+#include "irqflags.h"
+#include "apic.h"
+#include "drivers/clocksource.h"
+#include "libc/include/stdio.h"
+#include "libc/include/string.h"
+#include <stddef.h>
+#include <stdint.h>
+
+static irq_vector_stats_t vectors[IDT_ENTRIES];
+static irq_line_stats_t lines[IRQ_LINES];
+
+// Bumped directly by the apic_spurious stub, which does not enter C
+volatile uint32_t apic_spurious_count = 0;
+
+void irq_stats_count(uint8_t vector) {
+    vectors[vector].count++;
+}
+
+void irq_stats_spurious(uint8_t vector) {
+    vectors[vector].spurious++;
+}
+
+void irq_stats_unhandled(uint8_t vector) {
+    vectors[vector].unhandled++;
+}
+
+void irq_stats_run_time(uint8_t irq, uint32_t cycles) {
+    irq_line_stats_t* line = &lines[irq];
+    uint32_t bucket = 31 - __builtin_clz(cycles | 1);
+    if (bucket >= IRQ_HIST_BUCKETS) {
+        bucket = IRQ_HIST_BUCKETS - 1;
+    }
+    line->hist[bucket]++;
+    line->cycles += cycles;
+    if (cycles > line->max) {
+        line->max = cycles;
+    }
+}
+
+void irq_stats_get(uint8_t vector, irq_vector_stats_t* out) {
+    uint32_t flags = irq_save();
+    *out = vectors[vector];
+    if (vector == LAPIC_SPURIOUS_VECTOR) {
+        out->count += apic_spurious_count;
+        out->spurious += apic_spurious_count;
+    }
+    irq_restore(flags);
+}
+
+void irq_stats_get_line(uint8_t irq, irq_line_stats_t* out) {
+    uint32_t flags = irq_save();
+    *out = lines[irq & (IRQ_LINES - 1)];
+    irq_restore(flags);
+}
+
+void irq_stats_dump(void) {
+    kprintf("vector    count  spurious  unhandled\n");
+    for (uint32_t v = 0; v < IDT_ENTRIES; v++) {
+        irq_vector_stats_t s;
+        irq_stats_get(v, &s);
+        if (s.count != 0) {
+            kprintf("%6u %8u  %8u  %9u\n", v, s.count, s.spurious, s.unhandled);
+        }
+    }
+
+    kprintf("irq  cycles total      avg      max  histogram (log2 cycles:count)\n");
+    for (uint32_t irq = 0; irq < IRQ_LINES; irq++) {
+        irq_line_stats_t l;
+        irq_stats_get_line(irq, &l);
+        uint32_t runs = 0;
+        for (uint32_t b = 0; b < IRQ_HIST_BUCKETS; b++) {
+            runs += l.hist[b];
+        }
+        if (runs == 0) {
+            continue;
+        }
+
+        char hist[KPRINTF_BUF_SIZE / 2];
+        size_t len = 0;
+        for (uint32_t b = 0; b < IRQ_HIST_BUCKETS && len < sizeof(hist); b++) {
+            if (l.hist[b] != 0) {
+                len += ksnprintf(hist + len, sizeof(hist) - len, " %u:%u", b, l.hist[b]);
+            }
+        }
+        kprintf("%3u %13llu %8u %8u %s\n", irq, l.cycles, avg_u64_u32(l.cycles, runs), l.max, hist);
+    }
+}
+
+void irq_stats_reset(void) {
+    uint32_t flags = irq_save();
+    memset(vectors, 0, sizeof(vectors));
+    memset(lines, 0, sizeof(lines));
+    apic_spurious_count = 0;
+    irq_restore(flags);
+}
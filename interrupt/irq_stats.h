@@ -0,0 +1,42 @@
+#ifndef INTERRUPT_IRQ_STATS_H
+#define INTERRUPT_IRQ_STATS_H
+
+#include <stdint.h>
+
+// Handler run time histogram: bucket b counts runs of [2^b, 2^(b+1)) TSC
+// cycles, measured from irq_common_stub to the EOI; the last bucket is open.
+#define IRQ_HIST_BUCKETS    24
+#define IRQ_LINES           16
+
+// Counters for one IDT vector
+typedef struct {
+    uint32_t count;             // Interrupts taken, spurious ones included
+    uint32_t spurious;          // 8259 IRQ7/15 without an in-service bit, LAPIC spurious vector
+    uint32_t unhandled;         // No handler registered
+} irq_vector_stats_t;
+
+// Run time of one IRQ line's handler
+typedef struct {
+    uint64_t cycles;            // Total, for finding the line that eats the CPU
+    uint32_t max;
+    uint32_t hist[IRQ_HIST_BUCKETS];
+} irq_line_stats_t;
+
+// Updated from the interrupt paths without atomics: device IRQs are all
+// delivered to the boot CPU.
+void irq_stats_count(uint8_t vector);
+void irq_stats_spurious(uint8_t vector);
+void irq_stats_unhandled(uint8_t vector);
+void irq_stats_run_time(uint8_t irq, uint32_t cycles);
+
+// Snapshot of one vector / line
+void irq_stats_get(uint8_t vector, irq_vector_stats_t* out);
+void irq_stats_get_line(uint8_t irq, irq_line_stats_t* out);
+
+// Print every vector that fired, then the histograms of the busy lines
+// (kprintf; bound to F12 on the console)
+void irq_stats_dump(void);
+
+void irq_stats_reset(void);
+
+#endif // INTERRUPT_IRQ_STATS_H
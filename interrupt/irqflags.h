@@ -0,0 +1,31 @@
+#ifndef INTERRUPT_IRQFLAGS_H
+#define INTERRUPT_IRQFLAGS_H
+
+#include <stdint.h>
+
+#define EFLAGS_IF 0x200
+
+// Disable interrupts and return the previous EFLAGS
+static inline uint32_t irq_save(void) {
+    uint32_t flags;
+    asm volatile ( "pushf\n\tpop %0\n\tcli" : "=r"(flags) : : "memory" );
+    return flags;
+}
+
+// Re-enable interrupts if they were enabled when irq_save() was called
+static inline void irq_restore(uint32_t flags) {
+    if (flags & EFLAGS_IF) {
+        asm volatile ( "sti" : : : "memory" );
+    }
+}
+
+// Unconditional sti/cli, for code that knows the current state
+static inline void irq_enable(void) {
+    asm volatile ( "sti" : : : "memory" );
+}
+
+static inline void irq_disable(void) {
+    asm volatile ( "cli" : : : "memory" );
+}
+
+#endif // INTERRUPT_IRQFLAGS_H
@@ -1,9 +1,12 @@
 #include "isr.h"
 #include "idt.h"
+#include "irq_stats.h"
+#include "trace/trace.h"
+#include "drivers/serial.h"
+#include "libc/include/stdio.h"
 #include <stddef.h>
 
-// Placeholder for kernel printing function (defined in kernel.c or elsewhere)
-extern void term_print(const char* str);
+extern void term_flush(void);   // from drivers/vga.c
 
 // Array of custom interrupt handlers
 static isr_t interrupt_handlers[IDT_ENTRIES];
@@ -86,12 +89,19 @@ void isr_install() {
 
 // C-level ISR handler called by the assembly stubs
 void isr_handler(registers_t* regs) {
+    irq_stats_count(regs->int_no);
     // Check if a custom handler is registered for this interrupt
     if (interrupt_handlers[regs->int_no] != 0) {
+        trace_event(TRACE_ISR_ENTRY, regs->int_no, regs->err_code);
         interrupt_handlers[regs->int_no](regs);
+        trace_event(TRACE_ISR_EXIT, regs->int_no, 0);
     } else {
+        irq_stats_unhandled(regs->int_no);
         // Default handler: Print a message and halt (or handle appropriately)
-        term_print("Unhandled interrupt received!\n");
+        kprintf("Unhandled interrupt received!\n");
+        // Nothing will run the deferred flushes any more
+        term_flush();
+        serial_flush();
         // Kernel panic or specific handling logic here
         for (;;);
     }
@@ -0,0 +1,120 @@
+#include "pic.h"
+#include "io.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// PIC ports
+#define PIC1_CMD    0x20
+#define PIC1_DATA   0x21
+#define PIC2_CMD    0xA0
+#define PIC2_DATA   0xA1
+
+// PIC initialization commands
+#define ICW1_INIT       0x10
+#define ICW1_ICW4       0x01
+#define ICW4_8086       0x01
+
+#define PIC_EOI         0x20
+#define PIC_READ_ISR    0x0B        // OCW3: next command port read returns the in-service register
+
+// Function to remap the PIC controller IRQs
+void pic_remap(int offset1, int offset2) {
+    uint8_t mask1, mask2;
+
+    // Save masks
+    mask1 = inb(PIC1_DATA);
+    mask2 = inb(PIC2_DATA);
+
+    // Starts the initialization sequence (in cascade mode)
+    outb(PIC1_CMD, ICW1_INIT | ICW1_ICW4);
+    io_wait();
+    outb(PIC2_CMD, ICW1_INIT | ICW1_ICW4);
+    io_wait();
+
+    // ICW2: Master PIC vector offset
+    outb(PIC1_DATA, offset1); // Remap IRQ 0-7 to offset1..(offset1+7)
+    io_wait();
+    // ICW2: Slave PIC vector offset
+    outb(PIC2_DATA, offset2); // Remap IRQ 8-15 to offset2..(offset2+7)
+    io_wait();
+
+    // ICW3: tell Master PIC that there is a slave PIC at IRQ2 (0000 0100)
+    outb(PIC1_DATA, 4);
+    io_wait();
+    // ICW3: tell Slave PIC its cascade identity (0000 0010)
+    outb(PIC2_DATA, 2);
+    io_wait();
+
+    // ICW4: Have the PICs use 8086 mode (and not auto EOI)
+    outb(PIC1_DATA, ICW4_8086);
+    io_wait();
+    outb(PIC2_DATA, ICW4_8086);
+    io_wait();
+
+    // Restore saved masks (important for enabling/disabling specific IRQs later)
+    outb(PIC1_DATA, mask1); 
+    outb(PIC2_DATA, mask2);
+    
+}
+
+void pic_disable(void) {
+    outb(PIC1_DATA, 0xFF);
+    outb(PIC2_DATA, 0xFF);
+}
+
+// Send End-of-Interrupt signal to the PIC(s)
+static void pic_eoi(uint8_t irq) {
+    if (irq >= 8) {
+        outb(PIC2_CMD, PIC_EOI); // Send EOI to slave PIC
+    }
+    outb(PIC1_CMD, PIC_EOI);     // Send EOI to master PIC
+}
+
+// A line dropped before the INTA cycle makes the 8259 deliver its lowest
+// priority input (IRQ7, or IRQ15 on the slave) without setting the in-service
+// bit. Such interrupts must not be EOId, except that the master did see IRQ2.
+static int pic_spurious(uint8_t irq) {
+    if (irq != 7 && irq != 15) {
+        return 0;
+    }
+    uint8_t cmd = irq == 7 ? PIC1_CMD : PIC2_CMD;
+    outb(cmd, PIC_READ_ISR);
+    if (inb(cmd) & 0x80) {
+        return 0;
+    }
+    if (irq == 15) {
+        outb(PIC1_CMD, PIC_EOI);
+    }
+    return 1;
+}
+
+static void pic_set_mask(uint8_t irq, int masked) {
+    uint8_t pic_data_port = (irq < 8) ? PIC1_DATA : PIC2_DATA;
+    uint8_t irq_mask = (irq < 8) ? irq : irq - 8;
+    uint8_t current_mask = inb(pic_data_port);
+    if (masked) {
+        outb(pic_data_port, current_mask | (1 << irq_mask));
+    } else {
+        outb(pic_data_port, current_mask & ~(1 << irq_mask));
+    }
+}
+
+static void pic_mask(uint8_t irq) {
+    pic_set_mask(irq, 1);
+}
+
+static void pic_unmask(uint8_t irq) {
+    pic_set_mask(irq, 0);
+    if (irq >= 8) {
+        pic_set_mask(2, 0); // Slave interrupts arrive through the cascade line
+    }
+}
+
+const irq_chip_t pic_chip = {
+    .name = "8259 PIC",
+    .eoi = pic_eoi,
+    .mask = pic_mask,
+    .unmask = pic_unmask,
+    .set_priority = NULL,   // Fixed: IRQ 0 highest, then 1, 8-15, 3-7
+    .spurious = pic_spurious,
+};
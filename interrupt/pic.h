@@ -0,0 +1,16 @@
+#ifndef INTERRUPT_PIC_H
+#define INTERRUPT_PIC_H
+
+#include <stdint.h>
+#include "irq_chip.h"
+
+// Remap the 8259 PICs so IRQ 0-7 use offset1.. and IRQ 8-15 use offset2..
+void pic_remap(int offset1, int offset2);
+
+// Mask every line on both PICs (used when the APIC takes over)
+void pic_disable(void);
+
+// Legacy 8259 backend
+extern const irq_chip_t pic_chip;
+
+#endif // INTERRUPT_PIC_H
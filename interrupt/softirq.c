@@ -0,0 +1,299 @@
+#include "softirq.h"
+#include "interrupt/irqflags.h"
+#include "task/sched.h"
+#include "libc/include/stdio.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Softirqs and tasklets.
+// 'pending' has bit n set when softirq n was raised. The handlers run with
+// interrupts enabled; 'softirq_active' keeps an interrupt that arrives
+// meanwhile from starting them again (or preempting them) on its own exit.
+
+typedef struct {
+    tasklet_t* head;
+    tasklet_t** tail;
+} tasklet_list_t;
+
+static void tasklet_hi_action(void);
+static void tasklet_action(void);
+
+// Set up statically: drivers schedule tasklets from their IRQs before softirq_init()
+static softirq_fn_t handlers[SOFTIRQ_COUNT] = {
+    [SOFTIRQ_HI] = tasklet_hi_action,
+    [SOFTIRQ_TASKLET] = tasklet_action,
+};
+static tasklet_list_t tasklet_lists[SOFTIRQ_COUNT] = {
+    [SOFTIRQ_HI] = { NULL, &tasklet_lists[SOFTIRQ_HI].head },
+    [SOFTIRQ_TASKLET] = { NULL, &tasklet_lists[SOFTIRQ_TASKLET].head },
+};
+static volatile uint32_t pending;
+static uint32_t hardirq_depth;
+static int softirq_active;
+static thread_t* ksoftirqd;             // NULL until softirq_init(): only IRQ exits run softirqs
+static softirq_stats_t stats;
+
+#ifdef SOFTIRQ_BENCH
+static int bench_inline;        // Run tasklets in the top half, as before the split
+#endif
+
+// Run pending softirqs until none are left or the restart budget is spent.
+// Interrupts are disabled on entry and on return.
+static void run_pending(uint32_t* passes) {
+    softirq_active = 1;
+    for (uint32_t restart = 0; pending != 0 && restart < SOFTIRQ_MAX_RESTART; restart++) {
+        uint32_t batch = pending;
+        pending = 0;
+        (*passes)++;
+        irq_enable();
+        while (batch != 0) {
+            uint32_t nr = __builtin_ctz(batch);
+            batch &= batch - 1;
+            if (handlers[nr] != NULL) {
+                stats.runs[nr]++;
+                handlers[nr]();
+            }
+        }
+        irq_disable();
+    }
+    softirq_active = 0;
+}
+
+static void ksoftirqd_thread(void* arg) {
+    (void)arg;
+    for (;;) {
+        uint32_t flags = irq_save();
+        while (pending != 0) {
+            run_pending(&stats.thread_passes);
+            // Let other threads run between budgets
+            irq_restore(flags);
+            thread_yield();
+            flags = irq_save();
+        }
+        irq_restore(flags);
+        thread_block();
+    }
+}
+
+// Run one tasklet list; everything queued so far is one batch
+static void tasklet_run(tasklet_list_t* list) {
+    uint32_t flags = irq_save();
+    tasklet_t* t = list->head;
+    list->head = NULL;
+    list->tail = &list->head;
+    irq_restore(flags);
+
+    uint32_t batch = 0;
+    while (t != NULL) {
+        tasklet_t* next = t->next;
+        t->scheduled = 0;           // Scheduling it again from now on queues another run
+        t->fn(t->arg);
+        batch++;
+        t = next;
+    }
+    stats.tasklets += batch;
+    if (batch > stats.max_batch) {
+        stats.max_batch = batch;
+    }
+}
+
+static void tasklet_hi_action(void) {
+    tasklet_run(&tasklet_lists[SOFTIRQ_HI]);
+}
+
+static void tasklet_action(void) {
+    tasklet_run(&tasklet_lists[SOFTIRQ_TASKLET]);
+}
+
+void softirq_init(void) {
+    ksoftirqd = thread_create("ksoftirqd", ksoftirqd_thread, NULL, SCHED_PRIO_DEFAULT);
+}
+
+void open_softirq(uint32_t nr, softirq_fn_t fn) {
+    if (nr < SOFTIRQ_COUNT) {
+        handlers[nr] = fn;
+    }
+}
+
+void raise_softirq(uint32_t nr) {
+    uint32_t flags = irq_save();
+    pending |= 1u << nr;
+    stats.raised++;
+    // In an interrupt, irq_exit() or the running pass picks it up
+    if (!in_interrupt() && ksoftirqd != NULL) {
+        thread_unblock(ksoftirqd);
+    }
+    irq_restore(flags);
+}
+
+void tasklet_init(tasklet_t* t, tasklet_fn_t fn, void* arg) {
+    t->next = NULL;
+    t->scheduled = 0;
+    t->fn = fn;
+    t->arg = arg;
+}
+
+static void tasklet_queue(tasklet_t* t, uint32_t nr) {
+#ifdef SOFTIRQ_BENCH
+    if (bench_inline) {
+        t->fn(t->arg);
+        return;
+    }
+#endif
+    uint32_t flags = irq_save();
+    if (!t->scheduled) {
+        t->scheduled = 1;
+        t->next = NULL;
+        *tasklet_lists[nr].tail = t;
+        tasklet_lists[nr].tail = &t->next;
+        raise_softirq(nr);
+    }
+    irq_restore(flags);
+}
+
+void tasklet_schedule(tasklet_t* t) {
+    tasklet_queue(t, SOFTIRQ_TASKLET);
+}
+
+void tasklet_hi_schedule(tasklet_t* t) {
+    tasklet_queue(t, SOFTIRQ_HI);
+}
+
+void irq_enter(void) {
+    hardirq_depth++;
+}
+
+int irq_exit(void) {
+    hardirq_depth--;
+    if (hardirq_depth != 0 || softirq_active) {
+        return 0;       // Nested in another interrupt or in the bottom halves
+    }
+    if (pending != 0) {
+        run_pending(&stats.irq_exit_passes);
+        // Still raised after the budget: a flood, leave it to the thread
+        if (pending != 0 && ksoftirqd != NULL) {
+            stats.deferred++;
+            thread_unblock(ksoftirqd);
+        }
+    }
+    return 1;
+}
+
+int in_interrupt(void) {
+    return hardirq_depth != 0 || softirq_active;
+}
+
+void softirq_get_stats(softirq_stats_t* out) {
+    uint32_t flags = irq_save();
+    *out = stats;
+    irq_restore(flags);
+}
+
+void softirq_dump_stats(void) {
+    softirq_stats_t s;
+    softirq_get_stats(&s);
+    kprintf("softirq: %u raised, hi %u, tasklet %u runs; %u passes at IRQ exit, %u in ksoftirqd (%u handed over)\n",
+            s.raised, s.runs[SOFTIRQ_HI], s.runs[SOFTIRQ_TASKLET],
+            s.irq_exit_passes, s.thread_passes, s.deferred);
+    kprintf("softirq: %u tasklets run, up to %u per pass\n", s.tasklets, s.max_batch);
+}
+
+#ifdef SOFTIRQ_BENCH
+#include "interrupt/irq.h"
+#include "interrupt/io.h"
+#include "drivers/serial.h"
+#include "drivers/timer.h"
+#include "task/ktimer.h"
+
+#define BENCH_RUN_TICKS     200             // 2 s per mode
+#define BENCH_TIMER_NS      100000          // Timer interrupt every 100 us
+#define BENCH_IRQ           13              // FPU line: nothing else raises it
+#define BENCH_VECTOR        "45"            // 32 + BENCH_IRQ
+#define BENCH_RING_SIZE     256
+
+// Keyboard-style device on the bench line: read the data port, queue the
+// byte, let a tasklet consume the batch
+static uint8_t bench_ring[BENCH_RING_SIZE];
+static volatile uint32_t bench_head, bench_tail;
+static volatile uint32_t bench_consumed;
+static tasklet_t bench_tasklet;
+static ktimer_t bench_timer;
+static volatile int flood_stop;
+static volatile int flood_done;
+
+static void bench_consume(void* arg) {
+    (void)arg;
+    while (bench_tail != bench_head) {
+        bench_consumed += bench_ring[bench_tail++ & (BENCH_RING_SIZE - 1)];
+    }
+}
+
+static void bench_handler(registers_t* regs) {
+    (void)regs;
+    uint8_t data = inb(0x60);
+    if (bench_head - bench_tail < BENCH_RING_SIZE) {
+        bench_ring[bench_head++ & (BENCH_RING_SIZE - 1)] = data;
+    }
+    tasklet_schedule(&bench_tasklet);
+}
+
+// Periodic timer, so every 100 us there is an interrupt whose lateness counts
+static void bench_tick(void* arg) {
+    (void)arg;
+    add_timer(&bench_timer, bench_timer.expires_ns + BENCH_TIMER_NS);
+}
+
+static void flood_thread(void* arg) {
+    (void)arg;
+    static const char line[] = "softirq bench: serial flood ................................\n";
+    while (!flood_stop) {
+        for (int i = 0; i < 64; i++) {
+            asm volatile ("int $" BENCH_VECTOR);
+        }
+        if (serial_tx_space() >= sizeof(line)) {
+            serial_write(line, sizeof(line) - 1);
+        }
+    }
+    flood_done = 1;
+}
+
+static uint32_t bench_mode(int inline_bh) {
+    bench_inline = inline_bh;
+    flood_stop = 0;
+    flood_done = 0;
+    timer_latency_reset();
+    add_timer(&bench_timer, timer_now_ns() + BENCH_TIMER_NS);
+    thread_create("flood", flood_thread, NULL, SCHED_PRIO_DEFAULT);
+    thread_sleep(BENCH_RUN_TICKS);
+    uint32_t worst = timer_latency_max_ns();
+    flood_stop = 1;
+    while (!flood_done) {
+        thread_sleep(1);
+    }
+    del_timer(&bench_timer);
+    return worst;
+}
+
+static void bench_thread(void* arg) {
+    (void)arg;
+    tasklet_init(&bench_tasklet, bench_consume, NULL);
+    ktimer_setup(&bench_timer, bench_tick, NULL);
+    irq_register_handler(BENCH_IRQ, bench_handler);
+
+    timer_latency_reset();
+    thread_sleep(BENCH_RUN_TICKS);
+    uint32_t idle = timer_latency_max_ns();
+    uint32_t hard = bench_mode(1);
+    uint32_t deferred = bench_mode(0);
+    bench_inline = 0;
+    irq_unregister_handler(BENCH_IRQ);
+
+    kprintf("softirq: worst timer IRQ latency: idle %u ns, flood with work in the hard IRQ %u ns, "
+            "with bottom halves %u ns\n", idle, hard, deferred);
+    softirq_dump_stats();
+}
+
+void softirq_bench_start(void) {
+    thread_create("sqbench", bench_thread, NULL, SCHED_PRIO_MAX);
+}
+#endif
@@ -0,0 +1,81 @@
+#ifndef INTERRUPT_SOFTIRQ_H
+#define INTERRUPT_SOFTIRQ_H
+
+#include <stdint.h>
+
+// Bottom halves. IRQ handlers (top halves) acknowledge the device, queue
+// their work in O(1) and return, so the EOI goes out early. Raised softirqs
+// run on the way out of irq_handler with interrupts enabled, or from the
+// ksoftirqd thread when they keep getting re-raised. Every handler drains
+// all the work queued since its last run, so a flood costs one run per pass.
+//
+// Device IRQs are all delivered to the boot CPU, so the state is global.
+
+#define SOFTIRQ_HI          0       // tasklet_hi_schedule(): before everything else
+#define SOFTIRQ_TASKLET     1       // tasklet_schedule()
+#define SOFTIRQ_COUNT       2
+
+#define SOFTIRQ_MAX_RESTART 10      // Passes at IRQ exit before the rest goes to ksoftirqd
+
+typedef void (*softirq_fn_t)(void);
+typedef void (*tasklet_fn_t)(void* arg);
+
+// Deferred function. A tasklet is queued at most once at a time and never
+// runs concurrently with itself; scheduling it again while it runs queues
+// one more run.
+typedef struct tasklet {
+    struct tasklet* next;
+    volatile uint32_t scheduled;
+    tasklet_fn_t fn;
+    void* arg;
+} tasklet_t;
+
+typedef struct {
+    uint32_t raised;                // raise_softirq() calls
+    uint32_t runs[SOFTIRQ_COUNT];   // Handler runs per softirq
+    uint32_t irq_exit_passes;       // Passes run on the way out of an IRQ
+    uint32_t thread_passes;         // Passes run by ksoftirqd
+    uint32_t deferred;              // IRQ exits that left work to ksoftirqd
+    uint32_t tasklets;              // Tasklet runs
+    uint32_t max_batch;             // Most tasklets run by one handler pass
+} softirq_stats_t;
+
+// Start the ksoftirqd thread (needs sched_init()). Softirqs raised in
+// interrupts already run at IRQ exit before this.
+void softirq_init(void);
+
+// Install the handler of softirq 'nr'
+void open_softirq(uint32_t nr, softirq_fn_t fn);
+
+// Mark softirq 'nr' pending. O(1), callable from any context. Outside an
+// interrupt, ksoftirqd is woken to run it.
+void raise_softirq(uint32_t nr);
+
+void tasklet_init(tasklet_t* t, tasklet_fn_t fn, void* arg);
+void tasklet_schedule(tasklet_t* t);
+void tasklet_hi_schedule(tasklet_t* t);
+
+// Called by irq_handler around each interrupt: irq_exit() (after the EOI,
+// interrupts disabled) runs pending softirqs unless this interrupt arrived
+// while they were running, and returns whether the interrupted context may
+// be preempted.
+void irq_enter(void);
+int irq_exit(void);
+
+// In an interrupt handler or a bottom half
+int in_interrupt(void);
+
+// Counters
+void softirq_get_stats(softirq_stats_t* out);
+
+// Print the counters (kprintf; on F12 with the IRQ stats)
+void softirq_dump_stats(void);
+
+#ifdef SOFTIRQ_BENCH
+// Worst-case timer IRQ latency under a keyboard-style IRQ flood and serial
+// output, with the bottom halves run inside the hard IRQ and deferred
+// (build with -DSOFTIRQ_BENCH)
+void softirq_bench_start(void);
+#endif
+
+#endif // INTERRUPT_SOFTIRQ_H
@@ -1,8 +1,34 @@
 #include <stddef.h>
 #include <stdint.h>
 #include "interrupt/idt.h"
+#include "interrupt/irq.h"
+#include "interrupt/irq_stats.h"
+#include "interrupt/softirq.h"
 #include "drivers/timer.h"
+#include "drivers/clocksource.h"
+#include "drivers/rtc.h"
 #include "drivers/keyboard.h"
+#include "drivers/serial.h"
+#include "drivers/vga.h"
+#include "drivers/ata.h"
+#include "block/bcache.h"
+#include "fs/initrd.h"
+#include "trace/profile.h"
+#include "trace/trace.h"
+#include "bootloader/boot_info.h"
+#include "memory/pmm.h"
+#include "memory/paging.h"
+#include "memory/kmalloc.h"
+#include "memory/vmm.h"
+#include "task/sched.h"
+#include "cpu/gdt.h"
+#include "cpu/smp.h"
+#include "cpu/syscall.h"
+#include "cpu/fpu.h"
+#include "libc/include/string.h"
+#include "libc/include/stdio.h"
+#include "interrupt/irqflags.h"
+#include "task/ktimer.h"
 
 
 // Ensure we're using x86 compiler
@@ -10,175 +36,16 @@
     #error "This code must be compiled with an x86-elf compiler"
 #endif
 
-// VGA constants
-#define VGA_MEMORY 0xB8000
-#define VGA_WIDTH 80
-#define VGA_HEIGHT 25
-
-// VGA colors
-enum vga_color {
-    BLACK = 0,
-    BLUE = 1,
-    GREEN = 2,
-    CYAN = 3,
-    RED = 4,
-    MAGENTA = 5,
-    BROWN = 6,
-    LIGHT_GRAY = 7,
-    DARK_GRAY = 8,
-    LIGHT_BLUE = 9,
-    LIGHT_GREEN = 10,
-    LIGHT_CYAN = 11,
-    LIGHT_RED = 12,
-    LIGHT_MAGENTA = 13,
-    YELLOW = 14,
-    WHITE = 15
-};
-
-// Global variables
-static volatile uint16_t* const vga_buffer = (uint16_t*)VGA_MEMORY;
-static size_t term_row = 0;
-static size_t term_col = 0;
-static uint8_t term_color;
-
-// Create a VGA entry from character and color
-static inline uint16_t vga_entry(char c, uint8_t color) {
-    return (uint16_t)c | ((uint16_t)color << 8);
-}
-
-// Create a color attribute from foreground and background
-static inline uint8_t vga_color(enum vga_color fg, enum vga_color bg) {
-    return fg | (bg << 4);
-}
-
-// Initialize terminal
-void term_init(void) {
-    term_row = 0;
-    term_col = 0;
-    term_color = vga_color(WHITE, BLACK);
-    
-    // Clear screen
-    for (size_t y = 0; y < VGA_HEIGHT; y++) {
-        for (size_t x = 0; x < VGA_WIDTH; x++) {
-            const size_t index = y * VGA_WIDTH + x;
-            vga_buffer[index] = vga_entry(' ', term_color);
-        }
-    }
-}
-
-// Set terminal color
-void term_setcolor(enum vga_color fg, enum vga_color bg) {
-    term_color = vga_color(fg, bg);
-}
-
-// Scroll the screen up one line
-static void term_scroll(void) {
-    // Move each line up
-    for (size_t y = 1; y < VGA_HEIGHT; y++) {
-        for (size_t x = 0; x < VGA_WIDTH; x++) {
-            const size_t to_index = (y - 1) * VGA_WIDTH + x;
-            const size_t from_index = y * VGA_WIDTH + x;
-            vga_buffer[to_index] = vga_buffer[from_index];
-        }
-    }
-    
-    // Clear bottom line
-    for (size_t x = 0; x < VGA_WIDTH; x++) {
-        const size_t index = (VGA_HEIGHT - 1) * VGA_WIDTH + x;
-        vga_buffer[index] = vga_entry(' ', term_color);
-    }
-    term_row = VGA_HEIGHT - 1;
-}
-
-// Put a character on screen
-void term_putchar(char c) {
-    
-    switch (c) {
-        case '\n':
-            term_col = 0;
-            term_row++;
-            break;
-        case '\b':
-            if (term_col > 0) {
-                term_col--;
-                const size_t index = term_row * VGA_WIDTH + term_col;
-                vga_buffer[index] = vga_entry(' ', term_color);
-            }
-            break;
-
-        /* TODO: add cases
-            case '\t':  // tab (advance to next 8‑column boundary)
-            case '\r':  // carriage return
-            case 0x1B: // ESC sequences
-        */
-        default:
-            const size_t index = term_row * VGA_WIDTH + term_col;
-            vga_buffer[index] = vga_entry(c, term_color);
-            term_col++;
-            break;
-    }
-
-    if (term_col >= VGA_WIDTH) {
-        term_col = 0;
-        term_row++;
-    }
-    if (term_row >= VGA_HEIGHT) {
-        term_scroll();
-    }
-}
-
-void term_putc(char c) {
-    term_putchar(c);
-}
-
-void term_print(const char* str) {
-    for (size_t i = 0; str[i] != '\0'; i++) {
-        term_putchar(str[i]);
-    }
-}
-
- // Memory management definitions
-#define PAGE_PRESENT     0x1
-#define PAGE_WRITE       0x2
-#define PAGE_SIZE_FLAG   0x80
-
-static uint32_t page_directory[1024] __attribute__((aligned(4096)));
-static uint32_t first_page_table[1024] __attribute__((aligned(4096)));
-
-// Initialize paging (identity map first 4MB)
-void initialize_memory(void) {
-    // Clear page directory and first page table
-    for (int i = 0; i < 1024; i++) {
-        page_directory[i] = 0;
-        first_page_table[i] = 0;
-    }
-    // Identity map first 4MB using 4KB pages
-    for (int i = 0; i < 1024; i++) {
-        first_page_table[i] = (i * 0x1000) | PAGE_PRESENT | PAGE_WRITE;
-    }
-    // Point first entry of page directory to our page table
-    page_directory[0] = ((uint32_t)first_page_table) | PAGE_PRESENT | PAGE_WRITE;
-
-    // Load page directory into CR3
-    asm volatile("movl %0, %%cr3" :: "r"(page_directory));
-
-    // Enable paging by setting the PG bit in CR0
-    uint32_t cr0;
-    // Read CR0
-    asm volatile("movl %%cr0, %0" : "=r"(cr0));
-    // Set PG bit (bit 31)
-    cr0 |= 0x80000000;
-    // Write back to CR0
-    asm volatile("movl %0, %%cr0" :: "r"(cr0));
-}
-
+#ifdef BENCH_MODE
+#include "bench/bench.h"
+#endif
 
 // void kernel_main(void) {
 //     term_init();
 //     term_print("KERNEL REACHED\n");
 
 //     initialize_memory();
-//     term_print("Memory initialized.\n");
+//     kprintf("Memory initialized.\n");
 
 //     idt_install();
 //     term_print("Interrupts installed.\n");
@@ -187,7 +54,7 @@ void initialize_memory(void) {
 //     term_print("Timer initialized (100 Hz).\n");
 
 //     keyboard_init();
-//     term_print("Keyboard initialized.\n");
+//     kprintf("Keyboard initialized.\n");
     
 //     asm volatile ("sti");
 //     term_print("Interrupts enabled. Type something!\n");
@@ -201,44 +68,241 @@ void initialize_memory(void) {
 //     }
 // }
 
-// Kernel entry point
-void kernel_main(void) {
+// Echo typed characters; sleeps in keyboard_read() while nothing is typed
+static void console_thread(void* arg) {
+    (void)arg;
+    char buf[32];
+    for(;;) {
+        size_t n = keyboard_read(buf, sizeof(buf));
+        for (size_t i = 0; i < n; i++) {
+            if (buf[i] == KBD_PAGE_UP) {
+                term_scrollback(VGA_HEIGHT / 2);
+            } else if (buf[i] == KBD_PAGE_DOWN) {
+                term_scrollback(-(VGA_HEIGHT / 2));
+            } else if (buf[i] == KBD_F12) {
+                irq_stats_dump();
+                vmm_dump_stats();
+                fpu_dump_stats();
+                softirq_dump_stats();
+                ata_dump_stats();
+                bcache_dump_stats();
+                profile_dump_stats();
+                trace_dump_stats();
+            } else if (buf[i] == KBD_F11) {
+                // First press starts sampling, the second streams the samples over serial
+                if (profile_running()) {
+                    profile_dump_start();
+                } else if (profile_start(PROFILE_DEFAULT_HZ)) {
+                    kprintf("Profiling at %u Hz, F11 again to stop.\n", PROFILE_DEFAULT_HZ);
+                }
+            } else if (buf[i] == KBD_F10) {
+                // Tracepoints on and off; records stream out while they are on
+                if (trace_running()) {
+                    trace_stop();
+                    kprintf("Tracing stopped.\n");
+                } else if (trace_start()) {
+                    trace_stats_t ts;
+                    trace_get_stats(&ts);
+                    kprintf("Tracing to %s, F10 again to stop.\n",
+                            ts.debugcon ? "debugcon (port 0xE9)" : "the serial port");
+                }
+            } else {
+                term_putc(buf[i]); // Print the character to the screen
+            }
+        }
+        term_flush(); // Echo right away rather than at the next batched flush
+    }
+}
+
+// How stage 2 loaded us, and (BOOT_BENCH images) how long one sector per read took
+static void boot_report(const boot_info_t* boot_info) {
+    if (boot_info == NULL || boot_info->kernel_size == 0) {
+        return;
+    }
+    kprintf("Kernel loaded: %u KB at %p from drive 0x%x, %u reads, %llu cycles\n",
+            boot_info->kernel_size / 1024, (void*)boot_info->kernel_addr, boot_info->boot_drive,
+            boot_info->load_reads, boot_info->load_cycles);
+
+    uint64_t batched = boot_info->load_cycles;
+    uint64_t single = boot_info->sector_load_cycles;
+    if (single != 0 && batched != 0) {
+        // Ratio x100 without a 64-bit division
+        while ((single | batched) >> 25) {
+            single >>= 1;
+            batched >>= 1;
+        }
+        uint32_t ratio = batched ? (uint32_t)single * 100 / (uint32_t)batched : 0;
+        kprintf("Sector-by-sector load: %llu cycles, batched reads are %u.%02ux faster\n",
+                boot_info->sector_load_cycles, ratio / 100, ratio % 100);
+    }
+}
+
+// Monotonic clock source and the RTC's wall-clock time
+static void clock_report(void) {
+    uint32_t khz = clocksource_tsc_khz();
+    if (khz != 0) {
+        kprintf("Clock: %s, TSC at %u.%03u MHz\n", clocksource_name(), khz / 1000, khz % 1000);
+    } else {
+        kprintf("Clock: %s\n", clocksource_name());
+    }
+    rtc_time_t t;
+    rtc_get_time(&t);
+    kprintf("Wall clock: %04u-%02u-%02u %02u:%02u:%02u UTC\n",
+            t.year, t.month, t.day, t.hour, t.minute, t.second);
+}
+
+// Files packed after the kernel by the build script, indexed in place
+static void initrd_report(const boot_info_t* boot_info) {
+    uint32_t files = initrd_init(boot_info);
+    if (files == 0) {
+        kprintf("Initrd: none\n");
+        return;
+    }
+    initrd_info_t info;
+    initrd_get_info(&info);
+    kprintf("Initrd: %u files, %u KB, index built in %u us (%u cycles)\n",
+            files, info.bytes / 1024, timer_ns_to_us(info.build_ns),
+            (uint32_t)info.build_cycles);
+
+    // The archive is not NUL-terminated: print the message through a bounded copy
+    const initrd_file_t* motd = initrd_lookup("/etc/motd");
+    if (motd != NULL) {
+        char text[256];
+        uint32_t len = motd->size < sizeof(text) - 1 ? motd->size : sizeof(text) - 1;
+        memcpy(text, motd->data, len);
+        text[len] = '\0';
+        kprintf("%s", text);
+    }
+}
+
+// Kernel entry point (boot_info is filled in by stage 2, see bootloader/boot_info.h)
+void kernel_main(const boot_info_t* boot_info) {
+    // Own GDT first: the MBR's lies in memory the kernel's .bss now covers
+    gdt_init();
+    // FPU and SSE on (before the APs copy CR4), then CPU-specific memset/memcpy
+    fpu_init();
+    string_init();
+
     term_init();
+    // COM1 console, polled until interrupts are installed
+    int serial = serial_init();
     
     term_setcolor(GREEN, BLACK);
-    term_print("Welcome to rotOS!\n");
+    kprintf("Welcome to rotOS!\n");
     
     term_setcolor(WHITE, BLACK);
-    term_print("System initialized successfully.\n");
-    term_print("Terminal is ready.\n");
+    kprintf("System initialized successfully.\n");
+    kprintf("Terminal is ready%s.\n", serial ? " (serial console on COM1)" : "");
+    boot_report(boot_info);
+
+    // Kernel page tables: RAM direct mapped in the higher half, no identity map
+    initialize_memory(boot_info);
+    kprintf("Memory initialized (%s, %u MB direct mapped).\n",
+            paging_mode_name(), paging_direct_map_end() >> 20);
 
-    // Initialize memory and enable paging
-    initialize_memory();
-    term_print("Memory initialized.\n");
+    // Build the physical frame allocator from the BIOS memory map
+    pmm_init(boot_info);
+    pmm_stats_t mem;
+    pmm_get_stats(&mem);
+    kprintf("Physical memory: %u KB free\n", mem.free_frames * (PMM_FRAME_SIZE / 1024));
+
+    // Slab caches for kmalloc/kfree
+    kmalloc_init();
+    kprintf("Kernel heap initialized.\n");
 
     // Initialize Interrupts
     idt_install();  // Load the IDT
-    term_print("Interrupts installed.\n");
-
-    // Initialize Timer (PIT) to 100 Hz
-    timer_init(100);
-    term_print("Timer initialized (100 Hz).\n");
+    vmm_init();     // Page-fault handler: demand-paged regions, thread stack guard pages
+    syscall_init(); // int 0x80 gate and the SYSENTER MSRs
+    fpu_enable_lazy(); // #NM handler: FPU/SSE state follows threads lazily
+    serial_enable_irq();
+    kprintf("Interrupts installed (%s).\n", irq_chip_name());
+
+    // Calibrate the TSC against the PIT: the clock when it is invariant
+    clocksource_init();
+    // One-shot timer (LAPIC or PIT), no periodic tick
+    timer_init();
+    kprintf("Timer initialized (%s, tickless).\n", timer_source_name());
+    // Wall clock from the CMOS RTC, re-anchored by its IRQ8 every second
+    rtc_init();
+    clock_report();
+    initrd_report(boot_info);
+    term_enable_deferred_flush();
 
     // Initialize Keyboard (Commented out for debugging)
     keyboard_init();
     term_print("Keyboard initialized.\n");
 
+    // Kernel threads; kernel_main itself becomes the idle thread
+    sched_init();
+    softirq_init(); // ksoftirqd for bottom halves that outlast an IRQ exit
+    kprintf("Scheduler initialized.\n");
+
+    // Disks on the primary IDE channel (completions run in a tasklet)
+    kprintf("ATA drives: %u\n", ata_init());
+    // Block cache in front of them, with its write-back thread
+    kprintf("Buffer cache: up to %u KB.\n", bcache_init() * (BCACHE_BLOCK_SIZE / 1024));
+
     // Enable interrupts
     asm volatile ("sti");
-    term_print("Interrupts enabled. Type something!\n");
 
-    // Infinite loop: Poll keyboard and print characters
-    for(;;) {
-        char c = keyboard_getchar(); // Get char from keyboard buffer (non-blocking)
-        if (c != 0) {
-            term_putc(c); // Print the character to the screen
-        }
-        // Yield CPU or do other tasks
-        asm volatile ("hlt"); // Wait for next interrupt (timer or keyboard)
-    }
+    // Application processors (needs the timer for the INIT/STARTUP delays)
+    kprintf("CPUs online: %u\n", smp_init());
+    // Sample buffers for every CPU; F11 starts and stops sampling
+    profile_init();
+    // Trace rings for every CPU; F10 turns the tracepoints on and off
+    trace_init();
+    kprintf("Interrupts enabled. Type something!\n");
+
+#ifdef PMM_STRESS
+    pmm_stress();
+#endif
+#ifdef INITRD_BENCH
+    initrd_bench();
+#endif
+#ifdef KMALLOC_BENCH
+    kmalloc_bench();
+#endif
+#ifdef IRQ_BENCH
+    irq_bench();
+#endif
+#ifdef STRING_BENCH
+    string_bench();
+#endif
+#ifdef TERM_BENCH
+    term_bench();
+#endif
+#ifdef BENCH_MODE
+    bench_run_all();
+#endif
+
+    // Keyboard echo runs in its own thread
+    thread_create("console", console_thread, NULL, SCHED_PRIO_DEFAULT);
+#ifdef SCHED_BENCH
+    sched_bench_start();
+#endif
+#ifdef TIMER_BENCH
+    timer_bench_start();
+#endif
+#ifdef SMP_BENCH
+    smp_bench_start();
+#endif
+#ifdef SERIAL_BENCH
+    serial_bench_start();
+#endif
+#ifdef SYSCALL_BENCH
+    syscall_bench_start();
+#endif
+#ifdef SOFTIRQ_BENCH
+    softirq_bench_start();
+#endif
+#ifdef ATA_BENCH
+    ata_bench_start();
+#endif
+#ifdef BCACHE_BENCH
+    bcache_bench_start();
+#endif
+
+    // The boot context becomes the idle thread: reap exited threads and hlt
+    sched_idle();
 }
\ No newline at end of file
@@ -1,5 +1,60 @@
 global _start
 [bits 32]
 [extern kernel_main] ; Define calling point. Must have same name as kernel.c 'main' function
+[extern __bss_start] ; Provided by the linker
+[extern _end]
+
+KERNEL_VIRT_BASE equ 0xC0000000 ; Must match KERNEL_VIRT_BASE in memory/paging.h
+
+; The kernel is linked at KERNEL_VIRT_BASE + 1 MB but stage 2 loads and jumps
+; to it at 1 MB with paging off, so until paging is on symbols are used
+; through their physical address.
+%define PHYS(x) ((x) - KERNEL_VIRT_BASE)
+
+_start:
+; The MBR only loads the raw image, so .bss holds whatever was left in RAM. Zero it.
+mov edi, PHYS(__bss_start)
+mov ecx, PHYS(_end)
+sub ecx, edi
+xor eax, eax
+cld
+rep stosb
+
+; Boot page table: the first 4 MB, mapped both at 0 (for the next few
+; instructions and the stack) and at KERNEL_VIRT_BASE. initialize_memory()
+; replaces it with the full direct map and drops the identity half.
+mov edi, PHYS(boot_page_table)
+mov eax, 0x3                ; Present | write
+.fill:
+stosd
+add eax, 0x1000
+cmp edi, PHYS(boot_page_table) + 4096
+jne .fill
+mov eax, PHYS(boot_page_table) + 0x3
+mov [PHYS(boot_page_directory)], eax
+mov [PHYS(boot_page_directory) + (KERNEL_VIRT_BASE >> 22) * 4], eax
+
+mov eax, PHYS(boot_page_directory)
+mov cr3, eax
+mov eax, cr0
+or eax, 0x80000000          ; PG
+mov cr0, eax
+mov eax, higher_half        ; Absolute jump to the linked (virtual) address
+jmp eax
+
+higher_half:
+add esp, KERNEL_VIRT_BASE   ; Stage 2's stack, through the higher-half mapping
+test ebx, ebx
+jz .no_info
+add ebx, KERNEL_VIRT_BASE   ; boot_info_t* from stage 2 is physical
+.no_info:
+push ebx         ; boot_info_t* is the first argument to kernel_main
 call kernel_main ; Calls the C function. The linker will know where it is placed in memory
-jmp $
\ No newline at end of file
+jmp $
+
+section .bss
+align 4096
+boot_page_directory:
+resb 4096
+boot_page_table:
+resb 4096
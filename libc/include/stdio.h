@@ -0,0 +1,20 @@
+// libc/include/stdio.h
+#ifndef LIBC_STDIO_H
+#define LIBC_STDIO_H
+
+#include <stdarg.h>
+#include <stddef.h> // For size_t
+
+// Longest kprintf() line; longer output is truncated
+#define KPRINTF_BUF_SIZE    256
+
+// Supported: %d %i %u %x %X %p %s %c %%, flags '-' and '0', a field width,
+// a precision for %s, and the length modifiers l, ll and z.
+int kvsnprintf(char* buf, size_t size, const char* fmt, va_list args);
+int ksnprintf(char* buf, size_t size, const char* fmt, ...) __attribute__((format(printf, 3, 4)));
+
+// Format into a per-call stack buffer and write it to the serial console and
+// the VGA terminal. Safe from interrupt handlers; never waits for the UART.
+int kprintf(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+
+#endif // LIBC_STDIO_H
@@ -0,0 +1,33 @@
+// libc/include/string.h
+#ifndef LIBC_STRING_H
+#define LIBC_STRING_H
+
+#include <stddef.h> // For size_t
+
+// Pick the fastest implementations for this CPU: SSE2 when fpu_init()
+// enabled it. Call once on the boot CPU after fpu_init(); safe to skip.
+void string_init(void);
+
+// Name of the bulk copy/fill path chosen by string_init()
+const char* string_impl_name(void);
+
+void* memset(void* bufptr, int value, size_t size);
+void* memcpy(void* restrict dst, const void* restrict src, size_t size);
+void* memmove(void* dst, const void* src, size_t size);
+int memcmp(const void* a, const void* b, size_t size);
+void* memchr(const void* buf, int value, size_t size);
+
+size_t strlen(const char* str);
+size_t strnlen(const char* str, size_t max);
+int strcmp(const char* a, const char* b);
+int strncmp(const char* a, const char* b, size_t size);
+char* strcpy(char* restrict dst, const char* restrict src);
+char* strncpy(char* restrict dst, const char* restrict src, size_t size);
+char* strchr(const char* str, int c);
+
+#ifdef STRING_BENCH
+// Bytes/cycle of memset/memcpy from 16 B to 1 MB (build with -DSTRING_BENCH)
+void string_bench(void);
+#endif
+
+#endif // LIBC_STRING_H
@@ -0,0 +1,201 @@
+// libc/stdio/kprintf.c
+#include "libc/include/stdio.h"
+#include "drivers/serial.h"
+#include <stdarg.h>
+#include <stdint.h>
+
+extern void term_print(const char* str);    // from drivers/vga.c
+
+#define FLAG_LEFT           0x01
+#define FLAG_ZERO           0x02
+
+// Bounded output cursor; counts what would have been written past the end
+typedef struct {
+    char* buf;
+    size_t size;
+    size_t len;
+} out_t;
+
+static inline void put(out_t* out, char c) {
+    if (out->len + 1 < out->size) {
+        out->buf[out->len] = c;
+    }
+    out->len++;
+}
+
+// n /= 10, returning the remainder. The high word is divided first so the
+// 64-by-32 divl never overflows: no 64-bit division helper from libgcc.
+static uint32_t div10(uint64_t* n) {
+    uint32_t hi = (uint32_t)(*n >> 32);
+    uint32_t lo = (uint32_t)*n;
+    uint32_t rem = hi % 10;
+    hi /= 10;
+    asm ("divl %4" : "=a"(lo), "=d"(rem) : "a"(lo), "d"(rem), "r"(10u));
+    *n = ((uint64_t)hi << 32) | lo;
+    return rem;
+}
+
+// Emit 'len' characters of 'str' padded to 'width'
+static void put_field(out_t* out, const char* str, size_t len, int width, int flags, char sign) {
+    int pad = width - (int)len - (sign != 0);
+    char fill = (flags & FLAG_ZERO) && !(flags & FLAG_LEFT) ? '0' : ' ';
+    if (fill == '0' && sign) {
+        put(out, sign);
+    }
+    if (!(flags & FLAG_LEFT)) {
+        for (; pad > 0; pad--) {
+            put(out, fill);
+        }
+    }
+    if (fill != '0' && sign) {
+        put(out, sign);
+    }
+    for (size_t i = 0; i < len; i++) {
+        put(out, str[i]);
+    }
+    for (; pad > 0; pad--) {
+        put(out, ' ');
+    }
+}
+
+static void put_number(out_t* out, uint64_t value, unsigned base, int upper, int width, int flags, char sign) {
+    const char* digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    char tmp[20];
+    size_t i = sizeof(tmp);
+    do {
+        uint32_t d;
+        if (base == 16) {
+            d = value & 0xF;
+            value >>= 4;
+        } else {
+            d = div10(&value);
+        }
+        tmp[--i] = digits[d];
+    } while (value != 0);
+    put_field(out, &tmp[i], sizeof(tmp) - i, width, flags, sign);
+}
+
+int kvsnprintf(char* buf, size_t size, const char* fmt, va_list args) {
+    out_t out = { buf, size, 0 };
+
+    for (; *fmt != '\0'; fmt++) {
+        if (*fmt != '%') {
+            put(&out, *fmt);
+            continue;
+        }
+
+        int flags = 0;
+        for (;; fmt++) {
+            if (fmt[1] == '-') {
+                flags |= FLAG_LEFT;
+            } else if (fmt[1] == '0') {
+                flags |= FLAG_ZERO;
+            } else {
+                break;
+            }
+        }
+        int width = 0;
+        while (fmt[1] >= '0' && fmt[1] <= '9') {
+            width = width * 10 + (*++fmt - '0');
+        }
+        int precision = -1;
+        if (fmt[1] == '.') {
+            fmt++;
+            precision = 0;
+            while (fmt[1] >= '0' && fmt[1] <= '9') {
+                precision = precision * 10 + (*++fmt - '0');
+            }
+        }
+        int longs = 0, size_t_arg = 0;
+        while (fmt[1] == 'l' || fmt[1] == 'z') {
+            if (*++fmt == 'l') {
+                longs++;
+            } else {
+                size_t_arg = 1;
+            }
+        }
+        fmt++;
+
+        switch (*fmt) {
+            case 'd':
+            case 'i': {
+                int64_t v = longs >= 2 ? va_arg(args, long long)
+                          : longs == 1 ? va_arg(args, long)
+                          : size_t_arg ? (int64_t)va_arg(args, size_t)
+                          : va_arg(args, int);
+                put_number(&out, v < 0 ? -(uint64_t)v : (uint64_t)v, 10, 0, width, flags, v < 0 ? '-' : 0);
+                break;
+            }
+            case 'u':
+            case 'x':
+            case 'X': {
+                uint64_t v = longs >= 2 ? va_arg(args, unsigned long long)
+                           : longs == 1 ? va_arg(args, unsigned long)
+                           : size_t_arg ? va_arg(args, size_t)
+                           : va_arg(args, unsigned int);
+                put_number(&out, v, *fmt == 'u' ? 10 : 16, *fmt == 'X', width, flags, 0);
+                break;
+            }
+            case 'p':
+                put(&out, '0');
+                put(&out, 'x');
+                put_number(&out, (uintptr_t)va_arg(args, void*), 16, 0, 8, FLAG_ZERO, 0);
+                break;
+            case 's': {
+                const char* s = va_arg(args, const char*);
+                if (s == NULL) {
+                    s = "(null)";
+                }
+                size_t len = 0;
+                while (s[len] != '\0' && (precision < 0 || len < (size_t)precision)) {
+                    len++;
+                }
+                put_field(&out, s, len, width, flags & FLAG_LEFT, 0);
+                break;
+            }
+            case 'c': {
+                char c = (char)va_arg(args, int);
+                put_field(&out, &c, 1, width, flags & FLAG_LEFT, 0);
+                break;
+            }
+            case '%':
+                put(&out, '%');
+                break;
+            case '\0':
+                fmt--;                      // Lone '%' at the end
+                break;
+            default:
+                put(&out, '%');
+                put(&out, *fmt);
+                break;
+        }
+    }
+
+    if (size > 0) {
+        buf[out.len < size ? out.len : size - 1] = '\0';
+    }
+    return (int)out.len;
+}
+
+int ksnprintf(char* buf, size_t size, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int len = kvsnprintf(buf, size, fmt, args);
+    va_end(args);
+    return len;
+}
+
+int kprintf(const char* fmt, ...) {
+    char buf[KPRINTF_BUF_SIZE];
+    va_list args;
+    va_start(args, fmt);
+    int len = kvsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    if (len >= KPRINTF_BUF_SIZE) {
+        len = KPRINTF_BUF_SIZE - 1;
+    }
+
+    serial_write(buf, len);
+    term_print(buf);
+    return len;
+}
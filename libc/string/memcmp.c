@@ -0,0 +1,38 @@
+// libc/string/memcmp.c
+#include "libc/include/string.h"
+#include <stdint.h>
+
+int memcmp(const void* aptr, const void* bptr, size_t size) {
+    const uint8_t* a = aptr;
+    const uint8_t* b = bptr;
+
+    // Skip equal words; the first differing word is then resolved bytewise
+    while (size >= 4) {
+        uint32_t wa, wb;
+        __builtin_memcpy(&wa, a, 4);
+        __builtin_memcpy(&wb, b, 4);
+        if (wa != wb) {
+            break;
+        }
+        a += 4;
+        b += 4;
+        size -= 4;
+    }
+    for (size_t i = 0; i < size; i++) {
+        if (a[i] != b[i]) {
+            return a[i] < b[i] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+void* memchr(const void* bufptr, int value, size_t size) {
+    const uint8_t* buf = bufptr;
+    uint8_t c = (uint8_t)value;
+    for (size_t i = 0; i < size; i++) {
+        if (buf[i] == c) {
+            return (void*)(buf + i);
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,122 @@
+// libc/string/memcpy.c
+#include "libc/include/string.h"
+#include "string_impl.h"
+#include <stdint.h>
+
+// Copy 'blocks' 64-byte blocks to 16-byte aligned 'dst' (any 'src' alignment)
+static void sse2_copy(uint8_t* dst, const uint8_t* src, size_t blocks, int nontemporal) {
+    uint8_t save[4][16];                // xmm0-3, one asm operand each
+    if (nontemporal) {
+        asm volatile (
+            "movdqu %%xmm0, %[s0]\n\t"
+            "movdqu %%xmm1, %[s1]\n\t"
+            "movdqu %%xmm2, %[s2]\n\t"
+            "movdqu %%xmm3, %[s3]\n"
+            "1:\n\t"
+            "movdqu (%[src]), %%xmm0\n\t"
+            "movdqu 16(%[src]), %%xmm1\n\t"
+            "movdqu 32(%[src]), %%xmm2\n\t"
+            "movdqu 48(%[src]), %%xmm3\n\t"
+            "movntdq %%xmm0, (%[dst])\n\t"
+            "movntdq %%xmm1, 16(%[dst])\n\t"
+            "movntdq %%xmm2, 32(%[dst])\n\t"
+            "movntdq %%xmm3, 48(%[dst])\n\t"
+            "add $64, %[src]\n\t"
+            "add $64, %[dst]\n\t"
+            "dec %[blocks]\n\t"
+            "jnz 1b\n\t"
+            "sfence\n\t"
+            "movdqu %[s0], %%xmm0\n\t"
+            "movdqu %[s1], %%xmm1\n\t"
+            "movdqu %[s2], %%xmm2\n\t"
+            "movdqu %[s3], %%xmm3"
+            : [dst] "+r"(dst), [src] "+r"(src), [blocks] "+r"(blocks),
+              [s0] "+m"(save[0]), [s1] "+m"(save[1]), [s2] "+m"(save[2]), [s3] "+m"(save[3])
+            : : "memory");
+    } else {
+        asm volatile (
+            "movdqu %%xmm0, %[s0]\n\t"
+            "movdqu %%xmm1, %[s1]\n\t"
+            "movdqu %%xmm2, %[s2]\n\t"
+            "movdqu %%xmm3, %[s3]\n"
+            "1:\n\t"
+            "movdqu (%[src]), %%xmm0\n\t"
+            "movdqu 16(%[src]), %%xmm1\n\t"
+            "movdqu 32(%[src]), %%xmm2\n\t"
+            "movdqu 48(%[src]), %%xmm3\n\t"
+            "movdqa %%xmm0, (%[dst])\n\t"
+            "movdqa %%xmm1, 16(%[dst])\n\t"
+            "movdqa %%xmm2, 32(%[dst])\n\t"
+            "movdqa %%xmm3, 48(%[dst])\n\t"
+            "add $64, %[src]\n\t"
+            "add $64, %[dst]\n\t"
+            "dec %[blocks]\n\t"
+            "jnz 1b\n\t"
+            "movdqu %[s0], %%xmm0\n\t"
+            "movdqu %[s1], %%xmm1\n\t"
+            "movdqu %[s2], %%xmm2\n\t"
+            "movdqu %[s3], %%xmm3"
+            : [dst] "+r"(dst), [src] "+r"(src), [blocks] "+r"(blocks),
+              [s0] "+m"(save[0]), [s1] "+m"(save[1]), [s2] "+m"(save[2]), [s3] "+m"(save[3])
+            : : "memory");
+    }
+}
+
+void* memcpy(void* restrict dstptr, const void* restrict srcptr, size_t size) {
+    uint8_t* dst = dstptr;
+    const uint8_t* src = srcptr;
+    if (size < STRING_SMALL) {
+        for (size_t i = 0; i < size; i++) {
+            dst[i] = src[i];
+        }
+        return dstptr;
+    }
+
+    if (string_sse2 && size >= STRING_SSE2_MIN) {
+        // Align the destination; unaligned loads are cheap, unaligned stores are not
+        while ((uintptr_t)dst & 15) {
+            *dst++ = *src++;
+            size--;
+        }
+        sse2_copy(dst, src, size / 64, size >= STRING_NT_MIN);
+        dst += size & ~(size_t)63;
+        src += size & ~(size_t)63;
+        size &= 63;
+    } else {
+        while ((uintptr_t)dst & 3) {
+            *dst++ = *src++;
+            size--;
+        }
+    }
+
+    // Words with rep movsd, then the tail bytes
+    size_t words = size / 4;
+    asm volatile ("rep movsl" : "+D"(dst), "+S"(src), "+c"(words) : : "memory");
+    for (size_t i = 0; i < (size & 3); i++) {
+        dst[i] = src[i];
+    }
+    return dstptr;
+}
+
+void* memmove(void* dstptr, const void* srcptr, size_t size) {
+    uint8_t* dst = dstptr;
+    const uint8_t* src = srcptr;
+
+    // A forward copy is safe unless the destination starts inside the source
+    if (dst <= src || dst >= src + size) {
+        return memcpy(dstptr, srcptr, size);
+    }
+
+    // Backwards: tail bytes first so the rest is whole words, then std; rep movsd
+    while (size & 3) {
+        size--;
+        dst[size] = src[size];
+    }
+    size_t words = size / 4;
+    if (words) {
+        uint8_t* d = dst + size - 4;
+        const uint8_t* s = src + size - 4;
+        asm volatile ("std\n\trep movsl\n\tcld" : "+D"(d), "+S"(s), "+c"(words) : : "memory");
+    }
+    return dstptr;
+}
@@ -1,11 +1,96 @@
 // libc/string/memset.c
-#include "libc/include/memset.h" // Use relative path from implementation to its header
+#include "libc/include/string.h" // Use relative path from implementation to its header
+#include "string_impl.h"
 #include <stdint.h>
 
+// Fill 'blocks' 64-byte blocks at 16-byte aligned 'dst' with 'word'
+static void sse2_fill(uint8_t* dst, uint32_t word, size_t blocks, int nontemporal) {
+    uint8_t save[16];
+    if (nontemporal) {
+        asm volatile (
+            "movdqu %%xmm0, %[save]\n\t"
+            "movd %[word], %%xmm0\n\t"
+            "pshufd $0, %%xmm0, %%xmm0\n"
+            "1:\n\t"
+            "movntdq %%xmm0, (%[dst])\n\t"
+            "movntdq %%xmm0, 16(%[dst])\n\t"
+            "movntdq %%xmm0, 32(%[dst])\n\t"
+            "movntdq %%xmm0, 48(%[dst])\n\t"
+            "add $64, %[dst]\n\t"
+            "dec %[blocks]\n\t"
+            "jnz 1b\n\t"
+            "sfence\n\t"
+            "movdqu %[save], %%xmm0"
+            : [dst] "+r"(dst), [blocks] "+r"(blocks), [save] "+m"(save)
+            : [word] "r"(word)
+            : "memory");
+    } else {
+        asm volatile (
+            "movdqu %%xmm0, %[save]\n\t"
+            "movd %[word], %%xmm0\n\t"
+            "pshufd $0, %%xmm0, %%xmm0\n"
+            "1:\n\t"
+            "movdqa %%xmm0, (%[dst])\n\t"
+            "movdqa %%xmm0, 16(%[dst])\n\t"
+            "movdqa %%xmm0, 32(%[dst])\n\t"
+            "movdqa %%xmm0, 48(%[dst])\n\t"
+            "add $64, %[dst]\n\t"
+            "dec %[blocks]\n\t"
+            "jnz 1b\n\t"
+            "movdqu %[save], %%xmm0"
+            : [dst] "+r"(dst), [blocks] "+r"(blocks), [save] "+m"(save)
+            : [word] "r"(word)
+            : "memory");
+    }
+}
+
 void* memset(void* bufptr, int value, size_t size) {
     unsigned char* buf = (unsigned char*) bufptr;
-    for (size_t i = 0; i < size; i++) {
+    if (size < STRING_SMALL) {
+        for (size_t i = 0; i < size; i++) {
+            buf[i] = (unsigned char)value;
+        }
+        return bufptr;
+    }
+
+    uint32_t word = (uint8_t)value * 0x01010101u;
+    if (string_sse2 && size >= STRING_SSE2_MIN) {
+        // Bytes up to 16-byte alignment, then 64 bytes per iteration
+        while ((uintptr_t)buf & 15) {
+            *buf++ = (unsigned char)value;
+            size--;
+        }
+        sse2_fill(buf, word, size / 64, size >= STRING_NT_MIN);
+        buf += size & ~(size_t)63;
+        size &= 63;
+    } else {
+        while ((uintptr_t)buf & 3) {
+            *buf++ = (unsigned char)value;
+            size--;
+        }
+    }
+
+    // Words with rep stosd, then the tail bytes
+    size_t words = size / 4;
+    asm volatile ("rep stosl" : "+D"(buf), "+c"(words) : "a"(word) : "memory");
+    for (size_t i = 0; i < (size & 3); i++) {
         buf[i] = (unsigned char)value;
     }
     return bufptr;
 }
+
+#ifdef BENCH_MODE
+#include "bench/bench.h"
+
+#define BENCH_BUF_SIZE      (64 * 1024)
+
+static uint8_t bench_buf[BENCH_BUF_SIZE] __attribute__((aligned(64)));
+
+static void memset_bench(void* arg) {
+    memset(bench_buf, 0x5A, (size_t)arg);
+}
+
+BENCH_REGISTER(memset_64, .fn = memset_bench, .arg = (void*)64);
+BENCH_REGISTER(memset_4k, .fn = memset_bench, .arg = (void*)4096);
+BENCH_REGISTER(memset_64k, .fn = memset_bench, .arg = (void*)BENCH_BUF_SIZE, .repeats = 128);
+#endif
@@ -0,0 +1,73 @@
+// libc/string/str.c
+#include "libc/include/string.h"
+#include <stdint.h>
+
+// Word-at-a-time zero byte test: nonzero iff some byte of 'w' is 0
+#define HAS_ZERO(w)         (((w) - 0x01010101u) & ~(w) & 0x80808080u)
+
+size_t strlen(const char* str) {
+    const char* s = str;
+    while ((uintptr_t)s & 3) {
+        if (*s == '\0') {
+            return s - str;
+        }
+        s++;
+    }
+    // Aligned loads never cross a page boundary, so reading past the end is safe
+    const uint32_t* w = (const uint32_t*)s;
+    while (!HAS_ZERO(*w)) {
+        w++;
+    }
+    s = (const char*)w;
+    while (*s != '\0') {
+        s++;
+    }
+    return s - str;
+}
+
+size_t strnlen(const char* str, size_t max) {
+    size_t len = 0;
+    while (len < max && str[len] != '\0') {
+        len++;
+    }
+    return len;
+}
+
+int strcmp(const char* a, const char* b) {
+    while (*a != '\0' && *a == *b) {
+        a++;
+        b++;
+    }
+    return (uint8_t)*a - (uint8_t)*b;
+}
+
+int strncmp(const char* a, const char* b, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        if (a[i] != b[i] || a[i] == '\0') {
+            return (uint8_t)a[i] - (uint8_t)b[i];
+        }
+    }
+    return 0;
+}
+
+char* strcpy(char* restrict dst, const char* restrict src) {
+    return memcpy(dst, src, strlen(src) + 1);
+}
+
+char* strncpy(char* restrict dst, const char* restrict src, size_t size) {
+    size_t len = strnlen(src, size);
+    memcpy(dst, src, len);
+    memset(dst + len, 0, size - len);
+    return dst;
+}
+
+char* strchr(const char* str, int c) {
+    for (;; str++) {
+        if (*str == (char)c) {
+            return (char*)str;
+        }
+        if (*str == '\0') {
+            return NULL;
+        }
+    }
+}
@@ -0,0 +1,19 @@
+// libc/string/string_impl.h
+#ifndef LIBC_STRING_IMPL_H
+#define LIBC_STRING_IMPL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define STRING_SMALL        16              // Below this, plain byte loops
+#define STRING_SSE2_MIN     512             // Below this, rep stosd/movsd beats saving xmm registers
+#define STRING_NT_MIN       (256 * 1024)    // Non-temporal stores: don't flush the cache for huge buffers
+
+// Set by string_init() when SSE2 is present and enabled (cpu/fpu.c)
+extern int string_sse2;
+
+// The SSE2 paths save and restore the xmm registers they use instead of
+// taking kernel_fpu_begin(): the registers may hold a thread's lazily switched
+// state (cpu/fpu.c), and this keeps them safe in interrupt handlers.
+
+#endif // LIBC_STRING_IMPL_H
@@ -0,0 +1,106 @@
+// libc/string/string_init.c
+#include "libc/include/string.h"
+#include "string_impl.h"
+#include "cpu/fpu.h"
+#include <stdint.h>
+
+int string_sse2;
+
+void string_init(void) {
+    // fpu_init() has enabled SSE (CR4.OSFXSR) if the CPU has it
+    string_sse2 = fpu_has_sse2();
+}
+
+const char* string_impl_name(void) {
+    return string_sse2 ? "SSE2" : "rep movsd/stosd";
+}
+
+#ifdef STRING_BENCH
+#include "memory/pmm.h"
+#include "memory/paging.h"
+
+extern void term_print(const char* str);    // from drivers/vga.c
+extern void term_print_dec(uint32_t num);
+
+#define BENCH_FRAMES        256             // 1 MB per buffer
+#define BENCH_BYTES         (BENCH_FRAMES * PMM_FRAME_SIZE)
+#define BENCH_MIN_SIZE      16
+#define BENCH_ROUNDS        5               // Best of
+
+static inline uint32_t rdtsc_lo(void) {
+    uint32_t lo, hi;
+    asm volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return lo;
+}
+
+// Reference: what the old memset/memcpy did
+static void __attribute__((noinline)) byte_set(uint8_t* dst, uint8_t v, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        ((volatile uint8_t*)dst)[i] = v;
+    }
+}
+
+static void __attribute__((noinline)) byte_copy(uint8_t* dst, const uint8_t* src, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        ((volatile uint8_t*)dst)[i] = src[i];
+    }
+}
+
+// Repeat each operation until about 1 MB has been processed; best round wins
+static uint32_t bench_one(int op, uint8_t* dst, uint8_t* src, size_t size) {
+    uint32_t reps = BENCH_BYTES / size;
+    uint32_t best = 0xFFFFFFFF;
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+        uint32_t start = rdtsc_lo();
+        for (uint32_t i = 0; i < reps; i++) {
+            switch (op) {
+            case 0: memset(dst, i, size); break;
+            case 1: byte_set(dst, i, size); break;
+            case 2: memcpy(dst, src, size); break;
+            default: byte_copy(dst, src, size); break;
+            }
+        }
+        uint32_t cycles = rdtsc_lo() - start;
+        if (cycles < best) {
+            best = cycles;
+        }
+    }
+    return best ? best : 1;
+}
+
+// Bytes per cycle, x100 (at most 1 MB x 100, so 32 bits suffice)
+static uint32_t rate(size_t size, uint32_t cycles) {
+    return (BENCH_BYTES / size) * size * 100 / cycles;
+}
+
+void string_bench(void) {
+    uint32_t src_frames = pmm_alloc_frames(BENCH_FRAMES);
+    uint32_t dst_frames = pmm_alloc_frames(BENCH_FRAMES);
+    if (src_frames == 0 || dst_frames == 0) {
+        term_print("string: not enough memory for the benchmark\n");
+        return;
+    }
+    uint8_t* src = phys_to_virt(src_frames);
+    uint8_t* dst = phys_to_virt(dst_frames);
+
+    term_print("string: ");
+    term_print(string_impl_name());
+    term_print(", bytes/cycle x100 (new vs byte loop)\n");
+    for (size_t size = BENCH_MIN_SIZE; size <= BENCH_BYTES; size *= 4) {
+        term_print("string: ");
+        term_print_dec(size);
+        term_print(" B memset ");
+        term_print_dec(rate(size, bench_one(0, dst, src, size)));
+        term_print(" vs ");
+        term_print_dec(rate(size, bench_one(1, dst, src, size)));
+        term_print(", memcpy ");
+        term_print_dec(rate(size, bench_one(2, dst, src, size)));
+        term_print(" vs ");
+        term_print_dec(rate(size, bench_one(3, dst, src, size)));
+        term_print("\n");
+    }
+
+    pmm_free_frames(dst_frames, BENCH_FRAMES);
+    pmm_free_frames(src_frames, BENCH_FRAMES);
+}
+#endif
@@ -0,0 +1,75 @@
+#include "arena.h"
+#include "pmm.h"
+#include "paging.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Chunk header, at the start of every run of frames owned by the arena
+typedef struct arena_chunk {
+    struct arena_chunk* next;
+    uint32_t frames;
+} arena_chunk_t;
+
+void arena_init(arena_t* arena, uint32_t chunk_size) {
+    arena->chunks = NULL;
+    arena->cur = 0;
+    arena->end = 0;
+    arena->chunk_frames = (chunk_size + PMM_FRAME_SIZE - 1) / PMM_FRAME_SIZE;
+    if (arena->chunk_frames == 0) {
+        arena->chunk_frames = 1;
+    }
+    arena->bytes_used = 0;
+    arena->bytes_reserved = 0;
+}
+
+// Start a new chunk big enough for 'size' bytes at 'align'
+static int arena_grow(arena_t* arena, size_t size, size_t align) {
+    uint32_t need = sizeof(arena_chunk_t) + size + align;
+    uint32_t frames = arena->chunk_frames;
+    if (frames * PMM_FRAME_SIZE < need) {
+        frames = (need + PMM_FRAME_SIZE - 1) / PMM_FRAME_SIZE;
+    }
+
+    uint32_t addr = pmm_alloc_frames(frames);
+    if (addr == 0) {
+        return 0;
+    }
+    arena_chunk_t* chunk = phys_to_virt(addr);
+    chunk->next = arena->chunks;
+    chunk->frames = frames;
+    arena->chunks = chunk;
+    arena->cur = (uint32_t)chunk + sizeof(arena_chunk_t);
+    arena->end = (uint32_t)chunk + frames * PMM_FRAME_SIZE;
+    arena->bytes_reserved += frames * PMM_FRAME_SIZE;
+    return 1;
+}
+
+void* arena_alloc(arena_t* arena, size_t size, size_t align) {
+    if (align == 0) {
+        align = sizeof(void*);
+    }
+    uint32_t start = (arena->cur + align - 1) & ~(align - 1);
+    if (arena->chunks == NULL || start + size > arena->end) {
+        if (!arena_grow(arena, size, align)) {
+            return NULL;
+        }
+        start = (arena->cur + align - 1) & ~(align - 1);
+    }
+    arena->cur = start + size;
+    arena->bytes_used += size;
+    return (void*)start;
+}
+
+void arena_free_all(arena_t* arena) {
+    arena_chunk_t* chunk = arena->chunks;
+    while (chunk != NULL) {
+        arena_chunk_t* next = chunk->next;
+        pmm_free_frames(virt_to_phys(chunk), chunk->frames);
+        chunk = next;
+    }
+    arena->chunks = NULL;
+    arena->cur = 0;
+    arena->end = 0;
+    arena->bytes_used = 0;
+    arena->bytes_reserved = 0;
+}
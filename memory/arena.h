@@ -0,0 +1,30 @@
+#ifndef MEMORY_ARENA_H
+#define MEMORY_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Bump-pointer arena for short-lived allocations that are all released at once
+// (e.g. boot-time tables). Individual allocations cannot be freed.
+
+struct arena_chunk;
+
+typedef struct {
+    struct arena_chunk* chunks;     // Most recent chunk first
+    uint32_t cur;                   // Next free byte in the current chunk
+    uint32_t end;                   // End of the current chunk
+    uint32_t chunk_frames;          // Default chunk size in frames
+    uint32_t bytes_used;            // Bytes handed out since the last reset
+    uint32_t bytes_reserved;        // Bytes held in chunks
+} arena_t;
+
+// Prepare an arena that grows in chunks of at least chunk_size bytes
+void arena_init(arena_t* arena, uint32_t chunk_size);
+
+// Allocate 'size' bytes aligned to 'align' (a power of two). Returns NULL when out of memory.
+void* arena_alloc(arena_t* arena, size_t size, size_t align);
+
+// Release every chunk back to the frame allocator
+void arena_free_all(arena_t* arena);
+
+#endif // MEMORY_ARENA_H
@@ -0,0 +1,459 @@
+#include "kmalloc.h"
+#include "pmm.h"
+#include "paging.h"
+#include "libc/include/string.h"
+#include "drivers/timer.h"
+#include "interrupt/irqflags.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Slab allocator.
+// Every cache owns slabs of 2^slab_order frames. A slab starts with a
+// kmem_slab_t header followed by its objects; free objects are chained
+// through a pointer stored inside them. kfree() finds the owning slab in
+// O(1) through page_owner[], one word per physical frame.
+
+extern void term_print(const char* str);    // from drivers/vga.c
+extern void term_print_dec(uint32_t num);
+
+#define SLAB_MIN_OBJS       8               // Grow the slab order until at least this many objects fit
+#define SLAB_MAX_ORDER      3               // 32 KB
+#define SLAB_HEADER_SIZE    32              // sizeof(kmem_slab_t) rounded up to the object alignment
+#define KMALLOC_CLASSES     9               // 16, 32, ..., 4096
+#define OWNER_LARGE         0x1             // page_owner[] tag: large allocation, value = (frames << 1) | 1
+
+typedef struct kmem_slab {
+    kmem_cache_t* cache;
+    struct kmem_slab* next;
+    struct kmem_slab* prev;
+    void* free;                             // First free object
+    uint32_t in_use;
+} kmem_slab_t;
+
+static kmem_cache_t caches[KMEM_MAX_CACHES];
+static uint32_t cache_count = 0;
+static kmem_cache_t* kmalloc_caches[KMALLOC_CLASSES];
+static uint32_t* page_owner;                // Indexed by physical frame number
+
+// Free-list link lives at the start of a free object, or right behind it
+// when a constructor has to keep the object contents intact.
+static inline uint32_t free_offset(kmem_cache_t* cache) {
+    return cache->ctor ? cache->obj_size : 0;
+}
+
+static inline uint32_t obj_stride(kmem_cache_t* cache) {
+    return cache->ctor ? cache->obj_size + sizeof(void*) : cache->obj_size;
+}
+
+static inline void** free_link(kmem_cache_t* cache, void* obj) {
+    return (void**)((uint8_t*)obj + free_offset(cache));
+}
+
+static void slab_list_add(kmem_slab_t** head, kmem_slab_t* slab) {
+    slab->prev = NULL;
+    slab->next = *head;
+    if (*head) {
+        (*head)->prev = slab;
+    }
+    *head = slab;
+}
+
+static void slab_list_remove(kmem_slab_t** head, kmem_slab_t* slab) {
+    if (slab->prev) {
+        slab->prev->next = slab->next;
+    } else {
+        *head = slab->next;
+    }
+    if (slab->next) {
+        slab->next->prev = slab->prev;
+    }
+    slab->next = slab->prev = NULL;
+}
+
+static kmem_slab_t* slab_create(kmem_cache_t* cache) {
+    uint32_t frames = 1u << cache->slab_order;
+    uint32_t addr = pmm_alloc_frames(frames);
+    if (addr == 0) {
+        return NULL;
+    }
+
+    kmem_slab_t* slab = phys_to_virt(addr);
+    slab->cache = cache;
+    slab->next = slab->prev = NULL;
+    slab->in_use = 0;
+
+    for (uint32_t i = 0; i < frames; i++) {
+        page_owner[addr / PMM_FRAME_SIZE + i] = (uint32_t)slab;
+    }
+
+    // Construct every object once and chain them in address order
+    uint32_t stride = obj_stride(cache);
+    uint8_t* obj = (uint8_t*)slab + cache->first_obj;
+    slab->free = obj;
+    for (uint32_t i = 0; i < cache->objs_per_slab; i++, obj += stride) {
+        if (cache->ctor) {
+            cache->ctor(obj);
+        }
+        *free_link(cache, obj) = (i + 1 < cache->objs_per_slab) ? obj + stride : NULL;
+    }
+
+    cache->slabs++;
+    return slab;
+}
+
+static void slab_destroy(kmem_cache_t* cache, kmem_slab_t* slab) {
+    uint32_t frames = 1u << cache->slab_order;
+    uint32_t addr = virt_to_phys(slab);
+    for (uint32_t i = 0; i < frames; i++) {
+        page_owner[addr / PMM_FRAME_SIZE + i] = 0;
+    }
+    pmm_free_frames(addr, frames);
+    cache->slabs--;
+}
+
+static kmem_cache_t* cache_setup(const char* name, uint32_t size, kmem_ctor_t ctor) {
+    if (cache_count == KMEM_MAX_CACHES || size == 0) {
+        return NULL;
+    }
+    kmem_cache_t* cache = &caches[cache_count++];
+    memset(cache, 0, sizeof(*cache));
+
+    uint32_t i = 0;
+    for (; name[i] != '\0' && i < KMEM_NAME_LEN - 1; i++) {
+        cache->name[i] = name[i];
+    }
+    cache->name[i] = '\0';
+
+    // Room for the free-list link, 8-byte alignment
+    if (size < sizeof(void*)) {
+        size = sizeof(void*);
+    }
+    cache->obj_size = (size + 7) & ~7u;
+    cache->ctor = ctor;
+    cache->first_obj = SLAB_HEADER_SIZE;
+
+    uint32_t stride = obj_stride(cache);
+    for (cache->slab_order = 0; cache->slab_order < SLAB_MAX_ORDER; cache->slab_order++) {
+        uint32_t bytes = PMM_FRAME_SIZE << cache->slab_order;
+        if ((bytes - cache->first_obj) / stride >= SLAB_MIN_OBJS) {
+            break;
+        }
+    }
+    cache->objs_per_slab = ((PMM_FRAME_SIZE << cache->slab_order) - cache->first_obj) / stride;
+    cache->rate_ticks = get_timer_ticks();
+    return cache;
+}
+
+void kmalloc_init(void) {
+    // One owner word per physical frame
+    uint32_t frames = pmm_memory_end() / PMM_FRAME_SIZE;
+    uint32_t table_frames = (frames * sizeof(uint32_t) + PMM_FRAME_SIZE - 1) / PMM_FRAME_SIZE;
+    uint32_t table = pmm_alloc_frames(table_frames);
+    if (table == 0) {
+        term_print("kmalloc: no memory for page owner table!\n");
+        for (;;);
+    }
+    page_owner = phys_to_virt(table);
+    memset(page_owner, 0, table_frames * PMM_FRAME_SIZE);
+
+    char name[] = "kmalloc-    ";
+    for (uint32_t i = 0; i < KMALLOC_CLASSES; i++) {
+        uint32_t size = KMALLOC_MIN_SIZE << i;
+        // Append the size in decimal to the name
+        char digits[5];
+        int n = 0;
+        for (uint32_t v = size; v != 0; v /= 10) {
+            digits[n++] = '0' + (v % 10);
+        }
+        int pos = 8;
+        while (n > 0) {
+            name[pos++] = digits[--n];
+        }
+        name[pos] = '\0';
+        kmalloc_caches[i] = cache_setup(name, size, NULL);
+    }
+}
+
+kmem_cache_t* kmem_cache_create(const char* name, uint32_t size, kmem_ctor_t ctor) {
+    if (size > KMALLOC_MAX_SIZE) {
+        return NULL;
+    }
+    return cache_setup(name, size, ctor);
+}
+
+void* kmem_cache_alloc(kmem_cache_t* cache) {
+    uint32_t flags = irq_save();
+    kmem_slab_t* slab = cache->partial;
+    if (slab == NULL) {
+        if (cache->empty) {
+            slab = cache->empty;
+            cache->empty = NULL;
+        } else {
+            slab = slab_create(cache);
+            if (slab == NULL) {
+                irq_restore(flags);
+                return NULL;
+            }
+        }
+        slab_list_add(&cache->partial, slab);
+    }
+
+    void* obj = slab->free;
+    slab->free = *free_link(cache, obj);
+    if (++slab->in_use == cache->objs_per_slab) {
+        slab_list_remove(&cache->partial, slab); // Full slabs are not tracked
+    }
+
+    cache->objs_in_use++;
+    cache->allocs++;
+    irq_restore(flags);
+    return obj;
+}
+
+void kmem_cache_free(kmem_cache_t* cache, void* obj) {
+    kmem_slab_t* slab = (kmem_slab_t*)page_owner[virt_to_phys(obj) / PMM_FRAME_SIZE];
+    if (slab == NULL || ((uint32_t)slab & OWNER_LARGE) || slab->cache != cache) {
+        return; // Not one of ours
+    }
+
+    uint32_t flags = irq_save();
+    if (slab->in_use == cache->objs_per_slab) {
+        slab_list_add(&cache->partial, slab); // Was full
+    }
+    *free_link(cache, obj) = slab->free;
+    slab->free = obj;
+    slab->in_use--;
+    cache->objs_in_use--;
+    cache->frees++;
+
+    if (slab->in_use == 0) {
+        slab_list_remove(&cache->partial, slab);
+        if (cache->empty == NULL) {
+            cache->empty = slab;
+        } else {
+            slab_destroy(cache, slab);
+        }
+    }
+    irq_restore(flags);
+}
+
+// Size class index for 1 .. KMALLOC_MAX_SIZE bytes
+static inline uint32_t size_class(size_t size) {
+    if (size <= KMALLOC_MIN_SIZE) {
+        return 0;
+    }
+    return 32 - __builtin_clz(size - 1) - 4; // log2(round_up_pow2(size)) - log2(16)
+}
+
+void* kmalloc(size_t size) {
+    if (size == 0) {
+        return NULL;
+    }
+    if (size <= KMALLOC_MAX_SIZE) {
+        return kmem_cache_alloc(kmalloc_caches[size_class(size)]);
+    }
+
+    // Large allocation: whole frames from the frame allocator
+    uint32_t frames = (size + PMM_FRAME_SIZE - 1) / PMM_FRAME_SIZE;
+    uint32_t addr = pmm_alloc_frames(frames);
+    if (addr == 0) {
+        return NULL;
+    }
+    page_owner[addr / PMM_FRAME_SIZE] = (frames << 1) | OWNER_LARGE;
+    return phys_to_virt(addr);
+}
+
+void* kzalloc(size_t size) {
+    void* ptr = kmalloc(size);
+    if (ptr) {
+        memset(ptr, 0, size);
+    }
+    return ptr;
+}
+
+void kfree(void* ptr) {
+    if (ptr == NULL) {
+        return;
+    }
+    uint32_t addr = virt_to_phys(ptr);
+    uint32_t owner = page_owner[addr / PMM_FRAME_SIZE];
+    if (owner & OWNER_LARGE) {
+        page_owner[addr / PMM_FRAME_SIZE] = 0;
+        pmm_free_frames(addr, owner >> 1);
+    } else if (owner != 0) {
+        kmem_cache_free(((kmem_slab_t*)owner)->cache, ptr);
+    }
+}
+
+uint32_t kmem_cache_count(void) {
+    return cache_count;
+}
+
+void kmem_cache_get_stats(uint32_t index, kmem_cache_stats_t* stats) {
+    kmem_cache_t* cache = &caches[index];
+    stats->name = cache->name;
+    stats->obj_size = cache->obj_size;
+    stats->objs_in_use = cache->objs_in_use;
+    stats->objs_total = cache->slabs * cache->objs_per_slab;
+    stats->slabs = cache->slabs;
+    stats->bytes_reserved = cache->slabs * (PMM_FRAME_SIZE << cache->slab_order);
+    stats->allocs = cache->allocs;
+    stats->frees = cache->frees;
+}
+
+// Print one line per cache: objects in use/total, slabs, KB held, overhead and allocation rate
+void kmem_dump_stats(void) {
+    uint32_t now = get_timer_ticks();
+    term_print("cache         size  used/total  slabs  KB  ovh%  alloc/s\n");
+    for (uint32_t i = 0; i < cache_count; i++) {
+        kmem_cache_t* cache = &caches[i];
+        kmem_cache_stats_t s;
+        kmem_cache_get_stats(i, &s);
+
+        uint32_t used_bytes = s.objs_in_use * s.obj_size;
+        uint32_t overhead = s.bytes_reserved >= 100 ? (s.bytes_reserved - used_bytes) / (s.bytes_reserved / 100) : 0;
+        uint32_t elapsed = now - cache->rate_ticks;
+        uint32_t rate = elapsed ? ((cache->allocs - cache->rate_allocs) * TIMER_HZ) / elapsed : 0; // Per second
+        cache->rate_allocs = cache->allocs;
+        cache->rate_ticks = now;
+
+        term_print(s.name);
+        term_print(" ");
+        term_print_dec(s.obj_size);
+        term_print(" ");
+        term_print_dec(s.objs_in_use);
+        term_print("/");
+        term_print_dec(s.objs_total);
+        term_print(" ");
+        term_print_dec(s.slabs);
+        term_print(" ");
+        term_print_dec(s.bytes_reserved / 1024);
+        term_print(" ");
+        term_print_dec(overhead);
+        term_print(" ");
+        term_print_dec(rate);
+        term_print("\n");
+    }
+}
+
+#ifdef KMALLOC_BENCH
+#include "bench/bench.h"
+
+// Same random workload against the slab heap and a naive first-fit heap
+
+#define BENCH_SLOTS         512
+#define BENCH_TICKS         TIMER_HZ        // 1 second
+#define FF_HEAP_FRAMES      256             // 1 MB first-fit heap
+
+// First-fit block header; blocks are laid out back to back
+typedef struct ff_block {
+    uint32_t size;                          // Payload bytes
+    uint32_t free;
+} ff_block_t;
+
+static uint8_t* ff_heap;
+static uint32_t ff_heap_size;
+
+static void ff_init(void) {
+    ff_heap_size = FF_HEAP_FRAMES * PMM_FRAME_SIZE;
+    ff_heap = phys_to_virt(pmm_alloc_frames(FF_HEAP_FRAMES));
+    ff_block_t* b = (ff_block_t*)ff_heap;
+    b->size = ff_heap_size - sizeof(ff_block_t);
+    b->free = 1;
+}
+
+static void* ff_alloc(size_t size) {
+    size = (size + 7) & ~7u;
+    uint8_t* p = ff_heap;
+    while (p < ff_heap + ff_heap_size) {
+        ff_block_t* b = (ff_block_t*)p;
+        if (b->free) {
+            // Coalesce with following free blocks
+            ff_block_t* n = (ff_block_t*)(p + sizeof(ff_block_t) + b->size);
+            while ((uint8_t*)n < ff_heap + ff_heap_size && n->free) {
+                b->size += sizeof(ff_block_t) + n->size;
+                n = (ff_block_t*)(p + sizeof(ff_block_t) + b->size);
+            }
+            if (b->size >= size) {
+                if (b->size >= size + sizeof(ff_block_t) + 8) {
+                    ff_block_t* rest = (ff_block_t*)(p + sizeof(ff_block_t) + size);
+                    rest->size = b->size - size - sizeof(ff_block_t);
+                    rest->free = 1;
+                    b->size = size;
+                }
+                b->free = 0;
+                return p + sizeof(ff_block_t);
+            }
+        }
+        p += sizeof(ff_block_t) + b->size;
+    }
+    return NULL;
+}
+
+static void ff_free(void* ptr) {
+    if (ptr) {
+        ((ff_block_t*)((uint8_t*)ptr - sizeof(ff_block_t)))->free = 1;
+    }
+}
+
+static void* bench_ptr[BENCH_SLOTS];
+
+// Mostly small objects: 16 B .. 2 KB, skewed towards the low end
+static size_t bench_size(uint32_t* seed) {
+    uint32_t r = bench_rand(seed);
+    return (16u << (r % 4 == 0 ? (r >> 8) % 8 : (r >> 8) % 3)) - (r >> 16) % 8;
+}
+
+static uint32_t bench_run(void* (*alloc)(size_t), void (*release)(void*), uint32_t* failures) {
+    uint32_t seed = 0xC0FFEE;
+    uint32_t ops = 0;
+    *failures = 0;
+    for (int i = 0; i < BENCH_SLOTS; i++) {
+        bench_ptr[i] = NULL;
+    }
+
+    uint32_t start = get_timer_ticks();
+    while (get_timer_ticks() - start < BENCH_TICKS) {
+        for (int i = 0; i < 64; i++) {
+            uint32_t slot = bench_rand(&seed) % BENCH_SLOTS;
+            if (bench_ptr[slot]) {
+                release(bench_ptr[slot]);
+                bench_ptr[slot] = NULL;
+            } else {
+                bench_ptr[slot] = alloc(bench_size(&seed));
+                if (bench_ptr[slot] == NULL) {
+                    (*failures)++;
+                }
+            }
+        }
+        ops += 64;
+    }
+
+    for (int i = 0; i < BENCH_SLOTS; i++) {
+        release(bench_ptr[i]);
+    }
+    return ops;
+}
+
+void kmalloc_bench(void) {
+    uint32_t failures;
+    ff_init();
+
+    uint32_t slab_ops = bench_run(kmalloc, kfree, &failures);
+    term_print("kmalloc: slab      ");
+    term_print_dec(slab_ops);
+    term_print(" ops/s, failures ");
+    term_print_dec(failures);
+    term_print("\n");
+
+    uint32_t ff_ops = bench_run(ff_alloc, ff_free, &failures);
+    term_print("kmalloc: first-fit ");
+    term_print_dec(ff_ops);
+    term_print(" ops/s, failures ");
+    term_print_dec(failures);
+    term_print("\n");
+
+    pmm_free_frames(virt_to_phys(ff_heap), FF_HEAP_FRAMES);
+    kmem_dump_stats();
+}
+#endif
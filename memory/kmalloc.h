@@ -0,0 +1,74 @@
+#ifndef MEMORY_KMALLOC_H
+#define MEMORY_KMALLOC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define KMALLOC_MIN_SIZE    16
+#define KMALLOC_MAX_SIZE    4096        // Larger requests go straight to the frame allocator
+#define KMEM_MAX_CACHES     32
+#define KMEM_NAME_LEN       16
+
+// Object constructor, run once per object when its slab is created.
+// Objects must be handed back to kmem_cache_free() in their constructed state.
+typedef void (*kmem_ctor_t)(void* obj);
+
+struct kmem_slab;
+
+// A cache of equally sized objects carved out of slabs (runs of 2^order frames)
+typedef struct kmem_cache {
+    char name[KMEM_NAME_LEN];
+    uint32_t obj_size;
+    uint32_t slab_order;                // Slab = 2^slab_order frames
+    uint32_t objs_per_slab;
+    uint32_t first_obj;                 // Offset of the first object from the slab start
+    kmem_ctor_t ctor;
+
+    struct kmem_slab* partial;          // Slabs with at least one free object
+    struct kmem_slab* empty;            // One fully free slab kept to avoid pmm churn
+
+    // Statistics
+    uint32_t slabs;
+    uint32_t objs_in_use;
+    uint32_t allocs;
+    uint32_t frees;
+    uint32_t rate_allocs;               // Snapshot for kmem_dump_stats() rate calculation
+    uint32_t rate_ticks;
+} kmem_cache_t;
+
+// Snapshot of one cache for overhead checks
+typedef struct {
+    const char* name;
+    uint32_t obj_size;
+    uint32_t objs_in_use;
+    uint32_t objs_total;
+    uint32_t slabs;
+    uint32_t bytes_reserved;            // Frames held by the cache
+    uint32_t allocs;
+    uint32_t frees;
+} kmem_cache_stats_t;
+
+// Set up the size-class caches. Requires pmm_init() and paging.
+void kmalloc_init(void);
+
+// General purpose heap
+void* kmalloc(size_t size);
+void* kzalloc(size_t size);
+void kfree(void* ptr);
+
+// Dedicated caches with optional constructors
+kmem_cache_t* kmem_cache_create(const char* name, uint32_t size, kmem_ctor_t ctor);
+void* kmem_cache_alloc(kmem_cache_t* cache);
+void kmem_cache_free(kmem_cache_t* cache, void* obj);
+
+// Statistics
+uint32_t kmem_cache_count(void);
+void kmem_cache_get_stats(uint32_t index, kmem_cache_stats_t* stats);
+void kmem_dump_stats(void);
+
+#ifdef KMALLOC_BENCH
+// Slab vs. first-fit throughput comparison (build with -DKMALLOC_BENCH)
+void kmalloc_bench(void);
+#endif
+
+#endif // MEMORY_KMALLOC_H
@@ -0,0 +1,293 @@
+#include "paging.h"
+#include "pmm.h"
+#include "libc/include/string.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Kernel page tables.
+// kernel_entry.asm starts us on a boot page table that maps the first 4 MB
+// twice (identity and at KERNEL_VIRT_BASE). initialize_memory() replaces it
+// with the direct map of RAM and drops the identity half; after that only
+// paging_map() / paging_identity_map() add mappings below KERNEL_VIRT_BASE
+// (MMIO, ACPI tables outside the direct map, the AP trampoline).
+
+extern void term_print(const char* str);    // from drivers/vga.c
+extern char _end[];                         // end of kernel image (provided by the linker)
+
+#define CPUID_EDX_PSE       (1u << 3)
+#define CPUID_EDX_PGE       (1u << 13)
+#define CR4_PSE             (1u << 4)
+#define CR4_PGE             (1u << 7)
+
+#define PDE_INDEX(virt)     ((virt) >> 22)
+#define PTE_INDEX(virt)     (((virt) >> 12) & 0x3FF)
+
+static uint32_t page_directory[1024] __attribute__((aligned(4096)));
+static uint32_t direct_map_end;             // Physical, multiple of 4 MB
+static uint32_t boot_alloc_end;
+static const char* mode_name = "4 KB pages";
+
+static inline void invlpg(uint32_t virt) {
+    asm volatile("invlpg (%0)" :: "r"(virt) : "memory");
+}
+
+// One past the highest RAM address in the E820 map, rounded up to 4 MB
+static uint32_t ram_end(const boot_info_t* boot_info) {
+    if (boot_info == NULL || boot_info->e820_count == 0 || boot_info->e820_map == NULL) {
+        return PAGE_LARGE_SIZE;     // pmm_init() assumes 4 MB as well
+    }
+    const e820_entry_t* map = phys_to_virt((uint32_t)boot_info->e820_map);
+    uint64_t end = 0;
+    for (uint32_t i = 0; i < boot_info->e820_count; i++) {
+        if (map[i].type == E820_USABLE && map[i].base + map[i].length > end) {
+            end = map[i].base + map[i].length;
+        }
+    }
+    if (end > KERNEL_DIRECT_MAP_MAX) {
+        end = KERNEL_DIRECT_MAP_MAX;
+    }
+    return ((uint32_t)end + PAGE_LARGE_SIZE - 1) & ~(PAGE_LARGE_SIZE - 1);
+}
+
+// 4 KB page tables for the direct map, taken from the frames right after the
+// kernel. The boot page table only covers the first 4 MB, so that is where
+// they have to fit; RAM past the last table is left out of the direct map.
+static void map_direct_small(void) {
+    uint32_t next = (virt_to_phys(_end) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    uint32_t end = direct_map_end;
+    for (uint32_t phys = 0; phys < end; phys += PAGE_LARGE_SIZE) {
+        if (next + PAGE_SIZE > PAGE_LARGE_SIZE) {
+            term_print("paging: boot page tables full, direct map truncated\n");
+            direct_map_end = phys;
+            break;
+        }
+        uint32_t* table = phys_to_virt(next);
+        for (uint32_t i = 0; i < 1024; i++) {
+            table[i] = (phys + i * PAGE_SIZE) | PAGE_PRESENT | PAGE_WRITE;
+        }
+        page_directory[PDE_INDEX(KERNEL_VIRT_BASE + phys)] = next | PAGE_PRESENT | PAGE_WRITE;
+        next += PAGE_SIZE;
+    }
+    boot_alloc_end = next;
+}
+
+void initialize_memory(const boot_info_t* boot_info) {
+    uint32_t eax, ebx, ecx, edx;
+    asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(1));
+    int pse = (edx & CPUID_EDX_PSE) != 0;
+    int pge = (edx & CPUID_EDX_PGE) != 0;
+
+    for (int i = 0; i < 1024; i++) {
+        page_directory[i] = 0;
+    }
+    direct_map_end = ram_end(boot_info);
+
+    if (pse) {
+        // One PDE per 4 MB, no page tables at all
+        uint32_t global = pge ? PAGE_GLOBAL : 0;
+        for (uint32_t phys = 0; phys < direct_map_end; phys += PAGE_LARGE_SIZE) {
+            page_directory[PDE_INDEX(KERNEL_VIRT_BASE + phys)] =
+                phys | PAGE_SIZE_FLAG | global | PAGE_PRESENT | PAGE_WRITE;
+        }
+        mode_name = pge ? "4 MB global pages" : "4 MB pages";
+    } else {
+        map_direct_small();
+    }
+
+    uint32_t cr4;
+    asm volatile("movl %%cr4, %0" : "=r"(cr4));
+    if (pse) {
+        cr4 |= CR4_PSE;
+        asm volatile("movl %0, %%cr4" :: "r"(cr4));
+    }
+
+    // Load the new page directory (drops the boot identity mapping)
+    asm volatile("movl %0, %%cr3" :: "r"(virt_to_phys(page_directory)) : "memory");
+
+    // Turning PGE on flushes the whole TLB; global entries are kept from here on
+    if (pge) {
+        cr4 |= CR4_PGE;
+        asm volatile("movl %0, %%cr4" :: "r"(cr4) : "memory");
+    }
+}
+
+uint32_t paging_direct_map_end(void) {
+    return direct_map_end;
+}
+
+uint32_t paging_boot_alloc_end(void) {
+    return boot_alloc_end;
+}
+
+// How the direct map is built
+const char* paging_mode_name(void) {
+    return mode_name;
+}
+
+int paging_map(uint32_t virt, uint32_t phys, uint32_t flags) {
+    if (virt >= KERNEL_VIRT_BASE && virt - KERNEL_VIRT_BASE < direct_map_end) {
+        return 0;   // Owned by the direct map
+    }
+    uint32_t pde = page_directory[PDE_INDEX(virt)];
+    uint32_t* table;
+    if (pde & PAGE_PRESENT) {
+        table = phys_to_virt(pde & ~0xFFFu);
+        // Ring 3 needs the user bit at both levels
+        page_directory[PDE_INDEX(virt)] = pde | (flags & PAGE_USER);
+    } else {
+        // Page tables come from the frame allocator, so they are in the direct map
+        uint32_t frame = pmm_alloc_frame();
+        if (frame == 0) {
+            return 0;
+        }
+        table = phys_to_virt(frame);
+        memset(table, 0, PAGE_SIZE);
+        page_directory[PDE_INDEX(virt)] = frame | PAGE_PRESENT | PAGE_WRITE | (flags & PAGE_USER);
+    }
+
+    table[PTE_INDEX(virt)] = (phys & ~0xFFFu) | flags | PAGE_PRESENT;
+    invlpg(virt);
+    return 1;
+}
+
+void paging_unmap(uint32_t virt) {
+    uint32_t pde = page_directory[PDE_INDEX(virt)];
+    if (!(pde & PAGE_PRESENT) || (pde & PAGE_SIZE_FLAG)) {
+        return;
+    }
+    uint32_t* table = phys_to_virt(pde & ~0xFFFu);
+    table[PTE_INDEX(virt)] = 0;
+    invlpg(virt);
+}
+
+uint32_t paging_get(uint32_t virt) {
+    uint32_t pde = page_directory[PDE_INDEX(virt)];
+    if (!(pde & PAGE_PRESENT) || (pde & PAGE_SIZE_FLAG)) {
+        return 0;
+    }
+    uint32_t* table = phys_to_virt(pde & ~0xFFFu);
+    return table[PTE_INDEX(virt)];
+}
+
+int paging_identity_map(uint32_t phys, uint32_t size, uint32_t flags) {
+    uint32_t start = phys & ~0xFFFu;
+    uint32_t end = phys + size;
+    for (uint32_t addr = start; addr < end && addr >= start; addr += PAGE_SIZE) {
+        if (!paging_map(addr, addr, flags)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void* paging_map_phys(uint32_t phys, uint32_t size, uint32_t flags) {
+    if (phys < direct_map_end && size <= direct_map_end - phys) {
+        return phys_to_virt(phys);
+    }
+    if (!paging_identity_map(phys, size, flags)) {
+        return NULL;
+    }
+    return (void*)phys;
+}
+
+#ifdef BENCH_MODE
+#include "bench/bench.h"
+
+// TLB pressure: one load per 4 KB page over 16 MB of RAM, read through the
+// direct map (4 TLB entries with 4 MB pages) and through a 4 KB alias of the
+// same frames (4096 entries, far more than the data TLB holds). The CR3
+// benchmarks reload CR3 and touch 16 direct-map pages 1 MB apart, with and
+// without global pages.
+#define TLB_CHUNK_FRAMES    1024                // 4 MB, the largest buddy block
+#define TLB_CHUNKS          4
+#define TLB_ALIAS_BASE      0xF0000000          // Above the direct map, below MMIO
+
+static uint32_t tlb_chunks[TLB_CHUNKS];
+static uint32_t tlb_nchunks;
+
+static void tlb_setup(void* arg) {
+    (void)arg;
+    tlb_nchunks = 0;
+    while (tlb_nchunks < TLB_CHUNKS &&
+           (tlb_chunks[tlb_nchunks] = pmm_alloc_frames(TLB_CHUNK_FRAMES)) != 0) {
+        tlb_nchunks++;
+    }
+    for (uint32_t c = 0; c < tlb_nchunks; c++) {
+        for (uint32_t i = 0; i < TLB_CHUNK_FRAMES; i++) {
+            uint32_t off = (c * TLB_CHUNK_FRAMES + i) * PAGE_SIZE;
+            if (!paging_map(TLB_ALIAS_BASE + off, tlb_chunks[c] + i * PAGE_SIZE, PAGE_WRITE)) {
+                tlb_nchunks = c;    // Keep the chunks that are fully aliased
+                return;
+            }
+        }
+    }
+}
+
+static void tlb_teardown(void* arg) {
+    (void)arg;
+    for (uint32_t c = 0; c < TLB_CHUNKS && tlb_chunks[c] != 0; c++) {
+        for (uint32_t i = 0; i < TLB_CHUNK_FRAMES; i++) {
+            paging_unmap(TLB_ALIAS_BASE + (c * TLB_CHUNK_FRAMES + i) * PAGE_SIZE);
+        }
+        pmm_free_frames(tlb_chunks[c], TLB_CHUNK_FRAMES);
+        tlb_chunks[c] = 0;
+    }
+}
+
+static void tlb_walk_direct(void* arg) {
+    (void)arg;
+    for (uint32_t c = 0; c < tlb_nchunks; c++) {
+        volatile uint32_t* p = phys_to_virt(tlb_chunks[c]);
+        for (uint32_t i = 0; i < TLB_CHUNK_FRAMES; i++) {
+            (void)p[i * (PAGE_SIZE / 4)];
+        }
+    }
+}
+
+static void tlb_walk_alias(void* arg) {
+    (void)arg;
+    volatile uint32_t* p = (volatile uint32_t*)TLB_ALIAS_BASE;
+    for (uint32_t i = 0; i < tlb_nchunks * TLB_CHUNK_FRAMES; i++) {
+        (void)p[i * (PAGE_SIZE / 4)];
+    }
+}
+
+static void set_pge(uint32_t on) {
+    uint32_t cr4;
+    asm volatile("movl %%cr4, %0" : "=r"(cr4));
+    cr4 = on ? cr4 | CR4_PGE : cr4 & ~CR4_PGE;
+    asm volatile("movl %0, %%cr4" :: "r"(cr4) : "memory");
+}
+
+static void cr3_setup_noglobal(void* arg) {
+    tlb_setup(arg);
+    set_pge(0);
+}
+
+static void cr3_teardown_noglobal(void* arg) {
+    uint32_t edx, eax, ebx, ecx;
+    asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(1));
+    set_pge(edx & CPUID_EDX_PGE);
+    tlb_teardown(arg);
+}
+
+static void cr3_reload(void* arg) {
+    (void)arg;
+    asm volatile("movl %0, %%cr3" :: "r"(virt_to_phys(page_directory)) : "memory");
+    for (uint32_t c = 0; c < tlb_nchunks; c++) {
+        volatile uint32_t* p = phys_to_virt(tlb_chunks[c]);
+        for (uint32_t mb = 0; mb < 4; mb++) {
+            (void)p[mb * (0x100000 / 4)];
+        }
+    }
+}
+
+BENCH_REGISTER(tlb_walk_16m_direct, .fn = tlb_walk_direct, .setup = tlb_setup,
+               .teardown = tlb_teardown, .repeats = 64);
+BENCH_REGISTER(tlb_walk_16m_4k, .fn = tlb_walk_alias, .setup = tlb_setup,
+               .teardown = tlb_teardown, .repeats = 64);
+BENCH_REGISTER(tlb_cr3_reload_global, .fn = cr3_reload, .setup = tlb_setup,
+               .teardown = tlb_teardown);
+BENCH_REGISTER(tlb_cr3_reload_noglobal, .fn = cr3_reload, .setup = cr3_setup_noglobal,
+               .teardown = cr3_teardown_noglobal);
+#endif
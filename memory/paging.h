@@ -0,0 +1,70 @@
+#ifndef MEMORY_PAGING_H
+#define MEMORY_PAGING_H
+
+#include <stdint.h>
+#include "bootloader/boot_info.h"
+
+// Page table entry flags
+#define PAGE_PRESENT        0x1
+#define PAGE_WRITE          0x2
+#define PAGE_USER           0x4
+#define PAGE_WRITE_THROUGH  0x8
+#define PAGE_CACHE_DISABLE  0x10
+#define PAGE_SIZE_FLAG      0x80    // PDE maps a 4 MB page (needs CR4.PSE)
+#define PAGE_GLOBAL         0x100   // Kept in the TLB across CR3 loads (needs CR4.PGE)
+
+#define PAGE_SIZE           4096
+#define PAGE_LARGE_SIZE     0x400000
+
+// Flags for device registers (uncached)
+#define PAGE_MMIO           (PAGE_PRESENT | PAGE_WRITE | PAGE_CACHE_DISABLE | PAGE_WRITE_THROUGH)
+
+// The kernel runs in the top GB. Physical memory from 0 up to the end of RAM
+// (at most KERNEL_DIRECT_MAP_MAX) is mapped at KERNEL_VIRT_BASE + phys, which
+// leaves 0xF0000000 and up for MMIO and temporary mappings.
+// KERNEL_VIRT_BASE must match kernel_entry.asm and the link address in
+// scripts/linux-build.sh.
+#define KERNEL_VIRT_BASE        0xC0000000
+#define KERNEL_DIRECT_MAP_MAX   0x30000000      // 768 MB
+
+static inline void* phys_to_virt(uint32_t phys) {
+    return (void*)(phys + KERNEL_VIRT_BASE);
+}
+
+static inline uint32_t virt_to_phys(const void* virt) {
+    return (uint32_t)virt - KERNEL_VIRT_BASE;
+}
+
+// Replace the boot page tables with the kernel's own: RAM in the direct map
+// (4 MB global pages when the CPU has PSE/PGE, 4 KB page tables otherwise)
+// and nothing mapped below KERNEL_VIRT_BASE. Runs before pmm_init().
+void initialize_memory(const boot_info_t* boot_info);
+
+// How the direct map is built, e.g. "4 MB global pages"
+const char* paging_mode_name(void);
+
+// One past the last physical address in the direct map
+uint32_t paging_direct_map_end(void);
+
+// One past the last physical byte used by the page tables initialize_memory()
+// allocated before the frame allocator existed (0 if none)
+uint32_t paging_boot_alloc_end(void);
+
+// Map one 4 KB page, allocating a page table if needed. Returns 0 on failure
+// (including any address inside the direct map).
+int paging_map(uint32_t virt, uint32_t phys, uint32_t flags);
+
+// Remove the mapping of one 4 KB page
+void paging_unmap(uint32_t virt);
+
+// Page table entry of a 4 KB page (frame address and flags), 0 if not mapped
+uint32_t paging_get(uint32_t virt);
+
+// Identity map every page touching [phys, phys + size)
+int paging_identity_map(uint32_t phys, uint32_t size, uint32_t flags);
+
+// Pointer to [phys, phys + size): through the direct map when the range is
+// inside it, identity mapped otherwise. Returns NULL on failure.
+void* paging_map_phys(uint32_t phys, uint32_t size, uint32_t flags);
+
+#endif // MEMORY_PAGING_H
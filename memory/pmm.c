@@ -0,0 +1,465 @@
+#include "pmm.h"
+#include "paging.h"
+#include "interrupt/irqflags.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Physical frame allocator.
+// Free memory is kept in binary buddy lists (orders 0 .. PMM_MAX_ORDER-1).
+// A small LIFO cache of single frames sits in front of the lists so the
+// common pmm_alloc_frame()/pmm_free_frame() path is a plain push/pop.
+
+extern void term_print(const char* str);    // from drivers/vga.c
+extern char _end[];                         // end of kernel image (provided by the linker)
+
+#define LOW_MEMORY_END      0x100000        // Everything below 1 MB stays reserved (BIOS, VGA, kernel, stack)
+
+// frame_info[] flags (one byte per frame)
+#define FRAME_FREE          0x80            // Head of a free buddy block, low bits = order
+#define FRAME_CACHED        0x40            // Free frame parked in the hot cache
+#define FRAME_USED          0x20            // Handed out; only these may be freed
+
+// Free block header, stored in the first bytes of the free block itself
+typedef struct pmm_block {
+    struct pmm_block* next;
+    struct pmm_block* prev;
+} pmm_block_t;
+
+static pmm_block_t* free_lists[PMM_MAX_ORDER];
+static uint32_t free_counts[PMM_MAX_ORDER];
+static uint8_t* frame_info;                 // Per-frame state, indexed by frame number
+static uint32_t frame_count;                // Frames covered by frame_info
+static uint32_t total_frames;
+static uint32_t free_frames;
+
+static uint32_t initrd_first;               // Frames of the initrd: its files are used in place
+static uint32_t initrd_last;
+
+static uint32_t frame_cache[PMM_CACHE_SIZE];
+static uint32_t cache_top;
+
+static inline pmm_block_t* block_at(uint32_t frame) {
+    // Every frame handed out is inside the direct map
+    return phys_to_virt(frame * PMM_FRAME_SIZE);
+}
+
+static inline uint32_t frame_of(pmm_block_t* block) {
+    return virt_to_phys(block) / PMM_FRAME_SIZE;
+}
+
+static void list_push(uint32_t frame, uint32_t order) {
+    pmm_block_t* block = block_at(frame);
+    block->prev = NULL;
+    block->next = free_lists[order];
+    if (block->next) {
+        block->next->prev = block;
+    }
+    free_lists[order] = block;
+    free_counts[order]++;
+    frame_info[frame] = FRAME_FREE | order;
+}
+
+static void list_remove(uint32_t frame, uint32_t order) {
+    pmm_block_t* block = block_at(frame);
+    if (block->prev) {
+        block->prev->next = block->next;
+    } else {
+        free_lists[order] = block->next;
+    }
+    if (block->next) {
+        block->next->prev = block->prev;
+    }
+    free_counts[order]--;
+    frame_info[frame] = 0;
+}
+
+// Take a block of exactly 2^order frames, splitting a larger one if needed
+static uint32_t buddy_alloc(uint32_t order) {
+    uint32_t o = order;
+    while (o < PMM_MAX_ORDER && free_lists[o] == NULL) {
+        o++;
+    }
+    if (o == PMM_MAX_ORDER) {
+        return 0;
+    }
+
+    uint32_t frame = frame_of(free_lists[o]);
+    list_remove(frame, o);
+
+    // Return the upper halves to the lists until the block is the right size
+    while (o > order) {
+        o--;
+        list_push(frame + (1u << o), o);
+    }
+    return frame;
+}
+
+// Return a block of 2^order frames, merging with free buddies
+static void buddy_free(uint32_t frame, uint32_t order) {
+    while (order < PMM_MAX_ORDER - 1) {
+        uint32_t buddy = frame ^ (1u << order);
+        if (buddy >= frame_count || frame_info[buddy] != (FRAME_FREE | order)) {
+            break;
+        }
+        list_remove(buddy, order);
+        frame &= ~(1u << order);
+        order++;
+    }
+    list_push(frame, order);
+}
+
+// Free [start, end) as the largest naturally aligned blocks that fit
+static void buddy_free_range(uint32_t start, uint32_t end) {
+    while (start < end) {
+        uint32_t order = 0;
+        while (order < PMM_MAX_ORDER - 1 &&
+               (start & ((2u << order) - 1)) == 0 &&
+               start + (2u << order) <= end) {
+            order++;
+        }
+        buddy_free(start, order);
+        start += 1u << order;
+    }
+}
+
+static uint32_t order_for(uint32_t count) {
+    uint32_t order = 0;
+    while ((1u << order) < count) {
+        order++;
+    }
+    return order;
+}
+
+// Clamp an E820 entry to page-aligned frame numbers inside the direct map. Returns 0 if empty.
+static int entry_frames(const e820_entry_t* e, uint32_t* first, uint32_t* last) {
+    uint64_t start = e->base;
+    uint64_t end = e->base + e->length;
+    uint64_t limit = paging_direct_map_end();
+    if (start >= limit) {
+        return 0;
+    }
+    if (end > limit) {
+        end = limit;
+    }
+    *first = (uint32_t)((start + PMM_FRAME_SIZE - 1) / PMM_FRAME_SIZE);
+    *last = (uint32_t)(end / PMM_FRAME_SIZE);
+    return *first < *last;
+}
+
+// Hand [first, last) to the buddy lists, leaving out the initrd. Returns the frames freed.
+static uint32_t free_usable(uint32_t first, uint32_t last) {
+    if (first >= initrd_last || last <= initrd_first) {
+        buddy_free_range(first, last);
+        return last - first;
+    }
+    uint32_t freed = 0;
+    if (first < initrd_first) {
+        buddy_free_range(first, initrd_first);
+        freed += initrd_first - first;
+    }
+    if (last > initrd_last) {
+        buddy_free_range(initrd_last, last);
+        freed += last - initrd_last;
+    }
+    return freed;
+}
+
+void pmm_init(const boot_info_t* boot_info) {
+    static e820_entry_t fallback = { LOW_MEMORY_END, 0x300000, E820_USABLE, 0 };
+    const e820_entry_t* map = boot_info && boot_info->e820_map ?
+        phys_to_virt((uint32_t)boot_info->e820_map) : NULL;
+    uint32_t count = boot_info ? boot_info->e820_count : 0;
+
+    if (map == NULL || count == 0) {
+        // No E820 support: assume only the first 4 MB exist, as before
+        term_print("pmm: no E820 map, assuming 4 MB\n");
+        map = &fallback;
+        count = 1;
+    }
+
+    initrd_first = initrd_last = 0;
+    if (boot_info != NULL && boot_info->initrd_size != 0) {
+        initrd_first = boot_info->initrd_addr / PMM_FRAME_SIZE;
+        initrd_last = (boot_info->initrd_addr + boot_info->initrd_size + PMM_FRAME_SIZE - 1) / PMM_FRAME_SIZE;
+    }
+
+    // Size frame_info to the highest usable frame
+    uint32_t first, last;
+    frame_count = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (map[i].type == E820_USABLE && entry_frames(&map[i], &first, &last) && last > frame_count) {
+            frame_count = last;
+        }
+    }
+
+    // Place frame_info at the start of the first usable region above the kernel,
+    // the boot page tables and low memory
+    uint32_t reserved_end = virt_to_phys(_end);
+    if (reserved_end < paging_boot_alloc_end()) {
+        reserved_end = paging_boot_alloc_end();
+    }
+    if (reserved_end < LOW_MEMORY_END) {
+        reserved_end = LOW_MEMORY_END;
+    }
+    uint32_t info_frames = (frame_count + PMM_FRAME_SIZE - 1) / PMM_FRAME_SIZE;
+    frame_info = NULL;
+    for (uint32_t i = 0; i < count && frame_info == NULL; i++) {
+        if (map[i].type != E820_USABLE || !entry_frames(&map[i], &first, &last)) {
+            continue;
+        }
+        uint32_t lo = reserved_end / PMM_FRAME_SIZE;
+        uint32_t start = first > lo ? first : (lo + ((reserved_end % PMM_FRAME_SIZE) != 0));
+        if (start < initrd_last && start + info_frames > initrd_first) {
+            start = initrd_last;
+        }
+        if (start + info_frames <= last) {
+            frame_info = phys_to_virt(start * PMM_FRAME_SIZE);
+            reserved_end = (start + info_frames) * PMM_FRAME_SIZE;
+        }
+    }
+    if (frame_info == NULL) {
+        term_print("pmm: no room for frame map!\n");
+        for (;;);
+    }
+
+    for (uint32_t i = 0; i < frame_count; i++) {
+        frame_info[i] = 0;
+    }
+    for (uint32_t o = 0; o < PMM_MAX_ORDER; o++) {
+        free_lists[o] = NULL;
+        free_counts[o] = 0;
+    }
+    cache_top = 0;
+
+    // Hand every usable frame above the reserved area to the buddy lists
+    uint32_t lo = reserved_end / PMM_FRAME_SIZE;
+    total_frames = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (map[i].type != E820_USABLE || !entry_frames(&map[i], &first, &last)) {
+            continue;
+        }
+        if (first < lo) {
+            first = lo;
+        }
+        if (first >= last) {
+            continue;
+        }
+        total_frames += free_usable(first, last);
+    }
+    free_frames = total_frames;
+}
+
+uint32_t pmm_alloc_frame(void) {
+    uint32_t flags = irq_save();
+    uint32_t frame;
+    if (cache_top > 0) {
+        frame = frame_cache[--cache_top];
+    } else {
+        frame = buddy_alloc(0);
+    }
+    if (frame != 0) {
+        frame_info[frame] = FRAME_USED;
+        free_frames--;
+    }
+    irq_restore(flags);
+    return frame * PMM_FRAME_SIZE;
+}
+
+void pmm_free_frame(uint32_t addr) {
+    uint32_t frame = addr / PMM_FRAME_SIZE;
+    uint32_t flags = irq_save();
+    if (frame == 0 || frame >= frame_count || frame_info[frame] != FRAME_USED) {
+        irq_restore(flags);
+        return; // Out of range, never allocated or double free
+    }
+
+    if (cache_top == PMM_CACHE_SIZE) {
+        // Cache full: drain the older half back into the buddy lists
+        for (uint32_t i = 0; i < PMM_CACHE_SIZE / 2; i++) {
+            buddy_free(frame_cache[i], 0);
+        }
+        for (uint32_t i = PMM_CACHE_SIZE / 2; i < PMM_CACHE_SIZE; i++) {
+            frame_cache[i - PMM_CACHE_SIZE / 2] = frame_cache[i];
+        }
+        cache_top -= PMM_CACHE_SIZE / 2;
+    }
+    frame_cache[cache_top++] = frame;
+    frame_info[frame] = FRAME_CACHED;
+    free_frames++;
+    irq_restore(flags);
+}
+
+uint32_t pmm_alloc_frames(uint32_t count) {
+    if (count == 0) {
+        return 0;
+    }
+    if (count == 1) {
+        return pmm_alloc_frame();
+    }
+
+    uint32_t order = order_for(count);
+    if (order >= PMM_MAX_ORDER) {
+        return 0;
+    }
+    uint32_t flags = irq_save();
+    uint32_t frame = buddy_alloc(order);
+    if (frame != 0) {
+        // Give back the tail beyond 'count' frames
+        buddy_free_range(frame + count, frame + (1u << order));
+        for (uint32_t i = 0; i < count; i++) {
+            frame_info[frame + i] = FRAME_USED;
+        }
+        free_frames -= count;
+    }
+    irq_restore(flags);
+    return frame * PMM_FRAME_SIZE;
+}
+
+void pmm_free_frames(uint32_t addr, uint32_t count) {
+    uint32_t frame = addr / PMM_FRAME_SIZE;
+    if (count == 1) {
+        pmm_free_frame(addr);
+        return;
+    }
+    if (frame == 0 || count == 0 || frame + count > frame_count) {
+        return;
+    }
+    uint32_t flags = irq_save();
+    for (uint32_t i = 0; i < count; i++) {
+        if (frame_info[frame + i] != FRAME_USED) {
+            irq_restore(flags);
+            return;                     // Part of the range is free already, or was never allocated
+        }
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        frame_info[frame + i] = 0;
+    }
+    buddy_free_range(frame, frame + count);
+    free_frames += count;
+    irq_restore(flags);
+}
+
+void pmm_get_stats(pmm_stats_t* stats) {
+    stats->total_frames = total_frames;
+    stats->free_frames = free_frames;
+    stats->cached_frames = cache_top;
+    stats->largest_free_order = 0;
+    for (uint32_t o = 0; o < PMM_MAX_ORDER; o++) {
+        stats->free_blocks[o] = free_counts[o];
+        if (free_counts[o] != 0) {
+            stats->largest_free_order = o;
+        }
+    }
+}
+
+uint32_t pmm_fragmentation(uint32_t order) {
+    if (free_frames == 0) {
+        return 0;
+    }
+    // Free frames sitting in blocks big enough for a 2^order request
+    uint32_t usable = 0;
+    for (uint32_t o = order; o < PMM_MAX_ORDER; o++) {
+        usable += free_counts[o] << o;
+    }
+    return ((free_frames - usable) * 100) / free_frames;
+}
+
+uint32_t pmm_memory_end(void) {
+    return frame_count * PMM_FRAME_SIZE;
+}
+
+#ifdef PMM_STRESS
+#include "drivers/timer.h"
+#include "bench/bench.h"
+
+extern void term_print_dec(uint32_t num);  // from drivers/vga.c
+
+#define STRESS_SLOTS        1024
+#define STRESS_MAX_FRAMES   64
+#define TICKS_PER_RUN       TIMER_HZ        // 1 second per phase
+
+static uint32_t stress_addr[STRESS_SLOTS];
+static uint32_t stress_count[STRESS_SLOTS];
+
+static void report(const char* what, uint32_t value, const char* unit) {
+    term_print("pmm: ");
+    term_print(what);
+    term_print(" ");
+    term_print_dec(value);
+    term_print(unit);
+}
+
+void pmm_stress(void) {
+    uint32_t free_before = free_frames;
+    report("total memory", total_frames * (PMM_FRAME_SIZE / 1024), " KB\n");
+    report("free memory", free_frames * (PMM_FRAME_SIZE / 1024), " KB\n");
+
+    // Phase 1: single frames. Allocate/free pairs for one second.
+    uint32_t ops = 0;
+    uint32_t start = get_timer_ticks();
+    while (get_timer_ticks() - start < TICKS_PER_RUN) {
+        for (int i = 0; i < 256; i++) {
+            pmm_free_frame(pmm_alloc_frame());
+        }
+        ops += 256;
+    }
+    report("single frame alloc+free", ops, " /s\n");
+
+    // Phase 2: drain all memory one frame at a time (frames linked through their first word)
+    uint32_t head = 0;
+    uint32_t drained = 0;
+    start = get_timer_ticks();
+    for (uint32_t addr; (addr = pmm_alloc_frame()) != 0; drained++) {
+        *(uint32_t*)phys_to_virt(addr) = head;
+        head = addr;
+    }
+    uint32_t ticks = get_timer_ticks() - start;
+    report("drained frames", drained, "\n");
+    report("drain rate", drained * TIMER_HZ / (ticks ? ticks : 1), " frames/s\n");
+    while (head != 0) {
+        uint32_t next = *(uint32_t*)phys_to_virt(head);
+        pmm_free_frame(head);
+        head = next;
+    }
+
+    // Phase 3: random contiguous allocations of 1..64 frames with random frees
+    uint32_t seed = 0x12345678;
+    uint32_t failures = 0;
+    ops = 0;
+    for (int i = 0; i < STRESS_SLOTS; i++) {
+        stress_addr[i] = 0;
+    }
+    start = get_timer_ticks();
+    while (get_timer_ticks() - start < TICKS_PER_RUN) {
+        uint32_t slot = bench_rand(&seed) % STRESS_SLOTS;
+        if (stress_addr[slot] != 0) {
+            pmm_free_frames(stress_addr[slot], stress_count[slot]);
+            stress_addr[slot] = 0;
+        } else {
+            uint32_t n = 1 + bench_rand(&seed) % STRESS_MAX_FRAMES;
+            stress_addr[slot] = pmm_alloc_frames(n);
+            stress_count[slot] = n;
+            if (stress_addr[slot] == 0) {
+                failures++;
+            }
+        }
+        ops++;
+    }
+    report("mixed alloc/free", ops, " /s\n");
+    report("mixed failures", failures, "\n");
+    report("fragmentation (64 KB)", pmm_fragmentation(4), "%\n");
+    report("fragmentation (4 MB)", pmm_fragmentation(PMM_MAX_ORDER - 1), "%\n");
+
+    for (int i = 0; i < STRESS_SLOTS; i++) {
+        if (stress_addr[i] != 0) {
+            pmm_free_frames(stress_addr[i], stress_count[i]);
+        }
+    }
+    report("fragmentation after free (4 MB)", pmm_fragmentation(PMM_MAX_ORDER - 1), "%\n");
+    if (free_frames != free_before) {
+        report("LEAK frames", free_before - free_frames, "\n");
+    } else {
+        term_print("pmm: no leaks\n");
+    }
+}
+#endif
@@ -0,0 +1,49 @@
+#ifndef MEMORY_PMM_H
+#define MEMORY_PMM_H
+
+#include <stdint.h>
+#include "bootloader/boot_info.h"
+
+#define PMM_FRAME_SIZE      4096
+#define PMM_MAX_ORDER       11      // Largest buddy block: 2^10 frames (4 MB)
+#define PMM_CACHE_SIZE      64      // Hot single-frame cache in front of the buddy lists
+
+// Snapshot of allocator state
+typedef struct {
+    uint32_t total_frames;                  // Frames handed to the allocator at boot
+    uint32_t free_frames;                   // Frames currently free (including the hot cache)
+    uint32_t cached_frames;                 // Free frames sitting in the hot cache
+    uint32_t free_blocks[PMM_MAX_ORDER];    // Free buddy blocks per order
+    uint32_t largest_free_order;            // Order of the largest free block
+} pmm_stats_t;
+
+// Build the allocator from the E820 map passed in by the bootloader.
+// Runs after initialize_memory(): frames are reached through the direct map,
+// and RAM beyond it is not used. The initrd's frames are never handed out.
+void pmm_init(const boot_info_t* boot_info);
+
+// Allocate / free a single 4 KB frame. Returns the physical address, 0 when out of memory.
+// The frame is at phys_to_virt(addr) (memory/paging.h).
+uint32_t pmm_alloc_frame(void);
+void pmm_free_frame(uint32_t addr);
+
+// Allocate / free 'count' physically contiguous frames. Returns 0 on failure.
+uint32_t pmm_alloc_frames(uint32_t count);
+void pmm_free_frames(uint32_t addr, uint32_t count);
+
+// Allocator statistics
+void pmm_get_stats(pmm_stats_t* stats);
+
+// External fragmentation in percent: share of free memory that cannot
+// satisfy a contiguous request of 2^order frames
+uint32_t pmm_fragmentation(uint32_t order);
+
+// One past the highest usable physical address
+uint32_t pmm_memory_end(void);
+
+#ifdef PMM_STRESS
+// Allocation throughput / fragmentation stress test (build with -DPMM_STRESS)
+void pmm_stress(void);
+#endif
+
+#endif // MEMORY_PMM_H
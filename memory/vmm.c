@@ -0,0 +1,385 @@
+#include "vmm.h"
+#include "paging.h"
+#include "pmm.h"
+#include "kmalloc.h"
+#include "interrupt/isr.h"
+#include "interrupt/irqflags.h"
+#include "drivers/clocksource.h"
+#include "drivers/serial.h"
+#include "libc/include/stdio.h"
+#include "libc/include/string.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Demand paging for kernel regions.
+// A region only reserves address space. The first access to a page faults
+// (ISR 14) and the handler backs it: a fresh zero-filled frame, or for a
+// write to a page shared by vmm_clone(), a private copy. Frames carry a
+// reference count so shared ones are freed by their last user.
+
+extern void term_flush(void);   // from drivers/vga.c
+
+// Page-fault error code bits
+#define PF_PRESENT          0x1         // Protection violation (0: page not present)
+#define PF_WRITE            0x2
+#define PF_USER             0x4
+#define PF_RESERVED         0x8
+
+#define PAGE_FAULT_VECTOR   14
+
+typedef struct vmm_region {
+    uint32_t base;                      // Start of the reservation, guard page included
+    uint32_t start;                     // First usable page
+    uint32_t end;
+    uint32_t flags;
+    struct vmm_region* next;            // Sorted by address
+} vmm_region_t;
+
+static vmm_region_t* regions;
+static kmem_cache_t* region_cache;
+static uint16_t* frame_refs;            // Indexed by physical frame number
+static vmm_stats_t stats;
+
+static inline uint32_t rdtsc_lo(void) {
+    uint32_t lo, hi;
+    asm volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return lo;
+}
+
+static inline uint32_t pte_flags(const vmm_region_t* r) {
+    return (r->flags & VMM_WRITE) ? PAGE_WRITE : 0;
+}
+
+static vmm_region_t* find_region(uint32_t addr) {
+    for (vmm_region_t* r = regions; r != NULL && r->base <= addr; r = r->next) {
+        if (addr < r->end) {
+            return r;
+        }
+    }
+    return NULL;
+}
+
+// Back 'page' with a zero-filled frame
+static int back_page(vmm_region_t* r, uint32_t page) {
+    uint32_t frame = pmm_alloc_frame();
+    if (frame == 0) {
+        return 0;
+    }
+    memset(phys_to_virt(frame), 0, PAGE_SIZE);
+    if (!paging_map(page, frame, pte_flags(r))) {
+        pmm_free_frame(frame);
+        return 0;
+    }
+    frame_refs[frame / PAGE_SIZE] = 1;
+    stats.resident_pages++;
+    return 1;
+}
+
+static void put_frame(uint32_t frame) {
+    if (--frame_refs[frame / PAGE_SIZE] == 0) {
+        pmm_free_frame(frame);
+    }
+}
+
+// Fatal fault: report it and stop, like an unhandled exception
+static void fault_panic(registers_t* regs, uint32_t addr, const char* why) {
+    stats.fatal++;
+    kprintf("Page fault at %p: %s (eip %p, error 0x%x)\n", (void*)addr, why,
+            (void*)regs->eip, regs->err_code);
+    term_flush();
+    serial_flush();
+    for (;;);
+}
+
+// Resolve a fault on 'addr'. Returns NULL on success, otherwise why it is fatal.
+static const char* resolve(uint32_t addr, uint32_t err) {
+    uint32_t page = addr & ~(PAGE_SIZE - 1);
+    vmm_region_t* r = find_region(addr);
+    if (r == NULL) {
+        return "not mapped";
+    }
+    if (addr < r->start) {
+        return "guard page hit (stack overflow?)";
+    }
+    if (err & (PF_USER | PF_RESERVED)) {
+        return (err & PF_USER) ? "user access to kernel region" : "reserved bit set";
+    }
+
+    uint32_t pte = paging_get(page);
+    if (!(err & PF_PRESENT)) {
+        if (pte & PAGE_PRESENT) {
+            return NULL;                // Already backed (stale TLB entry)
+        }
+        if (!back_page(r, page)) {
+            return "out of memory";
+        }
+        stats.zero_fills++;
+        return NULL;
+    }
+
+    if (!(err & PF_WRITE) || !(r->flags & VMM_WRITE)) {
+        return "write to read-only region";
+    }
+    uint32_t frame = pte & ~(PAGE_SIZE - 1);
+    if (frame_refs[frame / PAGE_SIZE] == 1) {
+        // Every other sharer is gone: take the frame over
+        paging_map(page, frame, PAGE_WRITE);
+        stats.cow_reuses++;
+        return NULL;
+    }
+    uint32_t copy = pmm_alloc_frame();
+    if (copy == 0) {
+        return "out of memory";
+    }
+    memcpy(phys_to_virt(copy), phys_to_virt(frame), PAGE_SIZE);
+    paging_map(page, copy, PAGE_WRITE);
+    frame_refs[copy / PAGE_SIZE] = 1;
+    frame_refs[frame / PAGE_SIZE]--;
+    stats.cow_copies++;
+    return NULL;
+}
+
+// ISR 14. Runs with interrupts off (interrupt gate), so CR2 is still ours.
+static void page_fault_handler(registers_t* regs) {
+    uint32_t start = rdtsc_lo();
+    uint32_t addr;
+    asm volatile ("mov %%cr2, %0" : "=r"(addr));
+    stats.faults++;
+
+    const char* why = resolve(addr, regs->err_code);
+    if (why != NULL) {
+        fault_panic(regs, addr, why);
+    }
+
+    uint32_t cycles = rdtsc_lo() - start;
+    uint32_t bucket = 31 - __builtin_clz(cycles | 1);
+    if (bucket >= VMM_HIST_BUCKETS) {
+        bucket = VMM_HIST_BUCKETS - 1;
+    }
+    stats.hist[bucket]++;
+    stats.cycles += cycles;
+    if (cycles > stats.max) {
+        stats.max = cycles;
+    }
+}
+
+void vmm_init(void) {
+    // One reference count per physical frame
+    uint32_t frames = pmm_memory_end() / PMM_FRAME_SIZE;
+    uint32_t table_frames = (frames * sizeof(uint16_t) + PMM_FRAME_SIZE - 1) / PMM_FRAME_SIZE;
+    uint32_t table = pmm_alloc_frames(table_frames);
+    region_cache = kmem_cache_create("vmm_region", sizeof(vmm_region_t), NULL);
+    if (table == 0 || region_cache == NULL) {
+        kprintf("vmm: no memory for frame reference counts!\n");
+        for (;;);
+    }
+    frame_refs = phys_to_virt(table);
+    memset(frame_refs, 0, table_frames * PMM_FRAME_SIZE);
+    isr_register_handler(PAGE_FAULT_VECTOR, page_fault_handler);
+}
+
+// Reserve address space: first fit in the sorted region list
+static vmm_region_t* reserve(uint32_t pages, uint32_t flags) {
+    uint32_t guard = (flags & VMM_GUARD) ? PAGE_SIZE : 0;
+    uint32_t need = pages * PAGE_SIZE + guard;
+    if (pages == 0 || pages > (VMM_END - VMM_BASE) / PAGE_SIZE) {
+        return NULL;
+    }
+    vmm_region_t* r = kmem_cache_alloc(region_cache);
+    if (r == NULL) {
+        return NULL;
+    }
+
+    uint32_t irq = irq_save();
+    uint32_t base = VMM_BASE;
+    vmm_region_t** link = &regions;
+    while (*link != NULL && (*link)->base - base < need) {
+        base = (*link)->end;
+        link = &(*link)->next;
+    }
+    if (VMM_END - base < need) {
+        irq_restore(irq);
+        kmem_cache_free(region_cache, r);
+        return NULL;
+    }
+    r->base = base;
+    r->start = base + guard;
+    r->end = base + need;
+    r->flags = flags;
+    r->next = *link;
+    *link = r;
+    irq_restore(irq);
+    return r;
+}
+
+void* vmm_alloc(size_t size, uint32_t flags) {
+    vmm_region_t* r = reserve((size + PAGE_SIZE - 1) / PAGE_SIZE, flags);
+    if (r == NULL) {
+        return NULL;
+    }
+    if (flags & VMM_POPULATE) {
+        for (uint32_t page = r->start; page < r->end; page += PAGE_SIZE) {
+            uint32_t irq = irq_save();
+            int ok = back_page(r, page);
+            irq_restore(irq);
+            if (!ok) {
+                vmm_free((void*)r->start);
+                return NULL;
+            }
+        }
+    }
+    return (void*)r->start;
+}
+
+void vmm_free(void* addr) {
+    uint32_t irq = irq_save();
+    vmm_region_t** link = &regions;
+    while (*link != NULL && (*link)->start != (uint32_t)addr) {
+        link = &(*link)->next;
+    }
+    vmm_region_t* r = *link;
+    if (r == NULL) {
+        irq_restore(irq);
+        return;
+    }
+    *link = r->next;
+
+    for (uint32_t page = r->start; page < r->end; page += PAGE_SIZE) {
+        uint32_t pte = paging_get(page);
+        if (pte & PAGE_PRESENT) {
+            paging_unmap(page);
+            put_frame(pte & ~(PAGE_SIZE - 1));
+            stats.resident_pages--;
+        }
+    }
+    irq_restore(irq);
+    kmem_cache_free(region_cache, r);
+}
+
+void* vmm_clone(void* src) {
+    vmm_region_t* from = find_region((uint32_t)src);
+    if (from == NULL || from->start != (uint32_t)src) {
+        return NULL;
+    }
+    vmm_region_t* to = reserve((from->end - from->start) / PAGE_SIZE, from->flags & ~VMM_POPULATE);
+    if (to == NULL) {
+        return NULL;
+    }
+
+    // Both sides map the frame read-only; the first write makes a copy
+    uint32_t irq = irq_save();
+    for (uint32_t off = 0; off < from->end - from->start; off += PAGE_SIZE) {
+        uint32_t pte = paging_get(from->start + off);
+        if (!(pte & PAGE_PRESENT)) {
+            continue;
+        }
+        uint32_t frame = pte & ~(PAGE_SIZE - 1);
+        if (!paging_map(to->start + off, frame, 0)) {
+            // No page table: a partial clone would read zeros where the
+            // source has data. Pages already shared stay read-only in the
+            // source; its next write to them reuses the frame.
+            irq_restore(irq);
+            vmm_free((void*)to->start);
+            return NULL;
+        }
+        paging_map(from->start + off, frame, 0);
+        frame_refs[frame / PAGE_SIZE]++;
+        stats.resident_pages++;
+    }
+    irq_restore(irq);
+    return (void*)to->start;
+}
+
+void* vmm_alloc_stack(size_t size) {
+    return vmm_alloc(size, VMM_WRITE | VMM_POPULATE | VMM_GUARD);
+}
+
+void vmm_get_stats(vmm_stats_t* out) {
+    uint32_t irq = irq_save();
+    *out = stats;
+    irq_restore(irq);
+}
+
+void vmm_dump_stats(void) {
+    vmm_stats_t s;
+    vmm_get_stats(&s);
+    kprintf("page faults %u: zero-fill %u, cow copy %u, cow reuse %u, fatal %u; %u pages resident\n",
+            s.faults, s.zero_fills, s.cow_copies, s.cow_reuses, s.fatal, s.resident_pages);
+
+    uint32_t resolved = s.faults - s.fatal;
+    if (resolved == 0) {
+        return;
+    }
+    char hist[KPRINTF_BUF_SIZE / 2];
+    size_t len = 0;
+    for (uint32_t b = 0; b < VMM_HIST_BUCKETS && len < sizeof(hist); b++) {
+        if (s.hist[b] != 0) {
+            len += ksnprintf(hist + len, sizeof(hist) - len, " %u:%u", b, s.hist[b]);
+        }
+    }
+    kprintf("fault cycles avg %u max %u, histogram (log2 cycles:count)%s\n",
+            avg_u64_u32(s.cycles, resolved), s.max, hist);
+}
+
+#ifdef BENCH_MODE
+#include "bench/bench.h"
+
+// Cost of the lazy approach, one fault per sample: first touch of a
+// zero-fill page, first write to a copy-on-write page, and a write to an
+// already backed page for reference
+#define FAULT_BENCH_PAGES   (BENCH_DEFAULT_WARMUP + BENCH_MAX_REPEATS)
+
+static uint8_t* fault_src;
+static uint8_t* fault_dst;
+static uint32_t fault_next;
+
+static void fault_zero_setup(void* arg) {
+    (void)arg;
+    fault_dst = vmm_alloc(FAULT_BENCH_PAGES * PAGE_SIZE, VMM_WRITE);
+    fault_next = 0;
+}
+
+static void fault_cow_setup(void* arg) {
+    (void)arg;
+    fault_src = vmm_alloc(FAULT_BENCH_PAGES * PAGE_SIZE, VMM_WRITE | VMM_POPULATE);
+    fault_dst = fault_src ? vmm_clone(fault_src) : NULL;
+    fault_next = 0;
+}
+
+static void fault_teardown(void* arg) {
+    (void)arg;
+    if (fault_dst) {
+        vmm_free(fault_dst);
+    }
+    if (fault_src) {
+        vmm_free(fault_src);
+    }
+    fault_dst = fault_src = NULL;
+}
+
+static void fault_touch(void* arg) {
+    (void)arg;
+    if (fault_dst != NULL && fault_next < FAULT_BENCH_PAGES) {
+        ((volatile uint8_t*)fault_dst)[fault_next++ * PAGE_SIZE] = 1;
+    }
+}
+
+static void backed_setup(void* arg) {
+    (void)arg;
+    fault_dst = vmm_alloc(PAGE_SIZE, VMM_WRITE | VMM_POPULATE);
+}
+
+static void backed_touch(void* arg) {
+    (void)arg;
+    if (fault_dst != NULL) {
+        *(volatile uint8_t*)fault_dst = 1;
+    }
+}
+
+BENCH_REGISTER(vmm_fault_zero_fill, .fn = fault_touch, .setup = fault_zero_setup,
+               .teardown = fault_teardown);
+BENCH_REGISTER(vmm_fault_cow_copy, .fn = fault_touch, .setup = fault_cow_setup,
+               .teardown = fault_teardown);
+BENCH_REGISTER(vmm_write_backed, .fn = backed_touch, .setup = backed_setup,
+               .teardown = fault_teardown);
+#endif
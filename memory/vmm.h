@@ -0,0 +1,63 @@
+#ifndef MEMORY_VMM_H
+#define MEMORY_VMM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Demand-paged kernel regions between VMM_BASE and VMM_END, above the direct
+// map (memory/paging.h). Pages are backed on first touch by the page-fault
+// handler: zero-filled frames for fresh regions, private copies for
+// copy-on-write clones.
+#define VMM_BASE            0xF1000000  // 0xF0000000 - 16 MB: BENCH_MODE TLB alias window
+#define VMM_END             0xFEC00000  // IOAPIC and LAPIC are identity mapped above
+
+// Region flags
+#define VMM_WRITE           0x1         // Writable (otherwise faults on write are fatal)
+#define VMM_POPULATE        0x2         // Back every page now instead of on first touch
+#define VMM_GUARD           0x4         // Unmapped page below the region; touching it panics
+
+// Page-fault latency histogram: bucket b counts faults of [2^b, 2^(b+1))
+// TSC cycles from entering the handler to returning; the last bucket is open.
+#define VMM_HIST_BUCKETS    24
+
+typedef struct {
+    uint32_t faults;            // Page faults taken (fatal ones included)
+    uint32_t zero_fills;        // Fresh frame, zero-filled
+    uint32_t cow_copies;        // Shared frame copied on write
+    uint32_t cow_reuses;        // Last sharer wrote: the frame was made writable in place
+    uint32_t fatal;             // Outside any region, guard page or access violation
+    uint32_t resident_pages;    // Pages currently backed by a frame
+    uint64_t cycles;            // Total handler time of the resolved faults
+    uint32_t max;
+    uint32_t hist[VMM_HIST_BUCKETS];
+} vmm_stats_t;
+
+// Frame reference counts and the page-fault handler (ISR 14).
+// Needs kmalloc_init() and idt_install().
+void vmm_init(void);
+
+// Reserve 'size' bytes (rounded up to pages) of kernel address space.
+// Nothing is allocated until a page is touched, unless VMM_POPULATE is set.
+// Returns NULL when the address space or memory is exhausted.
+void* vmm_alloc(size_t size, uint32_t flags);
+
+// Unmap a region from vmm_alloc() / vmm_clone() and free the frames it owns
+void vmm_free(void* addr);
+
+// New region sharing every backed page of 'src' copy-on-write: both sides
+// read the same frames until one of them writes. The TLB is only flushed on
+// the calling CPU, so the source must not be in use on another CPU meanwhile.
+// Returns NULL when the address space or memory for page tables runs out.
+void* vmm_clone(void* src);
+
+// Kernel thread stack: 'size' bytes populated up front (the CPU cannot take a
+// fault while pushing an interrupt frame) with a guard page below it
+void* vmm_alloc_stack(size_t size);
+
+// Counters and latency histogram
+void vmm_get_stats(vmm_stats_t* out);
+
+// Print the counters and the latency histogram (kprintf; on F12 with the IRQ stats)
+void vmm_dump_stats(void);
+
+#endif // MEMORY_VMM_H
@@ -0,0 +1,15 @@
+#!/bin/bash
+# Build the benchmark image: the normal kernel with -DBENCH_MODE, which runs
+# every BENCH_REGISTER()ed microbenchmark at boot and prints one
+# "BENCH name=... min=... median=... p99=..." line per benchmark.
+#
+#   ./scripts/linux-build-bench.sh
+#   qemu-system-x86_64 -serial stdio -display none os-image-bench.bin | grep '^BENCH'
+
+# Exit on error
+set -e
+
+BUILD_DIR="./build-bench" \
+FINAL_BIN="./os-image-bench.bin" \
+EXTRA_FLAGS="-DBENCH_MODE $EXTRA_FLAGS" \
+    ./scripts/linux-build.sh
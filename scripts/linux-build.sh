@@ -5,27 +5,86 @@ set -e
 # Paths
 TARGET="i686-elf"
 MBR_SRC="mbr.asm"
+STAGE2_SRC="stage2.asm"
 KERNEL_SRC="kernel.c"
 KERNEL_ENTRY_SRC="kernel_entry.asm"
-BUILD_DIR="./build"
+BUILD_DIR="${BUILD_DIR:-./build}"
 MBR_BIN="$BUILD_DIR/mbr.bin"
+STAGE2_BIN="$BUILD_DIR/stage2.bin"
 KERNEL_BIN="$BUILD_DIR/kernel.bin"
-FINAL_BIN="$BUILD_DIR/../os-image.bin"
+FINAL_BIN="${FINAL_BIN:-./os-image.bin}"
 INTERRUPT_DIR="./interrupt"
 IDT_SRC="$INTERRUPT_DIR/idt.c"
 ISR_SRC="$INTERRUPT_DIR/isr.c"
 IRQ_SRC="$INTERRUPT_DIR/irq.c"
+PIC_SRC="$INTERRUPT_DIR/pic.c"
+APIC_SRC="$INTERRUPT_DIR/apic.c"
+IRQ_STATS_SRC="$INTERRUPT_DIR/irq_stats.c"
+SOFTIRQ_SRC="$INTERRUPT_DIR/softirq.c"
+ACPI_DIR="./acpi"
+ACPI_SRC="$ACPI_DIR/acpi.c"
 LIBC_DIR="./libc"
 MEMSET_SRC="$LIBC_DIR/string/memset.c"
+MEMCPY_SRC="$LIBC_DIR/string/memcpy.c"
+MEMCMP_SRC="$LIBC_DIR/string/memcmp.c"
+STR_SRC="$LIBC_DIR/string/str.c"
+STRING_INIT_SRC="$LIBC_DIR/string/string_init.c"
+KPRINTF_SRC="$LIBC_DIR/stdio/kprintf.c"
 INTERRUPT_ASM="$INTERRUPT_DIR/interrupt_asm.s"
 KERNEL_ELF="$BUILD_DIR/kernel.elf"
 DRIVER_DIR="./drivers"
 TIMER_SRC="$DRIVER_DIR/timer.c"
+CLOCKSOURCE_SRC="$DRIVER_DIR/clocksource.c"
+RTC_SRC="$DRIVER_DIR/rtc.c"
 KEYBOARD_SRC="$DRIVER_DIR/keyboard.c"
+SERIAL_SRC="$DRIVER_DIR/serial.c"
+PCI_SRC="$DRIVER_DIR/pci.c"
+ATA_SRC="$DRIVER_DIR/ata.c"
+VGA_SRC="$DRIVER_DIR/vga.c"
+BLOCK_DIR="./block"
+BLKDEV_SRC="$BLOCK_DIR/blkdev.c"
+BCACHE_SRC="$BLOCK_DIR/bcache.c"
+FS_DIR="./fs"
+INITRD_SRC="$FS_DIR/initrd.c"
+TRACE_DIR="./trace"
+PROFILE_SRC="$TRACE_DIR/profile.c"
+TRACE_SRC="$TRACE_DIR/trace.c"
+MEMORY_DIR="./memory"
+PMM_SRC="$MEMORY_DIR/pmm.c"
+KMALLOC_SRC="$MEMORY_DIR/kmalloc.c"
+ARENA_SRC="$MEMORY_DIR/arena.c"
+PAGING_SRC="$MEMORY_DIR/paging.c"
+VMM_SRC="$MEMORY_DIR/vmm.c"
+TASK_DIR="./task"
+SCHED_SRC="$TASK_DIR/sched.c"
+KTIMER_SRC="$TASK_DIR/ktimer.c"
+WORKPOOL_SRC="$TASK_DIR/workpool.c"
+CPU_DIR="./cpu"
+GDT_SRC="$CPU_DIR/gdt.c"
+SMP_SRC="$CPU_DIR/smp.c"
+SYSCALL_SRC="$CPU_DIR/syscall.c"
+FPU_SRC="$CPU_DIR/fpu.c"
+TRAMPOLINE_ASM="$CPU_DIR/trampoline.asm"
+USER_BENCH_ASM="$CPU_DIR/user_bench.asm"
+BENCH_DIR="./bench"
+BENCH_SRC="$BENCH_DIR/bench.c"
 
 
 # Build flags
-BUILD_FLAGS="-ffreestanding -Wall -Wextra -I. -g"
+# Extra defines can be passed in, e.g. EXTRA_FLAGS="-DPMM_STRESS" ./scripts/linux-build.sh
+# (scripts/linux-build-bench.sh builds the benchmark image this way)
+# BOOT_BENCH=1 pads the kernel to 1 MB and has stage 2 time batched against
+# sector-by-sector loading; kernel_main prints both.
+# INITRD_DIR (default ./initrd) is packed as a cpio newc archive and loaded
+# by stage 2 after the kernel; INITRD_BENCH_FILES=N adds N small files to it
+# (for EXTRA_FLAGS="-DINITRD_BENCH").
+# FRAME_POINTERS=1 keeps ebp as a frame pointer so the profiler records
+# backtraces (trace/profile.h); scripts/profile-fold.sh turns them into folded stacks.
+# -fno-tree-loop-distribute-patterns: don't turn libc's own loops into memset/memcpy calls
+BUILD_FLAGS="-ffreestanding -O2 -fno-tree-loop-distribute-patterns -Wall -Wextra -I. -g $EXTRA_FLAGS"
+if [ -n "$FRAME_POINTERS" ]; then
+    BUILD_FLAGS="$BUILD_FLAGS -fno-omit-frame-pointer -DPROFILE_BACKTRACE"
+fi
 
 # Temporarily add bin folder to path
 export PATH="./cross-tools/cross/bin:$PATH"
@@ -39,8 +98,15 @@ nasm -f elf "$KERNEL_ENTRY_SRC" -o "$BUILD_DIR/kernel_entry.o"
 # Compile kernel.c to object file
 $TARGET-gcc $BUILD_FLAGS -c "$KERNEL_SRC" -o "$BUILD_DIR/kernel.o"
 
-# Compile memset.c to object file
+# Compile the libc string functions to object files
 $TARGET-gcc $BUILD_FLAGS -c "$MEMSET_SRC" -o "$BUILD_DIR/memset.o"
+$TARGET-gcc $BUILD_FLAGS -c "$MEMCPY_SRC" -o "$BUILD_DIR/memcpy.o"
+$TARGET-gcc $BUILD_FLAGS -c "$MEMCMP_SRC" -o "$BUILD_DIR/memcmp.o"
+$TARGET-gcc $BUILD_FLAGS -c "$STR_SRC" -o "$BUILD_DIR/str.o"
+$TARGET-gcc $BUILD_FLAGS -c "$STRING_INIT_SRC" -o "$BUILD_DIR/string_init.o"
+
+# Compile kprintf.c to object file
+$TARGET-gcc $BUILD_FLAGS -c "$KPRINTF_SRC" -o "$BUILD_DIR/kprintf.o"
 
 # Compile idt.c to object file
 $TARGET-gcc $BUILD_FLAGS -c "$IDT_SRC" -o "$BUILD_DIR/idt.o"
@@ -51,26 +117,145 @@ $TARGET-gcc $BUILD_FLAGS -c "$ISR_SRC" -o "$BUILD_DIR/isr.o"
 # Compile irq.c to object file
 $TARGET-gcc $BUILD_FLAGS -c "$IRQ_SRC" -o "$BUILD_DIR/irq.o"
 
+# Compile pic.c to object file
+$TARGET-gcc $BUILD_FLAGS -c "$PIC_SRC" -o "$BUILD_DIR/pic.o"
+
+# Compile apic.c to object file
+$TARGET-gcc $BUILD_FLAGS -c "$APIC_SRC" -o "$BUILD_DIR/apic.o"
+
+# Compile irq_stats.c to object file
+$TARGET-gcc $BUILD_FLAGS -c "$IRQ_STATS_SRC" -o "$BUILD_DIR/irq_stats.o"
+
+# Compile softirq.c to object file
+$TARGET-gcc $BUILD_FLAGS -c "$SOFTIRQ_SRC" -o "$BUILD_DIR/softirq.o"
+
+# Compile acpi.c to object file
+$TARGET-gcc $BUILD_FLAGS -c "$ACPI_SRC" -o "$BUILD_DIR/acpi.o"
+
 # Compile interrupt_asm.s to object file
 nasm -f elf "$INTERRUPT_ASM" -o "$BUILD_DIR/interrupt_asm.o"
 
 # Compile timer.c to object file
 $TARGET-gcc $BUILD_FLAGS -c "$TIMER_SRC" -o "$BUILD_DIR/timer.o"
 
+# Compile clocksource.c to object file
+$TARGET-gcc $BUILD_FLAGS -c "$CLOCKSOURCE_SRC" -o "$BUILD_DIR/clocksource.o"
+
+# Compile rtc.c to object file
+$TARGET-gcc $BUILD_FLAGS -c "$RTC_SRC" -o "$BUILD_DIR/rtc.o"
+
 # Compile keyboard.c to object file
 $TARGET-gcc $BUILD_FLAGS -c "$KEYBOARD_SRC" -o "$BUILD_DIR/keyboard.o"
 
+# Compile serial.c to object file
+$TARGET-gcc $BUILD_FLAGS -c "$SERIAL_SRC" -o "$BUILD_DIR/serial.o"
+
+# Compile pci.c and ata.c to object files
+$TARGET-gcc $BUILD_FLAGS -c "$PCI_SRC" -o "$BUILD_DIR/pci.o"
+$TARGET-gcc $BUILD_FLAGS -c "$ATA_SRC" -o "$BUILD_DIR/ata.o"
+
+# Compile blkdev.c and bcache.c to object files
+$TARGET-gcc $BUILD_FLAGS -c "$BLKDEV_SRC" -o "$BUILD_DIR/blkdev.o"
+$TARGET-gcc $BUILD_FLAGS -c "$BCACHE_SRC" -o "$BUILD_DIR/bcache.o"
+
+# Compile initrd.c to object file
+$TARGET-gcc $BUILD_FLAGS -c "$INITRD_SRC" -o "$BUILD_DIR/initrd.o"
+
+# Compile profile.c and trace.c to object files
+$TARGET-gcc $BUILD_FLAGS -c "$PROFILE_SRC" -o "$BUILD_DIR/profile.o"
+$TARGET-gcc $BUILD_FLAGS -c "$TRACE_SRC" -o "$BUILD_DIR/trace.o"
+
+# Compile vga.c to object file
+$TARGET-gcc $BUILD_FLAGS -c "$VGA_SRC" -o "$BUILD_DIR/vga.o"
+
+# Compile pmm.c to object file
+$TARGET-gcc $BUILD_FLAGS -c "$PMM_SRC" -o "$BUILD_DIR/pmm.o"
+
+# Compile kmalloc.c to object file
+$TARGET-gcc $BUILD_FLAGS -c "$KMALLOC_SRC" -o "$BUILD_DIR/kmalloc.o"
+
+# Compile arena.c to object file
+$TARGET-gcc $BUILD_FLAGS -c "$ARENA_SRC" -o "$BUILD_DIR/arena.o"
+
+# Compile paging.c to object file
+$TARGET-gcc $BUILD_FLAGS -c "$PAGING_SRC" -o "$BUILD_DIR/paging.o"
+
+# Compile vmm.c to object file
+$TARGET-gcc $BUILD_FLAGS -c "$VMM_SRC" -o "$BUILD_DIR/vmm.o"
+
+# Compile sched.c to object file
+$TARGET-gcc $BUILD_FLAGS -c "$SCHED_SRC" -o "$BUILD_DIR/sched.o"
+
+# Compile ktimer.c to object file
+$TARGET-gcc $BUILD_FLAGS -c "$KTIMER_SRC" -o "$BUILD_DIR/ktimer.o"
+
+# Compile workpool.c to object file
+$TARGET-gcc $BUILD_FLAGS -c "$WORKPOOL_SRC" -o "$BUILD_DIR/workpool.o"
+
+# Compile gdt.c, smp.c, syscall.c and fpu.c to object files
+$TARGET-gcc $BUILD_FLAGS -c "$GDT_SRC" -o "$BUILD_DIR/gdt.o"
+$TARGET-gcc $BUILD_FLAGS -c "$SMP_SRC" -o "$BUILD_DIR/smp.o"
+$TARGET-gcc $BUILD_FLAGS -c "$SYSCALL_SRC" -o "$BUILD_DIR/syscall.o"
+$TARGET-gcc $BUILD_FLAGS -c "$FPU_SRC" -o "$BUILD_DIR/fpu.o"
+
+# Compile the benchmark harness to object file
+$TARGET-gcc $BUILD_FLAGS -c "$BENCH_SRC" -o "$BUILD_DIR/bench.o"
+
+# Assemble the AP startup trampoline
+nasm -f elf "$TRAMPOLINE_ASM" -o "$BUILD_DIR/trampoline.o"
+
+# Assemble the ring 3 side of the system call benchmark (copied out by SYSCALL_BENCH images)
+nasm -f elf "$USER_BENCH_ASM" -o "$BUILD_DIR/user_bench.o"
+
 # Link kernel and kernel_entry to ELF file (with symbols)
-$TARGET-ld -Ttext 0x1000 -o "$KERNEL_ELF" \
+# Stage 2 loads the image to 1 MB (KERNEL_LOAD_ADDR in bootloader/boot_layout.asm);
+# it is linked for the higher half, KERNEL_VIRT_BASE (memory/paging.h) + 1 MB
+$TARGET-ld -Ttext 0xC0100000 -o "$KERNEL_ELF" \
     "$BUILD_DIR/kernel_entry.o" \
     "$BUILD_DIR/kernel.o" \
     "$BUILD_DIR/memset.o" \
+    "$BUILD_DIR/memcpy.o" \
+    "$BUILD_DIR/memcmp.o" \
+    "$BUILD_DIR/str.o" \
+    "$BUILD_DIR/string_init.o" \
+    "$BUILD_DIR/kprintf.o" \
     "$BUILD_DIR/idt.o" \
     "$BUILD_DIR/interrupt_asm.o" \
     "$BUILD_DIR/isr.o" \
     "$BUILD_DIR/irq.o" \
+    "$BUILD_DIR/pic.o" \
+    "$BUILD_DIR/apic.o" \
+    "$BUILD_DIR/irq_stats.o" \
+    "$BUILD_DIR/softirq.o" \
+    "$BUILD_DIR/acpi.o" \
     "$BUILD_DIR/timer.o" \
-    "$BUILD_DIR/keyboard.o"
+    "$BUILD_DIR/clocksource.o" \
+    "$BUILD_DIR/rtc.o" \
+    "$BUILD_DIR/keyboard.o" \
+    "$BUILD_DIR/serial.o" \
+    "$BUILD_DIR/pci.o" \
+    "$BUILD_DIR/ata.o" \
+    "$BUILD_DIR/blkdev.o" \
+    "$BUILD_DIR/bcache.o" \
+    "$BUILD_DIR/initrd.o" \
+    "$BUILD_DIR/profile.o" \
+    "$BUILD_DIR/trace.o" \
+    "$BUILD_DIR/vga.o" \
+    "$BUILD_DIR/pmm.o" \
+    "$BUILD_DIR/kmalloc.o" \
+    "$BUILD_DIR/arena.o" \
+    "$BUILD_DIR/paging.o" \
+    "$BUILD_DIR/vmm.o" \
+    "$BUILD_DIR/sched.o" \
+    "$BUILD_DIR/ktimer.o" \
+    "$BUILD_DIR/workpool.o" \
+    "$BUILD_DIR/gdt.o" \
+    "$BUILD_DIR/smp.o" \
+    "$BUILD_DIR/syscall.o" \
+    "$BUILD_DIR/fpu.o" \
+    "$BUILD_DIR/trampoline.o" \
+    "$BUILD_DIR/user_bench.o" \
+    "$BUILD_DIR/bench.o"
 
 # Extract raw binary from ELF
 $TARGET-objcopy -O binary "$KERNEL_ELF" "$KERNEL_BIN"
@@ -80,12 +265,53 @@ KERNEL_SIZE=$(stat -c%s "$KERNEL_BIN")
 KERNEL_SECTORS=$(( (KERNEL_SIZE + 511) / 512 ))
 echo "Kernel size: $KERNEL_SIZE bytes ($KERNEL_SECTORS sectors)"
 
-# Assemble MBR with kernel sector count
+STAGE2_FLAGS=""
+if [ -n "$BOOT_BENCH" ]; then
+    STAGE2_FLAGS="-DBOOT_BENCH"
+    if [ "$KERNEL_SECTORS" -lt 2048 ]; then
+        KERNEL_SECTORS=2048
+        echo "BOOT_BENCH: kernel padded to 1 MB"
+    fi
+fi
+
+# Whole sectors, so the last read never runs past the end of the image
+truncate -s $(( KERNEL_SECTORS * 512 )) "$KERNEL_BIN"
+
+# Pack the initrd: files in name order, so builds of the same tree are identical
+INITRD_DIR="${INITRD_DIR:-./initrd}"
+INITRD_ROOT="$BUILD_DIR/initrd-root"
+INITRD_BIN="$BUILD_DIR/initrd.cpio"
+rm -rf "$INITRD_ROOT" "$INITRD_BIN"
+if [ -d "$INITRD_DIR" ] || [ -n "$INITRD_BENCH_FILES" ]; then
+    mkdir -p "$INITRD_ROOT"
+    if [ -d "$INITRD_DIR" ]; then
+        cp -r "$INITRD_DIR"/. "$INITRD_ROOT"
+    fi
+    if [ -n "$INITRD_BENCH_FILES" ]; then
+        mkdir -p "$INITRD_ROOT/bench"
+        for i in $(seq 1 "$INITRD_BENCH_FILES"); do
+            echo "file $i" > "$INITRD_ROOT/bench/f$i"
+        done
+    fi
+    (cd "$INITRD_ROOT" && find . | LC_ALL=C sort | cpio -o -H newc --quiet) > "$INITRD_BIN"
+    INITRD_SIZE=$(stat -c%s "$INITRD_BIN")
+    INITRD_SECTORS=$(( (INITRD_SIZE + 511) / 512 ))
+    truncate -s $(( INITRD_SECTORS * 512 )) "$INITRD_BIN"
+    STAGE2_FLAGS="$STAGE2_FLAGS -DINITRD_SECTORS=$INITRD_SECTORS -DINITRD_SIZE=$INITRD_SIZE"
+    echo "Initrd size: $INITRD_SIZE bytes ($INITRD_SECTORS sectors)"
+fi
+
+# Assemble the MBR (stage 1) and stage 2 with the kernel and initrd sector counts
 cd "./bootloader"
-nasm -f bin -DKERNEL_SECTORS=$KERNEL_SECTORS "$MBR_SRC" -o "../$MBR_BIN"
+nasm -f bin "$MBR_SRC" -o "../$MBR_BIN"
+nasm -f bin -DKERNEL_SECTORS=$KERNEL_SECTORS $STAGE2_FLAGS "$STAGE2_SRC" -o "../$STAGE2_BIN"
 cd ../
 
-# Concatenate MBR and kernel binary
-cat "$MBR_BIN" "$KERNEL_BIN" > "$FINAL_BIN"
+# Concatenate MBR, stage 2, kernel binary and initrd (if any)
+if [ -f "$INITRD_BIN" ]; then
+    cat "$MBR_BIN" "$STAGE2_BIN" "$KERNEL_BIN" "$INITRD_BIN" > "$FINAL_BIN"
+else
+    cat "$MBR_BIN" "$STAGE2_BIN" "$KERNEL_BIN" > "$FINAL_BIN"
+fi
 
 echo "Build complete: $FINAL_BIN"
\ No newline at end of file
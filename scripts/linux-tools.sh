@@ -22,6 +22,7 @@ apt-get install -y \
     wget \
     git \
     nasm \
+    cpio \
     qemu-system qemu-utils \
     gdb-multiarch 
 
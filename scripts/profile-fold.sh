@@ -0,0 +1,79 @@
+#!/bin/bash
+# Turn a profile dumped over serial (F11 twice, see trace/profile.h) into
+# folded stacks for flamegraph.pl or speedscope: one "cpuN;outer;...;leaf count"
+# line per distinct stack, heaviest first.
+#
+#   qemu-system-x86_64 -serial file:serial.log os-image.bin
+#   ./scripts/profile-fold.sh serial.log > kernel.folded
+#   flamegraph.pl kernel.folded > kernel.svg
+#
+# Symbols come from build/kernel.elf (built with -g); set KERNEL_ELF for
+# another image. Build with FRAME_POINTERS=1 for whole stacks; otherwise
+# each sample is just the interrupted function.
+
+# Exit on error
+set -e
+
+LOG="${1:-/dev/stdin}"
+KERNEL_ELF="${KERNEL_ELF:-./build/kernel.elf}"
+ADDR2LINE="${ADDR2LINE:-addr2line}"
+if ! command -v "$ADDR2LINE" > /dev/null && command -v i686-elf-addr2line > /dev/null; then
+    ADDR2LINE="i686-elf-addr2line"
+fi
+
+TMP_DIR=$(mktemp -d)
+trap 'rm -rf "$TMP_DIR"' EXIT
+
+# Sample lines of the last dump in the log, without the serial '\r'
+tr -d '\r' < "$LOG" | awk '
+    /^PROF begin / { n = 0 }
+    /^PROF s /     { lines[n++] = $0 }
+    END            { for (i = 0; i < n; i++) print lines[i] }
+' > "$TMP_DIR/samples"
+
+if [ ! -s "$TMP_DIR/samples" ]; then
+    echo "No PROF samples in $LOG" >&2
+    exit 1
+fi
+
+# Hex helpers (plain awk has no strtonum, and printf "%x" may stop at 2^31)
+HEX_AWK='
+    function hex2num(s,    i, v) {
+        v = 0
+        s = tolower(s)
+        for (i = 1; i <= length(s); i++) v = v * 16 + index("0123456789abcdef", substr(s, i, 1)) - 1
+        return v
+    }
+    function num2hex(v,    s) {
+        s = ""
+        do { s = substr("0123456789abcdef", v % 16 + 1, 1) s; v = int(v / 16) } while (v > 0)
+        return s
+    }'
+
+# Every address once. Return addresses are looked up one byte back, inside
+# the call instruction, so a call at the very end of a function is not
+# charged to the next one.
+awk "$HEX_AWK"'
+{
+    print num2hex(hex2num($5))
+    for (i = 6; i <= NF; i++) print num2hex(hex2num($i) - 1)
+}' "$TMP_DIR/samples" | sort -u > "$TMP_DIR/addrs"
+
+# addrN -> function name (addr2line -f prints the function, then file:line)
+sed 's/^/0x/' "$TMP_DIR/addrs" | "$ADDR2LINE" -f -e "$KERNEL_ELF" | awk 'NR % 2 == 1' > "$TMP_DIR/funcs"
+paste -d ' ' "$TMP_DIR/addrs" "$TMP_DIR/funcs" > "$TMP_DIR/symbols"
+
+awk "$HEX_AWK"'
+    NR == FNR { sym[$1] = ($2 == "??") ? "0x" $1 : $2; next }
+    {
+        if ($4 == "u") {
+            stack = "cpu" $3 ";[user]"
+        } else {
+            stack = "cpu" $3
+            for (i = NF; i >= 6; i--) stack = stack ";" sym[num2hex(hex2num($i) - 1)]
+            stack = stack ";" sym[num2hex(hex2num($5))]
+        }
+        count[stack]++
+    }
+    END { for (s in count) print s, count[s] }
+' "$TMP_DIR/symbols" "$TMP_DIR/samples" | sort -k2,2nr -t ' '
@@ -0,0 +1,105 @@
+#!/bin/bash
+# Convert a trace stream (F10 twice, see trace/trace.h) into Chrome trace
+# JSON for chrome://tracing or ui.perfetto.dev.
+#
+#   qemu-system-x86_64 -debugcon file:trace.bin os-image.bin     # Raw records
+#   ./scripts/trace-to-chrome.sh trace.bin > trace.json
+#
+#   qemu-system-x86_64 -serial file:serial.log os-image.bin      # No debugcon: "TRC" lines
+#   ./scripts/trace-to-chrome.sh serial.log > trace.json
+#
+# Each CPU gets two tracks: interrupts and exceptions as nested slices
+# (with timer, keyboard and scroll events as instants), and the running
+# thread. Timestamps come from the TSC, scaled by the rate in the stream
+# header.
+
+# Exit on error
+set -e
+
+INPUT="${1:-/dev/stdin}"
+
+# One record per line as 32 hex digits: serial lines carry them after "TRC ",
+# a debugcon capture is raw 16-byte records
+records() {
+    if grep -a -q '^TRC ' "$INPUT"; then
+        tr -d '\r' < "$INPUT" | grep -a '^TRC ' | cut -d ' ' -f 2
+    else
+        od -An -v -tx1 -w16 "$INPUT" | tr -d ' '
+    fi
+}
+
+records | awk '
+    function byte(i) {
+        return index("0123456789abcdef", substr(hex, 2 * i + 1, 1)) * 16 - 17 + \
+               index("0123456789abcdef", substr(hex, 2 * i + 2, 1))
+    }
+    function field(first, count,    i, v) {
+        v = 0
+        for (i = first + count - 1; i >= first; i--) v = v * 256 + byte(i)
+        return v
+    }
+    function out(json) {
+        printf "%s\n    %s", (events++ ? "," : ""), json
+    }
+    function ev(ph, name, tid, extra) {
+        out(sprintf("{\"ph\":\"%s\",\"name\":\"%s\",\"pid\":0,\"tid\":%d,\"ts\":%.3f%s}", \
+                    ph, name, tid, ts, extra))
+    }
+    function track(tid, name) {
+        if (!(tid in named)) {
+            named[tid] = 1
+            out(sprintf("{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", \
+                        tid, name))
+        }
+    }
+    function vector_name(v) {
+        if (v == 14) return "page fault"
+        if (v == 7) return "#NM"
+        if (v == 241) return "profile IPI"
+        return "vector " v
+    }
+
+    BEGIN { printf "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[" }
+    length($0) == 32 {
+        hex = tolower($0)
+        tsc = field(0, 8)
+        event = byte(8)
+        cpu = byte(9)
+        arg0 = field(10, 2)
+        arg1 = field(12, 4)
+
+        if (event == 1) {                           # Header
+            if (!khz) { khz = arg1; base = tsc }
+            next
+        }
+        if (!khz) next                              # Stream started before the capture
+        ts = (tsc - base) * 1000 / khz
+        irq_tid = cpu * 2
+        thread_tid = cpu * 2 + 1
+        track(irq_tid, "cpu" cpu " interrupts")
+
+        if (event == 2) {
+            ev("i", "lost " arg1 " records", irq_tid, ",\"s\":\"p\"")
+        } else if (event == 3) {
+            ev("B", "irq " arg0, irq_tid, sprintf(",\"args\":{\"vector\":%d}", arg1))
+        } else if (event == 4) {
+            ev("E", "irq " arg0, irq_tid, "")
+        } else if (event == 5) {
+            ev("B", vector_name(arg0), irq_tid, sprintf(",\"args\":{\"error_code\":%.0f}", arg1))
+        } else if (event == 6) {
+            ev("E", vector_name(arg0), irq_tid, "")
+        } else if (event == 7) {
+            ev("i", "timer", irq_tid, sprintf(",\"s\":\"t\",\"args\":{\"late_ns\":%.0f}", arg1))
+        } else if (event == 8) {
+            ev("i", "keyboard", irq_tid, sprintf(",\"s\":\"t\",\"args\":{\"scancode\":%d}", arg0))
+        } else if (event == 9) {
+            ev("i", "term_scroll", irq_tid, ",\"s\":\"t\"")
+        } else if (event == 10) {
+            track(thread_tid, "cpu" cpu " threads")
+            if (thread_tid in running) ev("E", "thread " running[thread_tid], thread_tid, "")
+            running[thread_tid] = arg1
+            ev("B", "thread " arg1, thread_tid, "")
+        }
+    }
+    END { printf "\n]}\n" }
+'
@@ -0,0 +1,199 @@
+#include "ktimer.h"
+#include "drivers/timer.h"
+#include "interrupt/irqflags.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Hierarchical timer wheel.
+// A timer due 'd' level 0 slots from now lives on level L, the smallest with
+// d < 64^(L+1), in slot (expires >> 6L) & 63. Whenever wheel_clk crosses a
+// 64^L boundary the matching level L slot is re-queued ("cascaded") onto the
+// finer levels, so adding and cancelling are O(1) list operations.
+
+#define LEVEL_MASK          (KTIMER_LEVEL_SIZE - 1)
+#define LEVEL_SHIFT(l)      ((l) * KTIMER_LEVEL_BITS)
+#define WHEEL_REACH         (1ull << (KTIMER_LEVELS * KTIMER_LEVEL_BITS))
+
+static ktimer_t* wheel[KTIMER_LEVELS * KTIMER_LEVEL_SIZE];
+static uint64_t occupied[KTIMER_LEVELS];    // Bit s set when slot s of the level is non-empty
+static uint64_t wheel_clk;                  // Level 0 slot being processed (time >> KTIMER_GRAN_SHIFT)
+
+// Distance from 'from' to the first occupied slot of 'level' (wrapping), -1 if the level is empty
+static int next_slot(uint32_t level, uint32_t from) {
+    uint64_t bits = occupied[level];
+    if (bits == 0) {
+        return -1;
+    }
+    if (from != 0) {
+        bits = (bits >> from) | (bits << (KTIMER_LEVEL_SIZE - from));
+    }
+    uint32_t low = (uint32_t)bits;
+    return low ? __builtin_ctz(low) : 32 + __builtin_ctz((uint32_t)(bits >> 32));
+}
+
+static void enqueue(ktimer_t* timer) {
+    uint64_t expires = timer->expires_ns >> KTIMER_GRAN_SHIFT;
+    if (expires < wheel_clk) {
+        expires = wheel_clk;                // Already due: run with the current slot
+    }
+    uint64_t delta = expires - wheel_clk;
+    if (delta >= WHEEL_REACH) {
+        expires = wheel_clk + WHEEL_REACH - 1; // Re-queued from the top level until it fits
+        delta = WHEEL_REACH - 1;
+    }
+
+    uint32_t level = 0;
+    while (delta >= (1ull << LEVEL_SHIFT(level + 1))) {
+        level++;
+    }
+    uint32_t slot = (expires >> LEVEL_SHIFT(level)) & LEVEL_MASK;
+
+    ktimer_t** head = &wheel[level * KTIMER_LEVEL_SIZE + slot];
+    timer->next = *head;
+    if (*head) {
+        (*head)->pprev = &timer->next;
+    }
+    *head = timer;
+    timer->pprev = head;
+    occupied[level] |= 1ull << slot;
+}
+
+static void unlink(ktimer_t* timer) {
+    *timer->pprev = timer->next;
+    if (timer->next) {
+        timer->next->pprev = timer->pprev;
+    }
+
+    // Emptied a wheel slot? (pprev may also point into a list being processed)
+    uint32_t index = ((uintptr_t)timer->pprev - (uintptr_t)wheel) / sizeof(wheel[0]);
+    if (index < KTIMER_LEVELS * KTIMER_LEVEL_SIZE && wheel[index] == NULL) {
+        occupied[index / KTIMER_LEVEL_SIZE] &= ~(1ull << (index % KTIMER_LEVEL_SIZE));
+    }
+    timer->next = NULL;
+    timer->pprev = NULL;
+}
+
+// Detach a slot into a local list whose head is '*list'
+static void take_slot(uint32_t level, uint32_t slot, ktimer_t** list) {
+    ktimer_t** head = &wheel[level * KTIMER_LEVEL_SIZE + slot];
+    *list = *head;
+    if (*list) {
+        (*list)->pprev = list;
+    }
+    *head = NULL;
+    occupied[level] &= ~(1ull << slot);
+}
+
+// Move one slot of a coarse level down to where its timers belong now
+static void cascade(uint32_t level) {
+    ktimer_t* list;
+    take_slot(level, (wheel_clk >> LEVEL_SHIFT(level)) & LEVEL_MASK, &list);
+    while (list) {
+        ktimer_t* timer = list;
+        unlink(timer);
+        enqueue(timer);
+    }
+}
+
+void ktimer_init(uint64_t now_ns) {
+    wheel_clk = now_ns >> KTIMER_GRAN_SHIFT;
+}
+
+void ktimer_setup(ktimer_t* timer, ktimer_fn_t fn, void* arg) {
+    timer->next = NULL;
+    timer->pprev = NULL;
+    timer->expires_ns = 0;
+    timer->fn = fn;
+    timer->arg = arg;
+}
+
+void add_timer(ktimer_t* timer, uint64_t expires_ns) {
+    uint32_t flags = irq_save();
+    if (timer->pprev) {
+        unlink(timer);
+    }
+    timer->expires_ns = expires_ns;
+    enqueue(timer);
+    timer_request_deadline(expires_ns);
+    irq_restore(flags);
+}
+
+int del_timer(ktimer_t* timer) {
+    uint32_t flags = irq_save();
+    int queued = timer->pprev != NULL;
+    if (queued) {
+        unlink(timer);
+    }
+    irq_restore(flags);
+    return queued;
+}
+
+void ktimer_run(uint64_t now_ns) {
+    uint64_t target = now_ns >> KTIMER_GRAN_SHIFT;
+    for (;;) {
+        // Run what is due in the current slot; a timer later in the same slot stays queued.
+        // Slots before 'target' are drained completely, including timers the callbacks add.
+        uint32_t slot = wheel_clk & LEVEL_MASK;
+        do {
+            ktimer_t* list;
+            take_slot(0, slot, &list);
+            while (list) {
+                ktimer_t* timer = list;
+                unlink(timer);
+                if (timer->expires_ns <= now_ns) {
+                    timer->fn(timer->arg);
+                } else {
+                    enqueue(timer);
+                }
+            }
+        } while (wheel_clk < target && (occupied[0] & (1ull << slot)));
+        if (wheel_clk >= target) {
+            break;
+        }
+
+        // Skip ahead to the next non-empty slot, cascade boundary or 'target', whichever is first
+        uint64_t next = (wheel_clk | LEVEL_MASK) + 1;
+        int distance = next_slot(0, (wheel_clk + 1) & LEVEL_MASK);
+        if (distance >= 0 && wheel_clk + 1 + distance < next) {
+            next = wheel_clk + 1 + distance;
+        }
+        wheel_clk = next < target ? next : target;
+
+        for (uint32_t level = 1; level < KTIMER_LEVELS; level++) {
+            if (wheel_clk & ((1ull << LEVEL_SHIFT(level)) - 1)) {
+                break;
+            }
+            cascade(level);
+        }
+    }
+}
+
+uint64_t ktimer_next_deadline(void) {
+    uint32_t flags = irq_save();
+    uint64_t deadline = KTIMER_NEVER;
+
+    // Level 0 holds the exact deadlines of the next 64 slots
+    int distance = next_slot(0, wheel_clk & LEVEL_MASK);
+    if (distance >= 0) {
+        uint32_t slot = (wheel_clk + distance) & LEVEL_MASK;
+        for (ktimer_t* timer = wheel[slot]; timer; timer = timer->next) {
+            if (timer->expires_ns < deadline) {
+                deadline = timer->expires_ns;
+            }
+        }
+    }
+
+    // Coarser levels: wake up when their first non-empty slot cascades
+    for (uint32_t level = 1; level < KTIMER_LEVELS; level++) {
+        uint64_t position = (wheel_clk >> LEVEL_SHIFT(level)) + 1;
+        distance = next_slot(level, position & LEVEL_MASK);
+        if (distance >= 0) {
+            uint64_t when = ((position + distance) << LEVEL_SHIFT(level)) << KTIMER_GRAN_SHIFT;
+            if (when < deadline) {
+                deadline = when;
+            }
+        }
+    }
+    irq_restore(flags);
+    return deadline;
+}
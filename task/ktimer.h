@@ -0,0 +1,47 @@
+#ifndef TASK_KTIMER_H
+#define TASK_KTIMER_H
+
+#include <stdint.h>
+
+// Hierarchical timer wheel: 4 levels of 64 slots. Level 0 slots are
+// 2^KTIMER_GRAN_SHIFT ns wide; each higher level is 64 times coarser.
+#define KTIMER_GRAN_SHIFT   16          // 65.536 us per level 0 slot
+#define KTIMER_LEVEL_BITS   6
+#define KTIMER_LEVEL_SIZE   (1 << KTIMER_LEVEL_BITS)
+#define KTIMER_LEVELS       4           // Reach: 2^40 ns (~18 minutes); later timers are re-queued
+#define KTIMER_NEVER        0xFFFFFFFFFFFFFFFFull
+
+// Callback run from the timer interrupt with interrupts disabled
+typedef void (*ktimer_fn_t)(void* arg);
+
+typedef struct ktimer {
+    struct ktimer* next;
+    struct ktimer** pprev;          // Link that points at us; NULL when not queued
+    uint64_t expires_ns;            // Absolute deadline on the timer_now_ns() clock
+    ktimer_fn_t fn;
+    void* arg;
+} ktimer_t;
+
+// Set up the wheel at the current time. Called by timer_init().
+void ktimer_init(uint64_t now_ns);
+
+// Prepare a timer before its first add_timer()
+void ktimer_setup(ktimer_t* timer, ktimer_fn_t fn, void* arg);
+
+// Arm 'timer' for the absolute time 'expires_ns' (re-arms it if already queued). O(1).
+void add_timer(ktimer_t* timer, uint64_t expires_ns);
+
+// Disarm a timer. Returns 1 if it was queued. O(1).
+int del_timer(ktimer_t* timer);
+
+static inline int timer_pending(const ktimer_t* timer) {
+    return timer->pprev != 0;
+}
+
+// Run every timer due at 'now_ns'. Called from the timer interrupt.
+void ktimer_run(uint64_t now_ns);
+
+// Earliest time at which ktimer_run() has work to do, KTIMER_NEVER if nothing is queued
+uint64_t ktimer_next_deadline(void);
+
+#endif // TASK_KTIMER_H
@@ -0,0 +1,379 @@
+#include "sched.h"
+#include "memory/kmalloc.h"
+#include "memory/vmm.h"
+#include "drivers/timer.h"
+#include "interrupt/irqflags.h"
+#include "cpu/percpu.h"
+#include "cpu/fpu.h"
+#include "trace/trace.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Preemptive priority round-robin scheduler.
+// Ready threads sit in one FIFO per priority; run_bitmap has bit p set when
+// queue p is non-empty, so picking the next thread is a single bit scan.
+// There is no scheduler tick: sleepers wake from their own ktimer and the
+// slice timer only runs while another thread of the current priority waits.
+// All scheduler state is protected by disabling interrupts (single CPU).
+
+extern void switch_context(uint32_t* old_esp, uint32_t new_esp); // interrupt_asm.s
+
+static thread_t* run_head[SCHED_PRIORITIES];
+static thread_t* run_tail[SCHED_PRIORITIES];
+static uint32_t run_bitmap;
+
+static thread_t idle_storage;               // The boot context, not heap allocated
+static thread_t* idle_thread;
+static thread_t* current;
+static thread_t* zombie_list;               // Exited threads waiting for the idle thread to free them
+static volatile int need_resched;
+static uint32_t next_id;
+static kmem_cache_t* thread_cache;
+static ktimer_t slice_timer;
+static uint32_t switch_tick;                // get_timer_ticks() when 'current' was switched in
+
+static void runqueue_push(thread_t* t) {
+    t->next = NULL;
+    if (run_tail[t->priority]) {
+        run_tail[t->priority]->next = t;
+    } else {
+        run_head[t->priority] = t;
+    }
+    run_tail[t->priority] = t;
+    run_bitmap |= 1u << t->priority;
+}
+
+static thread_t* runqueue_pop(void) {
+    if (run_bitmap == 0) {
+        return NULL;
+    }
+    uint32_t prio = 31 - __builtin_clz(run_bitmap);
+    thread_t* t = run_head[prio];
+    run_head[prio] = t->next;
+    if (run_head[prio] == NULL) {
+        run_tail[prio] = NULL;
+        run_bitmap &= ~(1u << prio);
+    }
+    t->next = NULL;
+    return t;
+}
+
+// Round-robin: preempt once the slice is used up if an equal or better thread waits
+static void slice_expired(void* arg) {
+    (void)arg;
+    if (current != idle_thread && (run_bitmap >> current->priority) != 0) {
+        need_resched = 1;
+    }
+}
+
+// Start a time slice for 'current' if another thread of its priority is waiting
+static void arm_slice(void) {
+    if (current != idle_thread && (run_bitmap & (1u << current->priority)) &&
+        !timer_pending(&slice_timer)) {
+        add_timer(&slice_timer, timer_now_ns() + SCHED_TIMESLICE_NS);
+    }
+}
+
+// Make 't' ready and request preemption if it outranks the running thread
+static void make_ready(thread_t* t) {
+    t->state = THREAD_READY;
+    runqueue_push(t);
+    if (t->priority > current->priority) {
+        need_resched = 1;
+    } else if (t->priority == current->priority) {
+        arm_slice();
+    }
+}
+
+static void sleep_expired(void* arg) {
+    thread_t* t = arg;
+    if (t->state == THREAD_SLEEPING) {
+        make_ready(t);
+    }
+}
+
+// Pick the next thread and switch to it. Interrupts must be disabled.
+static void schedule(void) {
+    thread_t* prev = current;
+    if (prev->state == THREAD_RUNNING) {
+        prev->state = THREAD_READY;
+        if (prev != idle_thread) {
+            runqueue_push(prev);
+        }
+    }
+
+    thread_t* next = runqueue_pop();
+    if (next == NULL) {
+        next = idle_thread;
+    }
+    need_resched = 0;
+    next->state = THREAD_RUNNING;
+    current = next;
+    del_timer(&slice_timer);
+    arm_slice();
+    if (next == prev) {
+        return;
+    }
+
+    uint32_t now = get_timer_ticks();
+    prev->ticks_run += now - switch_tick;
+    switch_tick = now;
+    next->switches++;
+    if (next->esp0 != 0) {
+        this_cpu()->tss.esp0 = next->esp0;  // Where traps from its ring 3 code land
+    }
+    fpu_switch(next);
+    trace_event(TRACE_SWITCH, prev->id, next->id);
+    switch_context(&prev->esp, next->esp);
+}
+
+// First code run by every new thread (entered from switch_context with interrupts off)
+static void thread_start(void) {
+    asm volatile ("sti");
+    current->entry(current->arg);
+    thread_exit();
+}
+
+static void set_name(thread_t* t, const char* name) {
+    uint32_t i = 0;
+    for (; name[i] != '\0' && i < THREAD_NAME_LEN - 1; i++) {
+        t->name[i] = name[i];
+    }
+    t->name[i] = '\0';
+}
+
+void sched_init(void) {
+    thread_cache = kmem_cache_create("thread", sizeof(thread_t), NULL);
+    ktimer_setup(&slice_timer, slice_expired, NULL);
+
+    idle_thread = &idle_storage;
+    idle_thread->id = next_id++;
+    set_name(idle_thread, "idle");
+    idle_thread->state = THREAD_RUNNING;
+    idle_thread->priority = SCHED_PRIO_IDLE;
+    ktimer_setup(&idle_thread->sleep_timer, sleep_expired, idle_thread);
+    current = idle_thread;
+}
+
+thread_t* thread_create(const char* name, thread_entry_t entry, void* arg, uint32_t priority) {
+    thread_t* t = kmem_cache_alloc(thread_cache);
+    if (t == NULL) {
+        return NULL;
+    }
+    t->stack = vmm_alloc_stack(THREAD_STACK_SIZE);
+    if (t->stack == NULL) {
+        kmem_cache_free(thread_cache, t);
+        return NULL;
+    }
+    if (!fpu_thread_init(t)) {
+        vmm_free(t->stack);
+        kmem_cache_free(thread_cache, t);
+        return NULL;
+    }
+
+    set_name(t, name);
+    if (priority > SCHED_PRIO_MAX) {
+        priority = SCHED_PRIO_MAX;
+    }
+    if (priority == SCHED_PRIO_IDLE) {
+        priority = SCHED_PRIO_IDLE + 1;
+    }
+    t->priority = priority;
+    t->entry = entry;
+    t->arg = arg;
+    t->ticks_run = 0;
+    t->switches = 0;
+    t->wake_pending = 0;
+    t->esp0 = 0;
+    ktimer_setup(&t->sleep_timer, sleep_expired, t);
+
+    // Initial frame popped by switch_context: edi, esi, ebx, ebp, return address
+    uint32_t* sp = (uint32_t*)((uint8_t*)t->stack + THREAD_STACK_SIZE);
+    *--sp = 0;                          // Return address of thread_start (never used)
+    *--sp = (uint32_t)thread_start;
+    *--sp = 0;                          // ebp
+    *--sp = 0;                          // ebx
+    *--sp = 0;                          // esi
+    *--sp = 0;                          // edi
+    t->esp = (uint32_t)sp;
+
+    uint32_t flags = irq_save();
+    t->id = next_id++;
+    make_ready(t);
+    irq_restore(flags);
+    return t;
+}
+
+void thread_exit(void) {
+    irq_save();
+    current->state = THREAD_DEAD;
+    fpu_thread_exit(current);
+    current->next = zombie_list;
+    zombie_list = current;
+    schedule();
+    for (;;); // Not reached
+}
+
+void thread_yield(void) {
+    uint32_t flags = irq_save();
+    schedule();
+    irq_restore(flags);
+}
+
+void thread_sleep(uint32_t ticks) {
+    sleep_ns((uint64_t)ticks * TIMER_TICK_NS);
+}
+
+void sleep_ns(uint64_t ns) {
+    if (ns == 0) {
+        thread_yield();
+        return;
+    }
+
+    uint32_t flags = irq_save();
+    current->state = THREAD_SLEEPING;
+    add_timer(&current->sleep_timer, timer_now_ns() + ns);
+    schedule();
+    irq_restore(flags);
+}
+
+void thread_block(void) {
+    uint32_t flags = irq_save();
+    if (current->wake_pending) {
+        current->wake_pending = 0;
+    } else {
+        current->state = THREAD_BLOCKED;
+        schedule();
+    }
+    irq_restore(flags);
+}
+
+void thread_unblock(thread_t* thread) {
+    uint32_t flags = irq_save();
+    if (thread->state == THREAD_BLOCKED) {
+        make_ready(thread);
+    } else {
+        thread->wake_pending = 1;
+    }
+    irq_restore(flags);
+}
+
+thread_t* thread_current(void) {
+    return current;
+}
+
+void sched_irq_exit(void) {
+    if (need_resched && current != NULL) {
+        schedule();
+    }
+}
+
+void sched_idle(void) {
+    for (;;) {
+        // Free exited threads; their stacks can't be released while they run
+        uint32_t flags = irq_save();
+        thread_t* dead = zombie_list;
+        zombie_list = NULL;
+        irq_restore(flags);
+
+        while (dead != NULL) {
+            thread_t* next = dead->next;
+            vmm_free(dead->stack);
+            fpu_thread_free(dead);
+            kmem_cache_free(thread_cache, dead);
+            dead = next;
+        }
+
+        asm volatile ("hlt"); // Wait for next interrupt
+    }
+}
+
+#ifdef SCHED_BENCH
+extern void term_print(const char* str);    // from drivers/vga.c
+extern void term_print_dec(uint32_t num);
+
+#define BENCH_YIELDS            10000
+#define BENCH_SPINNERS          4
+#define BENCH_FAIR_TICKS        200         // 2 seconds at 100 Hz
+
+static volatile uint32_t pingpong_done;
+static volatile uint32_t pingpong_start;
+static volatile uint32_t pingpong_end;
+static volatile uint32_t spin_stop;
+static volatile uint32_t spin_count[BENCH_SPINNERS];
+
+static inline uint32_t rdtsc_lo(void) {
+    uint32_t lo, hi;
+    asm volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return lo;
+}
+
+// Each yield hands the CPU straight to the other ping-pong thread
+static void pingpong_thread(void* arg) {
+    (void)arg;
+    if (pingpong_start == 0) {
+        pingpong_start = rdtsc_lo();
+    }
+    for (int i = 0; i < BENCH_YIELDS; i++) {
+        thread_yield();
+    }
+    if (++pingpong_done == 2) {
+        pingpong_end = rdtsc_lo();
+    }
+}
+
+static void spinner_thread(void* arg) {
+    volatile uint32_t* counter = (volatile uint32_t*)arg;
+    while (!spin_stop) {
+        (*counter)++;
+    }
+}
+
+static void bench_thread(void* arg) {
+    (void)arg;
+
+    // Context switch cost: two threads yielding to each other at a priority nobody else uses
+    pingpong_done = 0;
+    pingpong_start = 0;
+    thread_create("ping", pingpong_thread, NULL, SCHED_PRIO_MAX - 1);
+    thread_create("pong", pingpong_thread, NULL, SCHED_PRIO_MAX - 1);
+    while (pingpong_done < 2) {
+        thread_sleep(10);
+    }
+    term_print("sched: ");
+    term_print_dec((pingpong_end - pingpong_start) / (2 * BENCH_YIELDS));
+    term_print(" cycles per yield + context switch\n");
+
+    // Fairness: equal-priority CPU hogs share the CPU through time slices
+    spin_stop = 0;
+    thread_t* spinners[BENCH_SPINNERS];
+    for (int i = 0; i < BENCH_SPINNERS; i++) {
+        spin_count[i] = 0;
+        spinners[i] = thread_create("spin", spinner_thread, (void*)&spin_count[i], SCHED_PRIO_DEFAULT);
+    }
+    thread_sleep(BENCH_FAIR_TICKS);
+    spin_stop = 1;
+
+    uint32_t min = 0xFFFFFFFF, max = 0;
+    for (int i = 0; i < BENCH_SPINNERS; i++) {
+        term_print("sched: spinner ");
+        term_print_dec(i);
+        term_print(" count ");
+        term_print_dec(spin_count[i]);
+        term_print(" ticks ");
+        term_print_dec(spinners[i] ? spinners[i]->ticks_run : 0);
+        term_print(" switches ");
+        term_print_dec(spinners[i] ? spinners[i]->switches : 0);
+        term_print("\n");
+        if (spin_count[i] < min) min = spin_count[i];
+        if (spin_count[i] > max) max = spin_count[i];
+    }
+    term_print("sched: fairness min/max ");
+    term_print_dec(max >= 100 ? min / (max / 100) : 100);
+    term_print("%\n");
+}
+
+void sched_bench_start(void) {
+    thread_create("bench", bench_thread, NULL, SCHED_PRIO_MAX);
+}
+#endif
@@ -0,0 +1,84 @@
+#ifndef TASK_SCHED_H
+#define TASK_SCHED_H
+
+#include <stdint.h>
+#include "ktimer.h"
+
+#define SCHED_PRIORITIES        32
+#define SCHED_PRIO_IDLE         0       // Reserved for the idle thread
+#define SCHED_PRIO_DEFAULT      16
+#define SCHED_PRIO_MAX          (SCHED_PRIORITIES - 1)
+#define SCHED_TIMESLICE_NS      20000000 // Round-robin slice between equal-priority threads
+#define THREAD_STACK_SIZE       8192
+#define THREAD_NAME_LEN         16
+
+typedef void (*thread_entry_t)(void* arg);
+
+typedef enum {
+    THREAD_READY,
+    THREAD_RUNNING,
+    THREAD_SLEEPING,
+    THREAD_BLOCKED,
+    THREAD_DEAD
+} thread_state_t;
+
+typedef struct thread {
+    uint32_t esp;                   // Saved stack pointer; must stay first (used by switch_context)
+    uint32_t id;
+    char name[THREAD_NAME_LEN];
+    thread_state_t state;
+    uint32_t priority;
+    ktimer_t sleep_timer;           // Wakes the thread from THREAD_SLEEPING
+    uint32_t wake_pending;          // thread_unblock() arrived before thread_block()
+    thread_entry_t entry;
+    void* arg;
+    void* stack;                    // Base of the kernel stack allocation
+    uint32_t esp0;                  // Kernel stack for traps while in ring 3 (user_run), else 0
+    void* fpu_state;                // fxsave area (cpu/fpu.c), switched lazily
+    uint32_t fpu_used;              // fpu_state holds saved registers (else start from the clean state)
+    struct thread* next;            // Run queue / zombie list link
+
+    // Statistics
+    uint32_t ticks_run;             // TIMER_HZ ticks spent running, charged on every switch
+    uint32_t switches;              // Times this thread was switched in
+} thread_t;
+
+// Turn the boot context (kernel_main) into the idle thread. Call before enabling interrupts.
+void sched_init(void);
+
+// Create a runnable kernel thread. Returns NULL when out of memory.
+thread_t* thread_create(const char* name, thread_entry_t entry, void* arg, uint32_t priority);
+
+// Terminate the calling thread
+void thread_exit(void) __attribute__((noreturn));
+
+// Give up the CPU to another ready thread of the same or higher priority
+void thread_yield(void);
+
+// Sleep for at least 'ticks' TIMER_HZ ticks
+void thread_sleep(uint32_t ticks);
+
+// Sleep for at least 'ns' nanoseconds (one-shot timer, sub-millisecond precision)
+void sleep_ns(uint64_t ns);
+
+// Block the calling thread until thread_unblock() is called on it.
+// An unblock that arrives first is remembered, so callers can publish
+// themselves as waiters, re-check their condition and block without
+// disabling interrupts and without losing the wakeup.
+void thread_block(void);
+void thread_unblock(thread_t* thread);
+
+thread_t* thread_current(void);
+
+// Called by irq_handler after EOI; switches threads if a reschedule is pending
+void sched_irq_exit(void);
+
+// Idle loop for the boot thread: reaps dead threads and halts. Never returns.
+void sched_idle(void) __attribute__((noreturn));
+
+#ifdef SCHED_BENCH
+// Context-switch cost and fairness benchmark (build with -DSCHED_BENCH)
+void sched_bench_start(void);
+#endif
+
+#endif // TASK_SCHED_H
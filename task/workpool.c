@@ -0,0 +1,149 @@
+#include "workpool.h"
+#include "cpu/smp.h"
+#include "interrupt/irqflags.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Chase-Lev work-stealing deques with a fixed ring per CPU.
+// Owner operations run with interrupts disabled so threads sharing the boot
+// CPU never interleave on its deque; thieves synchronise only through 'top'.
+
+#define DEQUE_MASK          (WORKPOOL_DEQUE_SIZE - 1)
+
+typedef struct {
+    volatile int32_t top;               // Next slot to steal
+    volatile int32_t bottom;            // Next free slot for the owner
+    work_t* volatile slots[WORKPOOL_DEQUE_SIZE];
+} deque_t;
+
+static deque_t deques[SMP_MAX_CPUS];
+static volatile uint32_t workers = SMP_MAX_CPUS;
+
+static int deque_push(deque_t* q, work_t* work) {
+    int32_t b = q->bottom;
+    int32_t t = __atomic_load_n(&q->top, __ATOMIC_ACQUIRE);
+    if (b - t >= WORKPOOL_DEQUE_SIZE) {
+        return 0;
+    }
+    q->slots[b & DEQUE_MASK] = work;
+    __atomic_store_n(&q->bottom, b + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+static work_t* deque_pop(deque_t* q) {
+    int32_t b = q->bottom - 1;
+    q->bottom = b;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST); // Publish 'bottom' before reading 'top'
+    int32_t t = q->top;
+    if (t > b) {
+        q->bottom = b + 1;              // Empty
+        return NULL;
+    }
+    work_t* work = q->slots[b & DEQUE_MASK];
+    if (t == b) {
+        // Last item: race the thieves for it
+        if (!__atomic_compare_exchange_n(&q->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+            work = NULL;
+        }
+        q->bottom = b + 1;
+    }
+    return work;
+}
+
+static work_t* deque_steal(deque_t* q) {
+    int32_t t = __atomic_load_n(&q->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int32_t b = __atomic_load_n(&q->bottom, __ATOMIC_ACQUIRE);
+    if (t >= b) {
+        return NULL;
+    }
+    work_t* work = q->slots[t & DEQUE_MASK];
+    if (!__atomic_compare_exchange_n(&q->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        return NULL;                    // Lost to the owner or another thief
+    }
+    return work;
+}
+
+static void run(work_t* work) {
+    work->fn(work->arg);
+    __atomic_fetch_sub(&work->group->pending, 1, __ATOMIC_RELEASE);
+    this_cpu()->tasks_run++;
+}
+
+// Kick one halted worker so it comes looking for work
+static void wake_worker(uint32_t self) {
+    uint32_t count = smp_cpu_count();
+    for (uint32_t cpu = 1; cpu < count && cpu < workers; cpu++) {
+        if (cpu != self && cpu_data[cpu].sleeping) {
+            smp_wake(cpu);
+            return;
+        }
+    }
+}
+
+void work_submit(work_group_t* group, work_t* work, work_fn_t fn, void* arg) {
+    work->fn = fn;
+    work->arg = arg;
+    work->group = group;
+    __atomic_fetch_add(&group->pending, 1, __ATOMIC_RELAXED);
+
+    uint32_t flags = irq_save();
+    uint32_t self = smp_cpu_id();
+    int queued = deque_push(&deques[self], work);
+    irq_restore(flags);
+    if (!queued) {
+        run(work);
+        return;
+    }
+    __atomic_thread_fence(__ATOMIC_SEQ_CST); // Pairs with the idle loop's 'sleeping' check
+    wake_worker(self);
+}
+
+int workpool_run_one(void) {
+    uint32_t self = smp_cpu_id();
+    if (self >= workers) {
+        return 0;
+    }
+
+    uint32_t flags = irq_save();
+    work_t* work = deque_pop(&deques[self]);
+    irq_restore(flags);
+
+    if (work == NULL) {
+        uint32_t count = smp_cpu_count();
+        for (uint32_t i = 1; i < count && work == NULL; i++) {
+            work = deque_steal(&deques[(self + i) % count]);
+        }
+        if (work == NULL) {
+            return 0;
+        }
+        this_cpu()->steals++;
+    }
+    run(work);
+    return 1;
+}
+
+int workpool_has_work(void) {
+    if (smp_cpu_id() >= workers) {
+        return 0;
+    }
+    uint32_t count = smp_cpu_count();
+    for (uint32_t cpu = 0; cpu < count; cpu++) {
+        if (deques[cpu].bottom - deques[cpu].top > 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void work_wait(work_group_t* group) {
+    while (__atomic_load_n(&group->pending, __ATOMIC_ACQUIRE) != 0) {
+        if (!workpool_run_one()) {
+            asm volatile ("pause");
+        }
+    }
+}
+
+void workpool_set_workers(uint32_t count) {
+    workers = count ? count : 1;
+}
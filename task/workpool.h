@@ -0,0 +1,41 @@
+#ifndef TASK_WORKPOOL_H
+#define TASK_WORKPOOL_H
+
+#include <stdint.h>
+
+// Work-stealing task pool. Every CPU owns a Chase-Lev deque: the owner pushes
+// and pops at the bottom (LIFO, cache-warm), idle CPUs steal from the top.
+// Work items run to completion and must not block or touch non-SMP-safe
+// kernel services (terminal, kmalloc, scheduler).
+#define WORKPOOL_DEQUE_SIZE 1024        // Per CPU, power of two
+
+typedef void (*work_fn_t)(void* arg);
+
+// Completion counter for a batch of work items
+typedef struct {
+    volatile uint32_t pending;
+} work_group_t;
+
+// Caller-owned work item; must stay valid until its group completes
+typedef struct {
+    work_fn_t fn;
+    void* arg;
+    work_group_t* group;
+} work_t;
+
+// Queue 'work' on the calling CPU. Runs it inline if the local deque is full.
+void work_submit(work_group_t* group, work_t* work, work_fn_t fn, void* arg);
+
+// Help run queued work until every item of 'group' has finished
+void work_wait(work_group_t* group);
+
+// Run one item from the local deque or stolen from another CPU. Returns 0 if there was none.
+int workpool_run_one(void);
+
+// Non-zero if any deque has work a CPU is allowed to take
+int workpool_has_work(void);
+
+// Only CPUs 0..count-1 take work (for scaling measurements); default: all
+void workpool_set_workers(uint32_t count);
+
+#endif // TASK_WORKPOOL_H
@@ -0,0 +1,220 @@
+#include "harness.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Test and benchmark runner for the host build of the kernel code.
+//
+//   host_tests [--bench] [--filter=SUBSTR] [--min-time=SECONDS]
+//              [--save=FILE] [--compare=FILE] [--threshold=PERCENT]
+//
+// Tests always run. --bench also runs the benchmarks; --save writes their
+// ns/op as "name ns" lines and --compare fails the run when a benchmark got
+// more than --threshold percent slower than in such a file.
+
+#define BENCH_RUNS          3           // Timed runs per benchmark; the fastest counts
+#define BENCH_MAX_ITERS     1000000000ull
+#define BASELINE_MAX        256
+
+// Section bounds, provided by ld (weak: a section may be empty)
+extern const host_test_t* const __start_host_tests[] __attribute__((weak));
+extern const host_test_t* const __stop_host_tests[] __attribute__((weak));
+extern const host_bench_t* const __start_host_benches[] __attribute__((weak));
+extern const host_bench_t* const __stop_host_benches[] __attribute__((weak));
+
+static uint32_t failed_checks;
+
+typedef struct {
+    char name[64];
+    double ns;
+} baseline_t;
+
+static baseline_t baseline[BASELINE_MAX];
+static uint32_t baseline_count;
+
+void host_fail(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    printf("    FAILED ");
+    vprintf(fmt, args);
+    printf("\n");
+    va_end(args);
+    failed_checks++;
+}
+
+void host_check(int ok, const char* expr, const char* file, int line) {
+    if (!ok) {
+        printf("    FAILED %s:%d: %s\n", file, line, expr);
+        failed_checks++;
+    }
+}
+
+void host_check_eq(uint64_t a, uint64_t b, const char* expr, const char* file, int line) {
+    if (a != b) {
+        printf("    FAILED %s:%d: %s (0x%llx != 0x%llx)\n", file, line, expr,
+               (unsigned long long)a, (unsigned long long)b);
+        failed_checks++;
+    }
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int selected(const char* name, const char* filter) {
+    return filter == NULL || strstr(name, filter) != NULL;
+}
+
+static int run_tests(const char* filter) {
+    uint32_t run = 0, failed = 0;
+    for (const host_test_t* const* t = __start_host_tests; t < __stop_host_tests; t++) {
+        if (!selected((*t)->name, filter)) {
+            continue;
+        }
+        uint32_t before = failed_checks;
+        (*t)->fn();
+        run++;
+        if (failed_checks != before) {
+            failed++;
+        }
+        printf("[%s] %s\n", failed_checks != before ? "FAIL" : " OK ", (*t)->name);
+    }
+    printf("%u tests, %u failed\n", run, failed);
+    return failed == 0;
+}
+
+static double time_run(const host_bench_t* b, uint64_t iterations) {
+    host_bench_state_t state = { .iterations = iterations, .arg = b->arg };
+    double start = now_sec();
+    b->fn(&state);
+    return now_sec() - start;
+}
+
+// Grow the iteration count until a run lasts min_time, then keep the fastest of BENCH_RUNS
+static double measure(const host_bench_t* b, double min_time, uint64_t* iterations) {
+    uint64_t iters = 1;
+    double elapsed = time_run(b, iters);
+    while (elapsed < min_time && iters < BENCH_MAX_ITERS) {
+        double scale = elapsed > 0 ? min_time * 1.4 / elapsed : 10;
+        uint64_t next = scale > 10 ? iters * 10 : (uint64_t)(iters * scale) + 1;
+        iters = next < BENCH_MAX_ITERS ? next : BENCH_MAX_ITERS;
+        elapsed = time_run(b, iters);
+    }
+
+    double best = elapsed;
+    for (int i = 1; i < BENCH_RUNS; i++) {
+        double t = time_run(b, iters);
+        if (t < best) {
+            best = t;
+        }
+    }
+    *iterations = iters;
+    return best * 1e9 / iters;
+}
+
+static void load_baseline(const char* path) {
+    FILE* f = fopen(path, "r");
+    if (f == NULL) {
+        printf("no baseline at %s, nothing to compare\n", path);
+        return;
+    }
+    while (baseline_count < BASELINE_MAX &&
+           fscanf(f, "%63s %lf", baseline[baseline_count].name, &baseline[baseline_count].ns) == 2) {
+        baseline_count++;
+    }
+    fclose(f);
+}
+
+static const baseline_t* find_baseline(const char* name) {
+    for (uint32_t i = 0; i < baseline_count; i++) {
+        if (strcmp(baseline[i].name, name) == 0) {
+            return &baseline[i];
+        }
+    }
+    return NULL;
+}
+
+static int run_benches(const char* filter, double min_time, const char* save, double threshold) {
+    FILE* out = NULL;
+    if (save != NULL && (out = fopen(save, "w")) == NULL) {
+        printf("cannot write %s\n", save);
+        return 0;
+    }
+
+    int ok = 1;
+    printf("%-28s %14s %12s %12s %10s\n", "Benchmark", "Time", "Iterations", "Throughput", "Baseline");
+    for (const host_bench_t* const* b = __start_host_benches; b < __stop_host_benches; b++) {
+        if (!selected((*b)->name, filter)) {
+            continue;
+        }
+        uint64_t iters;
+        double ns = measure(*b, min_time, &iters);
+        printf("%-28s %11.2f ns %12llu", (*b)->name, ns, (unsigned long long)iters);
+        if ((*b)->bytes != 0) {
+            printf(" %9.2f GB/s", (*b)->bytes / ns);
+        } else {
+            printf(" %12s", "");
+        }
+
+        const baseline_t* base = find_baseline((*b)->name);
+        if (base != NULL && base->ns > 0) {
+            double change = (ns - base->ns) * 100 / base->ns;
+            printf(" %+9.1f%%", change);
+            if (change > threshold) {
+                printf("  REGRESSION");
+                ok = 0;
+            }
+        }
+        printf("\n");
+        if (out != NULL) {
+            fprintf(out, "%s %.3f\n", (*b)->name, ns);
+        }
+    }
+    if (out != NULL) {
+        fclose(out);
+    }
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    const char* filter = NULL;
+    const char* save = NULL;
+    const char* compare = NULL;
+    double min_time = 0.1;
+    double threshold = 10;
+    int bench = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char* a = argv[i];
+        if (strcmp(a, "--bench") == 0) {
+            bench = 1;
+        } else if (strncmp(a, "--filter=", 9) == 0) {
+            filter = a + 9;
+        } else if (strncmp(a, "--min-time=", 11) == 0) {
+            min_time = atof(a + 11);
+        } else if (strncmp(a, "--save=", 7) == 0) {
+            save = a + 7;
+        } else if (strncmp(a, "--compare=", 10) == 0) {
+            compare = a + 10;
+        } else if (strncmp(a, "--threshold=", 12) == 0) {
+            threshold = atof(a + 12);
+        } else {
+            printf("usage: %s [--bench] [--filter=SUBSTR] [--min-time=SECONDS]\n"
+                   "       [--save=FILE] [--compare=FILE] [--threshold=PERCENT]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    int ok = run_tests(filter);
+    if (bench) {
+        if (compare != NULL) {
+            load_baseline(compare);
+        }
+        ok &= run_benches(filter, min_time, save, threshold);
+    }
+    return ok ? 0 : 1;
+}
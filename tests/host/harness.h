@@ -0,0 +1,66 @@
+#ifndef TESTS_HOST_HARNESS_H
+#define TESTS_HOST_HARNESS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Host test and benchmark harness (tests/host/run.sh). Like the kernel's
+// BENCH_REGISTER, each test or benchmark is a pointer in a named section
+// whose bounds ld provides, so a new test file only has to be listed in
+// run.sh.
+//
+// Tests:       TEST(name) { CHECK(...); CHECK_EQ(a, b); }
+// Benchmarks:  BENCHMARK(name, .fn = bench_fn, .arg = ..., .bytes = ...)
+//
+// A benchmark function runs its body state->iterations times. The harness
+// grows the iteration count until one run takes at least --min-time, then
+// reports the fastest of three runs per iteration, google-benchmark style.
+
+typedef void (*host_test_fn_t)(void);
+
+typedef struct {
+    const char* name;
+    host_test_fn_t fn;
+} host_test_t;
+
+typedef struct {
+    uint64_t iterations;            // Loop count for this run
+    void* arg;                      // The benchmark's .arg
+} host_bench_state_t;
+
+typedef void (*host_bench_fn_t)(host_bench_state_t* state);
+
+typedef struct {
+    const char* name;
+    host_bench_fn_t fn;
+    void* arg;
+    uint64_t bytes;                 // Bytes processed per iteration (0: no throughput column)
+} host_bench_t;
+
+#define TEST(id)                                                                \
+    static void test_##id(void);                                                \
+    static const host_test_t test_desc_##id = { #id, test_##id };               \
+    static const host_test_t* const test_ptr_##id                              \
+        __attribute__((used, section("host_tests"))) = &test_desc_##id;         \
+    static void test_##id(void)
+
+#define BENCHMARK(id, ...)                                                      \
+    static const host_bench_t bench_desc_##id = { .name = #id, __VA_ARGS__ };   \
+    static const host_bench_t* const bench_ptr_##id                            \
+        __attribute__((used, section("host_benches"))) = &bench_desc_##id
+
+// A failed check is reported and fails the run; the test keeps going.
+// host_fail() does the same with a printf-style message.
+#define CHECK(cond) host_check((cond) != 0, #cond, __FILE__, __LINE__)
+#define CHECK_EQ(a, b) host_check_eq((uint64_t)(a), (uint64_t)(b), #a " == " #b, __FILE__, __LINE__)
+
+void host_fail(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+void host_check(int ok, const char* expr, const char* file, int line);
+void host_check_eq(uint64_t a, uint64_t b, const char* expr, const char* file, int line);
+
+// Keep the compiler from dropping a benchmark's work
+static inline void host_keep(const void* p) {
+    asm volatile ("" : : "r"(p) : "memory");
+}
+
+#endif // TESTS_HOST_HARNESS_H
@@ -0,0 +1,21 @@
+#ifndef INTERRUPT_IO_H
+#define INTERRUPT_IO_H
+
+#include <stdint.h>
+#include "mock_hw.h"
+
+// Host build: port I/O goes to the mock in tests/host/mock/mock_hw.c, which
+// logs writes and answers reads from per-port queues
+
+static inline void outb(uint16_t port, uint8_t val) {
+    mock_outb(port, val);
+}
+
+static inline uint8_t inb(uint16_t port) {
+    return mock_inb(port);
+}
+
+static inline void io_wait(void) {
+}
+
+#endif // INTERRUPT_IO_H
@@ -0,0 +1,31 @@
+#ifndef INTERRUPT_IRQFLAGS_H
+#define INTERRUPT_IRQFLAGS_H
+
+#include <stdint.h>
+#include "mock_hw.h"
+
+#define EFLAGS_IF 0x200
+
+// Host build: cli/sti fault in user mode. Track the nesting instead so tests
+// can check that every irq_save() is paired with an irq_restore().
+
+static inline uint32_t irq_save(void) {
+    mock_irq_depth++;
+    return EFLAGS_IF;
+}
+
+static inline void irq_restore(uint32_t flags) {
+    (void)flags;
+    mock_irq_depth--;
+}
+
+// Enabling inside a section counts as leaving it until irq_disable()
+static inline void irq_enable(void) {
+    mock_irq_depth--;
+}
+
+static inline void irq_disable(void) {
+    mock_irq_depth++;
+}
+
+#endif // INTERRUPT_IRQFLAGS_H
@@ -0,0 +1,155 @@
+#include "mock_hw.h"
+#include "interrupt/apic.h"
+#include "interrupt/irq.h"
+#include "drivers/clocksource.h"
+#include "drivers/serial.h"
+#include "task/sched.h"
+#include "trace/trace.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Mocked hardware plus the kernel services the tested code calls but whose
+// real implementations need the machine (scheduler, interrupt controller).
+
+typedef struct {
+    uint8_t values[MOCK_PORT_QUEUE];
+    uint32_t head, tail;
+    uint8_t fallback;
+    uint32_t reads;
+} port_t;
+
+static port_t ports[MOCK_PORTS];
+static mock_port_write_t port_log[MOCK_PORT_LOG];
+static uint32_t port_writes;
+
+int mock_lapic_present;
+uint32_t mock_lapic_regs[0x400 / 16];
+uint16_t mock_vga[MOCK_VGA_CELLS];
+int mock_irq_depth;
+isr_t mock_irq_handlers[16];
+char mock_serial[MOCK_SERIAL_SIZE];
+size_t mock_serial_len;
+uint64_t mock_ktime_ns;
+
+// The string functions take their SSE2 paths when set (string_init() needs ring 0)
+int string_sse2;
+
+void mock_outb(uint16_t port, uint8_t val) {
+    if (port_writes < MOCK_PORT_LOG) {
+        port_log[port_writes].port = port;
+        port_log[port_writes].value = val;
+    }
+    port_writes++;
+}
+
+uint8_t mock_inb(uint16_t port) {
+    port_t* p = &ports[port % MOCK_PORTS];
+    p->reads++;
+    if (p->head == p->tail) {
+        return p->fallback;
+    }
+    return p->values[p->tail++ % MOCK_PORT_QUEUE];
+}
+
+void mock_io_reset(void) {
+    for (uint32_t i = 0; i < MOCK_PORTS; i++) {
+        ports[i].head = ports[i].tail = 0;
+        ports[i].fallback = 0;
+        ports[i].reads = 0;
+    }
+    port_writes = 0;
+}
+
+void mock_io_queue(uint16_t port, uint8_t value) {
+    port_t* p = &ports[port % MOCK_PORTS];
+    if (p->head - p->tail < MOCK_PORT_QUEUE) {
+        p->values[p->head++ % MOCK_PORT_QUEUE] = value;
+    }
+}
+
+void mock_io_set_default(uint16_t port, uint8_t value) {
+    ports[port % MOCK_PORTS].fallback = value;
+}
+
+uint32_t mock_io_write_count(void) {
+    return port_writes < MOCK_PORT_LOG ? port_writes : MOCK_PORT_LOG;
+}
+
+const mock_port_write_t* mock_io_write(uint32_t index) {
+    return index < mock_io_write_count() ? &port_log[index] : NULL;
+}
+
+uint32_t mock_io_reads(uint16_t port) {
+    return ports[port % MOCK_PORTS].reads;
+}
+
+// interrupt/apic.h
+int lapic_present(void) {
+    return mock_lapic_present;
+}
+
+uint32_t lapic_read(uint32_t reg) {
+    return mock_lapic_regs[(reg >> 4) & 0x3F];
+}
+
+void lapic_write(uint32_t reg, uint32_t value) {
+    mock_lapic_regs[(reg >> 4) & 0x3F] = value;
+}
+
+// interrupt/irq.h
+void irq_register_handler(uint8_t irq, isr_t handler) {
+    mock_irq_handlers[irq & 15] = handler;
+}
+
+// drivers/clocksource.h: no TSC, so the timer keeps its counter clock
+int clocksource_tsc(void) {
+    return 0;
+}
+
+uint64_t ktime_get_ns(void) {
+    return mock_ktime_ns;
+}
+
+// drivers/serial.h
+size_t serial_write(const char* buf, size_t n) {
+    for (size_t i = 0; i < n && mock_serial_len + 1 < MOCK_SERIAL_SIZE; i++) {
+        mock_serial[mock_serial_len++] = buf[i];
+    }
+    mock_serial[mock_serial_len] = '\0';
+    return n;
+}
+
+// trace/trace.h: tracepoints stay disabled
+volatile uint8_t trace_enabled;
+
+void trace_record(uint8_t event, uint16_t arg0, uint32_t arg1) {
+    (void)event;
+    (void)arg0;
+    (void)arg1;
+}
+
+// task/sched.h: a single thread that never has to wait
+static thread_t host_thread;
+
+thread_t* thread_current(void) {
+    return &host_thread;
+}
+
+void thread_block(void) {
+}
+
+void thread_unblock(thread_t* thread) {
+    thread->wake_pending = 1;
+}
+
+void thread_yield(void) {
+}
+
+// No threads to start: ksoftirqd stays NULL, softirqs run from irq_exit()
+thread_t* thread_create(const char* name, thread_entry_t entry, void* arg, uint32_t priority) {
+    (void)name;
+    (void)entry;
+    (void)arg;
+    (void)priority;
+    return NULL;
+}
@@ -0,0 +1,60 @@
+#ifndef TESTS_HOST_MOCK_HW_H
+#define TESTS_HOST_MOCK_HW_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "interrupt/isr.h"
+
+// Hardware seen by kernel code in the host build (tests/host/run.sh).
+// Kernel sources are compiled with tests/host/mock ahead of the repo root on
+// the include path, so "interrupt/io.h" and "interrupt/irqflags.h" resolve to
+// the mocks next to this file, and with VGA_MEMORY pointing at mock_vga.
+
+#define MOCK_PORTS          0x400       // The ISA I/O range; higher ports alias into it
+#define MOCK_PORT_LOG       1024        // Writes kept by the port log (later ones are only counted)
+#define MOCK_PORT_QUEUE     512         // Scripted reads per port
+#define MOCK_VGA_CELLS      (80 * 25)
+#define MOCK_SERIAL_SIZE    4096
+
+typedef struct {
+    uint16_t port;
+    uint8_t value;
+} mock_port_write_t;
+
+// Port I/O
+void mock_outb(uint16_t port, uint8_t val);
+uint8_t mock_inb(uint16_t port);
+
+// Forget logged writes, queued reads and per-port defaults
+void mock_io_reset(void);
+
+// Queue a value for the next read of 'port'; reads past the queue return the default
+void mock_io_queue(uint16_t port, uint8_t value);
+void mock_io_set_default(uint16_t port, uint8_t value);
+
+// Writes since the last reset, oldest first, and reads of one port
+uint32_t mock_io_write_count(void);
+const mock_port_write_t* mock_io_write(uint32_t index);
+uint32_t mock_io_reads(uint16_t port);
+
+// Local APIC registers, by offset (lapic_read/lapic_write from interrupt/apic.h)
+extern int mock_lapic_present;
+extern uint32_t mock_lapic_regs[0x400 / 16];
+
+// What ktime_get_ns() returns (clocksource_tsc() is always 0)
+extern uint64_t mock_ktime_ns;
+
+// VGA text memory
+extern uint16_t mock_vga[MOCK_VGA_CELLS];
+
+// irq_save() nesting; 0 whenever the tested code left interrupts as it found them
+extern int mock_irq_depth;
+
+// Handlers passed to irq_register_handler()
+extern isr_t mock_irq_handlers[16];
+
+// Bytes passed to serial_write() (kprintf's console output), NUL-terminated
+extern char mock_serial[MOCK_SERIAL_SIZE];
+extern size_t mock_serial_len;
+
+#endif // TESTS_HOST_MOCK_HW_H
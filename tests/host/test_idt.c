@@ -0,0 +1,88 @@
+#include "harness.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// interrupt/idt.c, built into this file so the tests can read the table
+#include "interrupt/idt.c"
+
+static const idt_ptr_t* loaded_ptr;
+static uint32_t isr_installs, irq_installs;
+
+// Stand-ins for the real installers and the lidt stub in interrupt_asm.s
+void isr_install(void) {
+    isr_installs++;
+    idt_set_gate(14, 0x00101234, 0x08, 0x8E);
+}
+
+void irq_install(void) {
+    irq_installs++;
+    idt_set_gate(32, 0x00105678, 0x08, 0x8E);
+}
+
+void idt_load(idt_ptr_t* ptr) {
+    loaded_ptr = ptr;
+}
+
+TEST(idt_entry_layout) {
+    CHECK_EQ(sizeof(idt_entry_t), 8);
+    CHECK_EQ(sizeof(idt_ptr_t), 6);
+    CHECK_EQ(offsetof(idt_entry_t, base_lo), 0);
+    CHECK_EQ(offsetof(idt_entry_t, sel), 2);
+    CHECK_EQ(offsetof(idt_entry_t, always0), 4);
+    CHECK_EQ(offsetof(idt_entry_t, flags), 5);
+    CHECK_EQ(offsetof(idt_entry_t, base_hi), 6);
+}
+
+TEST(idt_set_gate_encoding) {
+    idt_set_gate(0x80, 0x12345678, 0x08, 0xEE);     // 32-bit interrupt gate, DPL 3
+    const uint8_t* raw = (const uint8_t*)&idt_entries[0x80];
+    static const uint8_t expected[8] = { 0x78, 0x56, 0x08, 0x00, 0x00, 0xEE, 0x34, 0x12 };
+    for (int i = 0; i < 8; i++) {
+        CHECK_EQ(raw[i], expected[i]);
+    }
+
+    // The present bit is always set; the type and DPL bits are kept
+    idt_set_gate(3, 0xC0001000, 0x08, 0x0F);
+    CHECK_EQ(idt_entries[3].flags, 0x8F);
+    CHECK_EQ(idt_entries[3].base_lo, 0x1000);
+    CHECK_EQ(idt_entries[3].base_hi, 0xC000);
+    CHECK_EQ(idt_entries[3].always0, 0);
+}
+
+TEST(idt_install_clears_and_loads) {
+    for (int i = 0; i < IDT_ENTRIES; i++) {
+        idt_entries[i].flags = 0xFF;                // Leftovers that install must wipe
+    }
+    uint32_t isr_before = isr_installs, irq_before = irq_installs;
+    idt_install();
+
+    CHECK_EQ(isr_installs - isr_before, 1);
+    CHECK_EQ(irq_installs - irq_before, 1);
+    CHECK(loaded_ptr == &idt_ptr);
+    CHECK_EQ(idt_ptr.limit, IDT_ENTRIES * 8 - 1);
+    CHECK_EQ(idt_ptr.base, (uint32_t)(uintptr_t)idt_entries);
+
+    int stale = 0;
+    for (int i = 0; i < IDT_ENTRIES; i++) {
+        stale += i != 14 && i != 32 && idt_entries[i].flags != 0;
+    }
+    CHECK_EQ(stale, 0);
+    CHECK_EQ(idt_entries[14].flags, 0x8E);
+    CHECK_EQ(idt_entries[32].base_lo, 0x5678);
+}
+
+static void bench_set_gate(host_bench_state_t* state) {
+    for (uint64_t i = 0; i < state->iterations; i++) {
+        idt_set_gate((uint8_t)i, 0x00100000 + (uint32_t)i * 16, 0x08, 0x8E);
+    }
+    host_keep(idt_entries);
+}
+
+static void bench_install(host_bench_state_t* state) {
+    for (uint64_t i = 0; i < state->iterations; i++) {
+        idt_install();
+    }
+}
+
+BENCHMARK(idt_set_gate, .fn = bench_set_gate);
+BENCHMARK(idt_install, .fn = bench_install);
@@ -0,0 +1,132 @@
+#include "harness.h"
+#include "mock/mock_hw.h"
+#include "drivers/keyboard.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// drivers/keyboard.c: scancodes arrive through the mocked data port, one
+// keyboard_handler() call per interrupt
+
+#define KBD_DATA_PORT       0x60
+#define KBD_STATUS_PORT     0x64
+#define RELEASE             0x80
+
+extern const unsigned char kbd_us_layout[128];
+
+static void drain(void) {
+    while (keyboard_getchar() != 0) {
+    }
+}
+
+static void press(uint8_t scancode) {
+    mock_io_queue(KBD_DATA_PORT, scancode);
+    keyboard_handler(NULL);
+}
+
+TEST(keyboard_init_drains_controller) {
+    mock_io_reset();
+    mock_io_queue(KBD_STATUS_PORT, 0x01);
+    mock_io_queue(KBD_STATUS_PORT, 0x01);
+    mock_io_queue(KBD_STATUS_PORT, 0x01);
+    keyboard_init();
+    CHECK_EQ(mock_io_reads(KBD_DATA_PORT), 3);
+    CHECK(mock_irq_handlers[1] == keyboard_handler);
+}
+
+TEST(keyboard_translates_scancode_set1) {
+    static const uint8_t hello[] = { 0x23, 0x12, 0x26, 0x26, 0x18, 0x1C };
+    mock_io_reset();
+    drain();
+    for (size_t i = 0; i < sizeof(hello); i++) {
+        press(hello[i]);
+        press(hello[i] | RELEASE);                  // Releases produce nothing
+    }
+    press(0x2A);                                    // Left shift: not mapped
+    press(0x39);
+    press(0x02);
+    press(0x0B);
+    press(0x0E);
+
+    const char expected[] = "hello\n 10\b";
+    for (size_t i = 0; expected[i] != '\0'; i++) {
+        CHECK_EQ(keyboard_getchar(), expected[i]);
+    }
+    CHECK_EQ(keyboard_getchar(), 0);
+}
+
+TEST(keyboard_special_keys) {
+    mock_io_reset();
+    drain();
+    press(0x49);
+    press(0x51);
+    press(0x58);
+    press(0x57);
+    press(0x44);
+    CHECK_EQ(keyboard_getchar(), KBD_PAGE_UP);
+    CHECK_EQ(keyboard_getchar(), KBD_PAGE_DOWN);
+    CHECK_EQ(keyboard_getchar(), KBD_F12);
+    CHECK_EQ(keyboard_getchar(), KBD_F11);
+    CHECK_EQ(keyboard_getchar(), KBD_F10);
+}
+
+TEST(keyboard_layout_table) {
+    const char digits[] = "1234567890-=";
+    for (int i = 0; digits[i] != '\0'; i++) {
+        CHECK_EQ(kbd_us_layout[0x02 + i], digits[i]);
+    }
+    const char top[] = "qwertyuiop[]";
+    for (int i = 0; top[i] != '\0'; i++) {
+        CHECK_EQ(kbd_us_layout[0x10 + i], top[i]);
+    }
+    const char home[] = "asdfghjkl;'`";
+    for (int i = 0; home[i] != '\0'; i++) {
+        CHECK_EQ(kbd_us_layout[0x1E + i], home[i]);
+    }
+    const char bottom[] = "\\zxcvbnm,./";
+    for (int i = 0; bottom[i] != '\0'; i++) {
+        CHECK_EQ(kbd_us_layout[0x2B + i], bottom[i]);
+    }
+}
+
+TEST(keyboard_ring_overflow) {
+    mock_io_reset();
+    drain();
+    uint32_t dropped = keyboard_dropped();
+    for (int i = 0; i < KBD_RING_SIZE + 5; i++) {
+        press(0x1E);                                // 'a'
+    }
+    CHECK_EQ(keyboard_dropped() - dropped, 5);
+
+    char buf[KBD_RING_SIZE + 8];
+    size_t n = keyboard_read(buf, sizeof(buf));
+    CHECK_EQ(n, KBD_RING_SIZE);
+    CHECK_EQ(buf[0], 'a');
+    CHECK_EQ(buf[n - 1], 'a');
+    CHECK_EQ(keyboard_getchar(), 0);
+}
+
+// One interrupt plus the reader's translation, per key
+static void bench_keypress(host_bench_state_t* state) {
+    mock_io_reset();
+    drain();
+    for (uint64_t i = 0; i < state->iterations; i++) {
+        press(0x10 + (i & 7));
+        host_keep((void*)(uintptr_t)keyboard_getchar());
+    }
+}
+
+// Fill the ring from the interrupt side, then drain it with keyboard_read()
+static void bench_burst(host_bench_state_t* state) {
+    char buf[64];
+    mock_io_reset();
+    drain();
+    for (uint64_t i = 0; i < state->iterations; i++) {
+        for (int k = 0; k < 64; k++) {
+            press(k & 1 ? 0x9E : 0x1E);             // Press and release 'a'
+        }
+        host_keep((void*)(uintptr_t)keyboard_read(buf, sizeof(buf)));
+    }
+}
+
+BENCHMARK(keyboard_keypress, .fn = bench_keypress);
+BENCHMARK(keyboard_burst_64, .fn = bench_burst);
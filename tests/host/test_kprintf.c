@@ -0,0 +1,67 @@
+#include "harness.h"
+#include "mock/mock_hw.h"
+#include "libc/include/stdio.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// libc/stdio/kprintf.c against the host C library's snprintf
+
+#define CHECK_FORMAT(fmt, ...)                                                  \
+    do {                                                                        \
+        char got[128], want[128];                                               \
+        int n = ksnprintf(got, sizeof(got), fmt, __VA_ARGS__);                  \
+        int m = snprintf(want, sizeof(want), fmt, __VA_ARGS__);                 \
+        if (n != m || strcmp(got, want) != 0) {                                 \
+            host_fail("%s: \"%s\" (%d), expected \"%s\" (%d)", fmt, got, n, want, m); \
+        }                                                                       \
+    } while (0)
+
+TEST(kprintf_matches_libc) {
+    CHECK_FORMAT("%d %i", 0, -1);
+    CHECK_FORMAT("%d", INT32_MIN);
+    CHECK_FORMAT("%u %u", 0u, UINT32_MAX);
+    CHECK_FORMAT("%x %X", 0xBEEFu, 0xBEEFu);
+    CHECK_FORMAT("%08x|%-8x|%8x", 0x1234u, 0x1234u, 0x1234u);
+    CHECK_FORMAT("%05d|%-5d|%5d", -42, -42, -42);
+    CHECK_FORMAT("%llu %lld", 18446744073709551615ull, (long long)INT64_MIN);
+    CHECK_FORMAT("%llx", 0x123456789ABCDEFull);
+    CHECK_FORMAT("%zu", (size_t)123456);
+    CHECK_FORMAT("%lu", 4000000000ul);
+    CHECK_FORMAT("[%s] [%10s] [%-10s] [%.3s]", "rot", "rot", "rot", "rotOS");
+    CHECK_FORMAT("%c%c%c %%", 'r', 'o', 't');
+}
+
+TEST(kprintf_truncates) {
+    char buf[8];
+    int n = ksnprintf(buf, sizeof(buf), "%s", "0123456789");
+    CHECK_EQ(n, 10);                                // Length it would have had
+    CHECK(strcmp(buf, "0123456") == 0);
+    CHECK_EQ(ksnprintf(NULL, 0, "%d", 12345), 5);
+}
+
+TEST(kprintf_console) {
+    mock_serial_len = 0;
+    kprintf("serial %u\n", 42u);
+    CHECK(strcmp(mock_serial, "serial 42\n") == 0);
+}
+
+static void bench_format(host_bench_state_t* state) {
+    char buf[KPRINTF_BUF_SIZE];
+    for (uint64_t i = 0; i < state->iterations; i++) {
+        ksnprintf(buf, sizeof(buf), "irq %u: %llu cycles at %p (%s)", (unsigned)i,
+                  (unsigned long long)i * 1000003, (void*)buf, "ok");
+        host_keep(buf);
+    }
+}
+
+static void bench_decimal64(host_bench_state_t* state) {
+    char buf[32];
+    for (uint64_t i = 0; i < state->iterations; i++) {
+        ksnprintf(buf, sizeof(buf), "%llu", 18446744073709551615ull - i);
+        host_keep(buf);
+    }
+}
+
+BENCHMARK(kprintf_format, .fn = bench_format);
+BENCHMARK(kprintf_decimal_u64, .fn = bench_decimal64);
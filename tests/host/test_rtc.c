@@ -0,0 +1,124 @@
+#include "harness.h"
+#include "mock/mock_hw.h"
+#include "drivers/rtc.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// drivers/rtc.c: register decoding, the epoch conversion and the wall clock
+// anchored by the update interrupt. CMOS registers are read through port
+// 0x71 in a fixed order, so the mocked reads are queued in that order.
+
+#define CMOS_INDEX_PORT     0x70
+#define CMOS_DATA_PORT      0x71
+#define NS_PER_SEC          1000000000ull
+
+// One rtc_get_time(): register A (no update in progress), then the six time
+// registers, twice
+static void queue_time(const uint8_t regs[6]) {
+    for (int pass = 0; pass < 2; pass++) {
+        mock_io_queue(CMOS_DATA_PORT, 0x00);
+        for (int i = 0; i < 6; i++) {
+            mock_io_queue(CMOS_DATA_PORT, regs[i]);
+        }
+    }
+}
+
+TEST(rtc_to_unix) {
+    static const struct {
+        rtc_time_t t;
+        uint64_t epoch;
+    } cases[] = {
+        { { 1970, 1, 1, 0, 0, 0 }, 0 },
+        { { 2000, 2, 29, 23, 59, 59 }, 951868799 },
+        { { 2012, 12, 12, 12, 12, 12 }, 1355314332 },
+        { { 2024, 2, 29, 23, 45, 30 }, 1709250330 },
+        { { 2099, 12, 31, 0, 0, 0 }, 4102358400ull },
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        CHECK_EQ(rtc_to_unix(&cases[i].t), cases[i].epoch);
+    }
+}
+
+TEST(rtc_init_bcd_12_hour) {
+    mock_io_reset();
+    mock_irq_handlers[RTC_IRQ] = NULL;
+    mock_ktime_ns = 5 * NS_PER_SEC;
+
+    // Register B: BCD, 12-hour. 2024-02-29 11:45:30 PM.
+    static const uint8_t regs[6] = { 0x30, 0x45, 0x80 | 0x11, 0x29, 0x02, 0x24 };
+    mock_io_queue(CMOS_DATA_PORT, 0x00);
+    queue_time(regs);
+    rtc_init();
+
+    CHECK(mock_irq_handlers[RTC_IRQ] != NULL);
+    CHECK_EQ(ktime_get_real_ns(), 1709250330ull * NS_PER_SEC);
+    mock_ktime_ns += 250000000;
+    CHECK_EQ(ktime_get_real_ns(), 1709250330ull * NS_PER_SEC + 250000000);
+
+    // Update-ended interrupt enabled in register B
+    int enabled = 0;
+    for (uint32_t i = 0; i + 1 < mock_io_write_count(); i++) {
+        if (mock_io_write(i)->port == CMOS_INDEX_PORT && mock_io_write(i)->value == 0x0B &&
+            mock_io_write(i + 1)->port == CMOS_DATA_PORT) {
+            enabled = mock_io_write(i + 1)->value == 0x10;
+        }
+    }
+    CHECK(enabled);
+    CHECK_EQ(mock_irq_depth, 0);
+}
+
+TEST(rtc_update_interrupt_reanchors) {
+    mock_io_reset();
+    mock_ktime_ns = 0;
+    static const uint8_t regs[6] = { 0x59, 0x59, 0x12, 0x31, 0x12, 0x99 };  // 12 AM
+    mock_io_queue(CMOS_DATA_PORT, 0x00);
+    queue_time(regs);
+    rtc_init();
+    CHECK_EQ(ktime_get_real_ns(), 4102361999ull * NS_PER_SEC);      // 2099-12-31 00:59:59
+
+    // Our clock ran 0.3 s behind the RTC: its next second starts at 0.7 s
+    mock_ktime_ns = 700000000;
+    static const uint8_t next[6] = { 0x00, 0x00, 0x01, 0x31, 0x12, 0x99 };
+    mock_io_queue(CMOS_DATA_PORT, 0x10);                            // Register C: update ended
+    for (int i = 0; i < 6; i++) {
+        mock_io_queue(CMOS_DATA_PORT, next[i]);
+    }
+    mock_irq_handlers[RTC_IRQ](NULL);
+    CHECK_EQ(rtc_updates(), 1);
+    mock_ktime_ns += 1000;
+    CHECK_EQ(ktime_get_real_ns(), 4102362000ull * NS_PER_SEC + 1000);
+
+    // Other interrupt sources in register C leave the anchor alone
+    mock_io_queue(CMOS_DATA_PORT, 0x40);
+    mock_irq_handlers[RTC_IRQ](NULL);
+    CHECK_EQ(rtc_updates(), 1);
+}
+
+TEST(rtc_update_never_steps_back) {
+    mock_io_reset();
+    mock_ktime_ns = 0;
+    static const uint8_t regs[6] = { 0x00, 0x00, 0x00, 0x01, 0x01, 0x30 };  // 2030-01-01 00:00:00
+    mock_io_queue(CMOS_DATA_PORT, 0x00);
+    queue_time(regs);
+    rtc_init();
+    uint64_t start = 1893456000ull * NS_PER_SEC;
+    CHECK_EQ(ktime_get_real_ns(), start);
+
+    // Our clock runs 0.2% fast: the RTC's next second comes at 1.002 s
+    mock_ktime_ns = 1002000000;
+    uint64_t before = ktime_get_real_ns();
+    CHECK_EQ(before, start + 1002000000);
+    static const uint8_t next[6] = { 0x01, 0x00, 0x00, 0x01, 0x01, 0x30 };
+    mock_io_queue(CMOS_DATA_PORT, 0x10);
+    for (int i = 0; i < 6; i++) {
+        mock_io_queue(CMOS_DATA_PORT, next[i]);
+    }
+    mock_irq_handlers[RTC_IRQ](NULL);
+
+    // Held at the last value until the new anchor passes it, then follows it
+    CHECK(ktime_get_real_ns() >= before);
+    mock_ktime_ns += 1000000;
+    CHECK_EQ(ktime_get_real_ns(), before);
+    mock_ktime_ns += 2000000;
+    CHECK_EQ(ktime_get_real_ns(), start + NS_PER_SEC + 3000000);
+}
@@ -0,0 +1,109 @@
+#include "harness.h"
+#include "mock/mock_hw.h"
+#include "interrupt/softirq.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// interrupt/softirq.c: tasklets queued from a (simulated) top half run on
+// irq_exit(). There is no ksoftirqd in the host build.
+
+#define LOG_SIZE            16
+
+static uint32_t runs;
+static uint32_t again;              // Times the tasklet reschedules itself
+static char order[LOG_SIZE];
+static uint32_t order_len;
+
+static void count_fn(void* arg) {
+    tasklet_t* self = arg;
+    runs++;
+    if (again > 0) {
+        again--;
+        tasklet_schedule(self);
+    }
+}
+
+static void log_fn(void* arg) {
+    if (order_len < LOG_SIZE) {
+        order[order_len++] = *(const char*)arg;
+    }
+}
+
+static void reset(void) {
+    runs = 0;
+    again = 0;
+    order_len = 0;
+}
+
+// One top half that queues 't' 'n' times
+static int interrupt(tasklet_t* t, int n) {
+    irq_enter();
+    for (int i = 0; i < n; i++) {
+        tasklet_schedule(t);
+    }
+    return irq_exit();
+}
+
+TEST(softirq_tasklet_batches_schedules) {
+    tasklet_t t;
+    tasklet_init(&t, count_fn, &t);
+    reset();
+    CHECK_EQ(interrupt(&t, 3), 1);
+    CHECK_EQ(runs, 1);
+    CHECK_EQ(t.scheduled, 0);
+    CHECK_EQ(mock_irq_depth, 0);
+}
+
+TEST(softirq_nested_exit_leaves_work_to_outer) {
+    tasklet_t t;
+    tasklet_init(&t, count_fn, &t);
+    reset();
+    irq_enter();
+    CHECK(in_interrupt());
+    CHECK_EQ(interrupt(&t, 1), 0);                  // Nested: no bottom halves, no preemption
+    CHECK_EQ(runs, 0);
+    CHECK_EQ(irq_exit(), 1);
+    CHECK_EQ(runs, 1);
+    CHECK(!in_interrupt());
+}
+
+TEST(softirq_reschedule_runs_again) {
+    tasklet_t t;
+    tasklet_init(&t, count_fn, &t);
+    reset();
+    again = 3;
+    interrupt(&t, 1);
+    CHECK_EQ(runs, 4);
+}
+
+TEST(softirq_restart_budget) {
+    tasklet_t t;
+    tasklet_init(&t, count_fn, &t);
+    reset();
+    again = 1000;
+    interrupt(&t, 1);
+    CHECK_EQ(runs, SOFTIRQ_MAX_RESTART);           // The rest would go to ksoftirqd
+
+    again = 0;
+    interrupt(&t, 0);                               // Next IRQ exit finishes it
+    CHECK_EQ(runs, SOFTIRQ_MAX_RESTART + 1);
+    CHECK_EQ(mock_irq_depth, 0);
+}
+
+TEST(softirq_hi_tasklets_first) {
+    static const char a = 'a', b = 'b', c = 'c';
+    tasklet_t ta, tb, tc;
+    tasklet_init(&ta, log_fn, (void*)&a);
+    tasklet_init(&tb, log_fn, (void*)&b);
+    tasklet_init(&tc, log_fn, (void*)&c);
+    reset();
+    irq_enter();
+    tasklet_schedule(&ta);
+    tasklet_schedule(&tb);
+    tasklet_hi_schedule(&tc);
+    irq_exit();
+    CHECK_EQ(order_len, 3);
+    CHECK_EQ(order[0], 'c');
+    CHECK_EQ(order[1], 'a');
+    CHECK_EQ(order[2], 'b');
+}
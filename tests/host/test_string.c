@@ -0,0 +1,194 @@
+#include "harness.h"
+#include "libc/include/string.h"
+#include "libc/string/string_impl.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// libc/string: every size class (byte loop, rep stosd/movsd, SSE2, non-temporal)
+// at every alignment, with and without the SSE2 paths
+
+#define GUARD               64
+#define GUARD_BYTE          0xEE
+#define BIG                 (STRING_NT_MIN + 77)
+
+static uint8_t buf[BIG + 2 * GUARD + 64] __attribute__((aligned(64)));
+static uint8_t src[BIG + 2 * GUARD + 64] __attribute__((aligned(64)));
+
+static const size_t sizes[] = {
+    0, 1, 2, 3, 4, 5, 7, 8, 15, 16, 17, 31, 32, 63, 64, 65, 100, 255, 256,
+    STRING_SSE2_MIN - 1, STRING_SSE2_MIN, STRING_SSE2_MIN + 1, 1000, 4095, 4096, 4097,
+    65536 + 13, BIG,
+};
+
+#define SIZES               (sizeof(sizes) / sizeof(sizes[0]))
+
+static void fill_ref(uint8_t* p, uint8_t value, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        p[i] = value;
+    }
+}
+
+// Guards either side of [off, off + n) must be untouched
+static int guards_ok(size_t off, size_t n) {
+    for (size_t i = off - GUARD; i < off; i++) {
+        if (buf[i] != GUARD_BYTE) {
+            return 0;
+        }
+    }
+    for (size_t i = off + n; i < off + n + GUARD; i++) {
+        if (buf[i] != GUARD_BYTE) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+TEST(memset_sizes_and_alignments) {
+    for (int sse2 = 0; sse2 <= 1; sse2++) {
+        string_sse2 = sse2;
+        for (size_t s = 0; s < SIZES; s++) {
+            for (size_t align = 0; align < 16; align += (sizes[s] > 4096 ? 5 : 1)) {
+                size_t off = GUARD + align;
+                size_t n = sizes[s];
+                fill_ref(buf, GUARD_BYTE, n + 2 * GUARD + 16);
+                // Only the low byte of the value counts
+                void* ret = memset(buf + off, 0x1A5, n);
+
+                int ok = ret == buf + off && guards_ok(off, n);
+                for (size_t i = 0; i < n && ok; i++) {
+                    ok = buf[off + i] == 0xA5;
+                }
+                if (!ok) {
+                    host_fail("memset of %zu bytes at +%zu (sse2 %d)", n, align, sse2);
+                    return;
+                }
+            }
+        }
+    }
+    string_sse2 = 1;
+}
+
+TEST(memcpy_sizes_and_alignments) {
+    for (size_t i = 0; i < sizeof(src); i++) {
+        src[i] = (uint8_t)(i * 131 + 7);
+    }
+    for (int sse2 = 0; sse2 <= 1; sse2++) {
+        string_sse2 = sse2;
+        for (size_t s = 0; s < SIZES; s++) {
+            for (size_t align = 0; align < 16; align += (sizes[s] > 4096 ? 7 : 3)) {
+                size_t off = GUARD + align;
+                size_t n = sizes[s];
+                fill_ref(buf, GUARD_BYTE, n + 2 * GUARD + 16);
+                void* ret = memcpy(buf + off, src + 1 + align / 2, n);
+                CHECK(ret == buf + off);
+                CHECK(guards_ok(off, n));
+                CHECK(memcmp(buf + off, src + 1 + align / 2, n) == 0);
+            }
+        }
+    }
+    string_sse2 = 1;
+}
+
+TEST(memmove_overlap) {
+    for (size_t n = 1; n < 300; n += 7) {
+        for (size_t shift = 1; shift < 20; shift += 3) {
+            for (size_t i = 0; i < n + shift; i++) {
+                buf[i] = (uint8_t)i;
+            }
+            memmove(buf + shift, buf, n);           // Forward overlap: copied backwards
+            int ok = 1;
+            for (size_t i = 0; i < n; i++) {
+                ok &= buf[shift + i] == (uint8_t)i;
+            }
+            CHECK(ok);
+
+            for (size_t i = 0; i < n + shift; i++) {
+                buf[i] = (uint8_t)i;
+            }
+            memmove(buf, buf + shift, n);           // Backward overlap
+            ok = 1;
+            for (size_t i = 0; i < n; i++) {
+                ok &= buf[i] == (uint8_t)(i + shift);
+            }
+            CHECK(ok);
+        }
+    }
+}
+
+TEST(memcmp_memchr) {
+    const char a[] = "abcdefgh";
+    const char b[] = "abcdefgi";
+    CHECK(memcmp(a, b, 7) == 0);
+    CHECK(memcmp(a, b, 8) < 0);
+    CHECK(memcmp(b, a, 8) > 0);
+    CHECK(memcmp(a, b, 0) == 0);
+    CHECK(memchr(a, 'e', 8) == a + 4);
+    CHECK(memchr(a, 'z', 8) == NULL);
+}
+
+TEST(str_functions) {
+    char s[64];
+    // strlen reads whole words: check every alignment and length
+    for (size_t align = 0; align < 8; align++) {
+        for (size_t len = 0; len < 40; len++) {
+            fill_ref((uint8_t*)s, 'x', sizeof(s));
+            s[align + len] = '\0';
+            CHECK_EQ(strlen(s + align), len);
+        }
+    }
+    CHECK_EQ(strnlen("hello", 3), 3);
+    CHECK_EQ(strnlen("hi", 10), 2);
+    CHECK(strcmp("abc", "abc") == 0);
+    CHECK(strcmp("abc", "abd") < 0);
+    CHECK(strcmp("ab", "abc") < 0);
+    CHECK(strcmp("\xff", "a") > 0);                 // Compared as unsigned char
+    CHECK(strncmp("abcx", "abcy", 3) == 0);
+    CHECK(strchr("rotOS", 'O') != NULL && *strchr("rotOS", 'O') == 'O');
+    CHECK(strchr("rotOS", '\0') != NULL);
+    CHECK(strchr("rotOS", 'z') == NULL);
+    CHECK(strcmp(strcpy(s, "kernel"), "kernel") == 0);
+}
+
+static void bench_memset(host_bench_state_t* state) {
+    size_t n = (size_t)state->arg;
+    for (uint64_t i = 0; i < state->iterations; i++) {
+        memset(buf, (int)i, n);
+        host_keep(buf);
+    }
+}
+
+static void bench_memset_bytewise(host_bench_state_t* state) {
+    size_t n = (size_t)state->arg;
+    for (uint64_t i = 0; i < state->iterations; i++) {
+        volatile uint8_t* p = buf;
+        for (size_t j = 0; j < n; j++) {
+            p[j] = (uint8_t)i;
+        }
+    }
+}
+
+static void bench_memcpy(host_bench_state_t* state) {
+    size_t n = (size_t)state->arg;
+    for (uint64_t i = 0; i < state->iterations; i++) {
+        memcpy(buf, src, n);
+        host_keep(buf);
+    }
+}
+
+static void bench_strlen(host_bench_state_t* state) {
+    fill_ref(buf, 'a', 4095);
+    buf[4095] = '\0';
+    for (uint64_t i = 0; i < state->iterations; i++) {
+        host_keep((void*)strlen((const char*)buf));
+    }
+}
+
+BENCHMARK(memset_64, .fn = bench_memset, .arg = (void*)64, .bytes = 64);
+BENCHMARK(memset_4k, .fn = bench_memset, .arg = (void*)4096, .bytes = 4096);
+BENCHMARK(memset_64k, .fn = bench_memset, .arg = (void*)65536, .bytes = 65536);
+BENCHMARK(memset_256k_nt, .fn = bench_memset, .arg = (void*)STRING_NT_MIN, .bytes = STRING_NT_MIN);
+BENCHMARK(memset_4k_bytewise, .fn = bench_memset_bytewise, .arg = (void*)4096, .bytes = 4096);
+BENCHMARK(memcpy_64, .fn = bench_memcpy, .arg = (void*)64, .bytes = 64);
+BENCHMARK(memcpy_4k, .fn = bench_memcpy, .arg = (void*)4096, .bytes = 4096);
+BENCHMARK(memcpy_64k, .fn = bench_memcpy, .arg = (void*)65536, .bytes = 65536);
+BENCHMARK(strlen_4k, .fn = bench_strlen, .bytes = 4095);
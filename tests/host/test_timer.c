@@ -0,0 +1,200 @@
+#include "harness.h"
+#include "mock/mock_hw.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// drivers/timer.c, built into this file so the tests can see the conversion
+// factors timer_init() derives and the clock state it keeps
+#include "drivers/timer.c"
+
+#define NS_PER_SEC          1000000000ull
+#define LAPIC_CYCLES_10MS   62500           // 100 MHz bus clock divided by 16
+
+// Restart timer_init() from scratch with the mocked PIT and LAPIC
+static void timer_reset(int lapic, uint32_t lapic_cycles) {
+    mock_io_reset();
+    mock_io_set_default(PIT_CHANNEL0_DATA_PORT, PIT_STATUS_NULL);  // No count loaded yet
+    mock_io_set_default(PIT_GATE_PORT, 0x20);                      // Channel 2 done at once
+    for (size_t i = 0; i < sizeof(mock_lapic_regs) / sizeof(mock_lapic_regs[0]); i++) {
+        mock_lapic_regs[i] = 0;
+    }
+    mock_lapic_regs[LAPIC_TIMER_CCR >> 4] = 0xFFFFFFFF - lapic_cycles;
+    mock_lapic_present = lapic;
+    use_lapic = 0;
+    timer_ready = 0;
+    clock_ns = 0;
+    clock_frac = 0;
+    hw_remaining = 0;
+    hw_expired = 0;
+    armed_ns = KTIMER_NEVER;
+}
+
+// (x * mult) >> shift against the exact x * to / from, for x up to 'max'
+// (at most TIMER_MAX_SLEEP_NS, so neither product overflows)
+static int conversion_ok(uint32_t mult, uint32_t shift, uint64_t from, uint64_t to, uint32_t max) {
+    for (uint64_t x = 1; x <= max; x = x * 3 / 2 + 1) {
+        uint64_t got = (x * mult) >> shift;
+        uint64_t exact = x * to / from;
+        uint64_t err = got > exact ? got - exact : exact - got;
+        // The multiplier is rounded down: off by at most one unit plus x / 2^shift
+        if (err > 1 + (x >> shift) + exact / (1ull << 31)) {
+            host_fail("x=%llu: %llu instead of %llu", (unsigned long long)x,
+                      (unsigned long long)got, (unsigned long long)exact);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+TEST(timer_div_u64_u32) {
+    uint64_t n = 0x123456789ABCDEFull;
+    for (uint32_t d = 1; d < 100000; d = d * 7 + 3) {
+        CHECK_EQ(div_u64_u32(n, d), n / d);
+        n = n * 6364136223846793005ull + 1442695040888963407ull;
+    }
+    CHECK_EQ(div_u64_u32(~0ull, 0xFFFFFFFF), ~0ull / 0xFFFFFFFF);
+}
+
+TEST(timer_calc_mult_is_tight) {
+    static const uint32_t rates[][2] = {
+        { PIT_BASE_FREQUENCY, 1000000000 },
+        { 1000000000, PIT_BASE_FREQUENCY },
+        { LAPIC_CYCLES_10MS, CALIBRATE_NS },
+        { CALIBRATE_NS, LAPIC_CYCLES_10MS },
+        { 1000000, CALIBRATE_NS },
+        { CALIBRATE_NS, 1000000 },
+    };
+    for (size_t i = 0; i < sizeof(rates) / sizeof(rates[0]); i++) {
+        uint32_t mult, shift;
+        calc_mult(&mult, &shift, rates[i][0], rates[i][1]);
+        // Largest shift whose multiplier fits: one more bit would overflow
+        CHECK(shift == 32 || ((uint64_t)rates[i][1] << (shift + 1)) / rates[i][0] > 0xFFFFFFFFull);
+        CHECK(conversion_ok(mult, shift, rates[i][0], rates[i][1], 0xFFFF));
+    }
+}
+
+TEST(timer_mul_u64_u32_shr) {
+    // Products that fit 64 bits against the plain expression
+    uint64_t a = 0x9E3779B9ull;
+    for (uint32_t shift = 0; shift <= 32; shift++) {
+        uint32_t mul = (uint32_t)(a * 2654435761u) | 1;
+        CHECK_EQ(mul_u64_u32_shr(a, mul, shift), (a * mul) >> shift);
+        a = (a * 6364136223846793005ull + 1) >> 32;
+    }
+    // Beyond 64 bits: 2^40 cycles times 2^31 / 2^32
+    CHECK_EQ(mul_u64_u32_shr(1ull << 40, 1u << 31, 32), 1ull << 39);
+    // An hour of a 2.4 GHz TSC, scaled the way clocksource_init() calibrates
+    // it: the multiplier is rounded down, by under a ns per 1.7 s
+    uint32_t mult, shift;
+    calc_mult(&mult, &shift, 60000000, 25000000);           // 25 ms window
+    uint64_t ns = mul_u64_u32_shr(3600ull * 2400000000ull, mult, shift);
+    CHECK(ns <= 3600 * NS_PER_SEC && ns > 3600 * NS_PER_SEC - 10000);
+}
+
+TEST(timer_init_pit) {
+    timer_reset(0, 0);
+    timer_init();
+
+    CHECK(!use_lapic);
+    CHECK_EQ(max_cycles, 0xFFFF);
+    CHECK(mock_irq_handlers[0] == timer_handler);
+    CHECK(conversion_ok(cyc2ns_mult, cyc2ns_shift, PIT_BASE_FREQUENCY, NS_PER_SEC, 0xFFFF));
+    CHECK(conversion_ok(ns2cyc_mult, ns2cyc_shift, NS_PER_SEC, PIT_BASE_FREQUENCY, TIMER_MAX_SLEEP_NS));
+
+    // Channel 0 stopped, read back, then armed for the longest sleep (capped at 0xFFFF)
+    static const mock_port_write_t expected[] = {
+        { PIT_CMD_PORT, PIT_CMD_CH0_ONESHOT },
+        { PIT_CMD_PORT, PIT_CMD_READBACK_CH0 },
+        { PIT_CMD_PORT, PIT_CMD_CH0_ONESHOT },
+        { PIT_CHANNEL0_DATA_PORT, 0xFF },
+        { PIT_CHANNEL0_DATA_PORT, 0xFF },
+    };
+    CHECK_EQ(mock_io_write_count(), sizeof(expected) / sizeof(expected[0]));
+    for (uint32_t i = 0; i < mock_io_write_count(); i++) {
+        CHECK_EQ(mock_io_write(i)->port, expected[i].port);
+        CHECK_EQ(mock_io_write(i)->value, expected[i].value);
+    }
+    CHECK_EQ(mock_irq_depth, 0);
+}
+
+TEST(timer_pit_clock) {
+    timer_reset(0, 0);
+    timer_init();
+
+    // 1193 PIT cycles later: one millisecond
+    uint32_t count = 0xFFFF - 1193;
+    mock_io_queue(PIT_CHANNEL0_DATA_PORT, 0);
+    mock_io_queue(PIT_CHANNEL0_DATA_PORT, count & 0xFF);
+    mock_io_queue(PIT_CHANNEL0_DATA_PORT, count >> 8);
+    uint64_t ns = timer_now_ns();
+    CHECK(ns > 999000 && ns < 1001000);
+
+    // Terminal count passed: the counter wrapped to 0xFFFF and kept going
+    mock_io_queue(PIT_CHANNEL0_DATA_PORT, PIT_STATUS_OUT);
+    mock_io_queue(PIT_CHANNEL0_DATA_PORT, 0xFF);
+    mock_io_queue(PIT_CHANNEL0_DATA_PORT, 0xFF - 10);
+    uint64_t later = timer_now_ns();
+    uint64_t expected = ns + ((uint64_t)count + 0x10000 - 0xF5FF) * NS_PER_SEC / PIT_BASE_FREQUENCY;
+    CHECK(later > expected - 1000 && later < expected + 1000);
+    CHECK_EQ(mock_irq_depth, 0);
+}
+
+TEST(timer_init_lapic) {
+    timer_reset(1, LAPIC_CYCLES_10MS);
+    timer_init();
+
+    CHECK(use_lapic);
+    CHECK_EQ(max_cycles, 0xFFFFFFFF);
+    CHECK_EQ(mock_lapic_regs[LAPIC_TIMER_DCR >> 4], LAPIC_TIMER_DIV16);
+    CHECK_EQ(mock_lapic_regs[LAPIC_LVT_TIMER >> 4], LAPIC_TIMER_VECTOR);
+    CHECK(conversion_ok(cyc2ns_mult, cyc2ns_shift, LAPIC_CYCLES_10MS, CALIBRATE_NS, TIMER_MAX_SLEEP_NS));
+
+    // Calibration window: PIT channel 2 loaded with 10 ms worth of cycles
+    uint32_t pit_count = PIT_BASE_FREQUENCY / 100;
+    int found = 0;
+    for (uint32_t i = 0; i + 1 < mock_io_write_count(); i++) {
+        if (mock_io_write(i)->port == PIT_CHANNEL2_DATA_PORT) {
+            found = mock_io_write(i)->value == (pit_count & 0xFF) &&
+                    mock_io_write(i + 1)->value == (pit_count >> 8);
+            break;
+        }
+    }
+    CHECK(found);
+
+    // Armed for the longest sleep: one second of LAPIC cycles
+    uint32_t icr = mock_lapic_regs[LAPIC_TIMER_ICR >> 4];
+    CHECK(icr >= LAPIC_CYCLES_10MS * 100 - 1 && icr <= LAPIC_CYCLES_10MS * 100);
+    CHECK_EQ(mock_irq_depth, 0);
+}
+
+static void bench_calc_mult(host_bench_state_t* state) {
+    uint32_t mult, shift;
+    for (uint64_t i = 0; i < state->iterations; i++) {
+        calc_mult(&mult, &shift, PIT_BASE_FREQUENCY + (uint32_t)(i & 1023), 1000000000);
+        host_keep(&mult);
+    }
+}
+
+// What clock_sync() pays per read: cycles to ns by multiply-shift
+static void bench_cycles_to_ns(host_bench_state_t* state) {
+    uint32_t mult, shift;
+    calc_mult(&mult, &shift, LAPIC_CYCLES_10MS, CALIBRATE_NS);
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < state->iterations; i++) {
+        sum += ((uint64_t)(uint32_t)i * mult) >> shift;
+        host_keep(&sum);
+    }
+}
+
+static void bench_now_pit(host_bench_state_t* state) {
+    timer_reset(0, 0);
+    timer_init();
+    mock_io_set_default(PIT_CHANNEL0_DATA_PORT, 0);
+    for (uint64_t i = 0; i < state->iterations; i++) {
+        host_keep((void*)(uintptr_t)timer_now_ns());
+    }
+}
+
+BENCHMARK(timer_calc_mult, .fn = bench_calc_mult);
+BENCHMARK(timer_cycles_to_ns, .fn = bench_cycles_to_ns);
+BENCHMARK(timer_now_ns_pit, .fn = bench_now_pit);
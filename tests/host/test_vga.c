@@ -0,0 +1,155 @@
+#include "harness.h"
+#include "mock/mock_hw.h"
+#include "drivers/vga.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// drivers/vga.c writing into mock_vga instead of 0xB8000. Until
+// term_enable_deferred_flush() (never called here) the shadow buffer is
+// copied out at each newline.
+
+#define CELL(c, color)      ((uint16_t)(uint8_t)(c) | ((uint16_t)(color) << 8))
+#define WHITE_ON_BLACK      0x0F
+
+// Text of screen row 'row', trailing blanks dropped
+static const char* row_text(int row) {
+    static char text[VGA_WIDTH + 1];
+    int len = 0;
+    for (int x = 0; x < VGA_WIDTH; x++) {
+        text[x] = (char)(mock_vga[row * VGA_WIDTH + x] & 0xFF);
+        if (text[x] != ' ') {
+            len = x + 1;
+        }
+    }
+    text[len] = '\0';
+    return text;
+}
+
+static int row_is(int row, const char* expected) {
+    const char* text = row_text(row);
+    for (int i = 0;; i++) {
+        if (text[i] != expected[i]) {
+            host_fail("row %d is \"%s\", expected \"%s\"", row, text, expected);
+            return 0;
+        }
+        if (text[i] == '\0') {
+            return 1;
+        }
+    }
+}
+
+static void print_numbered(int count) {
+    char line[16] = "line ";
+    for (int i = 0; i < count; i++) {
+        line[5] = (char)('0' + i / 10);
+        line[6] = (char)('0' + i % 10);
+        line[7] = '\n';
+        line[8] = '\0';
+        term_print(line);
+    }
+}
+
+TEST(vga_init_clears_screen) {
+    for (int i = 0; i < MOCK_VGA_CELLS; i++) {
+        mock_vga[i] = 0xDEAD;
+    }
+    term_init();
+    int wrong = 0;
+    for (int i = 0; i < MOCK_VGA_CELLS; i++) {
+        wrong += mock_vga[i] != CELL(' ', WHITE_ON_BLACK);
+    }
+    CHECK_EQ(wrong, 0);
+    CHECK_EQ(mock_irq_depth, 0);
+}
+
+TEST(vga_output_is_batched_per_line) {
+    term_init();
+    term_print("ab");
+    CHECK(row_is(0, ""));                           // Still only in the shadow buffer
+    term_print("c\n");
+    CHECK(row_is(0, "abc"));
+    CHECK_EQ(mock_vga[0], CELL('a', WHITE_ON_BLACK));
+
+    term_print("xy");
+    term_flush();
+    CHECK(row_is(1, "xy"));
+    CHECK_EQ(mock_irq_depth, 0);
+}
+
+TEST(vga_color_and_backspace) {
+    term_init();
+    term_setcolor(GREEN, BLUE);
+    term_print("ok!\b\n");
+    CHECK(row_is(0, "ok"));
+    CHECK_EQ(mock_vga[0], CELL('o', GREEN | (BLUE << 4)));
+    CHECK_EQ(mock_vga[2], CELL(' ', GREEN | (BLUE << 4)));
+    term_setcolor(WHITE, BLACK);
+}
+
+TEST(vga_wraps_and_scrolls) {
+    term_init();
+    char line[VGA_WIDTH + 2];
+    for (int x = 0; x < VGA_WIDTH + 1; x++) {
+        line[x] = (char)('a' + x % 26);
+    }
+    line[VGA_WIDTH + 1] = '\0';
+    term_print(line);                               // One character past the width wraps
+    term_print("\n");
+    CHECK_EQ(mock_vga[VGA_WIDTH - 1], CELL(line[VGA_WIDTH - 1], WHITE_ON_BLACK));
+    CHECK(row_is(1, "c"));
+
+    term_init();
+    print_numbered(30);
+    // 30 lines plus the empty cursor line: the first 6 scrolled off
+    CHECK(row_is(0, "line 06"));
+    CHECK(row_is(VGA_HEIGHT - 2, "line 29"));
+    CHECK(row_is(VGA_HEIGHT - 1, ""));
+}
+
+TEST(vga_scrollback) {
+    term_init();
+    print_numbered(30);
+
+    term_scrollback(100);                           // Clamped to the oldest line
+    CHECK(row_is(0, "line 00"));
+    term_scrollback(-3);
+    CHECK(row_is(0, "line 03"));
+    term_scrollback(-100);
+    CHECK(row_is(0, "line 06"));
+
+    term_scrollback(2);
+    term_print("new\n");                            // Output snaps back to the bottom
+    CHECK(row_is(0, "line 07"));
+    CHECK(row_is(VGA_HEIGHT - 2, "new"));
+    CHECK_EQ(mock_irq_depth, 0);
+}
+
+static void bench_print_line(host_bench_state_t* state) {
+    term_init();
+    for (uint64_t i = 0; i < state->iterations; i++) {
+        term_print("benchmark line: the quick brown fox jumps over the lazy dog 0123456789 abcdef\n");
+    }
+    host_keep(mock_vga);
+}
+
+static void bench_putchar(host_bench_state_t* state) {
+    term_init();
+    for (uint64_t i = 0; i < state->iterations; i++) {
+        term_putchar((i & 63) == 63 ? '\n' : 'x');
+    }
+    host_keep(mock_vga);
+}
+
+// Full-screen redraw: scroll back and forth one line
+static void bench_redraw(host_bench_state_t* state) {
+    term_init();
+    print_numbered(40);
+    for (uint64_t i = 0; i < state->iterations; i++) {
+        term_scrollback(i & 1 ? -1 : 1);
+    }
+    host_keep(mock_vga);
+}
+
+BENCHMARK(vga_print_line, .fn = bench_print_line, .bytes = 80);
+BENCHMARK(vga_putchar, .fn = bench_putchar);
+BENCHMARK(vga_redraw, .fn = bench_redraw, .bytes = VGA_WIDTH * VGA_HEIGHT * 2);
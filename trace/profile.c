@@ -0,0 +1,271 @@
+#include "profile.h"
+#include "interrupt/irq.h"
+#include "interrupt/idt.h"
+#include "interrupt/apic.h"
+#include "interrupt/irqflags.h"
+#include "cpu/smp.h"
+#include "drivers/serial.h"
+#include "drivers/timer.h"
+#include "memory/kmalloc.h"
+#include "memory/paging.h"
+#include "task/ktimer.h"
+#include "task/sched.h"
+#include "libc/include/stdio.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Sampling profiler.
+// Each CPU only ever appends to its own buffer, from its own interrupt
+// handler, so recording needs no lock. 'running' is cleared before the
+// buffers are read or reset; a sample IPI still in flight then records
+// nothing.
+
+#define DUMP_LINE_SIZE      160
+
+typedef struct {
+    profile_sample_t* buf;
+    volatile uint32_t count;
+    uint32_t user;
+    uint32_t lost;
+    uint32_t cycles;
+} profile_cpu_t;
+
+extern void ipi_profile(void);          // interrupt_asm.s
+
+static profile_cpu_t cpus[SMP_MAX_CPUS];
+static uint32_t ncpus;                  // CPUs with a buffer
+static ktimer_t sample_timer;
+static uint32_t period_ns;
+static uint32_t sample_hz;              // Rate of the last run, for the dump header
+static volatile int running;
+static volatile int dumping;
+static uint32_t ipis;
+
+static inline uint32_t rdtsc_lo(void) {
+    uint32_t lo, hi;
+    asm volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return lo;
+}
+
+#ifdef PROFILE_BACKTRACE
+extern char _etext[];                   // End of the kernel's code (linker)
+
+// Kernel address that can be read without faulting
+static int readable(uint32_t addr) {
+    if (addr < KERNEL_VIRT_BASE) {
+        return 0;
+    }
+    if (addr - KERNEL_VIRT_BASE < paging_direct_map_end()) {
+        return 1;
+    }
+    return (paging_get(addr) & PAGE_PRESENT) != 0;
+}
+
+// Follow the saved ebp chain from 'fp'. Frames must lie on the interrupted
+// stack (above 'sp', within one thread stack of it) and move up; return
+// addresses must point into kernel code.
+static uint32_t backtrace(uint32_t fp, uint32_t sp, uint32_t* out) {
+    uint32_t limit = sp + THREAD_STACK_SIZE;
+    uint32_t n = 0;
+    while (n < PROFILE_MAX_DEPTH && fp >= sp && fp < limit - 8 && (fp & 3) == 0 &&
+           readable(fp) && readable(fp + 7)) {
+        const uint32_t* frame = (const uint32_t*)fp;
+        uint32_t ret = frame[1];
+        if (ret < KERNEL_VIRT_BASE || ret >= (uint32_t)_etext) {
+            break;
+        }
+        out[n++] = ret;
+        sp = fp + 8;
+        fp = frame[0];
+    }
+    return n;
+}
+#endif
+
+// Record where this CPU was interrupted. Interrupts are disabled.
+static void record(const registers_t* regs) {
+    uint32_t id = smp_cpu_id();
+    if (!running || id >= ncpus) {
+        return;
+    }
+    profile_cpu_t* pc = &cpus[id];
+    if (pc->count >= PROFILE_SAMPLES) {
+        pc->lost++;
+        return;
+    }
+    uint32_t start = rdtsc_lo();
+    profile_sample_t* s = &pc->buf[pc->count];
+    s->eip = regs->eip;
+    s->flags = 0;
+    s->depth = 0;
+    if (regs->cs & 3) {
+        s->flags = PROFILE_USER;
+        pc->user++;
+    } else {
+#ifdef PROFILE_BACKTRACE
+        // Same privilege level: the CPU pushed eip, cs and eflags on the
+        // interrupted stack, so it continues right above them
+        s->depth = backtrace(regs->ebp, (uint32_t)&regs->useresp, s->frames);
+#endif
+    }
+    pc->count++;
+    pc->cycles += rdtsc_lo() - start;
+}
+
+// Sampling tick (hard IRQ on the boot CPU): sample here, then the APs
+static void profile_tick(void* arg) {
+    (void)arg;
+    registers_t* regs = irq_get_regs();
+    if (regs != NULL) {
+        record(regs);
+    }
+    for (uint32_t cpu = 1; cpu < ncpus; cpu++) {
+        if (cpu_data[cpu].online) {
+            lapic_send_ipi(cpu_data[cpu].apic_id, LAPIC_ICR_FIXED | PROFILE_VECTOR);
+            ipis++;
+        }
+    }
+    // One period after the last sample; periods the CPU sat with
+    // interrupts disabled are skipped, not made up for
+    uint64_t next = sample_timer.expires_ns + period_ns;
+    uint64_t now = timer_now_ns();
+    if (next <= now) {
+        next = now + period_ns;
+    }
+    add_timer(&sample_timer, next);
+}
+
+void profile_ipi_handler(registers_t* regs) {
+    record(regs);
+    lapic_write(LAPIC_EOI, 0);
+}
+
+uint32_t profile_init(void) {
+    uint32_t count = smp_cpu_count();
+    uint32_t cpu;
+    for (cpu = 0; cpu < count; cpu++) {
+        cpus[cpu].buf = kmalloc(PROFILE_SAMPLES * sizeof(profile_sample_t));
+        if (cpus[cpu].buf == NULL) {
+            break;
+        }
+    }
+    ncpus = cpu;
+    ktimer_setup(&sample_timer, profile_tick, NULL);
+    if (ncpus > 1) {
+        isr_register_handler(PROFILE_VECTOR, profile_ipi_handler);
+        idt_set_gate(PROFILE_VECTOR, (uint32_t)ipi_profile, 0x08, 0x8E);
+    }
+    return ncpus;
+}
+
+int profile_start(uint32_t hz) {
+    if (ncpus == 0 || running || dumping || hz == 0) {
+        return 0;
+    }
+    if (hz > PROFILE_MAX_HZ) {
+        hz = PROFILE_MAX_HZ;
+    }
+    for (uint32_t cpu = 0; cpu < ncpus; cpu++) {
+        cpus[cpu].count = 0;
+        cpus[cpu].user = 0;
+        cpus[cpu].lost = 0;
+        cpus[cpu].cycles = 0;
+    }
+    ipis = 0;
+    sample_hz = hz;
+    period_ns = 1000000000u / hz;
+
+    uint32_t flags = irq_save();
+    running = 1;
+    add_timer(&sample_timer, timer_now_ns() + period_ns);
+    irq_restore(flags);
+    return 1;
+}
+
+void profile_stop(void) {
+    uint32_t flags = irq_save();
+    running = 0;
+    del_timer(&sample_timer);
+    irq_restore(flags);
+}
+
+int profile_running(void) {
+    return running;
+}
+
+// Queue one line; '\n' goes out as "\r\n", hence the extra byte
+static void emit(const char* line, int len) {
+    if (len <= 0) {
+        return;
+    }
+    if (len >= DUMP_LINE_SIZE) {
+        len = DUMP_LINE_SIZE - 1;
+    }
+    while (serial_tx_space() < (size_t)len + 1) {
+        thread_sleep(1);
+    }
+    serial_write(line, len);
+}
+
+static void dump_thread(void* arg) {
+    (void)arg;
+    char line[DUMP_LINE_SIZE];
+
+    uint32_t total = 0, lost = 0;
+    emit(line, ksnprintf(line, sizeof(line), "PROF begin %u %u\n", sample_hz, ncpus));
+    for (uint32_t cpu = 0; cpu < ncpus; cpu++) {
+        const profile_cpu_t* pc = &cpus[cpu];
+        for (uint32_t i = 0; i < pc->count; i++) {
+            const profile_sample_t* s = &pc->buf[i];
+            int len = ksnprintf(line, sizeof(line), "PROF s %u %c %x", cpu,
+                                (s->flags & PROFILE_USER) ? 'u' : 'k', s->eip);
+            for (uint32_t d = 0; d < s->depth; d++) {
+                len += ksnprintf(line + len, sizeof(line) - len, " %x", s->frames[d]);
+            }
+            len += ksnprintf(line + len, sizeof(line) - len, "\n");
+            emit(line, len);
+        }
+        total += pc->count;
+        lost += pc->lost;
+    }
+    emit(line, ksnprintf(line, sizeof(line), "PROF end %u %u\n", total, lost));
+    kprintf("profile: %u samples written to the serial port\n", total);
+    dumping = 0;
+}
+
+int profile_dump_start(void) {
+    profile_stop();
+    if (ncpus == 0 || dumping) {
+        return 0;
+    }
+    dumping = 1;
+    if (thread_create("profdump", dump_thread, NULL, SCHED_PRIO_DEFAULT) == NULL) {
+        dumping = 0;
+        return 0;
+    }
+    return 1;
+}
+
+void profile_get_stats(profile_stats_t* out) {
+    out->hz = running ? sample_hz : 0;
+    out->samples = 0;
+    out->user = 0;
+    out->lost = 0;
+    out->cycles = 0;
+    out->ipis = ipis;
+    for (uint32_t cpu = 0; cpu < ncpus; cpu++) {
+        out->samples += cpus[cpu].count;
+        out->user += cpus[cpu].user;
+        out->lost += cpus[cpu].lost;
+        out->cycles += cpus[cpu].cycles;
+    }
+}
+
+void profile_dump_stats(void) {
+    profile_stats_t s;
+    profile_get_stats(&s);
+    kprintf("profile: %s%u Hz, %u samples (%u in ring 3), %u lost to full buffers, %u sample IPIs, "
+            "%u cycles per sample\n",
+            s.hz ? "running at " : "stopped, last ", s.hz ? s.hz : sample_hz, s.samples, s.user,
+            s.lost, s.ipis, s.samples ? s.cycles / s.samples : 0);
+}
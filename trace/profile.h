@@ -0,0 +1,72 @@
+#ifndef TRACE_PROFILE_H
+#define TRACE_PROFILE_H
+
+#include <stdint.h>
+#include "interrupt/isr.h" // For registers_t
+
+// Statistical profiler. While running, a ktimer fires at the sampling rate
+// and records where the boot CPU was interrupted; the same tick sends the
+// other CPUs an IPI so they record their own position. Samples go to
+// per-CPU buffers allocated by profile_init(), so taking one never
+// allocates or locks. Full buffers drop (and count) further samples.
+//
+// Images built with FRAME_POINTERS=1 (-fno-omit-frame-pointer
+// -DPROFILE_BACKTRACE) also record up to PROFILE_MAX_DEPTH return
+// addresses per kernel sample by walking the saved ebp chain.
+//
+// profile_dump_start() streams the samples over serial as text:
+//   PROF begin <hz> <cpus>
+//   PROF s <cpu> <k|u> <eip> [<return address> ...]     (hex, innermost first)
+//   PROF end <samples> <lost>
+// scripts/profile-fold.sh symbolizes them against build/kernel.elf and
+// prints folded stacks for flame graphs.
+
+#define PROFILE_DEFAULT_HZ  997         // Prime: no lockstep with 100 Hz or 1 kHz periodic work
+#define PROFILE_MAX_HZ      20000
+#define PROFILE_SAMPLES     4096        // Per CPU
+#define PROFILE_MAX_DEPTH   8
+#define PROFILE_VECTOR      0xF1        // Sample IPI to the APs
+
+#define PROFILE_USER        0x1         // Sample taken in ring 3 (no backtrace)
+
+typedef struct {
+    uint32_t eip;
+    uint16_t flags;
+    uint16_t depth;                     // Valid entries in 'frames'
+    uint32_t frames[PROFILE_MAX_DEPTH]; // Return addresses, innermost first
+} profile_sample_t;
+
+typedef struct {
+    uint32_t hz;                        // 0 when stopped
+    uint32_t samples;                   // Recorded, all CPUs
+    uint32_t user;                      // Of those, in ring 3
+    uint32_t lost;                      // Dropped because a buffer was full
+    uint32_t ipis;                      // Sample IPIs sent to APs
+    uint32_t cycles;                    // Spent recording samples (TSC)
+} profile_stats_t;
+
+// Allocate a sample buffer for every online CPU and install the sample IPI.
+// Call after smp_init(). Returns the number of CPUs covered (0: no memory).
+uint32_t profile_init(void);
+
+// Clear the buffers and start sampling at 'hz' (capped at PROFILE_MAX_HZ).
+// Returns 0 if already running, not initialized or a dump is in progress.
+int profile_start(uint32_t hz);
+
+void profile_stop(void);
+int profile_running(void);
+
+// Stop sampling and stream every sample over serial from a new thread,
+// which waits for room in the serial ring. Sampling cannot restart until it
+// is done. Returns 0 if a dump is already running.
+int profile_dump_start(void);
+
+// Sample IPI handler (registered on PROFILE_VECTOR by profile_init)
+void profile_ipi_handler(registers_t* regs);
+
+void profile_get_stats(profile_stats_t* out);
+
+// Print the counters (kprintf; on F12)
+void profile_dump_stats(void);
+
+#endif // TRACE_PROFILE_H
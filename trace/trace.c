@@ -0,0 +1,199 @@
+#include "trace.h"
+#include "interrupt/io.h"
+#include "interrupt/irqflags.h"
+#include "cpu/smp.h"
+#include "drivers/clocksource.h"
+#include "drivers/serial.h"
+#include "memory/kmalloc.h"
+#include "task/sched.h"
+#include "libc/include/stdio.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Tracing.
+// Each CPU writes only its own ring, with interrupts disabled for the few
+// stores of one record, so writers never contend. 'head' counts records
+// reserved, 'commit' records complete. The drain thread reads up to
+// 'commit' without stopping writers: after copying a record it checks that
+// 'head' has not lapped it, which would mean it was overwritten meanwhile.
+
+#define TRACE_RING_MASK     (TRACE_RING_SIZE - 1)
+#define SERIAL_LINE_SIZE    40          // "TRC " + 32 hex digits + "\r\n"
+
+// Keep the compiler from reordering ring accesses (x86 stores are not reordered with each other)
+#define barrier() asm volatile ("" : : : "memory")
+
+typedef struct {
+    trace_record_t* ring;
+    volatile uint32_t head;
+    volatile uint32_t commit;
+    uint32_t tail;                      // Next record to stream (drain thread only)
+    uint32_t lost;
+} trace_cpu_t;
+
+volatile uint8_t trace_enabled;
+
+static trace_cpu_t cpus[SMP_MAX_CPUS];
+static uint32_t ncpus;
+static uint32_t tsc_khz;
+static int use_debugcon;
+static volatile int draining;
+static uint32_t streamed;
+
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    asm volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+void trace_record(uint8_t event, uint16_t arg0, uint32_t arg1) {
+    uint32_t id = smp_cpu_id();
+    if (id >= ncpus) {
+        return;
+    }
+    trace_cpu_t* tc = &cpus[id];
+    uint32_t flags = irq_save();
+    uint32_t idx = tc->head;
+    tc->head = idx + 1;
+    barrier();
+    trace_record_t* r = &tc->ring[idx & TRACE_RING_MASK];
+    r->tsc = rdtsc();
+    r->event = event;
+    r->cpu = id;
+    r->arg0 = arg0;
+    r->arg1 = arg1;
+    barrier();
+    tc->commit = idx + 1;
+    irq_restore(flags);
+}
+
+uint32_t trace_init(void) {
+    uint32_t count = smp_cpu_count();
+    uint32_t cpu;
+    for (cpu = 0; cpu < count; cpu++) {
+        cpus[cpu].ring = kmalloc(TRACE_RING_SIZE * sizeof(trace_record_t));
+        if (cpus[cpu].ring == NULL) {
+            break;
+        }
+    }
+    ncpus = cpu;
+    // QEMU's and Bochs's debug console reads back as its own port number
+    use_debugcon = inb(TRACE_DEBUGCON_PORT) == TRACE_DEBUGCON_PORT;
+    tsc_khz = clocksource_tsc_khz();    // Calibrated against the PIT at boot
+    return ncpus;
+}
+
+// Send one record to the sink
+static void emit(const trace_record_t* r) {
+    if (use_debugcon) {
+        outsb(TRACE_DEBUGCON_PORT, r, sizeof(*r));
+    } else {
+        static const char digits[] = "0123456789abcdef";
+        char line[SERIAL_LINE_SIZE] = "TRC ";
+        const uint8_t* bytes = (const uint8_t*)r;
+        uint32_t len = 4;
+        for (uint32_t i = 0; i < sizeof(*r); i++) {
+            line[len++] = digits[bytes[i] >> 4];
+            line[len++] = digits[bytes[i] & 0xF];
+        }
+        line[len++] = '\n';
+        // '\n' goes out as "\r\n", hence the extra byte
+        while (serial_tx_space() < len + 1) {
+            thread_sleep(1);
+        }
+        serial_write(line, len);
+    }
+    streamed++;
+}
+
+static void emit_event(uint8_t event, uint8_t cpu, uint16_t arg0, uint32_t arg1) {
+    trace_record_t r = { rdtsc(), event, cpu, arg0, arg1 };
+    emit(&r);
+}
+
+// Stream everything committed on one CPU since the last drain
+static void drain_cpu(uint32_t cpu) {
+    trace_cpu_t* tc = &cpus[cpu];
+    uint32_t commit = tc->commit;
+    uint32_t lost = 0;
+    if (commit - tc->tail > TRACE_RING_SIZE) {
+        lost = commit - tc->tail - TRACE_RING_SIZE;
+        tc->tail = commit - TRACE_RING_SIZE;
+    }
+    while (tc->tail != commit) {
+        trace_record_t r = tc->ring[tc->tail & TRACE_RING_MASK];
+        barrier();
+        if (tc->head - tc->tail > TRACE_RING_SIZE) {
+            lost++;                     // Overwritten while we copied it
+        } else {
+            emit(&r);
+        }
+        tc->tail++;
+    }
+    if (lost != 0) {
+        tc->lost += lost;
+        emit_event(TRACE_LOST, cpu, 0, lost);
+    }
+}
+
+static void drain_thread(void* arg) {
+    (void)arg;
+    emit_event(TRACE_HEADER, 0, ncpus, tsc_khz);
+    for (;;) {
+        int last = !trace_enabled;      // Nothing new is recorded after this pass
+        for (uint32_t cpu = 0; cpu < ncpus; cpu++) {
+            drain_cpu(cpu);
+        }
+        if (last) {
+            break;
+        }
+        thread_sleep(TRACE_DRAIN_TICKS);
+    }
+    draining = 0;
+}
+
+int trace_start(void) {
+    if (ncpus == 0 || trace_enabled || draining) {
+        return 0;
+    }
+    // Records from an earlier run were all streamed or counted as lost
+    for (uint32_t cpu = 0; cpu < ncpus; cpu++) {
+        cpus[cpu].tail = cpus[cpu].commit;
+    }
+    draining = 1;
+    trace_enabled = 1;                  // Before the drain thread can look
+    if (thread_create("traced", drain_thread, NULL, SCHED_PRIO_DEFAULT) == NULL) {
+        trace_enabled = 0;
+        draining = 0;
+        return 0;
+    }
+    return 1;
+}
+
+void trace_stop(void) {
+    trace_enabled = 0;
+}
+
+int trace_running(void) {
+    return trace_enabled;
+}
+
+void trace_get_stats(trace_stats_t* out) {
+    out->recorded = 0;
+    out->lost = 0;
+    for (uint32_t cpu = 0; cpu < ncpus; cpu++) {
+        out->recorded += cpus[cpu].head;
+        out->lost += cpus[cpu].lost;
+    }
+    out->streamed = streamed;
+    out->tsc_khz = tsc_khz;
+    out->debugcon = use_debugcon;
+}
+
+void trace_dump_stats(void) {
+    trace_stats_t s;
+    trace_get_stats(&s);
+    kprintf("trace: %s to %s, %u records, %u streamed, %u lost, TSC %u kHz\n",
+            trace_enabled ? "running" : "stopped", s.debugcon ? "debugcon" : "serial",
+            s.recorded, s.streamed, s.lost, s.tsc_khz);
+}
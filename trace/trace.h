@@ -0,0 +1,83 @@
+#ifndef TRACE_TRACE_H
+#define TRACE_TRACE_H
+
+#include <stdint.h>
+
+// Static tracepoints. A disabled tracepoint is one byte compare and a
+// not-taken branch; the recording call sits out of line. Enabled, it
+// appends a 16-byte TSC-stamped record to this CPU's ring, overwriting
+// the oldest record when the reader falls behind.
+//
+// While tracing runs, the "traced" thread drains the rings to QEMU's
+// debugcon port (0xE9) as raw records, or to the serial port as one hex
+// line per record ("TRC <32 hex digits>") when there is no debugcon.
+// scripts/trace-to-chrome.sh turns either form into Chrome trace JSON
+// (chrome://tracing, ui.perfetto.dev).
+
+#define TRACE_RING_SIZE     4096        // Records per CPU (power of two)
+#define TRACE_DEBUGCON_PORT 0xE9
+#define TRACE_DRAIN_TICKS   1           // Drain every TIMER_HZ tick
+
+// Events: arg0 and arg1 for each
+enum {
+    TRACE_HEADER = 1,       // CPU count, TSC kHz (first record of a stream)
+    TRACE_LOST,             // -, records overwritten before they were read
+    TRACE_IRQ_ENTRY,        // IRQ line, vector
+    TRACE_IRQ_EXIT,         // IRQ line, -
+    TRACE_ISR_ENTRY,        // Vector, error code
+    TRACE_ISR_EXIT,         // Vector, -
+    TRACE_TIMER,            // -, lateness in ns
+    TRACE_KEYBOARD,         // Scancode, -
+    TRACE_SCROLL,           // -, -
+    TRACE_SWITCH,           // Previous thread id, next thread id
+};
+
+// Records carry no valid marker: a ring slot is complete once the ring's
+// commit count passes it, and the reader drops a copy when head has lapped it
+typedef struct {
+    uint64_t tsc;
+    uint8_t event;
+    uint8_t cpu;
+    uint16_t arg0;
+    uint32_t arg1;
+} trace_record_t;
+
+typedef struct {
+    uint32_t recorded;      // All CPUs
+    uint32_t streamed;
+    uint32_t lost;          // Overwritten before the drain thread got to them
+    uint32_t tsc_khz;
+    int debugcon;           // Sink: debugcon or serial
+} trace_stats_t;
+
+extern volatile uint8_t trace_enabled;
+
+void trace_record(uint8_t event, uint16_t arg0, uint32_t arg1);
+
+// Tracepoint
+#define trace_event(event, arg0, arg1)                          \
+    do {                                                        \
+        if (__builtin_expect(trace_enabled, 0)) {               \
+            trace_record((event), (arg0), (arg1));              \
+        }                                                       \
+    } while (0)
+
+// Allocate a ring for every online CPU, pick the sink and measure the TSC
+// rate. Call after smp_init(). Returns the number of CPUs covered.
+uint32_t trace_init(void);
+
+// Start tracing and the drain thread. Returns 0 if not initialized or
+// still stopping.
+int trace_start(void);
+
+// Stop recording; the drain thread streams what is left and exits
+void trace_stop(void);
+
+int trace_running(void);
+
+void trace_get_stats(trace_stats_t* out);
+
+// Print the counters (kprintf; on F12)
+void trace_dump_stats(void);
+
+#endif // TRACE_TRACE_H